@@ -1,39 +1,161 @@
 #include "actuators.h"
 
+#include <math.h>
+#include <stdatomic.h>
+#include <string.h>
+
 #include "driver/gpio.h"
+#include "driver/ledc.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/semphr.h"
-#include "sensor_data_shared.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "power.h"
+#include "soc/gpio_reg.h"
+#include "soc/soc.h"
+#include "trace.h"
 
 static const char *TAG = "ACTUATORS";
 
-#define LOW_WATER_SENSOR  15
-#define HIGH_WATER_SENSOR 30
+#define BLINK_DEFAULT_PERIOD_MS 500
+
+// LEDC configuration for dimmable LEDs
+// ESP32-C3 only has low-speed channels; 13 bits at 5 kHz fits the 80 MHz APB clock
+#define LEDC_MODE           LEDC_LOW_SPEED_MODE
+#define LEDC_TIMER          LEDC_TIMER_0
+#define LEDC_DUTY_RES       LEDC_TIMER_13_BIT
+#define LEDC_DUTY_MAX       ((1u << 13) - 1)
+#define LEDC_FREQ_HZ        5000
+#define LED_GAMMA           2.2f
+
+// Command ring (must be a power of two)
+#define LED_RING_SIZE       16
+#define LED_RING_MASK       (LED_RING_SIZE - 1)
+
+// How long led_apply_batch()/led_set_brightness() wait for the actuator task
+#define LED_WAIT_TIMEOUT_MS 100
+
+// Task notification index for "LED commands queued" and "LED command applied"
+// Index 0 belongs to the tasks themselves (settings, MQTT publisher, ESP-IDF
+// drivers): a stale LED wakeup there would be taken for one of theirs, and
+// theirs would cut an LED wait short.
+#define LED_NOTIFY_INDEX 1
+
+#if configTASK_NOTIFICATION_ARRAY_ENTRIES <= LED_NOTIFY_INDEX
+#error "LED commands need CONFIG_FREERTOS_TASK_NOTIFICATION_ARRAY_ENTRIES >= 2"
+#endif
+
+// External task handle (defined in main.c)
+extern TaskHandle_t actuator_task_handle;
 
 // Static LED info array
 // This stores GPIO mapping and metadata for each LED
 static led_info_t leds[LED_COUNT] = {
-    [LED_YELLOW_ROOF] = {.gpio = 2, .state = false, .color = "yellow", .location = "roof"},
-    [LED_WHITE_GARDEN] = {.gpio = 3, .state = false, .color = "white", .location = "garden"}};
-
-// Mutex for thread-safe state access
-// This protects the leds[] array from concurrent modification
-static SemaphoreHandle_t led_mutex = NULL;
+    [LED_YELLOW_ROOF] = {.gpio = 2,
+                         .caps = LED_CAP_ONOFF,
+                         .ledc_channel = -1,
+                         .color = "yellow",
+                         .location = "roof"},
+    [LED_WHITE_GARDEN] = {.gpio = 3,
+                          .caps = LED_CAP_ONOFF | LED_CAP_DIMMABLE,
+                          .ledc_channel = LEDC_CHANNEL_0,
+                          .color = "white",
+                          .location = "garden"}};
+
+// Command types for the actuator task
+typedef enum {
+    LED_CMD_BATCH,       // Apply led_batch_t
+    LED_CMD_BRIGHTNESS,  // Set brightness of one dimmable LED
+} led_cmd_type_t;
+
+// Command passed from producers to the actuator task
+typedef struct {
+    uint8_t type;  // led_cmd_type_t
+    uint8_t id;    // LED for LED_CMD_BRIGHTNESS
+    uint8_t brightness;
+    uint32_t fade_ms;
+    led_batch_t batch;
+    TaskHandle_t waiter;  // Task to notify once applied (NULL = fire and forget)
+    uint32_t posted_us;   // Time the command was posted (for latency stats)
+} led_cmd_t;
+
+// Ring slot
+// 'seq' tells producers and the consumer whose turn the slot is
+// (bounded MPSC queue after Dmitry Vyukov's design).
+typedef struct {
+    _Atomic uint32_t seq;
+    led_cmd_t cmd;
+} led_slot_t;
+
+static led_slot_t s_ring[LED_RING_SIZE];
+static _Atomic uint32_t s_ring_head = 0;     // Next position to claim (producers)
+static uint32_t s_ring_tail = 0;             // Next position to read (actuator task only)
+static _Atomic uint32_t s_ring_applied = 0;  // Everything before this position is applied
+
+// Current state of all LEDs (bit n = LED n)
+// Written only by the actuator task; atomic so readers never need a lock
+// and always see a consistent snapshot.
+static _Atomic uint32_t s_led_state = 0;
+
+// GPIO pins of all on/off LEDs, precomputed for register writes
+static uint32_t s_led_pins = 0;
+
+// Dimmable (LEDC) LEDs (bit n = LED n)
+static uint32_t s_pwm_leds = 0;
+
+// Brightness used when a dimmable LED is on (0-255, restored by led_on)
+static _Atomic uint8_t s_level[LED_COUNT];
+
+// Duty last written to each LEDC channel (actuator task only)
+static uint32_t s_pwm_duty[LED_COUNT];
+
+// End of the hardware fade running on each LEDC channel, 0 if none
+// LEDC stops in light sleep: the PWM power lock is held while a dimmable
+// LED is lit or a fade is running (actuator task only)
+static int64_t s_pwm_fade_end_us[LED_COUNT];
+static bool s_pwm_locked = false;
+
+// Blink timer (created by led_blink_start)
+static TimerHandle_t s_blink_timer = NULL;
+
+// Gamma-corrected duty for each brightness level
+// Perceived brightness is roughly duty^(1/2.2), so linear steps look linear.
+static uint16_t s_gamma[LED_BRIGHTNESS_MAX + 1];
+
+// Statistics
+// Producers only touch the atomic counters; the rest belong to the actuator task
+static _Atomic uint32_t s_stat_commands = 0;
+static _Atomic uint32_t s_stat_dropped = 0;
+static uint32_t s_stat_batches = 0;
+static uint32_t s_stat_max_batch = 0;
+static uint32_t s_stat_max_latency_us = 0;
+static _Atomic uint32_t s_stat_timer_max_late_us = 0;
+
+// Forward declarations of helper functions
+static void led_write_outputs(uint32_t state_mask);
+static void led_update_pwm(uint32_t state_mask);
+static esp_err_t led_pwm_init(void);
 
 esp_err_t led_init(void) {
     ESP_LOGI(TAG, "Initializing LED driver...");
 
-    // Create mutex for thread safety
-    led_mutex = xSemaphoreCreateMutex();
-    if (led_mutex == NULL) {
-        ESP_LOGE(TAG, "Failed to create mutex");
-        return ESP_FAIL;
+    // Empty ring: slot n is free for position n
+    for (int i = 0; i < LED_RING_SIZE; i++) {
+        atomic_store(&s_ring[i].seq, i);
     }
 
-    // Configure all LED GPIOs as outputs
-    gpio_config_t led_conf = {.pin_bit_mask = (1ULL << leds[LED_YELLOW_ROOF].gpio) |
-                                              (1ULL << leds[LED_WHITE_GARDEN].gpio),
+    // On/off LEDs are plain GPIOs, dimmable LEDs are routed to LEDC
+    for (int i = 0; i < LED_COUNT; i++) {
+        if (leds[i].caps & LED_CAP_DIMMABLE) {
+            s_pwm_leds |= LED_MASK(i);
+        } else {
+            s_led_pins |= 1u << leds[i].gpio;
+        }
+    }
+
+    // Configure on/off LED GPIOs as outputs
+    gpio_config_t led_conf = {.pin_bit_mask = s_led_pins,
                               .mode = GPIO_MODE_OUTPUT,
                               .pull_up_en = GPIO_PULLUP_DISABLE,
                               .pull_down_en = GPIO_PULLDOWN_DISABLE,
@@ -45,100 +167,557 @@ esp_err_t led_init(void) {
         return ret;
     }
 
-    // Initialize even LEDs to OFF
-    for (int i = 0; i < LED_COUNT; i++) {
-        if (i % 2 == 0) {
-            gpio_set_level(leds[i].gpio, 0);
-            leds[i].state = false;
-        }
+    ret = led_pwm_init();
+    if (ret != ESP_OK) {
+        return ret;
     }
 
-    // Initialize odd LEDs to ON
-    for (int i = 1; i < LED_COUNT; i++) {
+    // Initialize even LEDs to OFF and odd LEDs to ON (alternating blink)
+    // The actuator task isn't running yet, so write the outputs directly
+    uint32_t initial = 0;
+    for (int i = 0; i < LED_COUNT; i++) {
         if (i % 2 == 1) {
-            gpio_set_level(leds[i].gpio, 1);
-            leds[i].state = true;
+            initial |= LED_MASK(i);
         }
     }
+    atomic_store(&s_led_state, initial);
+    led_write_outputs(initial);
+    led_update_pwm(initial);
 
     ESP_LOGI(TAG, "LED driver initialized (GPIO2: %s/%s, %s, GPIO3: %s/%s, %s)",
              leds[LED_YELLOW_ROOF].color, leds[LED_YELLOW_ROOF].location,
-             leds[LED_YELLOW_ROOF].state ? "ON" : "OFF", leds[LED_WHITE_GARDEN].color,
-             leds[LED_WHITE_GARDEN].location, leds[LED_WHITE_GARDEN].state ? "ON" : "OFF");
+             (initial & LED_MASK(LED_YELLOW_ROOF)) ? "ON" : "OFF", leds[LED_WHITE_GARDEN].color,
+             leds[LED_WHITE_GARDEN].location,
+             (initial & LED_MASK(LED_WHITE_GARDEN)) ? "ON" : "OFF");
 
     return ESP_OK;
 }
 
-esp_err_t led_on(led_id_t id) {
-    // Input validation
-    if (id >= LED_COUNT) {
-        ESP_LOGE(TAG, "Invalid LED ID: %d", id);
-        return ESP_ERR_INVALID_ARG;
+/**
+ * Set up LEDC timer, channels and gamma table for dimmable LEDs
+ *
+ * @return ESP_OK on success
+ */
+static esp_err_t led_pwm_init(void) {
+    // Gamma table: brightness 0-255 -> 13-bit duty
+    for (int i = 0; i <= LED_BRIGHTNESS_MAX; i++) {
+        float x = (float) i / LED_BRIGHTNESS_MAX;
+        s_gamma[i] = (uint16_t) lroundf(powf(x, LED_GAMMA) * LEDC_DUTY_MAX);
     }
 
-    // Take mutex to protect state
-    if (xSemaphoreTake(led_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
-        ESP_LOGW(TAG, "Failed to acquire mutex");
-        return ESP_ERR_TIMEOUT;
+    for (int i = 0; i < LED_COUNT; i++) {
+        atomic_store(&s_level[i], LED_BRIGHTNESS_MAX);
+    }
+
+    if (s_pwm_leds == 0) {
+        return ESP_OK;
+    }
+
+    ledc_timer_config_t timer_conf = {.speed_mode = LEDC_MODE,
+                                      .duty_resolution = LEDC_DUTY_RES,
+                                      .timer_num = LEDC_TIMER,
+                                      .freq_hz = LEDC_FREQ_HZ,
+                                      .clk_cfg = LEDC_AUTO_CLK};
+    esp_err_t ret = ledc_timer_config(&timer_conf);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure LEDC timer: %s", esp_err_to_name(ret));
+        return ret;
     }
 
-    // Turn on LED
-    gpio_set_level(leds[id].gpio, 1);
-    leds[id].state = true;
+    for (int i = 0; i < LED_COUNT; i++) {
+        if (!(s_pwm_leds & LED_MASK(i))) {
+            continue;
+        }
+        ledc_channel_config_t chan_conf = {.gpio_num = leds[i].gpio,
+                                           .speed_mode = LEDC_MODE,
+                                           .channel = leds[i].ledc_channel,
+                                           .timer_sel = LEDC_TIMER,
+                                           .duty = 0,
+                                           .hpoint = 0};
+        ret = ledc_channel_config(&chan_conf);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to configure LEDC channel %d: %s", leds[i].ledc_channel,
+                     esp_err_to_name(ret));
+            return ret;
+        }
+    }
 
-    // Release mutex
-    xSemaphoreGive(led_mutex);
+    // Hardware fades: the LEDC peripheral ramps the duty, no CPU involved
+    ret = ledc_fade_func_install(0);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to install LEDC fade: %s", esp_err_to_name(ret));
+        return ret;
+    }
 
-    ESP_LOGD(TAG, "LED %d (%s) turned ON", id, leds[id].color);
+    ESP_LOGI(TAG, "LEDC initialized (%d Hz, 13-bit, gamma %.1f)", LEDC_FREQ_HZ, LED_GAMMA);
     return ESP_OK;
 }
 
-esp_err_t led_off(led_id_t id) {
+/**
+ * Stop the hardware fade running on a dimmable LED (actuator task only)
+ *
+ * LEDC duty calls wait until a running fade on the channel has finished,
+ * up to LED_FADE_MAX_MS, and every LED command queued behind would wait
+ * with them. Stopping the fade first lets the new duty take over at once.
+ */
+static void led_pwm_stop_fade(int id) {
+    if (s_pwm_fade_end_us[id] > esp_timer_get_time()) {
+        ledc_fade_stop(LEDC_MODE, leds[id].ledc_channel);
+    }
+    s_pwm_fade_end_us[id] = 0;
+}
+
+/**
+ * Bring dimmable LEDs in line with a state mask
+ *
+ * Channels whose duty is already right are skipped, which keeps a
+ * running fade from being cut short. Actuator task (or led_init) only.
+ */
+static void led_update_pwm(uint32_t state_mask) {
+    for (int i = 0; i < LED_COUNT; i++) {
+        if (!(s_pwm_leds & LED_MASK(i))) {
+            continue;
+        }
+        uint32_t duty = (state_mask & LED_MASK(i)) ? s_gamma[atomic_load(&s_level[i])] : 0;
+        if (duty != s_pwm_duty[i]) {
+            led_pwm_stop_fade(i);
+            ledc_set_duty_and_update(LEDC_MODE, leds[i].ledc_channel, duty, 0);
+            s_pwm_duty[i] = duty;
+        }
+    }
+}
+
+__attribute__((weak)) void led_gpio_write(uint32_t set_pins, uint32_t clear_pins) {
+    REG_WRITE(GPIO_OUT_W1TS_REG, set_pins);
+    REG_WRITE(GPIO_OUT_W1TC_REG, clear_pins);
+}
+
+/**
+ * Write LED outputs in one go
+ *
+ * Builds GPIO set/clear masks from the LED state mask and writes them to
+ * the W1TS/W1TC output registers, so all LEDs change on the same cycle.
+ * W1TS/W1TC only touch the bits that are written, so other GPIOs are safe.
+ * Dimmable LEDs are skipped here - see led_update_pwm().
+ *
+ * @param state_mask Desired state of all LEDs (bit n = LED n)
+ */
+static void led_write_outputs(uint32_t state_mask) {
+    uint32_t set_pins = 0;
+
+    for (int i = 0; i < LED_COUNT; i++) {
+        if ((state_mask & ~s_pwm_leds) & LED_MASK(i)) {
+            set_pins |= 1u << leds[i].gpio;
+        }
+    }
+
+    led_gpio_write(set_pins, s_led_pins & ~set_pins);
+}
+
+/**
+ * Push a command into the ring and wake the actuator task
+ *
+ * Lock-free and never blocks: producers claim a position with a CAS on
+ * the head and publish the slot by bumping its sequence number.
+ *
+ * @param cmd Command to queue
+ * @param[out] pos Ring position of the command (optional, for led_ring_wait)
+ * @return ESP_OK if queued, ESP_ERR_NO_MEM if the ring is full
+ */
+static esp_err_t led_ring_push(led_cmd_t *cmd, uint32_t *pos) {
+    cmd->posted_us = (uint32_t) esp_timer_get_time();
+
+    uint32_t head = atomic_load_explicit(&s_ring_head, memory_order_relaxed);
+    for (;;) {
+        led_slot_t *slot = &s_ring[head & LED_RING_MASK];
+        uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        int32_t diff = (int32_t) (seq - head);
+
+        if (diff == 0) {
+            // Slot is free for this position - try to claim it
+            if (atomic_compare_exchange_weak_explicit(&s_ring_head, &head, head + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                slot->cmd = *cmd;
+                atomic_store_explicit(&slot->seq, head + 1, memory_order_release);
+                break;
+            }
+            // CAS failed: 'head' now holds the fresh value, retry
+        } else if (diff < 0) {
+            // Slot still holds a command from the previous lap: ring is full
+            atomic_fetch_add(&s_stat_dropped, 1);
+            return ESP_ERR_NO_MEM;
+        } else {
+            // Another producer claimed this position first
+            head = atomic_load_explicit(&s_ring_head, memory_order_relaxed);
+        }
+    }
+
+    atomic_fetch_add(&s_stat_commands, 1);
+    if (pos != NULL) {
+        *pos = head;
+    }
+
+    if (actuator_task_handle != NULL) {
+        xTaskNotifyGiveIndexed(actuator_task_handle, LED_NOTIFY_INDEX);
+    }
+    return ESP_OK;
+}
+
+/**
+ * Pop the next command from the ring (actuator task only)
+ *
+ * @param[out] cmd Command read from the ring
+ * @return true if a command was read
+ */
+static bool led_ring_pop(led_cmd_t *cmd) {
+    led_slot_t *slot = &s_ring[s_ring_tail & LED_RING_MASK];
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+
+    if ((int32_t) (seq - (s_ring_tail + 1)) < 0) {
+        return false;  // Empty, or the producer hasn't finished writing yet
+    }
+
+    *cmd = slot->cmd;
+    // Hand the slot back to producers for the next lap
+    atomic_store_explicit(&slot->seq, s_ring_tail + LED_RING_SIZE, memory_order_release);
+    s_ring_tail++;
+    return true;
+}
+
+/**
+ * Wait until the command at ring position 'pos' has been applied
+ *
+ * The actuator task notifies waiters on LED_NOTIFY_INDEX after each batch. A stale
+ * notification (e.g. left over from an earlier call that timed out) just makes us check again.
+ */
+static esp_err_t led_ring_wait(uint32_t pos) {
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(LED_WAIT_TIMEOUT_MS);
+
+    while ((int32_t) (atomic_load(&s_ring_applied) - (pos + 1)) < 0) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout) {
+            ESP_LOGW(TAG, "Timed out waiting for actuator task");
+            return ESP_ERR_TIMEOUT;
+        }
+        ulTaskNotifyTakeIndexed(LED_NOTIFY_INDEX, pdTRUE, timeout - elapsed);
+    }
+    return ESP_OK;
+}
+
+/**
+ * Merge a batch into another, as if 'next' ran after 'into'
+ */
+static void led_batch_merge(led_batch_t *into, const led_batch_t *next) {
+    for (int i = 0; i < LED_COUNT; i++) {
+        if (next->on_mask & LED_MASK(i)) {
+            led_batch_add(into, i, LED_ACTION_ON);
+        } else if (next->off_mask & LED_MASK(i)) {
+            led_batch_add(into, i, LED_ACTION_OFF);
+        }
+        if (next->toggle_mask & LED_MASK(i)) {
+            led_batch_add(into, i, LED_ACTION_TOGGLE);
+        }
+    }
+}
+
+/**
+ * Apply a merged batch to the outputs (actuator task only)
+ */
+static void led_apply_merged(const led_batch_t *batch) {
+    uint32_t current = atomic_load(&s_led_state);
+    uint32_t next = ((current & ~batch->off_mask) | batch->on_mask) ^ batch->toggle_mask;
+
+    if (next == current) {
+        return;
+    }
+
+    // Single register write for all on/off LEDs
+    led_write_outputs(next);
+    if ((current ^ next) & s_pwm_leds) {
+        led_update_pwm(next);
+    }
+    atomic_store(&s_led_state, next);
+
+    ESP_LOGD(TAG, "LED batch applied: 0x%02lx -> 0x%02lx", current, next);
+}
+
+/**
+ * Set brightness of a dimmable LED (actuator task only)
+ */
+static void led_apply_brightness(const led_cmd_t *cmd) {
+    int id = cmd->id;
+    uint32_t duty = s_gamma[cmd->brightness];
+    uint32_t state = atomic_load(&s_led_state);
+
+    // Brightness 0 means off; any other level is also remembered for led_on()
+    if (cmd->brightness > 0) {
+        atomic_store(&s_level[id], cmd->brightness);
+        state |= LED_MASK(id);
+    } else {
+        state &= ~LED_MASK(id);
+    }
+
+    led_pwm_stop_fade(id);
+    esp_err_t ret;
+    if (cmd->fade_ms > 0) {
+        ret = ledc_set_fade_time_and_start(LEDC_MODE, leds[id].ledc_channel, duty, cmd->fade_ms,
+                                           LEDC_FADE_NO_WAIT);
+    } else {
+        ret = ledc_set_duty_and_update(LEDC_MODE, leds[id].ledc_channel, duty, 0);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set LED %d duty: %s", id, esp_err_to_name(ret));
+    }
+    s_pwm_duty[id] = duty;
+    if (cmd->fade_ms > 0 && ret == ESP_OK) {
+        s_pwm_fade_end_us[id] = esp_timer_get_time() + (int64_t) cmd->fade_ms * 1000;
+    }
+    atomic_store(&s_led_state, state);
+
+    ESP_LOGD(TAG, "LED %d (%s) brightness %u (fade %lu ms)", id, leds[id].color, cmd->brightness,
+             cmd->fade_ms);
+}
+
+/**
+ * Take or drop the PWM power lock to match the dimmable LEDs (actuator task only)
+ *
+ * @return Ticks until a fade to dark ends and the lock can go, portMAX_DELAY if none
+ */
+static TickType_t led_update_power_lock(void) {
+    bool lit = false;
+    int64_t fade_end_us = 0;
+    for (int i = 0; i < LED_COUNT; i++) {
+        lit = lit || s_pwm_duty[i] != 0;
+        if (s_pwm_fade_end_us[i] > fade_end_us) {
+            fade_end_us = s_pwm_fade_end_us[i];
+        }
+    }
+    int64_t fade_left_us = fade_end_us - esp_timer_get_time();
+
+    bool needed = lit || fade_left_us > 0;
+    if (needed != s_pwm_locked) {
+        if (needed) {
+            power_lock_acquire(POWER_LOCK_PWM);
+        } else {
+            power_lock_release(POWER_LOCK_PWM);
+        }
+        s_pwm_locked = needed;
+    }
+
+    if (lit || fade_left_us <= 0) {
+        return portMAX_DELAY;
+    }
+    return pdMS_TO_TICKS(fade_left_us / 1000) + 1;
+}
+
+void actuator_task(void *pvParameters) {
+    (void) pvParameters;
+
+    ESP_LOGI(TAG, "Actuator task started");
+
+    TaskHandle_t waiters[LED_RING_SIZE];
+    led_cmd_t cmd;
+
+    while (1) {
+        // Sleep until a producer pushes something (or a fade out ends)
+        ulTaskNotifyTakeIndexed(LED_NOTIFY_INDEX, pdTRUE, led_update_power_lock());
+
+        led_batch_t merged = {0};
+        int waiter_count = 0;
+        uint32_t count = 0;
+
+        TRACE_SPAN_BEGIN(TRACE_SPAN_LED_APPLY);
+
+        // Drain what is queued into one batch, at most a ringful, so producers
+        // that keep refilling the ring can't hold off the waiters already
+        // popped. Anything left was pushed after the notification was taken
+        // above, so its own notification wakes us again straight away.
+        while (count < LED_RING_SIZE && led_ring_pop(&cmd)) {
+            if (cmd.type == LED_CMD_BATCH) {
+                led_batch_merge(&merged, &cmd.batch);
+            } else {
+                // Brightness must land after the on/off changes queued before it
+                led_apply_merged(&merged);
+                merged = (led_batch_t) {0};
+                led_apply_brightness(&cmd);
+            }
+
+            if (cmd.waiter != NULL) {
+                waiters[waiter_count++] = cmd.waiter;
+            }
+
+            uint32_t latency_us = (uint32_t) esp_timer_get_time() - cmd.posted_us;
+            if (latency_us > s_stat_max_latency_us) {
+                s_stat_max_latency_us = latency_us;
+            }
+            count++;
+        }
+
+        if (count == 0) {
+            TRACE_SPAN_END(TRACE_SPAN_LED_APPLY);
+            continue;
+        }
+
+        led_apply_merged(&merged);
+        atomic_store(&s_ring_applied, s_ring_tail);
+        TRACE_SPAN_END(TRACE_SPAN_LED_APPLY);
+
+        s_stat_batches++;
+        if (count > s_stat_max_batch) {
+            s_stat_max_batch = count;
+        }
+
+        // Wake everyone waiting for one of these commands
+        for (int i = 0; i < waiter_count; i++) {
+            xTaskNotifyGiveIndexed(waiters[i], LED_NOTIFY_INDEX);
+        }
+    }
+}
+
+esp_err_t led_batch_add(led_batch_t *batch, led_id_t id, led_action_t action) {
     // Input validation
-    if (id >= LED_COUNT) {
-        ESP_LOGE(TAG, "Invalid LED ID: %d", id);
+    if (batch == NULL || id >= LED_COUNT) {
+        ESP_LOGE(TAG, "Invalid arguments (id=%d, batch=%p)", id, batch);
         return ESP_ERR_INVALID_ARG;
     }
 
-    // Take mutex to protect state
-    if (xSemaphoreTake(led_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
-        ESP_LOGW(TAG, "Failed to acquire mutex");
-        return ESP_ERR_TIMEOUT;
+    uint32_t bit = LED_MASK(id);
+
+    switch (action) {
+        case LED_ACTION_ON:
+            // "on" overrides anything queued before it
+            batch->off_mask &= ~bit;
+            batch->toggle_mask &= ~bit;
+            batch->on_mask |= bit;
+            break;
+
+        case LED_ACTION_OFF:
+            batch->on_mask &= ~bit;
+            batch->toggle_mask &= ~bit;
+            batch->off_mask |= bit;
+            break;
+
+        case LED_ACTION_TOGGLE:
+            // Toggling a forced value just flips it; toggling twice cancels out
+            if (batch->on_mask & bit) {
+                batch->on_mask &= ~bit;
+                batch->off_mask |= bit;
+            } else if (batch->off_mask & bit) {
+                batch->off_mask &= ~bit;
+                batch->on_mask |= bit;
+            } else {
+                batch->toggle_mask ^= bit;
+            }
+            break;
+
+        default:
+            ESP_LOGE(TAG, "Invalid LED action: %d", action);
+            return ESP_ERR_INVALID_ARG;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t led_parse_action(const char *str, led_action_t *action) {
+    if (str == NULL || action == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (strcmp(str, "on") == 0) {
+        *action = LED_ACTION_ON;
+    } else if (strcmp(str, "off") == 0) {
+        *action = LED_ACTION_OFF;
+    } else if (strcmp(str, "toggle") == 0) {
+        *action = LED_ACTION_TOGGLE;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+/**
+ * Check batch masks against known LEDs
+ */
+static bool led_batch_is_valid(const led_batch_t *batch) {
+    return batch != NULL &&
+           ((batch->on_mask | batch->off_mask | batch->toggle_mask) & ~LED_ALL_MASK) == 0;
+}
+
+esp_err_t led_apply_batch(const led_batch_t *batch, uint32_t *state_mask) {
+    // Input validation
+    if (!led_batch_is_valid(batch)) {
+        ESP_LOGE(TAG, "Invalid LED batch");
+        return ESP_ERR_INVALID_ARG;
     }
 
-    // Turn off LED
-    gpio_set_level(leds[id].gpio, 0);
-    leds[id].state = false;
+    led_cmd_t cmd = {
+        .type = LED_CMD_BATCH, .batch = *batch, .waiter = xTaskGetCurrentTaskHandle()};
+    uint32_t pos;
+    esp_err_t ret = led_ring_push(&cmd, &pos);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "LED command ring full");
+        return ret;
+    }
 
-    // Release mutex
-    xSemaphoreGive(led_mutex);
+    ret = led_ring_wait(pos);
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
-    ESP_LOGD(TAG, "LED %d (%s) turned OFF", id, leds[id].color);
+    if (state_mask != NULL) {
+        *state_mask = atomic_load(&s_led_state);
+    }
     return ESP_OK;
 }
 
-esp_err_t led_toggle(led_id_t id) {
+esp_err_t led_post_batch(const led_batch_t *batch) {
+    // Input validation
+    if (!led_batch_is_valid(batch)) {
+        ESP_LOGE(TAG, "Invalid LED batch");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    led_cmd_t cmd = {.type = LED_CMD_BATCH, .batch = *batch, .waiter = NULL};
+    return led_ring_push(&cmd, NULL);
+}
+
+/**
+ * Apply a single action to a single LED
+ *
+ * Helper for led_on/led_off/led_toggle - a batch of one.
+ */
+static esp_err_t led_apply_action(led_id_t id, led_action_t action) {
     // Input validation
     if (id >= LED_COUNT) {
         ESP_LOGE(TAG, "Invalid LED ID: %d", id);
         return ESP_ERR_INVALID_ARG;
     }
 
-    // Take mutex to protect state
-    if (xSemaphoreTake(led_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
-        ESP_LOGW(TAG, "Failed to acquire mutex");
-        return ESP_ERR_TIMEOUT;
+    led_batch_t batch = {0};
+    led_batch_add(&batch, id, action);
+
+    uint32_t state_mask = 0;
+    esp_err_t ret = led_apply_batch(&batch, &state_mask);
+    if (ret != ESP_OK) {
+        return ret;
     }
 
-    // Toggle LED state
-    leds[id].state = ((!leds[id].state) != 0);
-    gpio_set_level(leds[id].gpio, (int) leds[id].state ? 1 : 0);
+    ESP_LOGD(TAG, "LED %d (%s) turned %s", id, leds[id].color,
+             (state_mask & LED_MASK(id)) ? "ON" : "OFF");
+    return ESP_OK;
+}
 
-    // Release mutex
-    xSemaphoreGive(led_mutex);
+esp_err_t led_on(led_id_t id) {
+    return led_apply_action(id, LED_ACTION_ON);
+}
 
-    ESP_LOGD(TAG, "LED %d (%s) toggled to %s", id, leds[id].color, leds[id].state ? "ON" : "OFF");
-    return ESP_OK;
+esp_err_t led_off(led_id_t id) {
+    return led_apply_action(id, LED_ACTION_OFF);
+}
+
+esp_err_t led_toggle(led_id_t id) {
+    return led_apply_action(id, LED_ACTION_TOGGLE);
 }
 
 esp_err_t led_get_state(led_id_t id, bool *state) {
@@ -148,18 +727,85 @@ esp_err_t led_get_state(led_id_t id, bool *state) {
         return ESP_ERR_INVALID_ARG;
     }
 
-    // Take mutex to protect state
-    if (xSemaphoreTake(led_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
-        ESP_LOGW(TAG, "Failed to acquire mutex");
-        return ESP_ERR_TIMEOUT;
+    // Read state - lock-free, a single atomic load
+    *state = (atomic_load(&s_led_state) & LED_MASK(id)) != 0;
+
+    return ESP_OK;
+}
+
+/**
+ * Check and build a brightness command
+ *
+ * Helper for led_set_brightness/led_post_brightness.
+ */
+static esp_err_t led_brightness_cmd(led_id_t id, uint8_t brightness, uint32_t fade_ms,
+                                    led_cmd_t *cmd) {
+    // Input validation
+    if (id >= LED_COUNT || fade_ms > LED_FADE_MAX_MS) {
+        ESP_LOGE(TAG, "Invalid arguments (id=%d, fade_ms=%lu)", id, fade_ms);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!(leds[id].caps & LED_CAP_DIMMABLE)) {
+        ESP_LOGW(TAG, "LED %d (%s) is not dimmable", id, leds[id].color);
+        return ESP_ERR_NOT_SUPPORTED;
     }
 
-    // Read state
-    *state = leds[id].state;
+    *cmd = (led_cmd_t) {.type = LED_CMD_BRIGHTNESS,
+                        .id = (uint8_t) id,
+                        .brightness = brightness,
+                        .fade_ms = fade_ms};
+    return ESP_OK;
+}
 
-    // Release mutex
-    xSemaphoreGive(led_mutex);
+esp_err_t led_set_brightness(led_id_t id, uint8_t brightness, uint32_t fade_ms) {
+    led_cmd_t cmd;
+    esp_err_t ret = led_brightness_cmd(id, brightness, fade_ms, &cmd);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    cmd.waiter = xTaskGetCurrentTaskHandle();
+    uint32_t pos;
+    ret = led_ring_push(&cmd, &pos);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "LED command ring full");
+        return ret;
+    }
+
+    return led_ring_wait(pos);
+}
+
+esp_err_t led_post_brightness(led_id_t id, uint8_t brightness, uint32_t fade_ms) {
+    led_cmd_t cmd;
+    esp_err_t ret = led_brightness_cmd(id, brightness, fade_ms, &cmd);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return led_ring_push(&cmd, NULL);
+}
 
+esp_err_t led_get_brightness(led_id_t id, uint8_t *brightness) {
+    // Input validation
+    if (id >= LED_COUNT || brightness == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments (id=%d, brightness=%p)", id, brightness);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // On/off LEDs report full brightness when on
+    bool on = (atomic_load(&s_led_state) & LED_MASK(id)) != 0;
+    *brightness = on ? atomic_load(&s_level[id]) : 0;
+    return ESP_OK;
+}
+
+esp_err_t led_get_state_mask(uint32_t *state_mask) {
+    // Input validation
+    if (state_mask == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments (state_mask=%p)", state_mask);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // All LEDs live in one word, so a single load is a consistent snapshot
+    *state_mask = atomic_load(&s_led_state);
     return ESP_OK;
 }
 
@@ -175,12 +821,26 @@ const led_info_t *led_get_info(led_id_t id) {
     return &leds[id];
 }
 
+void led_get_stats(led_stats_t *stats) {
+    if (stats == NULL) {
+        return;
+    }
+
+    // Each counter is a single word; a slightly torn snapshot is fine for stats
+    stats->commands = atomic_load(&s_stat_commands);
+    stats->dropped = atomic_load(&s_stat_dropped);
+    stats->batches = s_stat_batches;
+    stats->max_batch = s_stat_max_batch;
+    stats->max_latency_us = s_stat_max_latency_us;
+    stats->timer_max_late_us = atomic_load(&s_stat_timer_max_late_us);
+}
+
 /**
  * LED timer callback
  *
  * It toggles both LEDs, creating an alternating blink pattern.
- * The blinking period is either 500ms or 100ms depending on
- * the raw value of water_sensor.
+ * The blinking period is set with led_blink_set_period() - the rule
+ * engine uses it to blink faster while the water sensor reads high.
  *
  * IMPORTANT: Timer callbacks must be quick and non-blocking!
  * - Don't use vTaskDelay()
@@ -188,51 +848,78 @@ const led_info_t *led_get_info(led_id_t id) {
  * - Don't do heavy processing
  *
  * If you need blocking operations, use a task instead.
+ *
+ * How late each callback runs against the one before shows how long the
+ * timer service was held up (by this or any other timer callback).
  */
 static void led_timer_callback(TimerHandle_t xTimer) {
-    // Toggle both LEDs
-    // The actuator driver is thread-safe (uses mutex internally)
-    led_toggle(LED_YELLOW_ROOF);
-    led_toggle(LED_WHITE_GARDEN);
-
-    static TickType_t current_period = pdMS_TO_TICKS(500);
-    static TickType_t new_period = pdMS_TO_TICKS(500);
-
-    // Calculate new period
-    // Allow some hysteresis (LOW_WATER - HIGH_WATER) to avoid switching too often
-    if (g_shared_sensor_data.water_raw > HIGH_WATER_SENSOR) {
-        new_period = pdMS_TO_TICKS(100);
-    }
-    if (g_shared_sensor_data.water_raw < LOW_WATER_SENSOR) {
-        new_period = pdMS_TO_TICKS(500);
+    // Timer service only, so no locking
+    static int64_t last_us = 0;
+    static TickType_t last_period = 0;
+
+    int64_t now = esp_timer_get_time();
+    TickType_t period = xTimerGetPeriod(xTimer);
+    // A period change restarts the timer: skip the first interval after it
+    if (last_us != 0 && period == last_period) {
+        int64_t late_us = now - last_us - (int64_t) period * portTICK_PERIOD_MS * 1000;
+        if (late_us > (int64_t) atomic_load(&s_stat_timer_max_late_us)) {
+            atomic_store(&s_stat_timer_max_late_us, (uint32_t) late_us);
+        }
     }
+    last_us = now;
+    last_period = period;
 
-    if (new_period != current_period) {
-        xTimerChangePeriod(xTimer, new_period, 0);
-        current_period = new_period;
-    }
+    // Post one toggle for both LEDs and return - the actuator task does the GPIO
+    // and LEDC work, so the timer daemon (and every other software timer) never waits
+    led_batch_t batch = {.toggle_mask = LED_MASK(LED_YELLOW_ROOF) | LED_MASK(LED_WHITE_GARDEN)};
+    led_post_batch(&batch);
 }
 
 esp_err_t led_blink_start(void) {
     // Create LED blink timer (instead of led_task)
-    ESP_LOGI(TAG, "Creating led_timer (period: 500ms)...");
-    TimerHandle_t led_timer = xTimerCreate("led_blink",         // Timer name (for debugging)
-                                           pdMS_TO_TICKS(500),  // Period: 500ms
-                                           pdTRUE,  // Auto-reload: timer repeats automatically
-                                           NULL,    // Timer ID: not used
-                                           led_timer_callback  // Callback function
+    ESP_LOGI(TAG, "Creating led_timer (period: %dms)...", BLINK_DEFAULT_PERIOD_MS);
+    s_blink_timer = xTimerCreate("led_blink",  // Timer name (for debugging)
+                                 pdMS_TO_TICKS(BLINK_DEFAULT_PERIOD_MS),  // Period
+                                 pdTRUE,  // Auto-reload: timer repeats automatically
+                                 NULL,    // Timer ID: not used
+                                 led_timer_callback  // Callback function
     );
 
-    if (led_timer == NULL) {
+    if (s_blink_timer == NULL) {
         ESP_LOGE(TAG, "Failed to create LED timer");
         return ESP_FAIL;
     }
     // Start the timer
     // Second parameter is block time: we give 100 ms for other higher priority tasks to start
-    if (xTimerStart(led_timer, pdMS_TO_TICKS(100)) != pdPASS) {
+    if (xTimerStart(s_blink_timer, pdMS_TO_TICKS(100)) != pdPASS) {
         ESP_LOGE(TAG, "Failed to start LED timer");
         return ESP_FAIL;
     }
 
     return ESP_OK;
 }
+
+esp_err_t led_blink_set_period(uint32_t period_ms) {
+    // Input validation
+    if (period_ms == 0 || pdMS_TO_TICKS(period_ms) == 0) {
+        ESP_LOGE(TAG, "Invalid blink period: %lu ms", period_ms);
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_blink_timer == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    TickType_t period = pdMS_TO_TICKS(period_ms);
+    if (xTimerGetPeriod(s_blink_timer) == period) {
+        return ESP_OK;
+    }
+
+    // Don't block - the timer command queue is only full under heavy load
+    if (xTimerChangePeriod(s_blink_timer, period, 0) != pdPASS) {
+        ESP_LOGW(TAG, "Failed to change blink period");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    ESP_LOGI(TAG, "Blink period set to %lu ms", period_ms);
+    return ESP_OK;
+}
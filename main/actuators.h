@@ -2,6 +2,7 @@
 #define ACTUATORS_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #include "esp_err.h"
 
@@ -12,24 +13,87 @@ typedef enum {
     LED_COUNT = 2
 } led_id_t;
 
-// LED state structure
+// Bitmask with one bit per LED (bit n = led_id_t n)
+#define LED_MASK(id)  (1u << (id))
+#define LED_ALL_MASK  ((1u << LED_COUNT) - 1)
+
+// Actions that can be applied to a single LED
+typedef enum {
+    LED_ACTION_ON,
+    LED_ACTION_OFF,
+    LED_ACTION_TOGGLE,
+} led_action_t;
+
+// Batch of LED changes applied atomically by led_apply_batch()
+//
+// New state is computed as ((state & ~off_mask) | on_mask) ^ toggle_mask.
+// Use led_batch_add() to build a batch from individual commands - it keeps
+// each LED in at most one mask so commands compose in the order they are added.
+typedef struct {
+    uint32_t on_mask;
+    uint32_t off_mask;
+    uint32_t toggle_mask;
+} led_batch_t;
+
+// LED capabilities (bit flags for led_info_t.caps)
+typedef enum {
+    LED_CAP_ONOFF = (1 << 0),     // Can be switched on/off/toggled
+    LED_CAP_DIMMABLE = (1 << 1),  // Brightness and hardware fades (LEDC PWM)
+} led_caps_t;
+
+// Brightness range for dimmable LEDs (gamma-corrected internally)
+#define LED_BRIGHTNESS_MAX 255
+#define LED_FADE_MAX_MS    10000  // Longest brightness fade
+
+// LED info structure (static metadata)
+// Current state is kept separately as a bitmask - see led_get_state_mask()
 typedef struct {
     int gpio;
-    bool state;
+    uint32_t caps;     // led_caps_t flags
+    int ledc_channel;  // LEDC channel if LED_CAP_DIMMABLE, -1 otherwise
     const char *color;
     const char *location;
 } led_info_t;
 
+// Actuator task statistics
+typedef struct {
+    uint32_t commands;           // Commands accepted into the ring
+    uint32_t dropped;            // Commands rejected because the ring was full
+    uint32_t batches;            // Times the actuator task applied queued commands
+    uint32_t max_batch;          // Most commands applied in one batch
+    uint32_t max_latency_us;     // Worst time from posting a command to applying it
+    uint32_t timer_max_late_us;  // Worst lateness of a blink timer callback (timer service)
+} led_stats_t;
+
 /**
  * Initialize all LEDs
  *
  * Sets up GPIO pins as outputs and initializes state to OFF.
  * Must be called before any other LED functions.
  *
+ * LED changes are applied by actuator_task(); until it is running,
+ * commands are queued and calls that wait for completion time out.
+ *
  * @return ESP_OK on success
  */
 esp_err_t led_init(void);
 
+/**
+ * Actuator task
+ *
+ * Owns all LED GPIO and LEDC state. Producers (HTTP, timers, rules) push
+ * commands into a lock-free ring and notify this task, which drains the
+ * ring (up to a ringful at a time), merges what it found into one batch
+ * and applies it with a single register write.
+ *
+ * Task parameters:
+ * - Priority: 6 (above sensor task - LED work is short and latency-sensitive)
+ * - Stack: 2KB
+ *
+ * @param pvParameters Unused (NULL)
+ */
+void actuator_task(void *pvParameters);
+
 /**
  * Turn LED on
  *
@@ -71,5 +135,138 @@ esp_err_t led_get_state(led_id_t id, bool *state);
  */
 const led_info_t *led_get_info(led_id_t id);
 
+/**
+ * Add a command to a batch
+ *
+ * Commands compose in order: "on" then "toggle" results in off,
+ * "toggle" twice cancels out.
+ *
+ * @param batch Batch to update
+ * @param id LED identifier
+ * @param action Action to apply
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if id or action invalid
+ */
+esp_err_t led_batch_add(led_batch_t *batch, led_id_t id, led_action_t action);
+
+/**
+ * Parse an action name ("on", "off", "toggle")
+ *
+ * @param str Action name
+ * @param[out] action Parsed action
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the name is unknown
+ */
+esp_err_t led_parse_action(const char *str, led_action_t *action);
+
+/**
+ * Apply a batch of LED changes
+ *
+ * Queues the batch for the actuator task and waits (up to 100 ms) until
+ * it has been applied. All changes land with one set/clear write to the
+ * GPIO output registers, so LEDs switch together.
+ *
+ * @param batch Changes to apply
+ * @param[out] state_mask Resulting state of all LEDs (optional, may be NULL)
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if a mask has unknown LEDs,
+ *         ESP_ERR_NO_MEM if the command ring is full, ESP_ERR_TIMEOUT if not applied in time
+ */
+esp_err_t led_apply_batch(const led_batch_t *batch, uint32_t *state_mask);
+
+/**
+ * Queue a batch of LED changes without waiting
+ *
+ * Never blocks - use this from timer callbacks and other contexts
+ * that must not wait for the actuator task.
+ *
+ * @param batch Changes to apply
+ * @return ESP_OK if queued, ESP_ERR_INVALID_ARG if a mask has unknown LEDs,
+ *         ESP_ERR_NO_MEM if the command ring is full
+ */
+esp_err_t led_post_batch(const led_batch_t *batch);
+
+/**
+ * Set LED brightness (dimmable LEDs only)
+ *
+ * Brightness is gamma-corrected, so steps look even to the eye.
+ * With fade_ms > 0 the LEDC peripheral ramps the duty in hardware and
+ * the call returns as soon as the fade has started. A later brightness or
+ * on/off change to the LED stops a running fade where it is and takes over.
+ * Brightness 0 turns the LED off; any other value turns it on and becomes
+ * the level restored by led_on().
+ *
+ * @param id LED identifier
+ * @param brightness 0-LED_BRIGHTNESS_MAX
+ * @param fade_ms Fade duration in milliseconds (0 = instant, max LED_FADE_MAX_MS)
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if LED is not dimmable,
+ *         ESP_ERR_INVALID_ARG if id or fade_ms invalid, ESP_ERR_NO_MEM if the command ring
+ *         is full, ESP_ERR_TIMEOUT if queued but not applied in time
+ */
+esp_err_t led_set_brightness(led_id_t id, uint8_t brightness, uint32_t fade_ms);
+
+/**
+ * Queue a brightness change without waiting
+ *
+ * Never blocks, like led_post_batch(). Commands from one task land in the
+ * order they were posted, whether batches or brightness changes.
+ *
+ * @param id LED identifier
+ * @param brightness 0-LED_BRIGHTNESS_MAX
+ * @param fade_ms Fade duration in milliseconds (0 = instant, max LED_FADE_MAX_MS)
+ * @return ESP_OK if queued, ESP_ERR_NOT_SUPPORTED if LED is not dimmable,
+ *         ESP_ERR_INVALID_ARG if id or fade_ms invalid, ESP_ERR_NO_MEM if the command ring is full
+ */
+esp_err_t led_post_brightness(led_id_t id, uint8_t brightness, uint32_t fade_ms);
+
+/**
+ * Get LED brightness
+ *
+ * On/off LEDs report LED_BRIGHTNESS_MAX when on and 0 when off.
+ *
+ * @param id LED identifier
+ * @param[out] brightness Current brightness (0-LED_BRIGHTNESS_MAX)
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if id invalid
+ */
+esp_err_t led_get_brightness(led_id_t id, uint8_t *brightness);
+
+/**
+ * Get state of all LEDs as a consistent snapshot
+ *
+ * @param[out] state_mask Bit n is set if LED n is on
+ * @return ESP_OK on success
+ */
+esp_err_t led_get_state_mask(uint32_t *state_mask);
+
+/**
+ * Get actuator task statistics
+ *
+ * @param[out] stats Statistics snapshot
+ */
+void led_get_stats(led_stats_t *stats);
+
+/**
+ * Write the GPIO output registers (W1TS/W1TC)
+ *
+ * All on/off LED changes go through this one call. The definition is weak,
+ * so a host test can link its own register file in its place.
+ *
+ * @param set_pins GPIOs to drive high (bit n = GPIO n)
+ * @param clear_pins GPIOs to drive low
+ */
+void led_gpio_write(uint32_t set_pins, uint32_t clear_pins);
+
+/**
+ * Start the alternating blink timer
+ *
+ * @return ESP_OK on success
+ */
 esp_err_t led_blink_start(void);
+
+/**
+ * Change the blink period
+ *
+ * Non-blocking - safe to call from any task.
+ *
+ * @param period_ms New period in milliseconds
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if blinking not started
+ */
+esp_err_t led_blink_set_period(uint32_t period_ms);
 #endif  // ACTUATORS_H
@@ -0,0 +1,236 @@
+#include "boot.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+
+static const char *TAG = "BOOT";
+
+#define BOOT_WORKER_STACK 4096       // Steps run here too (WiFi init needs the room)
+#define BOOT_HELPER_DONE  (1 << 23)  // Event bit: helper worker exited
+
+_Static_assert(BOOT_STEPS_MAX <= 23, "Step bits must fit an event group");
+
+static const char *const MILESTONE_NAMES[BOOT_MILESTONE_COUNT] = {
+    [BOOT_MILESTONE_FIRST_SAMPLE] = "first_sample",
+    [BOOT_MILESTONE_WIFI_CONNECTED] = "wifi_connected",
+    [BOOT_MILESTONE_HTTP_READY] = "http_ready",
+};
+
+// Timeline (written during boot, read-only afterwards)
+static boot_phase_t s_phases[BOOT_PHASES_MAX];
+static size_t s_phase_count = 0;
+static volatile uint32_t s_milestones[BOOT_MILESTONE_COUNT];
+
+// Init graph state (only valid inside boot_run)
+static const boot_step_t *s_steps = NULL;
+static size_t s_step_count = 0;
+static uint32_t s_started = 0;  // Steps picked by a worker
+static uint32_t s_done = 0;     // Steps finished or skipped
+static uint32_t s_failed = 0;   // Steps failed or skipped
+static esp_err_t s_result = ESP_OK;
+static EventGroupHandle_t s_events = NULL;  // Bit i = step i finished
+
+// Guards the graph state and phase allocation (two workers)
+static portMUX_TYPE s_boot_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static int boot_phase_begin_on(const char *name, uint8_t worker) {
+    portENTER_CRITICAL(&s_boot_mux);
+    int phase = s_phase_count < BOOT_PHASES_MAX ? (int) s_phase_count++ : -1;
+    portEXIT_CRITICAL(&s_boot_mux);
+
+    if (phase >= 0) {
+        s_phases[phase] = (boot_phase_t) {.name = name,
+                                          .start_us = (uint32_t) esp_timer_get_time(),
+                                          .worker = worker,
+                                          .result = ESP_OK};
+    }
+    return phase;
+}
+
+int boot_phase_begin(const char *name) {
+    return boot_phase_begin_on(name, 0);
+}
+
+void boot_phase_end(int phase) {
+    if (phase >= 0 && phase < BOOT_PHASES_MAX) {
+        s_phases[phase].end_us = (uint32_t) esp_timer_get_time();
+    }
+}
+
+/**
+ * Pick the next runnable step (inside s_boot_mux)
+ *
+ * Steps whose dependencies failed are marked skipped on the way.
+ *
+ * @param[out] skipped Steps skipped by this call
+ * @return Step index, or -1 if none is runnable right now
+ */
+static int boot_pick_step(uint32_t *skipped) {
+    for (size_t i = 0; i < s_step_count; i++) {
+        uint32_t bit = BOOT_DEP(i);
+        if ((s_started & bit) || (s_steps[i].deps & ~s_done)) {
+            continue;
+        }
+        s_started |= bit;
+        if (s_steps[i].deps & s_failed) {
+            s_done |= bit;
+            s_failed |= bit;
+            *skipped |= bit;
+            continue;
+        }
+        return i;
+    }
+    return -1;
+}
+
+/**
+ * Worker loop: run runnable steps until every step has been picked
+ */
+static void boot_worker(uint8_t worker) {
+    uint32_t all = BOOT_DEP(s_step_count) - 1;
+
+    while (true) {
+        uint32_t skipped = 0;
+        portENTER_CRITICAL(&s_boot_mux);
+        int step = boot_pick_step(&skipped);
+        uint32_t running = s_started & ~s_done;
+        bool picked_all = s_started == all;
+        portEXIT_CRITICAL(&s_boot_mux);
+
+        for (size_t i = 0; i < s_step_count; i++) {
+            if (skipped & BOOT_DEP(i)) {
+                ESP_LOGW(TAG, "Skipping %s (dependency failed)", s_steps[i].name);
+                int phase = boot_phase_begin_on(s_steps[i].name, worker);
+                if (phase >= 0) {
+                    s_phases[phase].result = ESP_ERR_INVALID_STATE;
+                }
+            }
+        }
+        if (skipped) {
+            xEventGroupSetBits(s_events, skipped);
+        }
+
+        if (step < 0) {
+            if (picked_all) {
+                return;
+            }
+            if (skipped) {
+                continue;  // Skips may have unblocked more steps
+            }
+            if (running == 0) {
+                ESP_LOGE(TAG, "Init graph stuck (dependency cycle?)");
+                portENTER_CRITICAL(&s_boot_mux);
+                s_result = s_result != ESP_OK ? s_result : ESP_ERR_INVALID_STATE;
+                s_started = all;
+                portEXIT_CRITICAL(&s_boot_mux);
+                return;
+            }
+            // Wait for any running step to finish, then look again
+            xEventGroupWaitBits(s_events, running, pdFALSE, pdFALSE, portMAX_DELAY);
+            continue;
+        }
+
+        int phase = boot_phase_begin_on(s_steps[step].name, worker);
+        esp_err_t ret = s_steps[step].fn();
+        boot_phase_end(phase);
+        if (phase >= 0) {
+            s_phases[phase].result = ret;
+        }
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "%s failed: %s", s_steps[step].name, esp_err_to_name(ret));
+        }
+
+        portENTER_CRITICAL(&s_boot_mux);
+        s_done |= BOOT_DEP(step);
+        if (ret != ESP_OK) {
+            s_failed |= BOOT_DEP(step);
+            s_result = s_result != ESP_OK ? s_result : ret;
+        }
+        portEXIT_CRITICAL(&s_boot_mux);
+        xEventGroupSetBits(s_events, BOOT_DEP(step));
+    }
+}
+
+static void boot_helper_task(void *pvParameters) {
+    (void) pvParameters;
+    boot_worker(1);
+    xEventGroupSetBits(s_events, BOOT_HELPER_DONE);
+    vTaskDelete(NULL);
+}
+
+esp_err_t boot_run(const boot_step_t *steps, size_t count) {
+    if (steps == NULL || count == 0 || count > BOOT_STEPS_MAX) {
+        ESP_LOGE(TAG, "Invalid arguments (count=%d)", (int) count);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_events = xEventGroupCreate();
+    if (s_events == NULL) {
+        ESP_LOGE(TAG, "Failed to create event group");
+        return ESP_ERR_NO_MEM;
+    }
+
+    s_steps = steps;
+    s_step_count = count;
+    s_started = 0;
+    s_done = 0;
+    s_failed = 0;
+    s_result = ESP_OK;
+
+    // Same priority as the caller, so the two workers share the CPU evenly
+    bool helper = xTaskCreate(boot_helper_task, "boot", BOOT_WORKER_STACK, NULL,
+                              uxTaskPriorityGet(NULL), NULL) == pdPASS;
+    if (!helper) {
+        ESP_LOGW(TAG, "No helper worker, running init steps serially");
+    }
+
+    boot_worker(0);
+    if (helper) {
+        xEventGroupWaitBits(s_events, BOOT_HELPER_DONE, pdFALSE, pdTRUE, portMAX_DELAY);
+    }
+
+    vEventGroupDelete(s_events);
+    s_events = NULL;
+    s_steps = NULL;
+    return s_result;
+}
+
+void boot_milestone(boot_milestone_t milestone) {
+    if (milestone >= BOOT_MILESTONE_COUNT || s_milestones[milestone] != 0) {
+        return;
+    }
+    uint32_t now = (uint32_t) esp_timer_get_time();
+    s_milestones[milestone] = now;
+    ESP_LOGI(TAG, "Milestone %s at %lu ms", MILESTONE_NAMES[milestone], now / 1000);
+}
+
+void boot_log_timeline(void) {
+    ESP_LOGI(TAG, "Boot timeline (ms since power-on):");
+    ESP_LOGI(TAG, "  Phase            Worker   Start     End  Duration");
+    for (size_t i = 0; i < s_phase_count; i++) {
+        const boot_phase_t *p = &s_phases[i];
+        uint32_t end = p->end_us != 0 ? p->end_us : p->start_us;
+        ESP_LOGI(TAG, "  %-16s %6u %7lu.%lu %7lu.%lu %6lu.%lu%s", p->name, p->worker,
+                 p->start_us / 1000, p->start_us / 100 % 10, end / 1000, end / 100 % 10,
+                 (end - p->start_us) / 1000, (end - p->start_us) / 100 % 10,
+                 p->result == ESP_OK ? "" : " (failed)");
+    }
+}
+
+const boot_phase_t *boot_get_phases(size_t *count) {
+    if (count != NULL) {
+        *count = s_phase_count;
+    }
+    return s_phases;
+}
+
+uint32_t boot_get_milestone(boot_milestone_t milestone) {
+    return milestone < BOOT_MILESTONE_COUNT ? s_milestones[milestone] : 0;
+}
+
+const char *boot_milestone_name(boot_milestone_t milestone) {
+    return milestone < BOOT_MILESTONE_COUNT ? MILESTONE_NAMES[milestone] : "unknown";
+}
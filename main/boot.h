@@ -0,0 +1,115 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Boot timeline and init graph
+//
+// app_main() describes initialization as a graph of steps with
+// dependencies; boot_run() executes it on two workers, so a step that
+// blocks (WiFi/PHY bring-up, NVS reads) doesn't hold back independent ones
+// (ADC and LED setup, starting the sensor tasks). Every step is recorded
+// with esp_timer timestamps, and milestones mark when the device becomes
+// useful. The timeline is logged and served at GET /api/system/boot.
+
+#define BOOT_STEPS_MAX  16
+#define BOOT_PHASES_MAX 24
+#define BOOT_WORKERS    2  // app_main + one helper task
+
+// Dependency bit for a step index
+#define BOOT_DEP(step) (1u << (step))
+
+// One node of the init graph
+typedef struct {
+    const char *name;
+    esp_err_t (*fn)(void);
+    uint32_t deps;  // BOOT_DEP() of every step that must finish first
+} boot_step_t;
+
+// One recorded phase (a step, or anything timed with boot_phase_begin())
+typedef struct {
+    const char *name;
+    uint32_t start_us;  // esp_timer time
+    uint32_t end_us;    // 0 while running
+    uint8_t worker;     // Which worker ran it (0 = app_main)
+    esp_err_t result;   // ESP_ERR_INVALID_STATE if skipped because a dependency failed
+} boot_phase_t;
+
+// Points where the device becomes useful
+typedef enum {
+    BOOT_MILESTONE_FIRST_SAMPLE,    // First sensor sample published
+    BOOT_MILESTONE_WIFI_CONNECTED,  // Got an IP address
+    BOOT_MILESTONE_HTTP_READY,      // HTTP server accepting requests
+    BOOT_MILESTONE_COUNT
+} boot_milestone_t;
+
+/**
+ * Run an init graph
+ *
+ * Steps run as soon as all their dependencies have finished, on the
+ * calling task and one helper task. A failed step is logged, and the steps
+ * depending on it are skipped.
+ *
+ * @param steps Steps; dependencies refer to indices in this array
+ * @param count Number of steps (at most BOOT_STEPS_MAX)
+ * @return ESP_OK if every step succeeded, otherwise the first failure
+ */
+esp_err_t boot_run(const boot_step_t *steps, size_t count);
+
+/**
+ * Start timing a phase outside the init graph
+ *
+ * @param name Phase name (must be a string literal)
+ * @return Phase handle for boot_phase_end(), -1 if the timeline is full
+ */
+int boot_phase_begin(const char *name);
+
+/**
+ * Finish a phase started with boot_phase_begin()
+ *
+ * @param phase Handle returned by boot_phase_begin()
+ */
+void boot_phase_end(int phase);
+
+/**
+ * Record a milestone (only the first call per milestone counts)
+ *
+ * Cheap enough to call on every iteration of a task loop.
+ *
+ * @param milestone Milestone reached
+ */
+void boot_milestone(boot_milestone_t milestone);
+
+/**
+ * Log the boot timeline
+ */
+void boot_log_timeline(void);
+
+/**
+ * Get the recorded phases
+ *
+ * @param[out] count Number of phases
+ * @return Phase array (owned by the boot module, read-only after boot)
+ */
+const boot_phase_t *boot_get_phases(size_t *count);
+
+/**
+ * Get the time a milestone was reached
+ *
+ * @param milestone Milestone
+ * @return esp_timer time in microseconds, 0 if not reached yet
+ */
+uint32_t boot_get_milestone(boot_milestone_t milestone);
+
+/**
+ * Get a milestone name
+ *
+ * @param milestone Milestone
+ * @return Name, e.g. "first_sample"
+ */
+const char *boot_milestone_name(boot_milestone_t milestone);
+
+#endif  // BOOT_H
@@ -0,0 +1,203 @@
+#include "calibration.h"
+
+#include <math.h>
+#include <string.h>
+
+static const char *const TYPE_NAMES[CALIB_TYPE_COUNT] = {"linear", "polynomial", "none",
+                                                         "piecewise"};
+
+const char *calibration_type_name(calib_type_t type) {
+    return type < CALIB_TYPE_COUNT ? TYPE_NAMES[type] : "?";
+}
+
+calib_type_t calibration_type_from_name(const char *name) {
+    for (int i = 0; i < CALIB_TYPE_COUNT; i++) {
+        if (strcmp(TYPE_NAMES[i], name) == 0) {
+            return (calib_type_t) i;
+        }
+    }
+    return CALIB_TYPE_COUNT;
+}
+
+esp_err_t calibration_validate(const calibration_t *calib) {
+    if (calib == NULL || calib->unit == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    size_t unit_len = strnlen(calib->unit, CALIB_UNIT_MAX);
+    if (unit_len == 0 || unit_len >= CALIB_UNIT_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    switch (calib->type) {
+        case CALIB_LINEAR:
+            return isfinite(calib->linear.m) && isfinite(calib->linear.b) ? ESP_OK
+                                                                          : ESP_ERR_INVALID_ARG;
+
+        case CALIB_POLYNOMIAL:
+            return isfinite(calib->poly.a) && isfinite(calib->poly.b) && isfinite(calib->poly.c)
+                       ? ESP_OK
+                       : ESP_ERR_INVALID_ARG;
+
+        case CALIB_PIECEWISE: {
+            const piecewise_calib_t *table = &calib->piecewise;
+            if (table->count < 2 || table->count > CALIB_PIECEWISE_MAX) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            for (int i = 0; i < table->count; i++) {
+                if (table->points[i].raw > CALIB_RAW_MAX || !isfinite(table->points[i].value) ||
+                    (i > 0 && table->points[i].raw <= table->points[i - 1].raw)) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+            }
+            return ESP_OK;
+        }
+
+        case CALIB_NONE:
+            return ESP_OK;
+
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+}
+
+/**
+ * Interpolate in a piecewise table, clamping to the end points
+ */
+static float apply_piecewise_calibration(int raw, const piecewise_calib_t *table) {
+    const calib_point_t *p = table->points;
+    if (raw <= p[0].raw) {
+        return p[0].value;
+    }
+    for (int i = 1; i < table->count; i++) {
+        if (raw <= p[i].raw) {
+            float t = (float) (raw - p[i - 1].raw) / (float) (p[i].raw - p[i - 1].raw);
+            return p[i - 1].value + t * (p[i].value - p[i - 1].value);
+        }
+    }
+    return p[table->count - 1].value;
+}
+
+float calibration_apply(const calibration_t *calib, int raw) {
+    float x = (float) raw;
+    switch (calib->type) {
+        case CALIB_LINEAR:
+            return calib->linear.m * x + calib->linear.b;
+
+        case CALIB_POLYNOMIAL:
+            return calib->poly.a * x * x + calib->poly.b * x + calib->poly.c;
+
+        case CALIB_PIECEWISE:
+            return apply_piecewise_calibration(raw, &calib->piecewise);
+
+        case CALIB_NONE:
+        default:
+            // No calibration - just use raw value
+            return x;
+    }
+}
+
+// Blob fields are copied byte-wise: the blob is packed and little-endian,
+// like the targets this runs on
+static uint8_t *put(uint8_t *p, const void *value, size_t size) {
+    memcpy(p, value, size);
+    return p + size;
+}
+
+static const uint8_t *get(const uint8_t *p, void *value, size_t size) {
+    memcpy(value, p, size);
+    return p + size;
+}
+
+size_t calibration_encode(const calibration_t *calib, uint8_t *buf) {
+    uint8_t *p = buf;
+    *p++ = CALIB_BLOB_VERSION;
+    *p++ = (uint8_t) calib->type;
+    char unit[CALIB_UNIT_MAX] = {0};
+    strncpy(unit, calib->unit, CALIB_UNIT_MAX - 1);
+    p = put(p, unit, CALIB_UNIT_MAX);
+
+    switch (calib->type) {
+        case CALIB_LINEAR:
+            p = put(p, &calib->linear.m, sizeof(float));
+            p = put(p, &calib->linear.b, sizeof(float));
+            break;
+
+        case CALIB_POLYNOMIAL:
+            p = put(p, &calib->poly.a, sizeof(float));
+            p = put(p, &calib->poly.b, sizeof(float));
+            p = put(p, &calib->poly.c, sizeof(float));
+            break;
+
+        case CALIB_PIECEWISE:
+            *p++ = calib->piecewise.count;
+            for (int i = 0; i < calib->piecewise.count; i++) {
+                p = put(p, &calib->piecewise.points[i].raw, sizeof(uint16_t));
+                p = put(p, &calib->piecewise.points[i].value, sizeof(float));
+            }
+            break;
+
+        case CALIB_NONE:
+        default:
+            break;
+    }
+    return (size_t) (p - buf);
+}
+
+esp_err_t calibration_decode(const uint8_t *buf, size_t len, calibration_t *calib, char *unit) {
+    if (len < 2 + CALIB_UNIT_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (buf[0] != CALIB_BLOB_VERSION) {
+        return ESP_ERR_INVALID_VERSION;
+    }
+
+    memset(calib, 0, sizeof(*calib));
+    calib->type = (calib_type_t) buf[1];
+    const uint8_t *p = get(buf + 2, unit, CALIB_UNIT_MAX);
+    unit[CALIB_UNIT_MAX - 1] = '\0';
+    calib->unit = unit;
+
+    size_t expected = 2 + CALIB_UNIT_MAX;
+    switch (calib->type) {
+        case CALIB_LINEAR:
+            expected += 2 * sizeof(float);
+            if (len == expected) {
+                p = get(p, &calib->linear.m, sizeof(float));
+                get(p, &calib->linear.b, sizeof(float));
+            }
+            break;
+
+        case CALIB_POLYNOMIAL:
+            expected += 3 * sizeof(float);
+            if (len == expected) {
+                p = get(p, &calib->poly.a, sizeof(float));
+                p = get(p, &calib->poly.b, sizeof(float));
+                get(p, &calib->poly.c, sizeof(float));
+            }
+            break;
+
+        case CALIB_PIECEWISE: {
+            uint8_t count = len > expected ? *p++ : 0;
+            expected += 1 + count * (sizeof(uint16_t) + sizeof(float));
+            if (count > CALIB_PIECEWISE_MAX) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            if (len == expected) {
+                calib->piecewise.count = count;
+                for (int i = 0; i < count; i++) {
+                    p = get(p, &calib->piecewise.points[i].raw, sizeof(uint16_t));
+                    p = get(p, &calib->piecewise.points[i].value, sizeof(float));
+                }
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    if (len != expected) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return calibration_validate(calib);
+}
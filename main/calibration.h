@@ -0,0 +1,119 @@
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Sensor calibration: maps a raw ADC value to a physical value
+//
+// Pure functions, no driver or OS dependencies: validation, evaluation and
+// the compact NVS encoding used by sensors.c.
+//
+// Stored blob (little-endian, packed):
+//   version u8, type u8, unit char[CALIB_UNIT_MAX] (NUL-padded), then
+//   linear      m f32, b f32
+//   polynomial  a f32, b f32, c f32
+//   piecewise   count u8, count x (raw u16, value f32)
+//   none        nothing
+
+#define CALIB_BLOB_VERSION  1
+#define CALIB_UNIT_MAX      8  // Including the NUL
+#define CALIB_PIECEWISE_MAX 8  // Points in a piecewise table
+#define CALIB_RAW_MAX       4095
+#define CALIB_BLOB_MAX      (2 + CALIB_UNIT_MAX + 1 + CALIB_PIECEWISE_MAX * 6)
+
+// Calibration type
+typedef enum {
+    CALIB_LINEAR,      // y = mx + b
+    CALIB_POLYNOMIAL,  // y = ax^2 + bx + c
+    CALIB_NONE,        // Raw value only
+    CALIB_PIECEWISE,   // Linear interpolation between table points
+    CALIB_TYPE_COUNT
+} calib_type_t;
+
+// Linear calibration params
+typedef struct {
+    float m;  // slope
+    float b;  // intercept
+} linear_calib_t;
+
+// Polynomial calibration params
+typedef struct {
+    float a;  // x^2 coefficient
+    float b;  // x coefficient
+    float c;  // constant
+} poly_calib_t;
+
+// Piecewise calibration point
+typedef struct {
+    uint16_t raw;  // 0-4095, strictly increasing along the table
+    float value;
+} calib_point_t;
+
+// Piecewise calibration table
+// Raw values outside the table take the value of the nearest end point.
+typedef struct {
+    uint8_t count;  // 2-CALIB_PIECEWISE_MAX
+    calib_point_t points[CALIB_PIECEWISE_MAX];
+} piecewise_calib_t;
+
+// Calibration configuration
+typedef struct {
+    calib_type_t type;
+    union {
+        linear_calib_t linear;
+        poly_calib_t poly;
+        piecewise_calib_t piecewise;
+    };
+    const char *unit;  // e.g., "lux", "%"
+} calibration_t;
+
+/**
+ * Get the name of a calibration type ("linear", "polynomial", "none", "piecewise")
+ */
+const char *calibration_type_name(calib_type_t type);
+
+/**
+ * Look up a calibration type by name
+ *
+ * @return Type, or CALIB_TYPE_COUNT if there is none
+ */
+calib_type_t calibration_type_from_name(const char *name);
+
+/**
+ * Check a calibration
+ *
+ * Coefficients and values must be finite, the unit 1 to
+ * CALIB_UNIT_MAX - 1 characters, piecewise tables 2 to CALIB_PIECEWISE_MAX
+ * points with raw values strictly increasing within 0-CALIB_RAW_MAX.
+ *
+ * @return ESP_OK if valid, ESP_ERR_INVALID_ARG otherwise
+ */
+esp_err_t calibration_validate(const calibration_t *calib);
+
+/**
+ * Map a raw value through a (valid) calibration
+ */
+float calibration_apply(const calibration_t *calib, int raw);
+
+/**
+ * Encode a (valid) calibration into the stored blob format
+ *
+ * @param[out] buf Output, at least CALIB_BLOB_MAX bytes
+ * @return Blob length
+ */
+size_t calibration_encode(const calibration_t *calib, uint8_t *buf);
+
+/**
+ * Decode and validate a stored blob
+ *
+ * @param[out] calib Calibration; its unit points into unit
+ * @param[out] unit Unit storage (CALIB_UNIT_MAX bytes)
+ * @return ESP_OK on success, ESP_ERR_INVALID_VERSION for another blob
+ *         version, ESP_ERR_INVALID_ARG if the blob is malformed
+ */
+esp_err_t calibration_decode(const uint8_t *buf, size_t len, calibration_t *calib, char *unit);
+
+#endif  // CALIBRATION_H
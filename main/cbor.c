@@ -0,0 +1,181 @@
+#include "cbor.h"
+
+#include <string.h>
+
+// Major types (high 3 bits of the initial byte)
+#define CBOR_UINT   0x00
+#define CBOR_NEGINT 0x20
+#define CBOR_TEXT   0x60
+#define CBOR_ARRAY  0x80
+#define CBOR_MAP    0xa0
+
+// Simple values and floats (major type 7), indefinite length marker
+#define CBOR_FALSE      0xf4
+#define CBOR_TRUE       0xf5
+#define CBOR_NULL       0xf6
+#define CBOR_HALF       0xf9
+#define CBOR_SINGLE     0xfa
+#define CBOR_INDEF_FLAG 0x1f
+#define CBOR_BREAK      0xff
+
+void cbor_writer_init(cbor_writer_t *w, uint8_t *buf, size_t size, cbor_flush_t flush,
+                      void *ctx) {
+    *w = (cbor_writer_t) {.buf = buf, .size = size, .flush = flush, .ctx = ctx, .error = ESP_OK};
+}
+
+/**
+ * Append raw bytes, flushing full buffers
+ */
+static void cbor_put(cbor_writer_t *w, const uint8_t *data, size_t len) {
+    while (len > 0 && w->error == ESP_OK) {
+        if (w->len == w->size) {
+            if (w->flush == NULL) {
+                w->error = ESP_ERR_NO_MEM;
+                return;
+            }
+            w->error = w->flush(w->ctx, w->buf, w->len);
+            w->flushed += w->len;
+            w->len = 0;
+            continue;
+        }
+        size_t n = w->size - w->len < len ? w->size - w->len : len;
+        memcpy(w->buf + w->len, data, n);
+        w->len += n;
+        data += n;
+        len -= n;
+    }
+}
+
+/**
+ * Write an initial byte with the shortest argument encoding
+ */
+static void cbor_put_head(cbor_writer_t *w, uint8_t major, uint64_t value) {
+    uint8_t head[9];
+    size_t len;
+
+    if (value < 24) {
+        head[0] = major | (uint8_t) value;
+        len = 1;
+    } else if (value <= UINT8_MAX) {
+        head[0] = major | 24;
+        head[1] = (uint8_t) value;
+        len = 2;
+    } else if (value <= UINT16_MAX) {
+        head[0] = major | 25;
+        len = 3;
+    } else if (value <= UINT32_MAX) {
+        head[0] = major | 26;
+        len = 5;
+    } else {
+        head[0] = major | 27;
+        len = 9;
+    }
+    // Big-endian argument
+    for (size_t i = len - 1; len > 2 && i > 0; i--) {
+        head[i] = (uint8_t) value;
+        value >>= 8;
+    }
+    cbor_put(w, head, len);
+}
+
+void cbor_write_uint(cbor_writer_t *w, uint64_t value) {
+    cbor_put_head(w, CBOR_UINT, value);
+}
+
+void cbor_write_int(cbor_writer_t *w, int64_t value) {
+    if (value >= 0) {
+        cbor_put_head(w, CBOR_UINT, (uint64_t) value);
+    } else {
+        cbor_put_head(w, CBOR_NEGINT, (uint64_t) (-1 - value));
+    }
+}
+
+/**
+ * Convert to half precision if that is exact
+ *
+ * @return true and the half in *half, or false if single precision is needed
+ */
+static bool cbor_float_to_half(uint32_t bits, uint16_t *half) {
+    uint16_t sign = (uint16_t) ((bits >> 16) & 0x8000);
+    int32_t exp = (int32_t) ((bits >> 23) & 0xff);
+    uint32_t mant = bits & 0x7fffff;
+
+    if (exp == 0 && mant == 0) {
+        *half = sign;  // +-0
+        return true;
+    }
+    if (exp == 0xff) {
+        *half = sign | 0x7c00 | (mant ? 0x200 : 0);  // Inf or NaN
+        return true;
+    }
+    exp -= 127;
+    if (exp < -14 || exp > 15 || (mant & 0x1fff) != 0) {
+        return false;  // Out of range, subnormal as half, or loses precision
+    }
+    *half = sign | (uint16_t) ((exp + 15) << 10) | (uint16_t) (mant >> 13);
+    return true;
+}
+
+void cbor_write_float(cbor_writer_t *w, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    uint16_t half;
+    if (cbor_float_to_half(bits, &half)) {
+        uint8_t out[3] = {CBOR_HALF, (uint8_t) (half >> 8), (uint8_t) half};
+        cbor_put(w, out, sizeof(out));
+    } else {
+        uint8_t out[5] = {CBOR_SINGLE, (uint8_t) (bits >> 24), (uint8_t) (bits >> 16),
+                          (uint8_t) (bits >> 8), (uint8_t) bits};
+        cbor_put(w, out, sizeof(out));
+    }
+}
+
+void cbor_write_bool(cbor_writer_t *w, bool value) {
+    uint8_t out = value ? CBOR_TRUE : CBOR_FALSE;
+    cbor_put(w, &out, 1);
+}
+
+void cbor_write_null(cbor_writer_t *w) {
+    uint8_t out = CBOR_NULL;
+    cbor_put(w, &out, 1);
+}
+
+void cbor_write_text(cbor_writer_t *w, const char *str) {
+    if (str == NULL) {
+        cbor_write_null(w);
+        return;
+    }
+    size_t len = strlen(str);
+    cbor_put_head(w, CBOR_TEXT, len);
+    cbor_put(w, (const uint8_t *) str, len);
+}
+
+static void cbor_put_container(cbor_writer_t *w, uint8_t major, size_t count) {
+    if (count == CBOR_INDEFINITE) {
+        uint8_t out = major | CBOR_INDEF_FLAG;
+        cbor_put(w, &out, 1);
+    } else {
+        cbor_put_head(w, major, count);
+    }
+}
+
+void cbor_write_array(cbor_writer_t *w, size_t count) {
+    cbor_put_container(w, CBOR_ARRAY, count);
+}
+
+void cbor_write_map(cbor_writer_t *w, size_t count) {
+    cbor_put_container(w, CBOR_MAP, count);
+}
+
+void cbor_write_break(cbor_writer_t *w) {
+    uint8_t out = CBOR_BREAK;
+    cbor_put(w, &out, 1);
+}
+
+esp_err_t cbor_writer_finish(cbor_writer_t *w, size_t *len) {
+    if (len != NULL) {
+        *len = w->flushed + w->len;
+    }
+    return w->error;
+}
@@ -0,0 +1,71 @@
+#ifndef CBOR_H
+#define CBOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Streaming CBOR encoder (RFC 8949)
+//
+// Items are written straight into a caller-provided buffer; there is no
+// document tree. With a flush callback the buffer is handed over whenever
+// it fills, so output size isn't limited by it (chunked HTTP responses).
+// Without one, running out of space marks the writer as failed and
+// cbor_writer_finish() reports it.
+//
+// Maps and arrays take their item count up front (a map of n entries is
+// followed by 2n items), or CBOR_INDEFINITE closed by cbor_write_break().
+// Floats use the shortest of half and single precision that is exact.
+
+#define CBOR_INDEFINITE SIZE_MAX
+
+/**
+ * Output callback
+ *
+ * @return ESP_OK to continue, anything else fails the writer
+ */
+typedef esp_err_t (*cbor_flush_t)(void *ctx, const uint8_t *buf, size_t len);
+
+typedef struct {
+    uint8_t *buf;
+    size_t size;
+    size_t len;      // Bytes in buf not flushed yet
+    size_t flushed;  // Bytes handed to flush so far
+    cbor_flush_t flush;
+    void *ctx;
+    esp_err_t error;  // First error, ESP_OK while healthy
+} cbor_writer_t;
+
+/**
+ * Start writing into a buffer
+ *
+ * @param flush Output callback, NULL to fail once the buffer is full
+ * @param ctx Passed to flush
+ */
+void cbor_writer_init(cbor_writer_t *w, uint8_t *buf, size_t size, cbor_flush_t flush,
+                      void *ctx);
+
+void cbor_write_uint(cbor_writer_t *w, uint64_t value);
+void cbor_write_int(cbor_writer_t *w, int64_t value);
+void cbor_write_float(cbor_writer_t *w, float value);
+void cbor_write_bool(cbor_writer_t *w, bool value);
+void cbor_write_null(cbor_writer_t *w);
+void cbor_write_text(cbor_writer_t *w, const char *str);  // NULL is written as null
+void cbor_write_array(cbor_writer_t *w, size_t count);
+void cbor_write_map(cbor_writer_t *w, size_t count);
+void cbor_write_break(cbor_writer_t *w);  // Ends an indefinite array or map
+
+/**
+ * Finish encoding
+ *
+ * Bytes still in the buffer are left there (not flushed) so callers can
+ * tell a response that fits in one piece from a streamed one.
+ *
+ * @param[out] len Total encoded length, including flushed bytes (optional)
+ * @return ESP_OK, ESP_ERR_NO_MEM if the output didn't fit, or the flush error
+ */
+esp_err_t cbor_writer_finish(cbor_writer_t *w, size_t *len);
+
+#endif  // CBOR_H
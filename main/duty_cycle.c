@@ -0,0 +1,327 @@
+#include "duty_cycle.h"
+
+#ifdef CONFIG_GEEKHOUSE_DUTY_CYCLE
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "mqtt_client.h"
+#include "mqtt_publisher.h"
+#include "sensors.h"
+#include "wifi_manager.h"
+
+static const char *TAG = "DUTY_CYCLE";
+
+#define DUTY_CYCLE_PERIOD_US    ((uint64_t) CONFIG_GEEKHOUSE_DUTY_CYCLE_PERIOD_S * 1000000)
+#define DUTY_CYCLE_BATCH        CONFIG_GEEKHOUSE_DUTY_CYCLE_BATCH
+#define DUTY_CYCLE_MAGIC        0x44555459  // "DUTY"
+#define DUTY_CYCLE_SLEEP_MIN_US 100000      // When a wake overran the period
+
+#define DUTY_TOPIC_BATCH  MQTT_TOPIC_PREFIX "/sensors/batch"
+#define DUTY_TOPIC_STATUS MQTT_TOPIC_PREFIX "/status/duty_cycle"
+
+// MQTT client events
+#define DUTY_MQTT_CONNECTED BIT0
+#define DUTY_MQTT_ACKED     BIT1
+
+// Reading as kept in RTC memory (the unit pointer is not kept)
+typedef struct {
+    uint32_t timestamp;
+    float value;
+    int16_t raw;
+    uint8_t id;
+    uint8_t reserved;
+} duty_cycle_record_t;
+
+// Everything that survives deep sleep
+typedef struct {
+    uint32_t magic;
+    int64_t power_on_us;  // RTC clock at power-on
+    uint32_t head;        // Oldest record
+    uint32_t count;
+    uint32_t backoff;  // Wakes between flush attempts after the last failure
+    uint32_t skip;     // Wakes left before the next attempt
+    duty_cycle_stats_t stats;
+    duty_cycle_record_t records[DUTY_CYCLE_CAPACITY];
+} duty_cycle_state_t;
+
+static RTC_DATA_ATTR duty_cycle_state_t s_rtc;
+
+// Flush (this wake only)
+static EventGroupHandle_t s_mqtt_events = NULL;
+static volatile int s_acked_msg_id = -1;
+static sensor_reading_t s_batch[MQTT_BATCH_MAX];
+static char s_payload[MQTT_PAYLOAD_MAX];
+
+/**
+ * RTC clock in microseconds (keeps counting through deep sleep)
+ */
+static int64_t duty_cycle_rtc_us(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/**
+ * Read every sensor once into the RTC buffer (oldest readings go when full)
+ */
+static void duty_cycle_sample(void) {
+    uint32_t now_ms = (uint32_t) ((duty_cycle_rtc_us() - s_rtc.power_on_us) / 1000);
+
+    for (int id = 0; id < SENSOR_COUNT; id++) {
+        sensor_reading_t reading;
+        if (sensor_read(id, &reading) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to read sensor %d", id);
+            continue;
+        }
+        if (s_rtc.count == DUTY_CYCLE_CAPACITY) {
+            s_rtc.head = (s_rtc.head + 1) % DUTY_CYCLE_CAPACITY;
+            s_rtc.count--;
+            s_rtc.stats.dropped++;
+        }
+        s_rtc.records[(s_rtc.head + s_rtc.count) % DUTY_CYCLE_CAPACITY] =
+            (duty_cycle_record_t) {.timestamp = now_ms,
+                                   .value = reading.calibrated_value,
+                                   .raw = (int16_t) reading.raw_value,
+                                   .id = (uint8_t) id};
+        s_rtc.count++;
+        s_rtc.stats.samples++;
+    }
+}
+
+/**
+ * MQTT event handler (MQTT client task)
+ */
+static void duty_cycle_mqtt_event(void *handler_args, esp_event_base_t base, int32_t event_id,
+                                  void *event_data) {
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t) event_data;
+
+    switch ((esp_mqtt_event_id_t) event_id) {
+        case MQTT_EVENT_CONNECTED:
+            xEventGroupSetBits(s_mqtt_events, DUTY_MQTT_CONNECTED);
+            break;
+        case MQTT_EVENT_PUBLISHED:
+            s_acked_msg_id = event->msg_id;
+            xEventGroupSetBits(s_mqtt_events, DUTY_MQTT_ACKED);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Ticks left until a deadline on the esp_timer clock (0 once passed)
+ */
+static TickType_t duty_cycle_ticks_left(int64_t deadline_us) {
+    int64_t left_us = deadline_us - esp_timer_get_time();
+    return left_us > 0 ? pdMS_TO_TICKS(left_us / 1000) + 1 : 0;
+}
+
+/**
+ * Publish with QoS 1 and wait for the PUBACK
+ *
+ * @return true if the broker acknowledged it before the deadline
+ */
+static bool duty_cycle_publish(esp_mqtt_client_handle_t client, const char *topic,
+                               const char *payload, size_t len, bool retain,
+                               int64_t deadline_us) {
+    xEventGroupClearBits(s_mqtt_events, DUTY_MQTT_ACKED);
+    int msg_id = esp_mqtt_client_publish(client, topic, payload, (int) len, 1, retain);
+    if (msg_id < 0) {
+        return false;
+    }
+    // The PUBACK may have been handled before msg_id was known here
+    while (s_acked_msg_id != msg_id) {
+        TickType_t left = duty_cycle_ticks_left(deadline_us);
+        if (left == 0 ||
+            !(xEventGroupWaitBits(s_mqtt_events, DUTY_MQTT_ACKED, pdTRUE, pdFALSE, left) &
+              DUTY_MQTT_ACKED)) {
+            return s_acked_msg_id == msg_id;
+        }
+    }
+    return true;
+}
+
+/**
+ * Publish the statistics (retained), best effort
+ */
+static void duty_cycle_publish_status(esp_mqtt_client_handle_t client, int64_t deadline_us) {
+    const duty_cycle_stats_t *st = &s_rtc.stats;
+    int len = snprintf(
+        s_payload, sizeof(s_payload),
+        "{\"period_s\":%d,\"batch\":%d,\"wakes\":%lu,\"samples\":%lu,\"dropped\":%lu,"
+        "\"pending\":%lu,\"flushes\":%lu,\"flush_failures\":%lu,"
+        "\"sample_wakes\":%lu,\"sample_awake_us\":%llu,\"sample_max_us\":%lu,"
+        "\"flush_wakes\":%lu,\"flush_awake_us\":%llu,\"flush_max_us\":%lu,\"asleep_us\":%llu}",
+        CONFIG_GEEKHOUSE_DUTY_CYCLE_PERIOD_S, DUTY_CYCLE_BATCH, st->wakes, st->samples,
+        st->dropped, s_rtc.count, st->flushes, st->flush_failures, st->sample_wakes,
+        (unsigned long long) st->sample_awake_us, st->sample_max_us, st->flush_wakes,
+        (unsigned long long) st->flush_awake_us, st->flush_max_us,
+        (unsigned long long) st->asleep_us);
+    if (len > 0 && len < (int) sizeof(s_payload)) {
+        duty_cycle_publish(client, DUTY_TOPIC_STATUS, s_payload, len, true, deadline_us);
+    }
+}
+
+/**
+ * Publish buffered readings, oldest first, until the buffer is empty
+ *
+ * Readings leave RTC memory only once their publish is acknowledged.
+ *
+ * @return ESP_OK if everything was delivered
+ */
+static esp_err_t duty_cycle_send(esp_mqtt_client_handle_t client, int64_t deadline_us) {
+    while (s_rtc.count > 0) {
+        size_t n = s_rtc.count < MQTT_BATCH_MAX ? s_rtc.count : MQTT_BATCH_MAX;
+        for (size_t i = 0; i < n; i++) {
+            const duty_cycle_record_t *r =
+                &s_rtc.records[(s_rtc.head + i) % DUTY_CYCLE_CAPACITY];
+            s_batch[i] = (sensor_reading_t) {.id = (sensor_id_t) r->id,
+                                             .raw_value = r->raw,
+                                             .calibrated_value = r->value,
+                                             .timestamp = r->timestamp};
+        }
+
+        size_t len = mqtt_encode_batch_payload(s_payload, sizeof(s_payload), s_batch, n);
+        if (len == 0) {
+            ESP_LOGE(TAG, "Batch of %d readings doesn't fit a payload", (int) n);
+            return ESP_ERR_NO_MEM;
+        }
+        if (!duty_cycle_publish(client, DUTY_TOPIC_BATCH, s_payload, len, false, deadline_us)) {
+            return ESP_ERR_TIMEOUT;
+        }
+        s_rtc.head = (s_rtc.head + n) % DUTY_CYCLE_CAPACITY;
+        s_rtc.count -= n;
+    }
+    return ESP_OK;
+}
+
+/**
+ * Bring up WiFi and MQTT and deliver the buffer
+ *
+ * @return ESP_OK if everything was delivered
+ */
+static esp_err_t duty_cycle_flush(esp_err_t (*network_init)(void)) {
+    int64_t deadline_us = esp_timer_get_time() + (int64_t) DUTY_CYCLE_FLUSH_TIMEOUT * 1000;
+
+    esp_err_t ret = network_init();
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Network init failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    if (!(xEventGroupWaitBits(wifi_manager_get_event_group(), WIFI_CONNECTED_BIT, pdFALSE,
+                              pdTRUE, duty_cycle_ticks_left(deadline_us)) &
+          WIFI_CONNECTED_BIT)) {
+        ESP_LOGW(TAG, "No WiFi connection");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    s_mqtt_events = xEventGroupCreate();
+    const esp_mqtt_client_config_t config = {
+        .broker.address.uri = CONFIG_GEEKHOUSE_MQTT_BROKER_URL,
+        .buffer.out_size = MQTT_PAYLOAD_MAX + 64,  // Payload + topic + fixed header
+    };
+    esp_mqtt_client_handle_t client = esp_mqtt_client_init(&config);
+    if (s_mqtt_events == NULL || client == NULL) {
+        ESP_LOGE(TAG, "Failed to create MQTT client");
+        return ESP_ERR_NO_MEM;
+    }
+    esp_mqtt_client_register_event(client, MQTT_EVENT_ANY, duty_cycle_mqtt_event, NULL);
+    esp_mqtt_client_start(client);
+
+    ret = ESP_ERR_TIMEOUT;
+    if (xEventGroupWaitBits(s_mqtt_events, DUTY_MQTT_CONNECTED, pdFALSE, pdTRUE,
+                            duty_cycle_ticks_left(deadline_us)) &
+        DUTY_MQTT_CONNECTED) {
+        ret = duty_cycle_send(client, deadline_us);
+        duty_cycle_publish_status(client, deadline_us);
+    } else {
+        ESP_LOGW(TAG, "No MQTT connection");
+    }
+
+    esp_mqtt_client_stop(client);
+    esp_mqtt_client_destroy(client);
+    return ret;
+}
+
+/**
+ * Record this wake's awake time and deep sleep until the next period
+ */
+static void __attribute__((noreturn)) duty_cycle_sleep(bool flushed) {
+    duty_cycle_stats_t *st = &s_rtc.stats;
+    uint32_t awake_us = (uint32_t) esp_timer_get_time();
+
+    if (flushed) {
+        st->flush_wakes++;
+        st->flush_awake_us += awake_us;
+        if (awake_us > st->flush_max_us) {
+            st->flush_max_us = awake_us;
+        }
+    } else {
+        st->sample_wakes++;
+        st->sample_awake_us += awake_us;
+        if (awake_us > st->sample_max_us) {
+            st->sample_max_us = awake_us;
+        }
+    }
+
+    uint64_t sleep_us = awake_us + DUTY_CYCLE_SLEEP_MIN_US < DUTY_CYCLE_PERIOD_US
+                            ? DUTY_CYCLE_PERIOD_US - awake_us
+                            : DUTY_CYCLE_SLEEP_MIN_US;
+    st->asleep_us += sleep_us;
+
+    esp_sleep_enable_timer_wakeup(sleep_us);
+    esp_deep_sleep_start();
+}
+
+void duty_cycle_run(esp_err_t (*network_init)(void)) {
+    // RTC memory only holds our state after a deep sleep wake
+    if (esp_reset_reason() != ESP_RST_DEEPSLEEP || s_rtc.magic != DUTY_CYCLE_MAGIC) {
+        memset(&s_rtc, 0, sizeof(s_rtc));
+        s_rtc.magic = DUTY_CYCLE_MAGIC;
+        s_rtc.power_on_us = duty_cycle_rtc_us();
+        ESP_LOGI(TAG, "Duty cycle: sample every %d s, flush every %d readings",
+                 CONFIG_GEEKHOUSE_DUTY_CYCLE_PERIOD_S, DUTY_CYCLE_BATCH);
+    }
+    s_rtc.stats.wakes++;
+
+    if (sensor_init() == ESP_OK) {
+        duty_cycle_sample();
+    }
+
+    bool due = s_rtc.count >= DUTY_CYCLE_BATCH;
+    if (due && s_rtc.skip > 0) {
+        s_rtc.skip--;  // Backing off after a failed flush
+        due = false;
+    }
+    if (!due) {
+        duty_cycle_sleep(false);
+    }
+
+    esp_err_t ret = duty_cycle_flush(network_init);
+    if (ret == ESP_OK) {
+        s_rtc.stats.flushes++;
+        s_rtc.backoff = 0;
+    } else {
+        s_rtc.stats.flush_failures++;
+        s_rtc.backoff = s_rtc.backoff == 0 ? 1 : s_rtc.backoff * 2;
+        if (s_rtc.backoff > DUTY_CYCLE_BACKOFF_MAX) {
+            s_rtc.backoff = DUTY_CYCLE_BACKOFF_MAX;
+        }
+        s_rtc.skip = s_rtc.backoff;
+        ESP_LOGW(TAG, "Flush failed (%s), %lu readings kept, retry in %lu wakes",
+                 esp_err_to_name(ret), s_rtc.count, s_rtc.backoff);
+    }
+    duty_cycle_sleep(true);
+}
+
+#endif  // CONFIG_GEEKHOUSE_DUTY_CYCLE
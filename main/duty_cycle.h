@@ -0,0 +1,66 @@
+#ifndef DUTY_CYCLE_H
+#define DUTY_CYCLE_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+// Deep-sleep duty cycle (CONFIG_GEEKHOUSE_DUTY_CYCLE)
+//
+// For battery nodes: instead of starting the tasks, every boot takes one
+// reading per sensor, appends them to a buffer in RTC memory (kept through
+// deep sleep) and goes back to deep sleep for the rest of
+// CONFIG_GEEKHOUSE_DUTY_CYCLE_PERIOD_S. Only when the buffer holds
+// CONFIG_GEEKHOUSE_DUTY_CYCLE_BATCH readings does a wake bring up WiFi
+// (fast reconnect from the cached BSSID, wifi_manager.h) and publish them
+// over MQTT with QoS 1, in the batch format of mqtt_publisher.h:
+//
+//   geekhouse/sensors/batch        readings, oldest first
+//   geekhouse/status/duty_cycle    statistics below (JSON, retained)
+//
+// Readings stay in RTC memory until the broker acknowledges them. A failed
+// flush is retried after twice as many wakes as the last one, up to
+// DUTY_CYCLE_BACKOFF_MAX; when the buffer is full the oldest readings go.
+//
+// Reading timestamps are milliseconds since power-on on the RTC clock,
+// which keeps running through deep sleep.
+//
+// Awake time is measured from app start to esp_deep_sleep_start(), split
+// into wakes that only sampled and wakes that flushed. ROM and bootloader
+// time before app start is not included. tools/duty_energy.py turns these
+// into samples per joule next to always-on operation.
+
+#define DUTY_CYCLE_CAPACITY      256    // Readings in RTC memory (12 bytes each)
+#define DUTY_CYCLE_FLUSH_TIMEOUT 15000  // ms for WiFi, MQTT connect and acks
+#define DUTY_CYCLE_BACKOFF_MAX   32     // Wakes between flush retries, at most
+
+// Duty cycle statistics (since power-on, kept in RTC memory)
+typedef struct {
+    uint32_t wakes;
+    uint32_t samples;         // Readings taken
+    uint32_t dropped;         // Readings lost to a full buffer
+    uint32_t flushes;         // Successful flushes
+    uint32_t flush_failures;  // Flushes given up (no WiFi, broker or acks)
+    uint32_t sample_wakes;    // Wakes that only sampled
+    uint64_t sample_awake_us;
+    uint32_t sample_max_us;
+    uint32_t flush_wakes;  // Wakes that tried to flush
+    uint64_t flush_awake_us;
+    uint32_t flush_max_us;
+    uint64_t asleep_us;  // Deep sleep time requested
+} duty_cycle_stats_t;
+
+#ifdef CONFIG_GEEKHOUSE_DUTY_CYCLE
+
+/**
+ * Sample, flush if due, and enter deep sleep (never returns)
+ *
+ * @param network_init Brings up the settings and WiFi (NVS is already up);
+ *                     only called on wakes that flush
+ */
+void duty_cycle_run(esp_err_t (*network_init)(void)) __attribute__((noreturn));
+
+#endif  // CONFIG_GEEKHOUSE_DUTY_CYCLE
+
+#endif  // DUTY_CYCLE_H
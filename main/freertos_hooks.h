@@ -0,0 +1,88 @@
+#ifndef FREERTOS_HOOKS_H
+#define FREERTOS_HOOKS_H
+
+// FreeRTOS trace hooks
+//
+// This header is force-included into every translation unit by the
+// top-level CMakeLists.txt, so the macros below are seen by the kernel's
+// tasks.c and queue.c. Keep it tiny: no ESP-IDF includes, and everything
+// it defines runs inside the scheduler with interrupts masked.
+
+#ifndef __ASSEMBLER__
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Context switches per task, indexed by TCB number (see stats_task.c)
+// Must be a power of two; task numbers only collide after this many tasks are created.
+#define TASK_SWITCH_SLOTS 32
+
+extern volatile uint32_t g_task_switch_count[TASK_SWITCH_SLOTS];
+
+// Trace event types (see trace.h)
+typedef enum {
+    TRACE_EVT_TASK_SWITCH = 1,          // obj = task switched in
+    TRACE_EVT_QUEUE_SEND = 2,           // obj = queue, arg = queue type (mutex give is a send)
+    TRACE_EVT_QUEUE_RECEIVE = 3,        // obj = queue, arg = queue type (mutex take is a receive)
+    TRACE_EVT_QUEUE_BLOCK_SEND = 4,     // Task blocks because the queue is full
+    TRACE_EVT_QUEUE_BLOCK_RECEIVE = 5,  // Task blocks because the queue is empty / mutex taken
+    TRACE_EVT_SPAN_BEGIN = 6,           // arg = trace_span_t
+    TRACE_EVT_SPAN_END = 7,             // arg = trace_span_t
+    TRACE_EVT_TASK_READY = 8,           // obj = task made ready (ready -> run = scheduling latency)
+} trace_event_type_t;
+
+#ifdef CONFIG_GEEKHOUSE_TRACE
+
+// Record an event (trace.c, IRAM)
+void trace_record(uint8_t type, uint32_t obj, uint16_t arg);
+void trace_record_isr(uint8_t type, uint32_t obj, uint16_t arg);
+
+#define TRACE_HOOK_SWITCH() \
+    trace_record(TRACE_EVT_TASK_SWITCH, (uint32_t) (uintptr_t) pxCurrentTCB, 0)
+#define traceMOVED_TASK_TO_READY_STATE(pxTCB) \
+    trace_record(TRACE_EVT_TASK_READY, (uint32_t) (uintptr_t) (pxTCB), 0)
+
+// Queue hooks expand inside queue.c, where Queue_t is complete;
+// ucQueueType tells mutexes and semaphores apart from plain queues.
+#define TRACE_HOOK_QUEUE(record, type, pxQueue) \
+    record(type, (uint32_t) (uintptr_t) (pxQueue), (pxQueue)->ucQueueType)
+
+#define traceQUEUE_SEND(pxQueue) TRACE_HOOK_QUEUE(trace_record, TRACE_EVT_QUEUE_SEND, pxQueue)
+#define traceQUEUE_RECEIVE(pxQueue) \
+    TRACE_HOOK_QUEUE(trace_record, TRACE_EVT_QUEUE_RECEIVE, pxQueue)
+#define traceBLOCKING_ON_QUEUE_SEND(pxQueue) \
+    TRACE_HOOK_QUEUE(trace_record, TRACE_EVT_QUEUE_BLOCK_SEND, pxQueue)
+#define traceBLOCKING_ON_QUEUE_RECEIVE(pxQueue) \
+    TRACE_HOOK_QUEUE(trace_record, TRACE_EVT_QUEUE_BLOCK_RECEIVE, pxQueue)
+#define traceQUEUE_SEND_FROM_ISR(pxQueue) \
+    TRACE_HOOK_QUEUE(trace_record_isr, TRACE_EVT_QUEUE_SEND, pxQueue)
+#define traceQUEUE_RECEIVE_FROM_ISR(pxQueue) \
+    TRACE_HOOK_QUEUE(trace_record_isr, TRACE_EVT_QUEUE_RECEIVE, pxQueue)
+
+#else
+
+#define TRACE_HOOK_SWITCH() ((void) 0)
+
+#endif  // CONFIG_GEEKHOUSE_TRACE
+
+// Count a switch-in of the current task
+// Expands inside tasks.c, where pxCurrentTCB is the task about to run.
+// Plain DRAM array and no function call, so it is safe with the cache disabled.
+#define traceTASK_SWITCHED_IN()                                                     \
+    do {                                                                            \
+        g_task_switch_count[pxCurrentTCB->uxTCBNumber & (TASK_SWITCH_SLOTS - 1)]++; \
+        TRACE_HOOK_SWITCH();                                                        \
+    } while (0)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // __ASSEMBLER__
+
+#endif  // FREERTOS_HOOKS_H
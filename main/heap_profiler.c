@@ -0,0 +1,243 @@
+#include "heap_profiler.h"
+
+#include <string.h>
+
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos_hooks.h"
+
+static const char *TAG = "HEAP_PROF";
+
+#ifdef CONFIG_GEEKHOUSE_HEAP_PROFILING
+
+#define HEAP_BLOCKS     CONFIG_GEEKHOUSE_HEAP_PROFILING_BLOCKS
+#define HEAP_MASK       (HEAP_BLOCKS - 1)
+#define HEAP_BLOCKS_MAX (HEAP_BLOCKS * 3 / 4)  // Keep probe sequences short
+#define HEAP_TAG_OTHER  0                      // Charged when the tag table is full
+
+_Static_assert((HEAP_BLOCKS & HEAP_MASK) == 0,
+               "CONFIG_GEEKHOUSE_HEAP_PROFILING_BLOCKS: power of two");
+
+// One live allocation (8 bytes)
+// Open addressing with linear probing; ptr == 0 marks an empty slot.
+typedef struct {
+    uint32_t ptr;
+    uint32_t size : 24;
+    uint32_t tag : 8;
+} heap_block_t;
+
+static heap_block_t s_blocks[HEAP_BLOCKS];
+static uint32_t s_block_count = 0;
+static heap_tag_stats_t s_tags[HEAP_PROFILER_TAGS_MAX];
+static size_t s_tag_count = 0;
+static uint32_t s_untracked = 0;
+static volatile bool s_enabled = false;
+
+// Explicit tag per task, indexed like g_task_switch_count (NULL = task name)
+static const char *s_scope_tag[TASK_SWITCH_SLOTS];
+
+// The hooks run in whichever task allocates; everything above is only
+// touched inside this critical section.
+static portMUX_TYPE s_heap_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static inline uint32_t IRAM_ATTR heap_hash(uint32_t ptr) {
+    // Blocks are at least 4-byte aligned, so drop the low bits first
+    return ((ptr >> 2) * 2654435761u) & HEAP_MASK;
+}
+
+/**
+ * Find or add a tag (inside s_heap_mux)
+ */
+static uint8_t IRAM_ATTR heap_tag_index(const char *name) {
+    for (size_t i = 0; i < s_tag_count; i++) {
+        if (strncmp(s_tags[i].name, name, HEAP_PROFILER_TAG_LEN - 1) == 0) {
+            return i;
+        }
+    }
+    if (s_tag_count >= HEAP_PROFILER_TAGS_MAX) {
+        return HEAP_TAG_OTHER;
+    }
+    heap_tag_stats_t *t = &s_tags[s_tag_count];
+    strncpy(t->name, name, HEAP_PROFILER_TAG_LEN - 1);
+    return s_tag_count++;
+}
+
+/**
+ * Find the slot holding ptr (inside s_heap_mux)
+ *
+ * @return Slot index, or -1 if ptr isn't tracked
+ */
+static int IRAM_ATTR heap_table_find(uint32_t ptr) {
+    for (uint32_t i = heap_hash(ptr);; i = (i + 1) & HEAP_MASK) {
+        if (s_blocks[i].ptr == ptr) {
+            return i;
+        }
+        if (s_blocks[i].ptr == 0) {
+            return -1;
+        }
+    }
+}
+
+/**
+ * Remove the entry at slot i (inside s_heap_mux)
+ *
+ * Backward-shift deletion: later entries of the same probe run move into
+ * the hole, so lookups never need tombstones.
+ */
+static void IRAM_ATTR heap_table_remove(uint32_t i) {
+    uint32_t j = i;
+    while (true) {
+        j = (j + 1) & HEAP_MASK;
+        if (s_blocks[j].ptr == 0) {
+            break;
+        }
+        // Entry j may fill the hole unless its home slot lies after the hole
+        uint32_t home = heap_hash(s_blocks[j].ptr);
+        if (((j - home) & HEAP_MASK) >= ((j - i) & HEAP_MASK)) {
+            s_blocks[i] = s_blocks[j];
+            i = j;
+        }
+    }
+    s_blocks[i].ptr = 0;
+    s_block_count--;
+}
+
+// Called by the heap component after every successful allocation
+void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps) {
+    (void) caps;
+    if (!s_enabled || ptr == NULL) {
+        return;
+    }
+
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    const char *tag = "isr";
+    if (task != NULL) {
+        tag = s_scope_tag[uxTaskGetTaskNumber(task) & (TASK_SWITCH_SLOTS - 1)];
+        if (tag == NULL) {
+            tag = pcTaskGetName(task);
+        }
+    }
+
+    portENTER_CRITICAL(&s_heap_mux);
+    if (s_block_count >= HEAP_BLOCKS_MAX || size >= (1 << 24)) {
+        s_untracked++;
+    } else {
+        uint8_t index = heap_tag_index(tag);
+        uint32_t slot = heap_hash((uint32_t) (uintptr_t) ptr);
+        while (s_blocks[slot].ptr != 0) {
+            slot = (slot + 1) & HEAP_MASK;
+        }
+        s_blocks[slot] = (heap_block_t) {.ptr = (uint32_t) (uintptr_t) ptr,
+                                         .size = size,
+                                         .tag = index};
+        s_block_count++;
+
+        heap_tag_stats_t *t = &s_tags[index];
+        t->live_bytes += size;
+        t->live_blocks++;
+        t->allocs++;
+        if (t->live_bytes > t->peak_bytes) {
+            t->peak_bytes = t->live_bytes;
+        }
+    }
+    portEXIT_CRITICAL(&s_heap_mux);
+}
+
+// Called by the heap component before every free
+void IRAM_ATTR esp_heap_trace_free_hook(void *ptr) {
+    if (!s_enabled || ptr == NULL) {
+        return;
+    }
+
+    portENTER_CRITICAL(&s_heap_mux);
+    int slot = heap_table_find((uint32_t) (uintptr_t) ptr);
+    if (slot >= 0) {
+        heap_tag_stats_t *t = &s_tags[s_blocks[slot].tag];
+        t->live_bytes -= s_blocks[slot].size;
+        t->live_blocks--;
+        t->frees++;
+        heap_table_remove(slot);
+    }
+    portEXIT_CRITICAL(&s_heap_mux);
+}
+
+esp_err_t heap_profiler_init(void) {
+    portENTER_CRITICAL(&s_heap_mux);
+    strncpy(s_tags[HEAP_TAG_OTHER].name, "other", HEAP_PROFILER_TAG_LEN - 1);
+    s_tag_count = 1;
+    s_enabled = true;
+    portEXIT_CRITICAL(&s_heap_mux);
+
+    ESP_LOGI(TAG, "Heap profiling enabled: %d blocks, %d tags (%d bytes)", HEAP_BLOCKS_MAX,
+             HEAP_PROFILER_TAGS_MAX, (int) (sizeof(s_blocks) + sizeof(s_tags)));
+    return ESP_OK;
+}
+
+const char *heap_profiler_set_tag(const char *tag) {
+    uint32_t slot = uxTaskGetTaskNumber(xTaskGetCurrentTaskHandle()) & (TASK_SWITCH_SLOTS - 1);
+    const char *prev = s_scope_tag[slot];
+    s_scope_tag[slot] = tag;
+    return prev;
+}
+
+esp_err_t heap_profiler_get_tags(heap_tag_stats_t *tags, size_t max, size_t *count) {
+    if (tags == NULL || count == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_heap_mux);
+    size_t n = s_tag_count < max ? s_tag_count : max;
+    memcpy(tags, s_tags, n * sizeof(heap_tag_stats_t));
+    portEXIT_CRITICAL(&s_heap_mux);
+
+    // Insertion sort by live bytes, largest first (n is small)
+    for (size_t i = 1; i < n; i++) {
+        heap_tag_stats_t t = tags[i];
+        size_t j = i;
+        while (j > 0 && tags[j - 1].live_bytes < t.live_bytes) {
+            tags[j] = tags[j - 1];
+            j--;
+        }
+        tags[j] = t;
+    }
+
+    *count = n;
+    return ESP_OK;
+}
+
+#else  // CONFIG_GEEKHOUSE_HEAP_PROFILING
+
+esp_err_t heap_profiler_get_tags(heap_tag_stats_t *tags, size_t max, size_t *count) {
+    (void) tags;
+    (void) max;
+    if (count != NULL) {
+        *count = 0;
+    }
+    ESP_LOGD(TAG, "Heap profiling disabled (CONFIG_GEEKHOUSE_HEAP_PROFILING)");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif  // CONFIG_GEEKHOUSE_HEAP_PROFILING
+
+void heap_profiler_get_summary(heap_summary_t *summary) {
+    if (summary == NULL) {
+        return;
+    }
+
+    memset(summary, 0, sizeof(*summary));
+    summary->free_bytes = esp_get_free_heap_size();
+    summary->min_free_bytes = esp_get_minimum_free_heap_size();
+    summary->largest_free_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+    if (summary->free_bytes > 0) {
+        summary->fragmentation_x100 =
+            10000 - (uint32_t) ((uint64_t) summary->largest_free_block * 10000 /
+                                summary->free_bytes);
+    }
+#ifdef CONFIG_GEEKHOUSE_HEAP_PROFILING
+    summary->untracked = s_untracked;
+#endif
+}
@@ -0,0 +1,91 @@
+#ifndef HEAP_PROFILER_H
+#define HEAP_PROFILER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+// Heap allocation accounting (CONFIG_GEEKHOUSE_HEAP_PROFILING)
+//
+// Built on the ESP-IDF heap hooks (CONFIG_HEAP_USE_HOOKS): every
+// allocation is charged to a tag, freed blocks are credited back to the tag
+// that allocated them. The tag is the allocating task's name, unless code
+// sets an explicit tag for a scope (HTTP handlers use their route).
+
+#define HEAP_PROFILER_TAGS_MAX 32
+#define HEAP_PROFILER_TAG_LEN  24
+
+// Per-tag allocation statistics
+typedef struct {
+    char name[HEAP_PROFILER_TAG_LEN];
+    uint32_t live_bytes;   // Currently allocated
+    uint32_t peak_bytes;   // Highest live_bytes since boot
+    uint32_t live_blocks;  // Currently allocated blocks
+    uint32_t allocs;       // Allocations since boot
+    uint32_t frees;        // Frees since boot
+} heap_tag_stats_t;
+
+// Heap-wide figures (always available)
+typedef struct {
+    uint32_t free_bytes;
+    uint32_t min_free_bytes;     // Lowest free_bytes since boot
+    uint32_t largest_free_block;
+    uint32_t fragmentation_x100;  // 100 * (1 - largest / free), percent * 100
+    uint32_t untracked;           // Allocations not tracked (table full or before init)
+} heap_summary_t;
+
+#ifdef CONFIG_GEEKHOUSE_HEAP_PROFILING
+
+/**
+ * Start charging allocations to tags
+ *
+ * Allocations made earlier are not tracked (their frees are ignored).
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t heap_profiler_init(void);
+
+/**
+ * Charge the calling task's allocations to a tag until restored
+ *
+ * Scopes nest: keep the return value and pass it to heap_profiler_set_tag()
+ * when the scope ends.
+ *
+ * @param tag Tag name (must be a string literal), NULL for the task name
+ * @return Previous tag of the calling task
+ */
+const char *heap_profiler_set_tag(const char *tag);
+
+#else
+
+static inline esp_err_t heap_profiler_init(void) {
+    return ESP_OK;
+}
+
+static inline const char *heap_profiler_set_tag(const char *tag) {
+    (void) tag;
+    return NULL;
+}
+
+#endif  // CONFIG_GEEKHOUSE_HEAP_PROFILING
+
+/**
+ * Get heap-wide figures
+ *
+ * @param[out] summary Heap summary
+ */
+void heap_profiler_get_summary(heap_summary_t *summary);
+
+/**
+ * Copy per-tag statistics, largest live_bytes first
+ *
+ * @param[out] tags Buffer for tag statistics
+ * @param max Buffer capacity
+ * @param[out] count Number of entries copied
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if profiling is disabled
+ */
+esp_err_t heap_profiler_get_tags(heap_tag_stats_t *tags, size_t max, size_t *count);
+
+#endif  // HEAP_PROFILER_H
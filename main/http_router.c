@@ -0,0 +1,493 @@
+#include "http_router.h"
+
+#include <string.h>
+
+_Static_assert(HTTP_ROUTER_MAX_NODES <= INT16_MAX, "Node indexes are int16_t");
+_Static_assert(HTTP_ROUTER_MAX_ROUTES <= INT16_MAX, "Route indexes are int16_t");
+
+// One segment of a pattern
+typedef struct {
+    const char *text;  // Literal text, or capture name
+    uint8_t len;
+    bool capture;
+    http_param_type_t type;
+} pattern_segment_t;
+
+/**
+ * Split the next segment off a pattern
+ *
+ * @param[in,out] p Position of the '/' before the segment; moved past it
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the segment is malformed
+ */
+static esp_err_t next_pattern_segment(const char **p, pattern_segment_t *seg) {
+    const char *start = *p + 1;
+    const char *end = start;
+    while (*end != '\0' && *end != '/') {
+        end++;
+    }
+    *p = end;
+    size_t len = (size_t) (end - start);
+    if (len == 0 || len > HTTP_ROUTER_SEGMENT_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (*start != '{') {
+        for (const char *c = start; c < end; c++) {
+            if (*c == '{' || *c == '}' || *c == '?') {
+                return ESP_ERR_INVALID_ARG;
+            }
+        }
+        *seg = (pattern_segment_t) {.text = start, .len = (uint8_t) len};
+        return ESP_OK;
+    }
+
+    // {name} or {name:type}
+    if (end[-1] != '}') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const char *name_end = start + 1;
+    while (name_end < end - 1 && *name_end != ':') {
+        char c = *name_end;
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+              c == '_')) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        name_end++;
+    }
+    if (name_end == start + 1) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    http_param_type_t type = HTTP_PARAM_STR;
+    if (*name_end == ':') {
+        size_t type_len = (size_t) (end - 1 - (name_end + 1));
+        if (type_len == 3 && strncmp(name_end + 1, "int", 3) == 0) {
+            type = HTTP_PARAM_INT;
+        } else if (type_len != 3 || strncmp(name_end + 1, "str", 3) != 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    *seg = (pattern_segment_t) {
+        .text = start + 1,
+        .len = (uint8_t) (name_end - start - 1),
+        .capture = true,
+        .type = type,
+    };
+    return ESP_OK;
+}
+
+/**
+ * Compare a literal segment with an edge (edge table order)
+ */
+static int edge_cmp(const http_router_edge_t *edge, uint16_t parent, const char *seg, size_t len) {
+    if (edge->parent != parent) {
+        return edge->parent < parent ? -1 : 1;
+    }
+    int c = memcmp(edge->segment, seg, edge->len < len ? edge->len : len);
+    if (c != 0) {
+        return c;
+    }
+    return edge->len == len ? 0 : (edge->len < len ? -1 : 1);
+}
+
+/**
+ * Binary search the edge table
+ *
+ * @param[out] pos Index of the edge, or where it would be inserted
+ * @return true if found
+ */
+static bool find_edge(const http_router_t *router, uint16_t parent, const char *seg, size_t len,
+                      uint16_t *pos) {
+    uint16_t lo = 0;
+    uint16_t hi = router->edge_count;
+    while (lo < hi) {
+        uint16_t mid = (uint16_t) ((lo + hi) / 2);
+        int c = edge_cmp(&router->edges[mid], parent, seg, len);
+        if (c == 0) {
+            *pos = mid;
+            return true;
+        }
+        if (c < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *pos = lo;
+    return false;
+}
+
+static int16_t new_node(http_router_t *router) {
+    http_router_node_t *node = &router->nodes[router->node_count];
+    *node = (http_router_node_t) {.capture = -1, .route = -1};
+    return (int16_t) router->node_count++;
+}
+
+/**
+ * Walk (and with create, extend) the trie along a pattern
+ *
+ * Without create, only checks the pattern and counts the nodes it would
+ * add, so a failing http_router_add() leaves the router untouched.
+ *
+ * @param[out] node Node of the pattern (create, or when nothing is added)
+ * @param[out] added Nodes that are (or would be) added
+ */
+static esp_err_t walk_pattern(http_router_t *router, const char *pattern, bool create,
+                              int16_t *node, uint16_t *added) {
+    *node = 0;
+    *added = 0;
+    int params = 0;
+    bool existing = true;  // Still on nodes that were there before
+
+    if (pattern[0] != '/') {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (pattern[1] == '\0') {
+        return ESP_OK;  // "/" is the root node
+    }
+
+    const char *p = pattern;
+    while (*p != '\0') {
+        pattern_segment_t seg;
+        esp_err_t ret = next_pattern_segment(&p, &seg);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+
+        if (seg.capture) {
+            if (++params > HTTP_ROUTER_MAX_PARAMS) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            if (existing) {
+                const http_router_node_t *n = &router->nodes[*node];
+                if (n->capture >= 0) {
+                    if (n->capture_type != seg.type || n->capture_name_len != seg.len ||
+                        strncmp(n->capture_name, seg.text, seg.len) != 0) {
+                        return ESP_ERR_INVALID_STATE;
+                    }
+                    *node = n->capture;
+                    continue;
+                }
+                existing = false;
+            }
+            (*added)++;
+            if (create) {
+                int16_t child = new_node(router);
+                http_router_node_t *n = &router->nodes[*node];
+                n->capture = child;
+                n->capture_name = seg.text;
+                n->capture_name_len = seg.len;
+                n->capture_type = (uint8_t) seg.type;
+                *node = child;
+            }
+            continue;
+        }
+
+        uint16_t pos = 0;
+        if (existing) {
+            if (find_edge(router, (uint16_t) *node, seg.text, seg.len, &pos)) {
+                *node = (int16_t) router->edges[pos].child;
+                continue;
+            }
+            existing = false;
+        }
+        (*added)++;
+        if (create) {
+            // New nodes get no children yet, so only this insert moves edges
+            find_edge(router, (uint16_t) *node, seg.text, seg.len, &pos);
+            int16_t child = new_node(router);
+            memmove(&router->edges[pos + 1], &router->edges[pos],
+                    (router->edge_count - pos) * sizeof(router->edges[0]));
+            router->edges[pos] = (http_router_edge_t) {
+                .parent = (uint16_t) *node,
+                .child = (uint16_t) child,
+                .segment = seg.text,
+                .len = seg.len,
+            };
+            router->edge_count++;
+            *node = child;
+        }
+    }
+    return ESP_OK;
+}
+
+void http_router_init(http_router_t *router) {
+    router->node_count = 0;
+    router->edge_count = 0;
+    router->route_count = 0;
+    new_node(router);  // Root ("/")
+}
+
+esp_err_t http_router_add(http_router_t *router, int method, const char *pattern) {
+    if (router == NULL || pattern == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int16_t node = 0;
+    uint16_t added = 0;
+    esp_err_t ret = walk_pattern(router, pattern, false, &node, &added);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (added == 0) {
+        // The whole path exists already; the method must be new
+        for (int16_t r = router->nodes[node].route; r >= 0; r = router->routes[r].next) {
+            if (router->routes[r].method == method) {
+                return ESP_ERR_INVALID_STATE;
+            }
+        }
+    }
+    if (router->node_count + added > HTTP_ROUTER_MAX_NODES ||
+        router->route_count >= HTTP_ROUTER_MAX_ROUTES) {
+        return ESP_ERR_NO_MEM;
+    }
+    if (added > 0) {
+        walk_pattern(router, pattern, true, &node, &added);
+    }
+
+    int16_t index = (int16_t) router->route_count++;
+    router->routes[index] = (http_router_route_t) {
+        .method = method,
+        .next = -1,
+    };
+
+    // Append, so the first route of a path is the first one added
+    int16_t *link = &router->nodes[node].route;
+    while (*link >= 0) {
+        link = &router->routes[*link].next;
+    }
+    *link = index;
+    return ESP_OK;
+}
+
+/**
+ * Parse a decimal int capture (0-INT32_MAX, digits only)
+ */
+static bool parse_int_segment(const char *s, size_t len, int32_t *out) {
+    if (len == 0 || len > 10) {
+        return false;
+    }
+    int64_t value = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] < '0' || s[i] > '9') {
+            return false;
+        }
+        value = value * 10 + (s[i] - '0');
+    }
+    if (value > INT32_MAX) {
+        return false;
+    }
+    *out = (int32_t) value;
+    return true;
+}
+
+esp_err_t http_router_match(const http_router_t *router, int method, const char *uri,
+                            http_match_t *match) {
+    match->route = -1;
+    match->param_count = 0;
+    match->query.count = 0;
+    if (router == NULL || uri == NULL || uri[0] != '/') {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    const char *path_end = uri;
+    while (*path_end != '\0' && *path_end != '?') {
+        path_end++;
+    }
+
+    int16_t node = 0;
+    const char *p = uri;
+    if (path_end - uri > 1) {
+        while (p < path_end) {
+            const char *seg = p + 1;
+            const char *seg_end = seg;
+            while (seg_end < path_end && *seg_end != '/') {
+                seg_end++;
+            }
+            p = seg_end;
+            size_t len = (size_t) (seg_end - seg);
+            if (len == 0) {
+                return ESP_ERR_NOT_FOUND;  // "//" or a trailing '/'
+            }
+
+            uint16_t pos = 0;
+            if (find_edge(router, (uint16_t) node, seg, len, &pos)) {
+                node = (int16_t) router->edges[pos].child;
+                continue;
+            }
+
+            const http_router_node_t *n = &router->nodes[node];
+            if (n->capture < 0 || match->param_count >= HTTP_ROUTER_MAX_PARAMS) {
+                return ESP_ERR_NOT_FOUND;
+            }
+            http_param_t *param = &match->params[match->param_count];
+            *param = (http_param_t) {
+                .name = n->capture_name,
+                .name_len = n->capture_name_len,
+                .type = (http_param_type_t) n->capture_type,
+                .str = seg,
+                .len = (uint16_t) len,
+            };
+            if (param->type == HTTP_PARAM_INT && !parse_int_segment(seg, len, &param->i)) {
+                return ESP_ERR_NOT_FOUND;
+            }
+            match->param_count++;
+            node = n->capture;
+        }
+    }
+
+    int16_t first = router->nodes[node].route;
+    if (first < 0) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    int16_t route = first;
+    while (route >= 0 && router->routes[route].method != method) {
+        route = router->routes[route].next;
+    }
+    if (route < 0) {
+        match->route = first;
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    match->route = route;
+
+    if (*path_end == '?') {
+        return http_query_parse(path_end + 1, strlen(path_end + 1), &match->query);
+    }
+    return ESP_OK;
+}
+
+int http_router_next_method(const http_router_t *router, int route) {
+    if (route < 0 || route >= router->route_count) {
+        return -1;
+    }
+    return router->routes[route].next;
+}
+
+int http_router_method(const http_router_t *router, int route) {
+    if (route < 0 || route >= router->route_count) {
+        return -1;
+    }
+    return router->routes[route].method;
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * Percent-decode src into the query buffer
+ *
+ * @param[in,out] used Bytes of out->buf in use
+ * @return Decoded NUL-terminated string in out->buf
+ */
+static esp_err_t decode_component(const char *src, size_t len, http_query_t *out, size_t *used,
+                                  const char **decoded) {
+    char *dst = out->buf + *used;
+    char *limit = out->buf + sizeof(out->buf) - 1;  // Room for the NUL
+    *decoded = dst;
+    for (size_t i = 0; i < len; i++) {
+        char c = src[i];
+        if (c == '+') {
+            c = ' ';
+        } else if (c == '%') {
+            int hi = i + 2 < len ? hex_value(src[i + 1]) : -1;
+            int lo = i + 2 < len ? hex_value(src[i + 2]) : -1;
+            if (hi < 0 || lo < 0 || (hi == 0 && lo == 0)) {
+                return ESP_ERR_INVALID_ARG;  // Truncated, not hex, or %00
+            }
+            c = (char) (hi << 4 | lo);
+            i += 2;
+        }
+        if (dst >= limit) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        *dst++ = c;
+    }
+    *dst++ = '\0';
+    *used = (size_t) (dst - out->buf);
+    return ESP_OK;
+}
+
+esp_err_t http_query_parse(const char *query, size_t len, http_query_t *out) {
+    out->count = 0;
+    size_t used = 0;
+    const char *p = query;
+    const char *end = query + len;
+
+    while (p < end) {
+        const char *item_end = memchr(p, '&', (size_t) (end - p));
+        if (item_end == NULL) {
+            item_end = end;
+        }
+        if (item_end > p) {
+            if (out->count >= HTTP_ROUTER_MAX_QUERY) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            const char *eq = memchr(p, '=', (size_t) (item_end - p));
+            const char *key_end = eq != NULL ? eq : item_end;
+            esp_err_t ret = decode_component(p, (size_t) (key_end - p), out, &used,
+                                             &out->items[out->count].key);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+            if (eq != NULL) {
+                ret = decode_component(eq + 1, (size_t) (item_end - eq - 1), out, &used,
+                                       &out->items[out->count].value);
+                if (ret != ESP_OK) {
+                    return ret;
+                }
+            } else {
+                out->items[out->count].value = "";
+            }
+            out->count++;
+        }
+        p = item_end + 1;
+    }
+    return ESP_OK;
+}
+
+const char *http_query_get(const http_query_t *query, const char *key) {
+    for (int i = 0; i < query->count; i++) {
+        if (strcmp(query->items[i].key, key) == 0) {
+            return query->items[i].value;
+        }
+    }
+    return NULL;
+}
+
+static const http_param_t *find_param(const http_match_t *match, const char *name) {
+    size_t len = strlen(name);
+    for (int i = 0; i < match->param_count; i++) {
+        const http_param_t *param = &match->params[i];
+        if (param->name_len == len && strncmp(param->name, name, len) == 0) {
+            return param;
+        }
+    }
+    return NULL;
+}
+
+bool http_match_get_int(const http_match_t *match, const char *name, int32_t *out) {
+    const http_param_t *param = find_param(match, name);
+    if (param == NULL || param->type != HTTP_PARAM_INT) {
+        return false;
+    }
+    *out = param->i;
+    return true;
+}
+
+const char *http_match_get_str(const http_match_t *match, const char *name, size_t *len) {
+    const http_param_t *param = find_param(match, name);
+    if (param == NULL) {
+        return NULL;
+    }
+    *len = param->len;
+    return param->str;
+}
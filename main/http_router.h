@@ -0,0 +1,189 @@
+#ifndef HTTP_ROUTER_H
+#define HTTP_ROUTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// URI router for the REST API
+//
+// Routes are path patterns made of literal segments and typed captures:
+//   /api/sensors/{id:int}/config
+//   /api/files/{name}            ({name} is short for {name:str})
+// http_router_add() compiles them into a trie held in the router itself.
+// http_router_match() walks a request path one segment at a time. Literal
+// children are found by binary search over the sorted edge table, and the
+// capture child is tried when no literal matches. Matching depends on the
+// path depth and log(edges), not on the number of routes, and allocates
+// nothing. Captures point into the request URI and are not copied.
+//
+// Literal segments take precedence over a capture at the same position and
+// the walk doesn't backtrack: with /a/{id:int} and /a/b/c, "/a/b" is not
+// found.
+//
+// Pure code without httpd or OS dependencies, so it also builds on the host.
+
+#ifndef HTTP_ROUTER_MAX_ROUTES
+#define HTTP_ROUTER_MAX_ROUTES 32  // Routes (pattern + method)
+#endif
+#ifndef HTTP_ROUTER_MAX_NODES
+#define HTTP_ROUTER_MAX_NODES 48  // Distinct path prefixes, including the root
+#endif
+#define HTTP_ROUTER_MAX_PARAMS   4    // Captures in one pattern
+#define HTTP_ROUTER_MAX_QUERY    8    // Query parameters kept per request
+#define HTTP_ROUTER_QUERY_BUF    128  // Decoded query keys and values, NUL-terminated
+#define HTTP_ROUTER_SEGMENT_MAX  255  // Longest literal segment in a pattern
+
+// Capture type
+typedef enum {
+    HTTP_PARAM_INT,  // Decimal 0-INT32_MAX
+    HTTP_PARAM_STR,  // Any non-empty segment
+} http_param_type_t;
+
+// Captured path parameter
+typedef struct {
+    const char *name;  // Points into the pattern (name_len characters)
+    uint8_t name_len;
+    http_param_type_t type;
+    int32_t i;        // HTTP_PARAM_INT
+    const char *str;  // Segment in the URI (len characters, not NUL-terminated)
+    uint16_t len;
+} http_param_t;
+
+// Parsed query string
+typedef struct {
+    uint8_t count;
+    struct {
+        const char *key;    // NUL-terminated, in buf
+        const char *value;  // NUL-terminated, in buf ("" if the parameter has no '=')
+    } items[HTTP_ROUTER_MAX_QUERY];
+    char buf[HTTP_ROUTER_QUERY_BUF];
+} http_query_t;
+
+// Result of http_router_match()
+typedef struct {
+    int route;  // Route index (order of http_router_add()), -1 if the path is unknown
+    uint8_t param_count;
+    http_param_t params[HTTP_ROUTER_MAX_PARAMS];
+    http_query_t query;
+} http_match_t;
+
+// Trie node (one per distinct path prefix)
+typedef struct {
+    int16_t capture;  // Child for a capture segment, -1 if none
+    int16_t route;    // First route ending here, -1 if none
+    const char *capture_name;
+    uint8_t capture_name_len;
+    uint8_t capture_type;  // http_param_type_t
+} http_router_node_t;
+
+// Literal edge; the edge table is kept sorted by (parent, segment)
+typedef struct {
+    uint16_t parent;
+    uint16_t child;
+    const char *segment;  // Points into the pattern
+    uint8_t len;
+} http_router_edge_t;
+
+// Route slot
+typedef struct {
+    int method;    // Opaque to the router (httpd_method_t)
+    int16_t next;  // Next route with the same path, -1 if none
+} http_router_route_t;
+
+// Router (fixed storage, no heap)
+typedef struct {
+    http_router_node_t nodes[HTTP_ROUTER_MAX_NODES];
+    http_router_edge_t edges[HTTP_ROUTER_MAX_NODES];
+    http_router_route_t routes[HTTP_ROUTER_MAX_ROUTES];
+    uint16_t node_count;
+    uint16_t edge_count;
+    uint16_t route_count;
+} http_router_t;
+
+/**
+ * Reset a router to no routes
+ */
+void http_router_init(http_router_t *router);
+
+/**
+ * Add a route
+ *
+ * The pattern is not copied and must stay valid as long as the router
+ * (a string literal). Routes are numbered in the order they are added.
+ *
+ * @param method Request method (compared as-is)
+ * @param pattern Path pattern, e.g. "/api/leds/{id:int}"
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the pattern is
+ *         malformed, ESP_ERR_INVALID_STATE if it duplicates a route or its
+ *         capture conflicts with another pattern at the same position,
+ *         ESP_ERR_NO_MEM if the router is full
+ */
+esp_err_t http_router_add(http_router_t *router, int method, const char *pattern);
+
+/**
+ * Match a request URI (path and optional query string)
+ *
+ * @param method Request method
+ * @param uri Request URI, e.g. "/api/sensors/12/config?format=cbor"
+ * @param[out] match Route, captures and query parameters. On
+ *             ESP_ERR_NOT_SUPPORTED route is the first route for the path
+ *             (see http_router_next_method())
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if no route has this path,
+ *         ESP_ERR_NOT_SUPPORTED if routes have this path but not this
+ *         method, ESP_ERR_INVALID_ARG if the query string is malformed,
+ *         ESP_ERR_INVALID_SIZE if it doesn't fit http_query_t
+ */
+esp_err_t http_router_match(const http_router_t *router, int method, const char *uri,
+                            http_match_t *match);
+
+/**
+ * Get the next route with the same path (e.g. to list allowed methods)
+ *
+ * @return Route index, or -1 if there is none
+ */
+int http_router_next_method(const http_router_t *router, int route);
+
+/**
+ * Get the method of a route
+ */
+int http_router_method(const http_router_t *router, int route);
+
+/**
+ * Parse a query string ("a=1&b=x%20y") into query
+ *
+ * Keys and values are percent-decoded ('+' is a space). Empty parameters
+ * ("a=1&&b") are skipped.
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for a bad escape,
+ *         ESP_ERR_INVALID_SIZE if there are too many parameters or they
+ *         don't fit the buffer
+ */
+esp_err_t http_query_parse(const char *query, size_t len, http_query_t *out);
+
+/**
+ * Get a query parameter
+ *
+ * @return Value, or NULL if the parameter is absent
+ */
+const char *http_query_get(const http_query_t *query, const char *key);
+
+/**
+ * Get a captured integer
+ *
+ * @return true if the match has an int capture with this name
+ */
+bool http_match_get_int(const http_match_t *match, const char *name, int32_t *out);
+
+/**
+ * Get a captured segment
+ *
+ * @param[out] len Segment length
+ * @return Start of the segment (not NUL-terminated), or NULL if the match
+ *         has no capture with this name
+ */
+const char *http_match_get_str(const http_match_t *match, const char *name, size_t *len);
+
+#endif  // HTTP_ROUTER_H
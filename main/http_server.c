@@ -4,17 +4,191 @@
 #include <time.h>
 
 #include "actuators.h"
+#include "boot.h"
 #include "cJSON.h"
+#include "cbor.h"
 #include "esp_err.h"
 #include "esp_http_server.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "esp_wifi.h"
+#include "heap_profiler.h"
+#include "http_router.h"
+#include "http_session.h"
+#include "lock_profiler.h"
+#include "metrics.h"
+#include "mqtt_commands.h"
+#include "mqtt_publisher.h"
+#include "network_task.h"
+#include "power.h"
+#include "rules.h"
 #include "sensors.h"
+#include "settings.h"
+#include "stats_task.h"
+#include "telemetry_buffer.h"
+#include "trace.h"
+#include "wifi_manager.h"
 
 static const char *TAG = "HTTP_SRV";
 static httpd_handle_t s_server = NULL;
 
+// Maximum number of routes
+#define HTTP_MAX_ROUTES 24
+
+// httpd task stack (the default 4 KB is tight for cJSON handlers plus the route match)
+#define HTTP_TASK_STACK 6144
+
+// Receive timeouts (recv_wait_timeout, 5 s by default) a request body may take before 408
+#define HTTP_BODY_TIMEOUTS 2
+_Static_assert(HTTP_MAX_ROUTES <= HTTP_ROUTER_MAX_ROUTES, "Router too small");
+
+// Log-linear latency histogram: 4 buckets per power of two microseconds
+// (under 25% relative error), exact below 4 us, last bucket also catches >= 7.3 s.
+#define HTTP_HIST_SUB_BITS 2
+#define HTTP_HIST_SUB      (1 << HTTP_HIST_SUB_BITS)
+#define HTTP_HIST_BUCKETS  88
+
+// Route handler: match holds the path captures and query parameters
+typedef esp_err_t (*route_fn_t)(httpd_req_t *req, const http_match_t *match);
+
+// Route table entry
+typedef struct {
+    httpd_method_t method;
+    const char *pattern;  // See http_router.h, e.g. "/api/leds/{id:int}"
+    route_fn_t handler;
+} route_def_t;
+
+// Request metrics for one route, indexed like the route table
+// The accounting fields are only touched from the httpd task (which runs
+// every handler, including GET /api/system/http), so they need no lock.
+typedef struct {
+    route_fn_t handler;
+    const char *uri;  // Route pattern (heap profiler tag)
+    httpd_method_t method;
+    metric_t *requests;
+    metric_t *errors;
+    metric_t *latency;
+    char labels[64];  // route="...",method="..."
+
+    // Accounting for GET /api/system/http
+    uint32_t status[4];  // Responses by class: 2xx, 3xx, 4xx, 5xx
+    uint64_t bytes_sent;
+    uint32_t max_us;
+    uint32_t histogram[HTTP_HIST_BUCKETS];
+} route_metrics_t;
+
+static route_metrics_t s_route_metrics[HTTP_MAX_ROUTES];
+static size_t s_route_count = 0;
+static bool s_route_metrics_registered = false;
+
+// Every request goes through one catch-all httpd handler per method, which
+// looks the route up here (see dispatch_handler())
+static http_router_t s_router;
+
+// Route match of the request being handled, for helpers that aren't passed it
+static const http_match_t *s_match = NULL;
+
+// Response of the request being handled (set by the send helpers)
+static struct {
+    uint16_t status;
+    uint32_t bytes;
+    int64_t encode_start_us;  // Set by encode_begin(), 0 if the route isn't measured
+} s_response;
+
+// Wire formats of negotiated resources (Accept: application/json or application/cbor)
+typedef enum {
+    HTTP_FORMAT_JSON,
+    HTTP_FORMAT_CBOR,
+    HTTP_FORMAT_COUNT,
+} http_format_t;
+
+static const char *const HTTP_FORMAT_NAMES[HTTP_FORMAT_COUNT] = {"json", "cbor"};
+
+// Encoding cost per format, for GET /api/system/http (httpd task only)
+typedef struct {
+    uint32_t responses;
+    uint64_t bytes;
+    uint64_t total_us;
+    uint32_t max_us;
+    metric_t *duration;
+} http_encode_stats_t;
+
+static http_encode_stats_t s_encode_stats[HTTP_FORMAT_COUNT];
+
+// CBOR output buffer; larger responses are streamed in chunks (httpd task only)
+#define HTTP_CBOR_BUF_SIZE 512
+static uint8_t s_cbor_buf[HTTP_CBOR_BUF_SIZE];
+
+// Request latency buckets (microseconds)
+static const uint32_t HTTP_LATENCY_BOUNDS_US[] = {1000,   2500,   5000,   10000,  25000,
+                                                  50000,  100000, 250000, 500000, 1000000};
+
+// Encode time buckets (microseconds)
+static const uint32_t HTTP_ENCODE_BOUNDS_US[] = {50, 100, 200, 500, 1000, 2000, 5000, 10000};
+
+// register_route_metrics() alone must fit the registry (see METRICS_MAX)
+_Static_assert(3 * HTTP_MAX_ROUTES + HTTP_FORMAT_COUNT <= METRICS_MAX, "Metrics registry full");
+_Static_assert(HTTP_MAX_ROUTES * (sizeof(HTTP_LATENCY_BOUNDS_US) / sizeof(uint32_t) + 1) +
+                       HTTP_FORMAT_COUNT * (sizeof(HTTP_ENCODE_BOUNDS_US) / sizeof(uint32_t) + 1) <=
+                   METRICS_BUCKETS_MAX,
+               "Metrics bucket pool too small");
+
+/**
+ * Helper: Start measuring how long building the response body takes
+ *
+ * Called by negotiated handlers once their data is gathered, so only the
+ * representation (cJSON tree + printing, or CBOR encoding) is timed.
+ */
+static void encode_begin(void) {
+    s_response.encode_start_us = esp_timer_get_time();
+}
+
+/**
+ * Helper: Account for an encoded response body
+ */
+static void encode_end(http_format_t format, size_t bytes) {
+    if (s_response.encode_start_us == 0) {
+        return;
+    }
+    uint32_t elapsed_us = (uint32_t) (esp_timer_get_time() - s_response.encode_start_us);
+    s_response.encode_start_us = 0;
+
+    http_encode_stats_t *stats = &s_encode_stats[format];
+    stats->responses++;
+    stats->bytes += bytes;
+    stats->total_us += elapsed_us;
+    if (elapsed_us > stats->max_us) {
+        stats->max_us = elapsed_us;
+    }
+    metrics_observe(stats->duration, elapsed_us);
+}
+
+/**
+ * Helper: Check whether the client prefers CBOR
+ *
+ * A "format=cbor" or "format=json" query parameter decides; otherwise CBOR
+ * is chosen if Accept lists application/cbor ahead of application/json (or
+ * without it). Sets "Vary: Accept" either way, since the caller serves a
+ * negotiated resource.
+ */
+static bool wants_cbor(httpd_req_t *req) {
+    httpd_resp_set_hdr(req, "Vary", "Accept");
+
+    const char *format = s_match != NULL ? http_query_get(&s_match->query, "format") : NULL;
+    if (format != NULL) {
+        return strcmp(format, "cbor") == 0;
+    }
+
+    char accept[96];
+    esp_err_t ret = httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept));
+    if (ret != ESP_OK && ret != ESP_ERR_HTTPD_RESULT_TRUNC) {
+        return false;
+    }
+    const char *cbor = strstr(accept, "application/cbor");
+    const char *json = strstr(accept, "application/json");
+    return cbor != NULL && (json == NULL || cbor < json);
+}
+
 /**
  * Helper: Send JSON response
  *
@@ -30,26 +204,153 @@ static esp_err_t send_json_response(httpd_req_t *req, cJSON *json) {
         return ESP_FAIL;
     }
 
+    size_t len = strlen(json_str);
+    encode_end(HTTP_FORMAT_JSON, len);
+
     httpd_resp_set_type(req, "application/json");
-    httpd_resp_sendstr(req, json_str);
+    httpd_resp_send(req, json_str, len);
+    s_response.bytes += len;
     free(json_str);
     return ESP_OK;
 }
 
+/**
+ * Helper: CBOR output callback, streams full buffers as chunks
+ */
+static esp_err_t cbor_flush_chunk(void *ctx, const uint8_t *buf, size_t len) {
+    return httpd_resp_send_chunk((httpd_req_t *) ctx, (const char *) buf, len);
+}
+
+/**
+ * Helper: Start a CBOR response
+ *
+ * Returns a writer on the shared output buffer; encode the body into it
+ * and finish with send_cbor_response().
+ */
+static cbor_writer_t *cbor_response_begin(httpd_req_t *req) {
+    static cbor_writer_t writer;
+
+    httpd_resp_set_type(req, "application/cbor");
+    cbor_writer_init(&writer, s_cbor_buf, sizeof(s_cbor_buf), cbor_flush_chunk, req);
+    encode_begin();
+    return &writer;
+}
+
+/**
+ * Helper: Send an encoded CBOR response
+ *
+ * Bodies that fit the buffer go out in one piece with Content-Length,
+ * larger ones end the chunked response started by the writer.
+ */
+static esp_err_t send_cbor_response(httpd_req_t *req, cbor_writer_t *w) {
+    size_t len = 0;
+    esp_err_t ret = cbor_writer_finish(w, &len);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "CBOR response failed: %s", esp_err_to_name(ret));
+        return ESP_FAIL;
+    }
+    encode_end(HTTP_FORMAT_CBOR, len);
+
+    if (w->flushed == 0) {
+        ret = httpd_resp_send(req, (const char *) w->buf, w->len);
+    } else {
+        ret = httpd_resp_send_chunk(req, (const char *) w->buf, w->len);
+        if (ret == ESP_OK) {
+            ret = httpd_resp_send_chunk(req, NULL, 0);
+        }
+    }
+    s_response.bytes += len;
+    return ret;
+}
+
 /**
  * Helper: Send error JSON response
  */
 static esp_err_t send_error_response(httpd_req_t *req, int status, const char *message) {
+    if (status == 404) {
+        httpd_resp_set_status(req, "404 Not Found");
+    } else if (status == 405) {
+        httpd_resp_set_status(req, "405 Method Not Allowed");
+    } else if (status == 408) {
+        httpd_resp_set_status(req, "408 Request Timeout");
+    } else if (status == 503) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+    } else {
+        status = 400;
+        httpd_resp_set_status(req, "400 Bad Request");
+    }
+    s_response.status = status;
+    s_response.encode_start_us = 0;  // Not a representation worth measuring
+
+    if (wants_cbor(req)) {
+        cbor_writer_t *w = cbor_response_begin(req);
+        cbor_write_map(w, 1);
+        cbor_write_text(w, "error");
+        cbor_write_text(w, message);
+        s_response.encode_start_us = 0;
+        return send_cbor_response(req, w);
+    }
+
     cJSON *json = cJSON_CreateObject();
     cJSON_AddStringToObject(json, "error", message);
-
-    httpd_resp_set_status(req, status == 404 ? "404 Not Found" : "400 Bad Request");
     return send_json_response(req, json);
 }
 
+/**
+ * Helper: Send part of a chunked response
+ *
+ * Output callback for the streaming renderers (metrics, trace).
+ */
+static esp_err_t send_chunk(void *ctx, const char *buf, size_t len) {
+    s_response.bytes += len;
+    return httpd_resp_send_chunk((httpd_req_t *) ctx, buf, len);
+}
+
+/**
+ * Helper: Read the whole request body
+ *
+ * httpd_req_recv() may return less than requested, so keep reading
+ * until content_len bytes have arrived. A client that stalls for
+ * HTTP_BODY_TIMEOUTS receive timeouts gets 408 rather than holding the
+ * server task. The body is NUL-terminated.
+ *
+ * On failure the error has been sent (400 empty or too large, 408 timed
+ * out, nothing if the socket failed): the handler returns ESP_FAIL, which
+ * closes the connection along with any unread body.
+ *
+ * @return Body length, or -1 on failure
+ */
+static int read_request_body(httpd_req_t *req, char *buf, size_t size) {
+    if (req->content_len == 0 || req->content_len >= size) {
+        send_error_response(req, 400, "Empty or too large request body");
+        return -1;
+    }
+
+    size_t total = 0;
+    int timeouts = 0;
+    while (total < req->content_len) {
+        int received = httpd_req_recv(req, buf + total, req->content_len - total);
+        if (received == HTTPD_SOCK_ERR_TIMEOUT && ++timeouts < HTTP_BODY_TIMEOUTS) {
+            continue;
+        }
+        if (received == HTTPD_SOCK_ERR_TIMEOUT) {
+            ESP_LOGW(TAG, "Request body timed out (%d of %d bytes)", (int) total,
+                     (int) req->content_len);
+            send_error_response(req, 408, "Timed out reading request body");
+            return -1;
+        }
+        if (received <= 0) {
+            return -1;
+        }
+        total += received;
+    }
+    buf[total] = '\0';
+    return (int) total;
+}
+
 // ---- GET /api ----
 
-static esp_err_t get_api_root_handler(httpd_req_t *req) {
+static esp_err_t get_api_root_handler(httpd_req_t *req, const http_match_t *match) {
     cJSON *root = cJSON_CreateObject();
     cJSON_AddStringToObject(root, "name", "Geekhouse API");
     cJSON_AddStringToObject(root, "version", "1.0.0");
@@ -68,22 +369,86 @@ static esp_err_t get_api_root_handler(httpd_req_t *req) {
     cJSON_AddStringToObject(leds, "href", "/api/leds");
     cJSON_AddStringToObject(leds, "title", "All LED states and control");
 
+    cJSON *rules = cJSON_AddObjectToObject(links, "rules");
+    cJSON_AddStringToObject(rules, "href", "/api/rules");
+    cJSON_AddStringToObject(rules, "title", "Automation rules");
+
+    cJSON *config = cJSON_AddObjectToObject(links, "config");
+    cJSON_AddStringToObject(config, "href", "/api/config");
+    cJSON_AddStringToObject(config, "title", "Device settings");
+
     cJSON *system = cJSON_AddObjectToObject(links, "system");
     cJSON_AddStringToObject(system, "href", "/api/system");
     cJSON_AddStringToObject(system, "title", "System information");
 
+    cJSON *metrics = cJSON_AddObjectToObject(links, "metrics");
+    cJSON_AddStringToObject(metrics, "href", "/metrics");
+    cJSON_AddStringToObject(metrics, "title", "Prometheus metrics");
+
     return send_json_response(req, root);
 }
 // ---- GET /api/sensors ----
+// JSON or CBOR (Accept: application/cbor). CBOR carries the same fields
+// without the _links hypermedia.
+
+/**
+ * Helper: Encode a sensor as a CBOR map (fields as in the JSON representation)
+ *
+ * @param ret Result of sensor_read(); on failure the reading fields are
+ *            replaced by "error" if with_error is set, else left out
+ */
+static void write_sensor_cbor(cbor_writer_t *w, int id, const sensor_reading_t *reading,
+                              esp_err_t ret, bool with_error) {
+    const sensor_info_t *info = sensor_get_info(id);
+
+    cbor_write_map(w, 3 + (ret == ESP_OK ? 4 : with_error ? 1 : 0));
+    cbor_write_text(w, "id");
+    cbor_write_uint(w, id);
+    cbor_write_text(w, "type");
+    cbor_write_text(w, info->type == SENSOR_TYPE_LIGHT ? "light" : "water");
+    cbor_write_text(w, "location");
+    cbor_write_text(w, info->location);
+
+    if (ret == ESP_OK) {
+        cbor_write_text(w, "raw_value");
+        cbor_write_int(w, reading->raw_value);
+        cbor_write_text(w, "calibrated_value");
+        cbor_write_float(w, reading->calibrated_value);
+        cbor_write_text(w, "unit");
+        cbor_write_text(w, reading->unit);
+        cbor_write_text(w, "timestamp");
+        cbor_write_uint(w, reading->timestamp);
+    } else if (with_error) {
+        cbor_write_text(w, "error");
+        cbor_write_text(w, "read failed");
+    }
+}
+
+static esp_err_t get_sensors_handler(httpd_req_t *req, const http_match_t *match) {
+    sensor_reading_t readings[SENSOR_COUNT];
+    esp_err_t results[SENSOR_COUNT];
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        results[i] = sensor_read(i, &readings[i]);
+    }
 
-static esp_err_t get_sensors_handler(httpd_req_t *req) {
+    if (wants_cbor(req)) {
+        cbor_writer_t *w = cbor_response_begin(req);
+        cbor_write_map(w, 1);
+        cbor_write_text(w, "sensors");
+        cbor_write_array(w, SENSOR_COUNT);
+        for (int i = 0; i < SENSOR_COUNT; i++) {
+            write_sensor_cbor(w, i, &readings[i], results[i], true);
+        }
+        return send_cbor_response(req, w);
+    }
+
+    encode_begin();
     cJSON *root = cJSON_CreateObject();
     cJSON *sensors = cJSON_AddArrayToObject(root, "sensors");
 
     for (int i = 0; i < SENSOR_COUNT; i++) {
         const sensor_info_t *info = sensor_get_info(i);
-        sensor_reading_t reading;
-        esp_err_t ret = sensor_read(i, &reading);
+        const sensor_reading_t *reading = &readings[i];
 
         cJSON *sensor = cJSON_CreateObject();
         cJSON_AddNumberToObject(sensor, "id", i);
@@ -91,11 +456,11 @@ static esp_err_t get_sensors_handler(httpd_req_t *req) {
                                 info->type == SENSOR_TYPE_LIGHT ? "light" : "water");
         cJSON_AddStringToObject(sensor, "location", info->location);
 
-        if (ret == ESP_OK) {
-            cJSON_AddNumberToObject(sensor, "raw_value", reading.raw_value);
-            cJSON_AddNumberToObject(sensor, "calibrated_value", reading.calibrated_value);
-            cJSON_AddStringToObject(sensor, "unit", reading.unit);
-            cJSON_AddNumberToObject(sensor, "timestamp", reading.timestamp);
+        if (results[i] == ESP_OK) {
+            cJSON_AddNumberToObject(sensor, "raw_value", reading->raw_value);
+            cJSON_AddNumberToObject(sensor, "calibrated_value", reading->calibrated_value);
+            cJSON_AddStringToObject(sensor, "unit", reading->unit);
+            cJSON_AddNumberToObject(sensor, "timestamp", reading->timestamp);
         } else {
             cJSON_AddStringToObject(sensor, "error", "read failed");
         }
@@ -120,15 +485,85 @@ static esp_err_t get_sensors_handler(httpd_req_t *req) {
     return send_json_response(req, root);
 }
 
-// ---- GET /api/sensors/{id} ----
+// ---- GET /api/sensors/{id}/config ----
+
+/**
+ * Helper: Add a calibration's fields to a JSON object
+ */
+static void add_calibration_fields(cJSON *obj, const calibration_t *calib) {
+    cJSON_AddStringToObject(obj, "type", calibration_type_name(calib->type));
+    cJSON_AddStringToObject(obj, "unit", calib->unit);
+
+    switch (calib->type) {
+        case CALIB_LINEAR:
+            cJSON_AddNumberToObject(obj, "m", calib->linear.m);
+            cJSON_AddNumberToObject(obj, "b", calib->linear.b);
+            break;
+
+        case CALIB_POLYNOMIAL:
+            cJSON_AddNumberToObject(obj, "a", calib->poly.a);
+            cJSON_AddNumberToObject(obj, "b", calib->poly.b);
+            cJSON_AddNumberToObject(obj, "c", calib->poly.c);
+            break;
+
+        case CALIB_PIECEWISE: {
+            cJSON *points = cJSON_AddArrayToObject(obj, "points");
+            for (int i = 0; i < calib->piecewise.count; i++) {
+                cJSON *point = cJSON_CreateArray();
+                cJSON_AddItemToArray(point, cJSON_CreateNumber(calib->piecewise.points[i].raw));
+                cJSON_AddItemToArray(point, cJSON_CreateNumber(calib->piecewise.points[i].value));
+                cJSON_AddItemToArray(points, point);
+            }
+            break;
+        }
+
+        case CALIB_NONE:
+        default:
+            break;
+    }
+}
 
-static esp_err_t get_sensor_by_id_handler(httpd_req_t *req) {
-    // Extract sensor ID from URI
-    // URI is like "/api/sensors/0" - get the last character
-    const char *uri = req->uri;
-    int id = uri[strlen("/api/sensors/")] - '0';
+/**
+ * Helper: Send a sensor's calibration with self/update/sensor links
+ */
+static esp_err_t send_sensor_config_response(httpd_req_t *req, int id) {
+    calibration_t calib;
+    sensor_get_calibration(id, &calib);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "id", id);
+    add_calibration_fields(cJSON_AddObjectToObject(root, "calibration"), &calib);
+
+    // Add _links with action hints
+    cJSON *links = cJSON_AddObjectToObject(root, "_links");
+    char href[40];
+    snprintf(href, sizeof(href), "/api/sensors/%d/config", id);
+    cJSON *self = cJSON_AddObjectToObject(links, "self");
+    cJSON_AddStringToObject(self, "href", href);
+    cJSON *update = cJSON_AddObjectToObject(links, "update");
+    cJSON_AddStringToObject(update, "href", href);
+    cJSON_AddStringToObject(update, "method", "PUT");
+    cJSON_AddStringToObject(update, "title", "Replace calibration");
+    snprintf(href, sizeof(href), "/api/sensors/%d", id);
+    cJSON *sensor = cJSON_AddObjectToObject(links, "sensor");
+    cJSON_AddStringToObject(sensor, "href", href);
+
+    return send_json_response(req, root);
+}
+
+static esp_err_t get_sensor_config_handler(httpd_req_t *req, const http_match_t *match) {
+    int32_t id = 0;
+    if (!http_match_get_int(match, "id", &id) || id >= SENSOR_COUNT) {
+        return send_error_response(req, 404, "Sensor not found");
+    }
+    return send_sensor_config_response(req, id);
+}
+
+// ---- GET /api/sensors/{id} ----
 
-    if (id < 0 || id >= SENSOR_COUNT) {
+static esp_err_t get_sensor_by_id_handler(httpd_req_t *req, const http_match_t *match) {
+    int32_t id = 0;
+    if (!http_match_get_int(match, "id", &id) || id >= SENSOR_COUNT) {
         return send_error_response(req, 404, "Sensor not found");
     }
 
@@ -136,6 +571,13 @@ static esp_err_t get_sensor_by_id_handler(httpd_req_t *req) {
     sensor_reading_t reading;
     esp_err_t ret = sensor_read(id, &reading);
 
+    if (wants_cbor(req)) {
+        cbor_writer_t *w = cbor_response_begin(req);
+        write_sensor_cbor(w, id, &reading, ret, false);
+        return send_cbor_response(req, w);
+    }
+
+    encode_begin();
     cJSON *root = cJSON_CreateObject();
     cJSON_AddNumberToObject(root, "id", id);
     cJSON_AddStringToObject(root, "type", info->type == SENSOR_TYPE_LIGHT ? "light" : "water");
@@ -157,26 +599,208 @@ static esp_err_t get_sensor_by_id_handler(httpd_req_t *req) {
     cJSON *collection = cJSON_AddObjectToObject(links, "collection");
     cJSON_AddStringToObject(collection, "href", "/api/sensors");
     cJSON_AddStringToObject(collection, "title", "All sensors");
+    snprintf(href, sizeof(href), "/api/sensors/%d/config", id);
+    cJSON *config = cJSON_AddObjectToObject(links, "config");
+    cJSON_AddStringToObject(config, "href", href);
+    cJSON_AddStringToObject(config, "title", "Calibration");
 
     return send_json_response(req, root);
 }
 
+// ---- PUT /api/sensors/{id}/config ----
+// Body: {"type": "linear", "m": 0.0244, "b": 0, "unit": "%"}
+//       {"type": "polynomial", "a": 0.00001, "b": 0.1, "c": 0, "unit": "lux"}
+//       {"type": "piecewise", "points": [[0, 0], [2048, 40], [4095, 100]], "unit": "%"}
+//       {"type": "none"}
+//
+// Replaces the sensor's calibration and stores it in NVS. Sampling goes
+// on while it is swapped in.
+
+#define SENSOR_CONFIG_BODY_MAX 512
+
+/**
+ * Helper: Read a required number field into a float
+ */
+static bool get_float_field(const cJSON *json, const char *name, float *out) {
+    const cJSON *item = cJSON_GetObjectItem(json, name);
+    if (!cJSON_IsNumber(item)) {
+        return false;
+    }
+    *out = (float) item->valuedouble;
+    return true;
+}
+
+/**
+ * Helper: Parse a calibration body (ranges are checked by calibration_validate())
+ */
+static esp_err_t parse_calibration(const cJSON *json, calibration_t *calib) {
+    memset(calib, 0, sizeof(*calib));
+    const cJSON *type = cJSON_GetObjectItem(json, "type");
+    const cJSON *unit = cJSON_GetObjectItem(json, "unit");
+    if (!cJSON_IsString(type) || (unit != NULL && !cJSON_IsString(unit))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    calib->type = calibration_type_from_name(type->valuestring);
+    calib->unit = unit != NULL ? unit->valuestring : calib->type == CALIB_NONE ? "raw" : NULL;
+
+    switch (calib->type) {
+        case CALIB_LINEAR:
+            return get_float_field(json, "m", &calib->linear.m) &&
+                           get_float_field(json, "b", &calib->linear.b)
+                       ? ESP_OK
+                       : ESP_ERR_INVALID_ARG;
+
+        case CALIB_POLYNOMIAL:
+            return get_float_field(json, "a", &calib->poly.a) &&
+                           get_float_field(json, "b", &calib->poly.b) &&
+                           get_float_field(json, "c", &calib->poly.c)
+                       ? ESP_OK
+                       : ESP_ERR_INVALID_ARG;
+
+        case CALIB_PIECEWISE: {
+            const cJSON *points = cJSON_GetObjectItem(json, "points");
+            if (!cJSON_IsArray(points) || cJSON_GetArraySize(points) > CALIB_PIECEWISE_MAX) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            const cJSON *point = NULL;
+            cJSON_ArrayForEach(point, points) {
+                const cJSON *raw = cJSON_GetArrayItem(point, 0);
+                const cJSON *value = cJSON_GetArrayItem(point, 1);
+                if (!cJSON_IsArray(point) || cJSON_GetArraySize(point) != 2 ||
+                    !cJSON_IsNumber(raw) || !cJSON_IsNumber(value) || raw->valuedouble < 0 ||
+                    raw->valuedouble > CALIB_RAW_MAX) {
+                    return ESP_ERR_INVALID_ARG;
+                }
+                calib_point_t *p = &calib->piecewise.points[calib->piecewise.count++];
+                p->raw = (uint16_t) raw->valuedouble;
+                p->value = (float) value->valuedouble;
+            }
+            return ESP_OK;
+        }
+
+        case CALIB_NONE:
+            return ESP_OK;
+
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+}
+
+static esp_err_t put_sensor_config_handler(httpd_req_t *req, const http_match_t *match) {
+    int32_t id = 0;
+    if (!http_match_get_int(match, "id", &id) || id >= SENSOR_COUNT) {
+        return send_error_response(req, 404, "Sensor not found");
+    }
+
+    char body[SENSOR_CONFIG_BODY_MAX];
+    if (read_request_body(req, body, sizeof(body)) < 0) {
+        return ESP_FAIL;
+    }
+    cJSON *json = cJSON_Parse(body);
+    if (json == NULL) {
+        return send_error_response(req, 400, "Invalid JSON");
+    }
+
+    // The unit points into the cJSON tree until the calibration is installed
+    calibration_t calib;
+    esp_err_t ret = parse_calibration(json, &calib);
+    if (ret == ESP_OK) {
+        ret = calibration_validate(&calib) == ESP_OK ? sensor_save_calibration(id, &calib)
+                                                     : ESP_ERR_INVALID_ARG;
+    }
+    cJSON_Delete(json);
+
+    if (ret == ESP_ERR_INVALID_ARG) {
+        return send_error_response(req, 400,
+                                   "Invalid calibration (check type, coefficients, points "
+                                   "and unit)");
+    } else if (ret != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to store calibration");
+        return ESP_FAIL;
+    }
+
+    return send_sensor_config_response(req, id);
+}
+
 // ---- GET /api/leds ----
 
-static esp_err_t get_leds_handler(httpd_req_t *req) {
+/**
+ * Helper: Add LED fields to a JSON object
+ *
+ * Adds id, metadata, state, capabilities and (for dimmable LEDs) brightness.
+ */
+static void add_led_fields(cJSON *obj, int id, bool state) {
+    const led_info_t *info = led_get_info(id);
+
+    cJSON_AddNumberToObject(obj, "id", id);
+    cJSON_AddStringToObject(obj, "color", info->color);
+    cJSON_AddStringToObject(obj, "location", info->location);
+    cJSON_AddBoolToObject(obj, "state", (cJSON_bool) state);
+
+    cJSON *caps = cJSON_AddArrayToObject(obj, "capabilities");
+    if (info->caps & LED_CAP_ONOFF) {
+        cJSON_AddItemToArray(caps, cJSON_CreateString("onoff"));
+    }
+    if (info->caps & LED_CAP_DIMMABLE) {
+        cJSON_AddItemToArray(caps, cJSON_CreateString("dimmable"));
+
+        uint8_t brightness = 0;
+        led_get_brightness(id, &brightness);
+        cJSON_AddNumberToObject(obj, "brightness", brightness);
+    }
+}
+
+/**
+ * Helper: Encode an LED as a CBOR map (fields as in add_led_fields())
+ */
+static void write_led_cbor(cbor_writer_t *w, int id, bool state) {
+    const led_info_t *info = led_get_info(id);
+    bool dimmable = (info->caps & LED_CAP_DIMMABLE) != 0;
+    bool onoff = (info->caps & LED_CAP_ONOFF) != 0;
+
+    cbor_write_map(w, dimmable ? 6 : 5);
+    cbor_write_text(w, "id");
+    cbor_write_uint(w, id);
+    cbor_write_text(w, "color");
+    cbor_write_text(w, info->color);
+    cbor_write_text(w, "location");
+    cbor_write_text(w, info->location);
+    cbor_write_text(w, "state");
+    cbor_write_bool(w, state);
+
+    cbor_write_text(w, "capabilities");
+    cbor_write_array(w, onoff + dimmable);
+    if (onoff) {
+        cbor_write_text(w, "onoff");
+    }
+    if (dimmable) {
+        cbor_write_text(w, "dimmable");
+
+        uint8_t brightness = 0;
+        led_get_brightness(id, &brightness);
+        cbor_write_text(w, "brightness");
+        cbor_write_uint(w, brightness);
+    }
+}
+
+/**
+ * Helper: Build LED collection JSON
+ *
+ * Builds the full LED collection from a single state snapshot, so all
+ * LEDs in the response are consistent with each other.
+ *
+ * @param state_mask State of all LEDs (bit n = LED n)
+ * @return cJSON object (caller owns it)
+ */
+static cJSON *build_leds_json(uint32_t state_mask) {
     cJSON *root = cJSON_CreateObject();
     cJSON *leds = cJSON_AddArrayToObject(root, "leds");
 
     for (int i = 0; i < LED_COUNT; i++) {
         const led_info_t *info = led_get_info(i);
-        bool state = false;
-        led_get_state(i, &state);
 
         cJSON *led = cJSON_CreateObject();
-        cJSON_AddNumberToObject(led, "id", i);
-        cJSON_AddStringToObject(led, "color", info->color);
-        cJSON_AddStringToObject(led, "location", info->location);
-        cJSON_AddBoolToObject(led, "state", (cJSON_bool) state);
+        add_led_fields(led, i, (state_mask & LED_MASK(i)) != 0);
 
         // Add _links with action hints
         cJSON *links = cJSON_AddObjectToObject(led, "_links");
@@ -192,6 +816,15 @@ static esp_err_t get_leds_handler(httpd_req_t *req) {
         cJSON_AddStringToObject(control, "title", "Control LED");
         cJSON_AddStringToObject(control, "accepts", "{\"action\": \"on|off|toggle\"}");
 
+        if (info->caps & LED_CAP_DIMMABLE) {
+            cJSON *dim = cJSON_AddObjectToObject(links, "brightness");
+            cJSON_AddStringToObject(dim, "href", href);
+            cJSON_AddStringToObject(dim, "method", "PUT");
+            cJSON_AddStringToObject(dim, "title", "Set brightness");
+            cJSON_AddStringToObject(dim, "accepts",
+                                    "{\"brightness\": 0-255, \"fade_ms\": 0-10000}");
+        }
+
         cJSON_AddItemToArray(leds, led);
     }
 
@@ -199,30 +832,56 @@ static esp_err_t get_leds_handler(httpd_req_t *req) {
     cJSON *links = cJSON_AddObjectToObject(root, "_links");
     cJSON *self = cJSON_AddObjectToObject(links, "self");
     cJSON_AddStringToObject(self, "href", "/api/leds");
+    cJSON *batch = cJSON_AddObjectToObject(links, "batch");
+    cJSON_AddStringToObject(batch, "href", "/api/leds");
+    cJSON_AddStringToObject(batch, "method", "POST");
+    cJSON_AddStringToObject(batch, "title", "Control several LEDs at once");
+    cJSON_AddStringToObject(batch, "accepts",
+                            "[{\"id\": 0, \"action\": \"on|off|toggle\"}] or "
+                            "{\"on\": mask, \"off\": mask, \"toggle\": mask}");
     cJSON *up = cJSON_AddObjectToObject(links, "up");
     cJSON_AddStringToObject(up, "href", "/api");
     cJSON_AddStringToObject(up, "title", "API root");
 
-    return send_json_response(req, root);
+    return root;
 }
 
-// ---- POST /api/leds/{id} ----
-// Body: {"action": "on"} or {"action": "off"} or {"action": "toggle"}
+/**
+ * Helper: Send the LED collection (JSON or CBOR)
+ */
+static esp_err_t send_leds_response(httpd_req_t *req, uint32_t state_mask) {
+    if (wants_cbor(req)) {
+        cbor_writer_t *w = cbor_response_begin(req);
+        cbor_write_map(w, 1);
+        cbor_write_text(w, "leds");
+        cbor_write_array(w, LED_COUNT);
+        for (int i = 0; i < LED_COUNT; i++) {
+            write_led_cbor(w, i, (state_mask & LED_MASK(i)) != 0);
+        }
+        return send_cbor_response(req, w);
+    }
 
-static esp_err_t post_led_handler(httpd_req_t *req) {
-    // Extract LED ID from URI
-    const char *uri = req->uri;
-    int id = uri[strlen("/api/leds/")] - '0';
+    encode_begin();
+    return send_json_response(req, build_leds_json(state_mask));
+}
 
-    if (id < 0 || id >= LED_COUNT) {
-        return send_error_response(req, 404, "LED not found");
-    }
+static esp_err_t get_leds_handler(httpd_req_t *req, const http_match_t *match) {
+    uint32_t state_mask = 0;
+    led_get_state_mask(&state_mask);
 
-    // Read request body
-    char body[128] = {0};
-    int received = httpd_req_recv(req, body, sizeof(body) - 1);
-    if (received <= 0) {
-        return send_error_response(req, 400, "Empty request body");
+    return send_leds_response(req, state_mask);
+}
+
+// ---- POST /api/leds ----
+// Body: [{"id": 0, "action": "on"}, {"id": 1, "action": "toggle"}]
+//   or: {"on": 1, "off": 0, "toggle": 2}  (bitmasks, bit n = LED n)
+//
+// All commands are applied atomically; responds with the whole collection.
+
+static esp_err_t post_leds_handler(httpd_req_t *req, const http_match_t *match) {
+    char body[512];
+    if (read_request_body(req, body, sizeof(body)) < 0) {
+        return ESP_FAIL;
     }
 
     // Parse JSON body
@@ -231,41 +890,93 @@ static esp_err_t post_led_handler(httpd_req_t *req) {
         return send_error_response(req, 400, "Invalid JSON");
     }
 
-    cJSON *action = cJSON_GetObjectItem(json, "action");
-    if (!cJSON_IsString(action)) {
-        cJSON_Delete(json);
-        return send_error_response(req, 400, "Missing 'action' field (on/off/toggle)");
-    }
-
-    // Execute action
-    esp_err_t ret = ESP_OK;
-    if (strcmp(action->valuestring, "on") == 0) {
-        ret = led_on(id);
-    } else if (strcmp(action->valuestring, "off") == 0) {
-        ret = led_off(id);
-    } else if (strcmp(action->valuestring, "toggle") == 0) {
-        ret = led_toggle(id);
+    led_batch_t batch = {0};
+
+    if (cJSON_IsArray(json)) {
+        // Command list form - commands compose in order
+        cJSON *cmd = NULL;
+        cJSON_ArrayForEach(cmd, json) {
+            cJSON *id = cJSON_GetObjectItem(cmd, "id");
+            cJSON *action = cJSON_GetObjectItem(cmd, "action");
+            if (!cJSON_IsNumber(id) || !cJSON_IsString(action)) {
+                cJSON_Delete(json);
+                return send_error_response(req, 400, "Each command needs 'id' and 'action'");
+            }
+            if (id->valueint < 0 || id->valueint >= LED_COUNT) {
+                cJSON_Delete(json);
+                return send_error_response(req, 404, "LED not found");
+            }
+            led_action_t led_action;
+            if (led_parse_action(action->valuestring, &led_action) != ESP_OK) {
+                cJSON_Delete(json);
+                return send_error_response(req, 400, "Invalid action (use: on, off, toggle)");
+            }
+            led_batch_add(&batch, id->valueint, led_action);
+        }
+    } else if (cJSON_IsObject(json)) {
+        // Bitmask form
+        cJSON *on = cJSON_GetObjectItem(json, "on");
+        cJSON *off = cJSON_GetObjectItem(json, "off");
+        cJSON *toggle = cJSON_GetObjectItem(json, "toggle");
+        if ((on != NULL && !cJSON_IsNumber(on)) || (off != NULL && !cJSON_IsNumber(off)) ||
+            (toggle != NULL && !cJSON_IsNumber(toggle))) {
+            cJSON_Delete(json);
+            return send_error_response(req, 400, "Masks must be numbers");
+        }
+        batch.on_mask = on ? (uint32_t) on->valueint : 0;
+        batch.off_mask = off ? (uint32_t) off->valueint : 0;
+        batch.toggle_mask = toggle ? (uint32_t) toggle->valueint : 0;
+        if (((batch.on_mask | batch.off_mask | batch.toggle_mask) & ~LED_ALL_MASK) != 0) {
+            cJSON_Delete(json);
+            return send_error_response(req, 404, "LED not found");
+        }
+        if ((batch.on_mask & batch.off_mask) != 0) {
+            cJSON_Delete(json);
+            return send_error_response(req, 400, "LED cannot be both on and off");
+        }
     } else {
         cJSON_Delete(json);
-        return send_error_response(req, 400, "Invalid action (use: on, off, toggle)");
+        return send_error_response(req, 400, "Expected command array or mask object");
     }
 
     cJSON_Delete(json);
 
+    // Apply all changes at once
+    uint32_t state_mask = 0;
+    esp_err_t ret = led_apply_batch(&batch, &state_mask);
+    if (ret == ESP_ERR_NO_MEM) {
+        return send_error_response(req, 503, "LED command queue full");
+    }
+    if (ret == ESP_ERR_TIMEOUT) {
+        // Queued, so it still lands: not worth a retry, which would toggle twice
+        return send_error_response(req, 503, "LED command queued but not applied yet");
+    }
     if (ret != ESP_OK) {
         return send_error_response(req, 400, "LED operation failed");
     }
 
-    // Return updated LED state
+    return send_json_response(req, build_leds_json(state_mask));
+}
+
+/**
+ * Helper: Send single LED resource
+ *
+ * Returns the current LED state with self/collection links (JSON) or
+ * just the fields (CBOR).
+ */
+static esp_err_t send_led_response(httpd_req_t *req, int id) {
     bool state = false;
     led_get_state(id, &state);
-    const led_info_t *info = led_get_info(id);
 
+    if (wants_cbor(req)) {
+        cbor_writer_t *w = cbor_response_begin(req);
+        write_led_cbor(w, id, state);
+        return send_cbor_response(req, w);
+    }
+
+    encode_begin();
     cJSON *root = cJSON_CreateObject();
-    cJSON_AddNumberToObject(root, "id", id);
-    cJSON_AddStringToObject(root, "color", info->color);
-    cJSON_AddStringToObject(root, "location", info->location);
-    cJSON_AddBoolToObject(root, "state", (cJSON_bool) state);
+    add_led_fields(root, id, state);
 
     // Add _links to response
     cJSON *links = cJSON_AddObjectToObject(root, "_links");
@@ -279,27 +990,473 @@ static esp_err_t post_led_handler(httpd_req_t *req) {
     return send_json_response(req, root);
 }
 
-// ---- GET /api/system ----
-
-static esp_err_t get_system_handler(httpd_req_t *req) {
-    cJSON *root = cJSON_CreateObject();
+// ---- POST /api/leds/{id} ----
+// Body: {"action": "on"} or {"action": "off"} or {"action": "toggle"}
 
-    // Current time
-    time_t now = 0;
-    struct tm timeinfo;
-    time(&now);
-    localtime_r(&now, &timeinfo);
+static esp_err_t post_led_handler(httpd_req_t *req, const http_match_t *match) {
+    int32_t id = 0;
+    if (!http_match_get_int(match, "id", &id) || id >= LED_COUNT) {
+        return send_error_response(req, 404, "LED not found");
+    }
 
-    char strftime_buf[64];
-    strftime(strftime_buf, sizeof(strftime_buf), "%Y-%m-%d %H:%M:%S", &timeinfo);
-    cJSON_AddStringToObject(root, "current_time", strftime_buf);
+    // Read request body
+    char body[128] = {0};
+    int received = httpd_req_recv(req, body, sizeof(body) - 1);
+    if (received <= 0) {
+        return send_error_response(req, 400, "Empty request body");
+    }
 
-    // Uptime
-    int64_t uptime_ms = esp_timer_get_time() / 1000;
-    cJSON_AddNumberToObject(root, "uptime_ms", (double) uptime_ms);
+    // Parse JSON body
+    cJSON *json = cJSON_Parse(body);
+    if (json == NULL) {
+        return send_error_response(req, 400, "Invalid JSON");
+    }
 
-    // Memory
-    cJSON *memory = cJSON_AddObjectToObject(root, "memory");
+    cJSON *action = cJSON_GetObjectItem(json, "action");
+    if (!cJSON_IsString(action)) {
+        cJSON_Delete(json);
+        return send_error_response(req, 400, "Missing 'action' field (on/off/toggle)");
+    }
+
+    // Execute action
+    esp_err_t ret = ESP_OK;
+    led_action_t led_action;
+    if (led_parse_action(action->valuestring, &led_action) != ESP_OK) {
+        cJSON_Delete(json);
+        return send_error_response(req, 400, "Invalid action (use: on, off, toggle)");
+    }
+
+    cJSON_Delete(json);
+
+    if (led_action == LED_ACTION_ON) {
+        ret = led_on(id);
+    } else if (led_action == LED_ACTION_OFF) {
+        ret = led_off(id);
+    } else {
+        ret = led_toggle(id);
+    }
+
+    if (ret != ESP_OK) {
+        return send_error_response(req, 400, "LED operation failed");
+    }
+
+    return send_led_response(req, id);
+}
+
+// ---- PUT /api/leds/{id} ----
+// Body: {"brightness": 128, "fade_ms": 500}  (fade_ms optional, default 0)
+
+static esp_err_t put_led_handler(httpd_req_t *req, const http_match_t *match) {
+    int32_t id = 0;
+    if (!http_match_get_int(match, "id", &id) || id >= LED_COUNT) {
+        return send_error_response(req, 404, "LED not found");
+    }
+    if (!(led_get_info(id)->caps & LED_CAP_DIMMABLE)) {
+        return send_error_response(req, 400, "LED does not support brightness");
+    }
+
+    char body[128];
+    if (read_request_body(req, body, sizeof(body)) < 0) {
+        return ESP_FAIL;
+    }
+
+    // Parse JSON body
+    cJSON *json = cJSON_Parse(body);
+    if (json == NULL) {
+        return send_error_response(req, 400, "Invalid JSON");
+    }
+
+    cJSON *brightness = cJSON_GetObjectItem(json, "brightness");
+    cJSON *fade_ms = cJSON_GetObjectItem(json, "fade_ms");
+    if (!cJSON_IsNumber(brightness) || brightness->valueint < 0 ||
+        brightness->valueint > LED_BRIGHTNESS_MAX) {
+        cJSON_Delete(json);
+        return send_error_response(req, 400, "Missing or invalid 'brightness' (0-255)");
+    }
+    if (fade_ms != NULL && (!cJSON_IsNumber(fade_ms) || fade_ms->valuedouble < 0 ||
+                            fade_ms->valuedouble > LED_FADE_MAX_MS)) {
+        cJSON_Delete(json);
+        char message[48];
+        snprintf(message, sizeof(message), "Invalid 'fade_ms' (0-%d)", LED_FADE_MAX_MS);
+        return send_error_response(req, 400, message);
+    }
+
+    uint8_t level = (uint8_t) brightness->valueint;
+    uint32_t fade = fade_ms ? (uint32_t) fade_ms->valueint : 0;
+    cJSON_Delete(json);
+
+    // The request is valid by now: what is left is the actuator task being busy
+    esp_err_t ret = led_set_brightness(id, level, fade);
+    if (ret == ESP_ERR_NO_MEM) {
+        return send_error_response(req, 503, "LED command queue full");
+    }
+    if (ret == ESP_ERR_TIMEOUT) {
+        return send_error_response(req, 503, "LED command queued but not applied yet");
+    }
+    if (ret != ESP_OK) {
+        return send_error_response(req, 400, "LED operation failed");
+    }
+
+    return send_led_response(req, id);
+}
+
+// ---- GET /api/rules ----
+
+// Names used in rule JSON, indexed by rule_cond_t / rule_action_type_t
+static const char *RULE_COND_NAMES[] = {"above", "below"};
+static const char *RULE_ACTION_NAMES[] = {"none", "led_on", "led_off", "brightness",
+                                          "blink_period"};
+
+#define RULES_BODY_MAX 4096
+
+/**
+ * Helper: Add rule action JSON
+ */
+static void add_rule_action(cJSON *obj, const char *name, const rule_action_t *action) {
+    cJSON *json = cJSON_AddObjectToObject(obj, name);
+    cJSON_AddStringToObject(json, "action", RULE_ACTION_NAMES[action->type]);
+    if (action->type == RULE_ACTION_LED_ON || action->type == RULE_ACTION_LED_OFF ||
+        action->type == RULE_ACTION_BRIGHTNESS) {
+        cJSON_AddNumberToObject(json, "led", action->led);
+    }
+    if (action->type == RULE_ACTION_BRIGHTNESS || action->type == RULE_ACTION_BLINK_PERIOD) {
+        cJSON_AddNumberToObject(json, "value", action->value);
+    }
+}
+
+/**
+ * Helper: Parse rule action JSON
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if malformed
+ */
+static esp_err_t parse_rule_action(const cJSON *json, rule_action_t *action) {
+    memset(action, 0, sizeof(*action));
+    if (json == NULL) {
+        return ESP_OK;  // Optional - defaults to "none"
+    }
+
+    cJSON *name = cJSON_GetObjectItem(json, "action");
+    cJSON *led = cJSON_GetObjectItem(json, "led");
+    cJSON *value = cJSON_GetObjectItem(json, "value");
+    if (!cJSON_IsString(name)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int type = -1;
+    for (int i = 0; i < sizeof(RULE_ACTION_NAMES) / sizeof(RULE_ACTION_NAMES[0]); i++) {
+        if (strcmp(name->valuestring, RULE_ACTION_NAMES[i]) == 0) {
+            type = i;
+        }
+    }
+    if (type < 0 || (led != NULL && !cJSON_IsNumber(led)) ||
+        (value != NULL && !cJSON_IsNumber(value))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ((led && (led->valueint < 0 || led->valueint > UINT8_MAX)) ||
+        (value && (value->valueint < 0 || value->valueint > UINT16_MAX))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    action->type = (uint8_t) type;
+    action->led = led ? (uint8_t) led->valueint : 0;
+    action->value = value ? (uint16_t) value->valueint : 0;
+    return ESP_OK;
+}
+
+/**
+ * Helper: Parse one rule definition
+ *
+ * Only checks shape and ranges of fields here; rules_load() does
+ * the semantic validation (sensor ids, LED capabilities, ...).
+ */
+static esp_err_t parse_rule(const cJSON *json, rule_def_t *def) {
+    cJSON *sensor = cJSON_GetObjectItem(json, "sensor");
+    cJSON *cond = cJSON_GetObjectItem(json, "condition");
+    cJSON *threshold = cJSON_GetObjectItem(json, "threshold");
+    cJSON *hysteresis = cJSON_GetObjectItem(json, "hysteresis");
+    cJSON *duration = cJSON_GetObjectItem(json, "duration_ms");
+
+    if (!cJSON_IsNumber(sensor) || !cJSON_IsString(cond) || !cJSON_IsNumber(threshold) ||
+        (hysteresis != NULL && !cJSON_IsNumber(hysteresis)) ||
+        (duration != NULL && !cJSON_IsNumber(duration))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (sensor->valueint < 0 || sensor->valueint > UINT8_MAX || threshold->valueint < 0 ||
+        threshold->valueint > UINT16_MAX ||
+        (hysteresis && (hysteresis->valueint < 0 || hysteresis->valueint > UINT16_MAX)) ||
+        (duration && (duration->valuedouble < 0 || duration->valuedouble > UINT32_MAX))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(def, 0, sizeof(*def));
+    if (strcmp(cond->valuestring, RULE_COND_NAMES[RULE_COND_ABOVE]) == 0) {
+        def->cond = RULE_COND_ABOVE;
+    } else if (strcmp(cond->valuestring, RULE_COND_NAMES[RULE_COND_BELOW]) == 0) {
+        def->cond = RULE_COND_BELOW;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    def->sensor = (uint8_t) sensor->valueint;
+    def->threshold = (uint16_t) threshold->valueint;
+    def->hysteresis = hysteresis ? (uint16_t) hysteresis->valueint : 0;
+    def->duration_ms = duration ? (uint32_t) duration->valuedouble : 0;
+
+    if (parse_rule_action(cJSON_GetObjectItem(json, "enter"), &def->enter) != ESP_OK ||
+        parse_rule_action(cJSON_GetObjectItem(json, "exit"), &def->exit) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t get_rules_handler(httpd_req_t *req, const http_match_t *match) {
+    static rule_def_t defs[RULES_MAX];  // Keep off the httpd task stack
+    size_t count = rules_get(defs, RULES_MAX);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON *rules = cJSON_AddArrayToObject(root, "rules");
+
+    for (size_t i = 0; i < count; i++) {
+        cJSON *rule = cJSON_CreateObject();
+        cJSON_AddNumberToObject(rule, "sensor", defs[i].sensor);
+        cJSON_AddStringToObject(rule, "condition", RULE_COND_NAMES[defs[i].cond]);
+        cJSON_AddNumberToObject(rule, "threshold", defs[i].threshold);
+        cJSON_AddNumberToObject(rule, "hysteresis", defs[i].hysteresis);
+        cJSON_AddNumberToObject(rule, "duration_ms", defs[i].duration_ms);
+        add_rule_action(rule, "enter", &defs[i].enter);
+        add_rule_action(rule, "exit", &defs[i].exit);
+        cJSON_AddItemToArray(rules, rule);
+    }
+
+    // Evaluation statistics
+    rules_stats_t stats;
+    rules_get_stats(&stats);
+    cJSON *stats_json = cJSON_AddObjectToObject(root, "stats");
+    cJSON_AddNumberToObject(stats_json, "frames", stats.frames);
+    cJSON_AddNumberToObject(stats_json, "rules_checked", stats.rules_checked);
+    cJSON_AddNumberToObject(stats_json, "transitions", stats.transitions);
+    cJSON_AddNumberToObject(stats_json, "last_eval_us", stats.last_eval_us);
+    cJSON_AddNumberToObject(stats_json, "max_eval_us", stats.max_eval_us);
+    cJSON_AddNumberToObject(stats_json, "actions_dropped", stats.actions_dropped);
+
+    // Add _links with action hints
+    cJSON *links = cJSON_AddObjectToObject(root, "_links");
+    cJSON *self = cJSON_AddObjectToObject(links, "self");
+    cJSON_AddStringToObject(self, "href", "/api/rules");
+    cJSON *replace = cJSON_AddObjectToObject(links, "replace");
+    cJSON_AddStringToObject(replace, "href", "/api/rules");
+    cJSON_AddStringToObject(replace, "method", "POST");
+    cJSON_AddStringToObject(replace, "title", "Replace all rules");
+    cJSON *up = cJSON_AddObjectToObject(links, "up");
+    cJSON_AddStringToObject(up, "href", "/api");
+    cJSON_AddStringToObject(up, "title", "API root");
+
+    return send_json_response(req, root);
+}
+
+// ---- POST /api/rules ----
+// Body: [{"sensor": 1, "condition": "above", "threshold": 30, "hysteresis": 15,
+//         "duration_ms": 0, "enter": {"action": "blink_period", "value": 100},
+//         "exit": {"action": "blink_period", "value": 500}}]
+//
+// Replaces the whole rule table and stores it in NVS.
+
+static esp_err_t post_rules_handler(httpd_req_t *req, const http_match_t *match) {
+    char *body = malloc(RULES_BODY_MAX);
+    if (body == NULL) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    if (read_request_body(req, body, RULES_BODY_MAX) < 0) {
+        free(body);
+        return ESP_FAIL;
+    }
+
+    cJSON *json = cJSON_Parse(body);
+    free(body);
+    if (json == NULL) {
+        return send_error_response(req, 400, "Invalid JSON");
+    }
+    if (!cJSON_IsArray(json) || cJSON_GetArraySize(json) > RULES_MAX) {
+        cJSON_Delete(json);
+        return send_error_response(req, 400, "Expected an array of up to 16 rules");
+    }
+
+    static rule_def_t defs[RULES_MAX];  // Keep off the httpd task stack
+    size_t count = 0;
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, json) {
+        if (parse_rule(item, &defs[count]) != ESP_OK) {
+            cJSON_Delete(json);
+            return send_error_response(req, 400, "Malformed rule");
+        }
+        count++;
+    }
+    cJSON_Delete(json);
+
+    esp_err_t ret = rules_load(defs, count, true);
+    if (ret == ESP_ERR_INVALID_ARG) {
+        return send_error_response(req, 400, "Invalid rule (check sensor, LED and ranges)");
+    } else if (ret != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Failed to store rules");
+        return ESP_FAIL;
+    }
+
+    return get_rules_handler(req, match);
+}
+
+// ---- GET /api/config ----
+
+#define CONFIG_BODY_MAX 512
+
+static esp_err_t get_config_handler(httpd_req_t *req, const http_match_t *match) {
+    settings_stats_t stats;
+    settings_get_stats(&stats);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "version", stats.schema_version);
+
+    cJSON *settings = cJSON_AddObjectToObject(root, "settings");
+    for (int i = 0; i < SETTING_COUNT; i++) {
+        const setting_def_t *def = settings_get_def((setting_key_t) i);
+        cJSON *item = cJSON_AddObjectToObject(settings, def->name);
+
+        if (def->type == SETTING_TYPE_STR) {
+            char value[SETTINGS_STR_MAX + 1];
+            settings_get_str((setting_key_t) i, value, sizeof(value));
+            cJSON_AddStringToObject(item, "type", "string");
+            if (def->secret) {
+                // Write-only: only say whether there is one
+                cJSON_AddBoolToObject(item, "set", value[0] != '\0');
+                cJSON_AddBoolToObject(item, "secret", true);
+            } else {
+                cJSON_AddStringToObject(item, "value", value);
+                cJSON_AddStringToObject(item, "default", def->default_str);
+            }
+            cJSON_AddNumberToObject(item, "max_len", def->max);
+        } else {
+            cJSON_AddNumberToObject(item, "value", settings_get_u32((setting_key_t) i));
+            cJSON_AddStringToObject(item, "type", "int");
+            cJSON_AddNumberToObject(item, "default", def->default_u32);
+            cJSON_AddNumberToObject(item, "min", def->min);
+            cJSON_AddNumberToObject(item, "max", def->max);
+        }
+        cJSON_AddStringToObject(item, "applies", def->applies);
+    }
+
+    // NVS store
+    cJSON *store = cJSON_AddObjectToObject(root, "store");
+    cJSON_AddNumberToObject(store, "loaded_version", stats.loaded_version);
+    cJSON_AddNumberToObject(store, "pending", stats.pending);
+    cJSON_AddNumberToObject(store, "updates", stats.updates);
+    cJSON_AddNumberToObject(store, "rejected", stats.rejected);
+    cJSON_AddNumberToObject(store, "commits", stats.commits);
+    cJSON_AddNumberToObject(store, "commit_failures", stats.commit_failures);
+    cJSON_AddNumberToObject(store, "keys_written", stats.keys_written);
+    cJSON_AddNumberToObject(store, "last_commit_us", stats.last_commit_us);
+    cJSON_AddNumberToObject(store, "max_commit_us", stats.max_commit_us);
+
+    // Add _links with action hints
+    cJSON *links = cJSON_AddObjectToObject(root, "_links");
+    cJSON *self = cJSON_AddObjectToObject(links, "self");
+    cJSON_AddStringToObject(self, "href", "/api/config");
+    cJSON *update = cJSON_AddObjectToObject(links, "update");
+    cJSON_AddStringToObject(update, "href", "/api/config");
+    cJSON_AddStringToObject(update, "method", "PATCH");
+    cJSON_AddStringToObject(update, "title", "Change some settings");
+    cJSON *up = cJSON_AddObjectToObject(links, "up");
+    cJSON_AddStringToObject(up, "href", "/api");
+    cJSON_AddStringToObject(up, "title", "API root");
+
+    return send_json_response(req, root);
+}
+
+// ---- PATCH /api/config ----
+// Body: {"sensor.period_ms": 5000, "wifi.ssid": "garden"}
+//
+// Changes the given settings together (all or none). They apply right
+// away and reach NVS with the next batched commit.
+
+static esp_err_t patch_config_handler(httpd_req_t *req, const http_match_t *match) {
+    char body[CONFIG_BODY_MAX];
+    if (read_request_body(req, body, sizeof(body)) < 0) {
+        return ESP_FAIL;
+    }
+
+    cJSON *json = cJSON_Parse(body);
+    if (json == NULL) {
+        return send_error_response(req, 400, "Invalid JSON");
+    }
+    if (!cJSON_IsObject(json) || cJSON_GetArraySize(json) > SETTING_COUNT) {
+        cJSON_Delete(json);
+        return send_error_response(req, 400, "Expected an object of settings");
+    }
+
+    setting_update_t updates[SETTING_COUNT];
+    size_t count = 0;
+    char message[64];
+    cJSON *item = NULL;
+    cJSON_ArrayForEach(item, json) {
+        setting_key_t key = settings_find(item->string);
+        if (key == SETTING_COUNT) {
+            snprintf(message, sizeof(message), "Unknown setting '%.32s'", item->string);
+            cJSON_Delete(json);
+            return send_error_response(req, 400, message);
+        }
+
+        setting_update_t *update = &updates[count++];
+        update->key = key;
+        update->str = NULL;
+        update->u32 = 0;
+        bool typed = false;
+        if (settings_get_def(key)->type == SETTING_TYPE_STR) {
+            typed = cJSON_IsString(item);
+            update->str = item->valuestring;
+        } else if (cJSON_IsNumber(item) && item->valuedouble >= 0 &&
+                   item->valuedouble <= UINT32_MAX &&
+                   item->valuedouble == (double) (uint32_t) item->valuedouble) {
+            typed = true;
+            update->u32 = (uint32_t) item->valuedouble;
+        }
+        if (!typed || settings_validate(update) != ESP_OK) {
+            snprintf(message, sizeof(message), "Invalid value for '%s'",
+                     settings_get_def(key)->name);
+            cJSON_Delete(json);
+            return send_error_response(req, 400, message);
+        }
+    }
+
+    // String values point into the cJSON tree until the update is done
+    esp_err_t ret = settings_update(updates, count);
+    cJSON_Delete(json);
+    if (ret != ESP_OK) {
+        return send_error_response(req, 400, "Invalid settings");
+    }
+
+    return get_config_handler(req, match);
+}
+
+// ---- GET /api/system ----
+
+static esp_err_t get_system_handler(httpd_req_t *req, const http_match_t *match) {
+    cJSON *root = cJSON_CreateObject();
+
+    // Current time
+    time_t now = 0;
+    struct tm timeinfo;
+    time(&now);
+    localtime_r(&now, &timeinfo);
+
+    char strftime_buf[64];
+    strftime(strftime_buf, sizeof(strftime_buf), "%Y-%m-%d %H:%M:%S", &timeinfo);
+    cJSON_AddStringToObject(root, "current_time", strftime_buf);
+
+    // Uptime
+    int64_t uptime_ms = esp_timer_get_time() / 1000;
+    cJSON_AddNumberToObject(root, "uptime_ms", (double) uptime_ms);
+
+    // Memory
+    cJSON *memory = cJSON_AddObjectToObject(root, "memory");
     cJSON_AddNumberToObject(memory, "free_heap", esp_get_free_heap_size());
     cJSON_AddNumberToObject(memory, "min_free_heap", esp_get_minimum_free_heap_size());
 
@@ -310,12 +1467,100 @@ static esp_err_t get_system_handler(httpd_req_t *req) {
         cJSON_AddStringToObject(wifi, "ssid", (char *) ap_info.ssid);
         cJSON_AddNumberToObject(wifi, "rssi", ap_info.rssi);
         cJSON_AddNumberToObject(wifi, "channel", ap_info.primary);
+
+        wifi_manager_stats_t wifi_stats;
+        wifi_manager_get_stats(&wifi_stats);
+        cJSON_AddNumberToObject(wifi, "connects", wifi_stats.connects);
+        cJSON_AddNumberToObject(wifi, "fast_connects", wifi_stats.fast_connects);
+        cJSON_AddNumberToObject(wifi, "fallbacks", wifi_stats.fallbacks);
+        cJSON_AddNumberToObject(wifi, "boot_time_to_ip_ms", wifi_stats.boot_time_to_ip_ms);
+        cJSON_AddNumberToObject(wifi, "last_time_to_ip_ms", wifi_stats.last_time_to_ip_ms);
+        cJSON_AddBoolToObject(wifi, "cached_lease", wifi_stats.cached_lease);
     }
 
+    // MQTT telemetry
+    mqtt_publisher_stats_t mqtt_stats;
+    if (mqtt_publisher_get_stats(&mqtt_stats) == ESP_OK) {
+        cJSON *mqtt = cJSON_AddObjectToObject(root, "mqtt");
+        cJSON_AddBoolToObject(mqtt, "connected", mqtt_stats.connected);
+        cJSON_AddNumberToObject(mqtt, "publishes", mqtt_stats.publishes);
+        cJSON_AddNumberToObject(mqtt, "errors", mqtt_stats.errors);
+        cJSON_AddNumberToObject(mqtt, "readings", mqtt_stats.readings);
+        cJSON_AddNumberToObject(mqtt, "dropped", mqtt_stats.dropped);
+        cJSON_AddNumberToObject(mqtt, "inflight", mqtt_stats.inflight);
+        cJSON_AddNumberToObject(mqtt, "bytes_per_reading",
+                                mqtt_stats.readings ? mqtt_stats.bytes / mqtt_stats.readings : 0);
+        cJSON_AddNumberToObject(mqtt, "last_latency_us", mqtt_stats.last_latency_us);
+        cJSON_AddNumberToObject(mqtt, "max_latency_us", mqtt_stats.max_latency_us);
+
+        telemetry_buffer_stats_t buf_stats;
+        telemetry_buffer_get_stats(&buf_stats);
+        cJSON *buffer = cJSON_AddObjectToObject(mqtt, "buffer");
+        cJSON_AddNumberToObject(buffer, "buffered", buf_stats.buffered);
+        cJSON_AddNumberToObject(buffer, "dropped", buf_stats.dropped);
+        cJSON_AddNumberToObject(buffer, "replayed", buf_stats.replayed);
+        cJSON_AddNumberToObject(buffer, "pending_ram", buf_stats.pending_ram);
+        cJSON_AddNumberToObject(buffer, "pending_flash", buf_stats.pending_flash);
+        cJSON_AddNumberToObject(buffer, "flash_capacity", buf_stats.flash_capacity);
+        cJSON_AddNumberToObject(buffer, "flash_errors", buf_stats.flash_errors);
+
+        mqtt_commands_stats_t cmd_stats;
+        if (mqtt_commands_get_stats(&cmd_stats) == ESP_OK) {
+            cJSON *commands = cJSON_AddObjectToObject(mqtt, "commands");
+            cJSON_AddNumberToObject(commands, "received", cmd_stats.received);
+            cJSON_AddNumberToObject(commands, "applied", cmd_stats.applied);
+            cJSON_AddNumberToObject(commands, "rejected", cmd_stats.rejected);
+            cJSON_AddNumberToObject(commands, "dropped", cmd_stats.dropped);
+            cJSON_AddNumberToObject(commands, "duplicates", cmd_stats.duplicates);
+            cJSON_AddNumberToObject(commands, "last_latency_us", cmd_stats.last_latency_us);
+            cJSON_AddNumberToObject(commands, "max_latency_us", cmd_stats.max_latency_us);
+        }
+    }
+
+    // Network supervisor
+    network_stats_t net_stats;
+    network_get_stats(&net_stats);
+    cJSON *network = cJSON_AddObjectToObject(root, "network");
+    cJSON_AddStringToObject(network, "state", network_state_name(net_stats.state));
+    cJSON_AddNumberToObject(network, "outages", net_stats.outages);
+    cJSON_AddNumberToObject(network, "restarts", net_stats.restarts);
+    cJSON_AddNumberToObject(network, "downtime_ms", net_stats.downtime_ms);
+    cJSON_AddNumberToObject(network, "last_recovery_ms", net_stats.last_recovery_ms);
+    cJSON_AddNumberToObject(network, "max_recovery_ms", net_stats.max_recovery_ms);
+
+    // Actuator task
+    led_stats_t led_stats;
+    led_get_stats(&led_stats);
+    cJSON *actuators = cJSON_AddObjectToObject(root, "actuators");
+    cJSON_AddNumberToObject(actuators, "commands", led_stats.commands);
+    cJSON_AddNumberToObject(actuators, "dropped", led_stats.dropped);
+    cJSON_AddNumberToObject(actuators, "batches", led_stats.batches);
+    cJSON_AddNumberToObject(actuators, "max_batch", led_stats.max_batch);
+    cJSON_AddNumberToObject(actuators, "max_latency_us", led_stats.max_latency_us);
+    cJSON_AddNumberToObject(actuators, "timer_max_late_us", led_stats.timer_max_late_us);
+
     // Add _links with action hints
     cJSON *links = cJSON_AddObjectToObject(root, "_links");
     cJSON *self = cJSON_AddObjectToObject(links, "self");
     cJSON_AddStringToObject(self, "href", "/api/system");
+    cJSON *tasks = cJSON_AddObjectToObject(links, "tasks");
+    cJSON_AddStringToObject(tasks, "href", "/api/system/tasks");
+    cJSON_AddStringToObject(tasks, "title", "Per-task CPU, context switches and stack");
+    cJSON *boot = cJSON_AddObjectToObject(links, "boot");
+    cJSON_AddStringToObject(boot, "href", "/api/system/boot");
+    cJSON_AddStringToObject(boot, "title", "Boot timeline and milestones");
+    cJSON *http = cJSON_AddObjectToObject(links, "http");
+    cJSON_AddStringToObject(http, "href", "/api/system/http");
+    cJSON_AddStringToObject(http, "title", "Per-route request counts and latency");
+    cJSON *heap = cJSON_AddObjectToObject(links, "heap");
+    cJSON_AddStringToObject(heap, "href", "/api/system/heap");
+    cJSON_AddStringToObject(heap, "title", "Heap usage by allocation tag");
+    cJSON *locks = cJSON_AddObjectToObject(links, "locks");
+    cJSON_AddStringToObject(locks, "href", "/api/system/locks");
+    cJSON_AddStringToObject(locks, "title", "Mutex contention");
+    cJSON *power = cJSON_AddObjectToObject(links, "power");
+    cJSON_AddStringToObject(power, "href", "/api/system/power");
+    cJSON_AddStringToObject(power, "title", "Time per power state and wakeups");
     cJSON *up = cJSON_AddObjectToObject(links, "up");
     cJSON_AddStringToObject(up, "href", "/api");
     cJSON_AddStringToObject(up, "title", "API root");
@@ -323,58 +1568,635 @@ static esp_err_t get_system_handler(httpd_req_t *req) {
     return send_json_response(req, root);
 }
 
+// ---- GET /api/system/tasks ----
+
+static const char *const TASK_STATE_NAMES[] = {"running", "ready",   "blocked",
+                                               "suspended", "deleted", "invalid"};
+
+static esp_err_t get_system_tasks_handler(httpd_req_t *req, const http_match_t *match) {
+    static task_stats_t tasks[TASK_STATS_MAX];  // Keep off the httpd task stack
+    uint32_t interval_ms = 0;
+    size_t count = stats_get_tasks(tasks, TASK_STATS_MAX, &interval_ms);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "interval_ms", interval_ms);
+    cJSON *list = cJSON_AddArrayToObject(root, "tasks");
+    uint32_t stack_size = 0;
+    uint32_t stack_recommended = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const task_stats_t *t = &tasks[i];
+        cJSON *task = cJSON_CreateObject();
+        cJSON_AddStringToObject(task, "name", t->name);
+        cJSON_AddNumberToObject(task, "number", t->number);
+        cJSON_AddNumberToObject(task, "priority", t->priority);
+        cJSON_AddStringToObject(task, "state",
+                                TASK_STATE_NAMES[t->state < 6 ? t->state : 5]);
+        cJSON_AddNumberToObject(task, "stack_free", t->stack_free);
+        cJSON_AddNumberToObject(task, "stack_delta", t->stack_delta);
+        if (t->stack_size > 0) {
+            cJSON_AddNumberToObject(task, "stack_size", t->stack_size);
+            cJSON_AddNumberToObject(task, "stack_recommended", t->stack_recommended);
+            stack_size += t->stack_size;
+            stack_recommended += t->stack_recommended;
+        }
+
+        // Rolling window, newest first
+        cJSON *cpu = cJSON_AddArrayToObject(task, "cpu_percent");
+        cJSON *switches = cJSON_AddArrayToObject(task, "switches_per_s");
+        for (int j = 0; j < t->samples; j++) {
+            cJSON_AddItemToArray(cpu, cJSON_CreateNumber(t->cpu_x100[j] / 100.0));
+            cJSON_AddItemToArray(switches, cJSON_CreateNumber(t->switches_per_s[j]));
+        }
+        cJSON_AddItemToArray(list, task);
+    }
+
+    // Stack sizing report (tasks created by main.c only)
+    cJSON *stacks = cJSON_AddObjectToObject(root, "stacks");
+    cJSON_AddNumberToObject(stacks, "configured", stack_size);
+    cJSON_AddNumberToObject(stacks, "recommended", stack_recommended);
+    cJSON_AddNumberToObject(stacks, "reclaimable", (double) stack_size - stack_recommended);
+
+    // Add _links with action hints
+    cJSON *links = cJSON_AddObjectToObject(root, "_links");
+    cJSON *self = cJSON_AddObjectToObject(links, "self");
+    cJSON_AddStringToObject(self, "href", "/api/system/tasks");
+    cJSON *up = cJSON_AddObjectToObject(links, "up");
+    cJSON_AddStringToObject(up, "href", "/api/system");
+    cJSON_AddStringToObject(up, "title", "System information");
+
+    return send_json_response(req, root);
+}
+
+// ---- GET /api/system/heap ----
+
+static esp_err_t get_system_heap_handler(httpd_req_t *req, const http_match_t *match) {
+    static heap_tag_stats_t tags[HEAP_PROFILER_TAGS_MAX];  // Keep off the httpd task stack
+    heap_summary_t summary;
+    size_t count = 0;
+
+    // Snapshot first, so building the response doesn't show up in it
+    heap_profiler_get_summary(&summary);
+    esp_err_t ret = heap_profiler_get_tags(tags, HEAP_PROFILER_TAGS_MAX, &count);
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "free_bytes", summary.free_bytes);
+    cJSON_AddNumberToObject(root, "min_free_bytes", summary.min_free_bytes);
+    cJSON_AddNumberToObject(root, "largest_free_block", summary.largest_free_block);
+    cJSON_AddNumberToObject(root, "fragmentation_percent", summary.fragmentation_x100 / 100.0);
+    cJSON_AddBoolToObject(root, "profiling", ret == ESP_OK);
+
+    // Tags, largest live bytes first
+    if (ret == ESP_OK) {
+        cJSON_AddNumberToObject(root, "untracked", summary.untracked);
+        cJSON *list = cJSON_AddArrayToObject(root, "tags");
+        for (size_t i = 0; i < count; i++) {
+            const heap_tag_stats_t *t = &tags[i];
+            cJSON *tag = cJSON_CreateObject();
+            cJSON_AddStringToObject(tag, "name", t->name);
+            cJSON_AddNumberToObject(tag, "live_bytes", t->live_bytes);
+            cJSON_AddNumberToObject(tag, "peak_bytes", t->peak_bytes);
+            cJSON_AddNumberToObject(tag, "live_blocks", t->live_blocks);
+            cJSON_AddNumberToObject(tag, "allocs", t->allocs);
+            cJSON_AddNumberToObject(tag, "frees", t->frees);
+            cJSON_AddItemToArray(list, tag);
+        }
+    }
+
+    // Add _links with action hints
+    cJSON *links = cJSON_AddObjectToObject(root, "_links");
+    cJSON *self = cJSON_AddObjectToObject(links, "self");
+    cJSON_AddStringToObject(self, "href", "/api/system/heap");
+    cJSON *up = cJSON_AddObjectToObject(links, "up");
+    cJSON_AddStringToObject(up, "href", "/api/system");
+    cJSON_AddStringToObject(up, "title", "System information");
+
+    return send_json_response(req, root);
+}
+
+// ---- GET /api/system/boot ----
+
+static esp_err_t get_system_boot_handler(httpd_req_t *req, const http_match_t *match) {
+    cJSON *root = cJSON_CreateObject();
+
+    // Init phases, in start order (steps on different workers overlap)
+    size_t count = 0;
+    const boot_phase_t *phases = boot_get_phases(&count);
+    cJSON *list = cJSON_AddArrayToObject(root, "phases");
+    for (size_t i = 0; i < count; i++) {
+        const boot_phase_t *p = &phases[i];
+        cJSON *phase = cJSON_CreateObject();
+        cJSON_AddStringToObject(phase, "name", p->name);
+        cJSON_AddNumberToObject(phase, "worker", p->worker);
+        cJSON_AddNumberToObject(phase, "start_us", p->start_us);
+        cJSON_AddNumberToObject(phase, "duration_us",
+                                p->end_us != 0 ? p->end_us - p->start_us : 0);
+        if (p->result != ESP_OK) {
+            cJSON_AddStringToObject(phase, "error", esp_err_to_name(p->result));
+        }
+        cJSON_AddItemToArray(list, phase);
+    }
+
+    // Milestones (us since power-on, null if not reached)
+    cJSON *milestones = cJSON_AddObjectToObject(root, "milestones_us");
+    for (int m = 0; m < BOOT_MILESTONE_COUNT; m++) {
+        uint32_t at = boot_get_milestone(m);
+        if (at != 0) {
+            cJSON_AddNumberToObject(milestones, boot_milestone_name(m), at);
+        } else {
+            cJSON_AddNullToObject(milestones, boot_milestone_name(m));
+        }
+    }
+
+    // Add _links with action hints
+    cJSON *links = cJSON_AddObjectToObject(root, "_links");
+    cJSON *self = cJSON_AddObjectToObject(links, "self");
+    cJSON_AddStringToObject(self, "href", "/api/system/boot");
+    cJSON *up = cJSON_AddObjectToObject(links, "up");
+    cJSON_AddStringToObject(up, "href", "/api/system");
+    cJSON_AddStringToObject(up, "title", "System information");
+
+    return send_json_response(req, root);
+}
+
+// ---- GET /api/system/http ----
+
+/**
+ * Histogram bucket for a latency
+ *
+ * Below HTTP_HIST_SUB us one bucket per microsecond; above, the top
+ * HTTP_HIST_SUB_BITS bits after the leading one select the sub-bucket.
+ */
+static uint32_t http_hist_index(uint32_t us) {
+    if (us < HTTP_HIST_SUB) {
+        return us;
+    }
+    uint32_t exp = 31 - __builtin_clz(us);
+    uint32_t sub = (us >> (exp - HTTP_HIST_SUB_BITS)) & (HTTP_HIST_SUB - 1);
+    uint32_t index = (exp - HTTP_HIST_SUB_BITS + 1) * HTTP_HIST_SUB + sub;
+    return index < HTTP_HIST_BUCKETS ? index : HTTP_HIST_BUCKETS - 1;
+}
+
+/**
+ * Lowest latency that falls into a bucket (inverse of http_hist_index)
+ */
+static uint32_t http_hist_lower(uint32_t index) {
+    if (index < HTTP_HIST_SUB) {
+        return index;
+    }
+    uint32_t exp = index / HTTP_HIST_SUB + HTTP_HIST_SUB_BITS - 1;
+    uint32_t sub = index % HTTP_HIST_SUB;
+    return (HTTP_HIST_SUB + sub) << (exp - HTTP_HIST_SUB_BITS);
+}
+
+/**
+ * Latency at a percentile: upper edge of the bucket holding it, capped at the max
+ */
+static uint32_t http_hist_percentile(const route_metrics_t *route, uint32_t count,
+                                     uint32_t percent) {
+    uint32_t rank = (uint32_t) (((uint64_t) count * percent + 99) / 100);
+    uint32_t seen = 0;
+    for (uint32_t i = 0; i < HTTP_HIST_BUCKETS; i++) {
+        seen += route->histogram[i];
+        if (seen >= rank && seen > 0) {
+            uint32_t upper = i + 1 < HTTP_HIST_BUCKETS ? http_hist_lower(i + 1) - 1 : UINT32_MAX;
+            return upper < route->max_us ? upper : route->max_us;
+        }
+    }
+    return 0;
+}
+
+static esp_err_t get_system_http_handler(httpd_req_t *req, const http_match_t *match) {
+    static const char *const STATUS_CLASSES[] = {"2xx", "3xx", "4xx", "5xx"};
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON *list = cJSON_AddArrayToObject(root, "routes");
+
+    for (size_t i = 0; i < s_route_count; i++) {
+        const route_metrics_t *r = &s_route_metrics[i];
+        uint32_t count = r->status[0] + r->status[1] + r->status[2] + r->status[3];
+
+        cJSON *route = cJSON_CreateObject();
+        cJSON_AddStringToObject(route, "route", r->uri);
+        cJSON_AddStringToObject(route, "method", http_method_str(r->method));
+        cJSON_AddNumberToObject(route, "requests", count);
+        cJSON *status = cJSON_AddObjectToObject(route, "status");
+        for (int c = 0; c < 4; c++) {
+            if (r->status[c] > 0) {
+                cJSON_AddNumberToObject(status, STATUS_CLASSES[c], r->status[c]);
+            }
+        }
+        cJSON_AddNumberToObject(route, "bytes_sent", (double) r->bytes_sent);
+
+        if (count > 0) {
+            cJSON *latency = cJSON_AddObjectToObject(route, "latency_us");
+            cJSON_AddNumberToObject(latency, "p50", http_hist_percentile(r, count, 50));
+            cJSON_AddNumberToObject(latency, "p90", http_hist_percentile(r, count, 90));
+            cJSON_AddNumberToObject(latency, "p99", http_hist_percentile(r, count, 99));
+            cJSON_AddNumberToObject(latency, "max", r->max_us);
+
+            // Non-empty buckets as [lower bound us, count]
+            cJSON *histogram = cJSON_AddArrayToObject(route, "histogram");
+            for (uint32_t b = 0; b < HTTP_HIST_BUCKETS; b++) {
+                if (r->histogram[b] > 0) {
+                    cJSON *bucket = cJSON_CreateArray();
+                    cJSON_AddItemToArray(bucket, cJSON_CreateNumber(http_hist_lower(b)));
+                    cJSON_AddItemToArray(bucket, cJSON_CreateNumber(r->histogram[b]));
+                    cJSON_AddItemToArray(histogram, bucket);
+                }
+            }
+        }
+        cJSON_AddItemToArray(list, route);
+    }
+
+    // Connection pool
+    http_session_stats_t sessions;
+    http_session_get_stats(&sessions);
+    cJSON *connections = cJSON_AddObjectToObject(root, "connections");
+    cJSON_AddNumberToObject(connections, "max", sessions.max_sockets);
+    cJSON_AddNumberToObject(connections, "open", sessions.open);
+    cJSON_AddNumberToObject(connections, "peak", sessions.peak_open);
+    cJSON_AddNumberToObject(connections, "accepted", sessions.accepted);
+    cJSON_AddNumberToObject(connections, "rejected", sessions.rejected);
+    cJSON_AddNumberToObject(connections, "closed", sessions.closed);
+    cJSON_AddNumberToObject(connections, "idle_closed", sessions.idle_closed);
+    cJSON_AddNumberToObject(connections, "requests", sessions.requests);
+
+    // Body encoding cost of negotiated resources, per wire format
+    cJSON *encoding = cJSON_AddObjectToObject(root, "encoding");
+    for (int f = 0; f < HTTP_FORMAT_COUNT; f++) {
+        const http_encode_stats_t *e = &s_encode_stats[f];
+        cJSON *format = cJSON_AddObjectToObject(encoding, HTTP_FORMAT_NAMES[f]);
+        cJSON_AddNumberToObject(format, "responses", e->responses);
+        cJSON_AddNumberToObject(format, "avg_bytes", e->responses ? e->bytes / e->responses : 0);
+        cJSON_AddNumberToObject(format, "avg_us", e->responses ? e->total_us / e->responses : 0);
+        cJSON_AddNumberToObject(format, "max_us", e->max_us);
+    }
+
+    // Add _links with action hints
+    cJSON *links = cJSON_AddObjectToObject(root, "_links");
+    cJSON *self = cJSON_AddObjectToObject(links, "self");
+    cJSON_AddStringToObject(self, "href", "/api/system/http");
+    cJSON *up = cJSON_AddObjectToObject(links, "up");
+    cJSON_AddStringToObject(up, "href", "/api/system");
+    cJSON_AddStringToObject(up, "title", "System information");
+
+    return send_json_response(req, root);
+}
+
+// ---- GET /api/system/locks ----
+
+static esp_err_t get_system_locks_handler(httpd_req_t *req, const http_match_t *match) {
+    static lock_stats_t locks[LOCK_PROFILER_MAX];  // Keep off the httpd task stack
+    size_t count = 0;
+    if (lock_profiler_get_stats(locks, LOCK_PROFILER_MAX, &count) == ESP_ERR_NOT_SUPPORTED) {
+        return send_error_response(req, 404,
+                                   "Lock profiling disabled (CONFIG_GEEKHOUSE_LOCK_PROFILING)");
+    }
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON *list = cJSON_AddArrayToObject(root, "locks");
+
+    for (size_t i = 0; i < count; i++) {
+        const lock_stats_t *l = &locks[i];
+        cJSON *lock = cJSON_CreateObject();
+        cJSON_AddStringToObject(lock, "name", l->name);
+        cJSON_AddNumberToObject(lock, "acquires", l->acquires);
+        cJSON_AddNumberToObject(lock, "contended", l->contended);
+        cJSON_AddNumberToObject(lock, "timeouts", l->timeouts);
+        cJSON_AddNumberToObject(lock, "wait_total_us", (double) l->wait_total_us);
+        cJSON_AddNumberToObject(lock, "wait_max_us", l->wait_max_us);
+        cJSON_AddNumberToObject(lock, "hold_total_us", (double) l->hold_total_us);
+        cJSON_AddNumberToObject(lock, "hold_max_us", l->hold_max_us);
+        if (l->timeout_owner[0] != '\0') {
+            cJSON_AddStringToObject(lock, "timeout_owner", l->timeout_owner);
+        }
+        cJSON_AddItemToArray(list, lock);
+    }
+
+    // Add _links with action hints
+    cJSON *links = cJSON_AddObjectToObject(root, "_links");
+    cJSON *self = cJSON_AddObjectToObject(links, "self");
+    cJSON_AddStringToObject(self, "href", "/api/system/locks");
+    cJSON *up = cJSON_AddObjectToObject(links, "up");
+    cJSON_AddStringToObject(up, "href", "/api/system");
+    cJSON_AddStringToObject(up, "title", "System information");
+
+    return send_json_response(req, root);
+}
+
+// ---- GET /api/system/power ----
+
+/**
+ * Add a duration in microseconds with its share of uptime
+ */
+static void add_power_state(cJSON *parent, const char *name, uint64_t us, uint64_t uptime_us) {
+    cJSON *state = cJSON_AddObjectToObject(parent, name);
+    cJSON_AddNumberToObject(state, "us", (double) us);
+    cJSON_AddNumberToObject(state, "percent",
+                            uptime_us ? (double) (us * 10000 / uptime_us) / 100.0 : 0);
+}
+
+static esp_err_t get_system_power_handler(httpd_req_t *req, const http_match_t *match) {
+    power_stats_t stats;
+    if (power_get_stats(&stats) == ESP_ERR_NOT_SUPPORTED) {
+        return send_error_response(req, 404,
+                                   "Power management disabled (CONFIG_GEEKHOUSE_POWER_SAVE)");
+    }
+
+    cJSON *root = cJSON_CreateObject();
+    cJSON *config = cJSON_AddObjectToObject(root, "config");
+    cJSON_AddNumberToObject(config, "max_mhz", stats.max_mhz);
+    cJSON_AddNumberToObject(config, "min_mhz", stats.min_mhz);
+    cJSON_AddNumberToObject(config, "listen_interval", stats.listen_interval);
+
+    cJSON_AddNumberToObject(root, "uptime_us", (double) stats.uptime_us);
+    cJSON *states = cJSON_AddObjectToObject(root, "states");
+    add_power_state(states, "sleep", stats.sleep_us, stats.uptime_us);
+    add_power_state(states, "active", stats.active_us, stats.uptime_us);
+    add_power_state(states, "idle", stats.idle_us, stats.uptime_us);
+
+    cJSON_AddNumberToObject(root, "sleeps", stats.sleeps);
+    cJSON_AddNumberToObject(root, "avg_sleep_us",
+                            stats.sleeps ? (double) (stats.sleep_us / stats.sleeps) : 0);
+    cJSON *wakeups = cJSON_AddObjectToObject(root, "wakeups");
+    for (int i = 0; i < POWER_WAKE_COUNT; i++) {
+        cJSON_AddNumberToObject(wakeups, power_wake_name(i), stats.wakeups[i]);
+    }
+
+    cJSON *locks = cJSON_AddObjectToObject(root, "locks");
+    for (int i = 0; i < POWER_LOCK_COUNT; i++) {
+        cJSON *lock = cJSON_AddObjectToObject(locks, power_lock_name(i));
+        cJSON_AddNumberToObject(lock, "acquires", stats.lock_acquires[i]);
+        cJSON_AddNumberToObject(lock, "held_us", (double) stats.lock_held_us[i]);
+        cJSON_AddNumberToObject(lock, "held_max_us", stats.lock_held_max_us[i]);
+    }
+
+    // Add _links with action hints
+    cJSON *links = cJSON_AddObjectToObject(root, "_links");
+    cJSON *self = cJSON_AddObjectToObject(links, "self");
+    cJSON_AddStringToObject(self, "href", "/api/system/power");
+    cJSON *up = cJSON_AddObjectToObject(links, "up");
+    cJSON_AddStringToObject(up, "href", "/api/system");
+    cJSON_AddStringToObject(up, "title", "System information");
+
+    return send_json_response(req, root);
+}
+
+// ---- GET /api/trace ----
+
+static esp_err_t get_trace_handler(httpd_req_t *req, const http_match_t *match) {
+    httpd_resp_set_type(req, "application/octet-stream");
+    httpd_resp_set_hdr(req, "Content-Disposition", "attachment; filename=\"geekhouse.trace\"");
+
+    esp_err_t ret = trace_dump(send_chunk, req);
+    if (ret == ESP_ERR_NOT_SUPPORTED) {
+        // Nothing has been sent yet, so a JSON error still works
+        return send_error_response(req, 404, "Tracing disabled (CONFIG_GEEKHOUSE_TRACE)");
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Trace dump aborted: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
+// ---- GET /metrics ----
+
+static esp_err_t get_metrics_handler(httpd_req_t *req, const http_match_t *match) {
+    // Streamed straight from the registry in chunks - no full-page buffer
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    esp_err_t ret = metrics_render(send_chunk, req);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Metrics render aborted: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    return httpd_resp_send_chunk(req, NULL, 0);
+}
+
 // ---- URI registration ----
 
+static const route_def_t ROUTES[] = {
+    {HTTP_GET, "/api", get_api_root_handler},
+    {HTTP_GET, "/api/sensors", get_sensors_handler},
+    {HTTP_GET, "/api/sensors/{id:int}", get_sensor_by_id_handler},
+    {HTTP_GET, "/api/sensors/{id:int}/config", get_sensor_config_handler},
+    {HTTP_PUT, "/api/sensors/{id:int}/config", put_sensor_config_handler},
+    {HTTP_GET, "/api/leds", get_leds_handler},
+    {HTTP_POST, "/api/leds", post_leds_handler},
+    {HTTP_POST, "/api/leds/{id:int}", post_led_handler},
+    {HTTP_PUT, "/api/leds/{id:int}", put_led_handler},
+    {HTTP_GET, "/api/rules", get_rules_handler},
+    {HTTP_POST, "/api/rules", post_rules_handler},
+    {HTTP_GET, "/api/config", get_config_handler},
+    {HTTP_PATCH, "/api/config", patch_config_handler},
+    {HTTP_GET, "/api/system", get_system_handler},
+    {HTTP_GET, "/api/system/tasks", get_system_tasks_handler},
+    {HTTP_GET, "/api/system/boot", get_system_boot_handler},
+    {HTTP_GET, "/api/system/http", get_system_http_handler},
+    {HTTP_GET, "/api/system/heap", get_system_heap_handler},
+    {HTTP_GET, "/api/system/locks", get_system_locks_handler},
+    {HTTP_GET, "/api/system/power", get_system_power_handler},
+    {HTTP_GET, "/api/trace", get_trace_handler},
+    {HTTP_GET, "/metrics", get_metrics_handler},
+};
+#define ROUTE_COUNT (sizeof(ROUTES) / sizeof(ROUTES[0]))
+_Static_assert(ROUTE_COUNT <= HTTP_MAX_ROUTES, "Too many routes");
+
+// Methods the router answers (a catch-all httpd handler each), so even a
+// method no route uses gets a JSON 404/405. HEAD is left to httpd: every
+// handler sends a body, which a HEAD response must not have.
+static const httpd_method_t DISPATCH_METHODS[] = {
+    HTTP_GET, HTTP_POST, HTTP_PUT, HTTP_PATCH, HTTP_DELETE, HTTP_OPTIONS,
+};
+#define DISPATCH_METHOD_COUNT (sizeof(DISPATCH_METHODS) / sizeof(DISPATCH_METHODS[0]))
+
+/**
+ * Run a matched route: counts requests and measures latency
+ */
+static esp_err_t route_handler(httpd_req_t *req, const http_match_t *match) {
+    route_metrics_t *route = &s_route_metrics[match->route];
+
+    TRACE_SPAN_BEGIN(TRACE_SPAN_HTTP);
+    power_lock_acquire(POWER_LOCK_HTTP);
+    const char *prev_tag = heap_profiler_set_tag(route->uri);
+    s_response.status = 200;
+    s_response.bytes = 0;
+    s_response.encode_start_us = 0;
+    int64_t start = esp_timer_get_time();
+    esp_err_t ret = route->handler(req, match);
+    heap_profiler_set_tag(prev_tag);
+    power_lock_release(POWER_LOCK_HTTP);
+    TRACE_SPAN_END(TRACE_SPAN_HTTP);
+    uint32_t elapsed_us = (uint32_t) (esp_timer_get_time() - start);
+
+    metrics_inc(route->requests);
+    if (ret != ESP_OK) {
+        metrics_inc(route->errors);
+        // Handlers that fail have sent an error, or lost the socket (counted as a 500)
+        if (s_response.status < 400) {
+            s_response.status = 500;
+        }
+    }
+    metrics_observe(route->latency, elapsed_us);
+
+    route->status[(s_response.status / 100 - 2) & 3]++;
+    route->bytes_sent += s_response.bytes;
+    route->histogram[http_hist_index(elapsed_us)]++;
+    if (elapsed_us > route->max_us) {
+        route->max_us = elapsed_us;
+    }
+    return ret;
+}
+
+/**
+ * Catch-all httpd handler: looks the request up in the router
+ *
+ * Unknown paths get 404, known paths with another method 405 with an
+ * Allow header, malformed query strings 400 and connections over the
+ * per-client limit 503. None of these count towards a route.
+ */
+static esp_err_t dispatch_handler(httpd_req_t *req) {
+    http_match_t match;
+    esp_err_t ret = http_router_match(&s_router, req->method, req->uri, &match);
+    s_match = &match;
+
+    if (!http_session_touch(req)) {
+        ret = send_error_response(req, 503, "Too many connections from this client");
+    } else if (ret == ESP_OK) {
+        ret = route_handler(req, &match);
+    } else if (ret == ESP_ERR_NOT_FOUND) {
+        ret = send_error_response(req, 404, "Not found");
+    } else if (ret == ESP_ERR_NOT_SUPPORTED) {
+        char allow[40] = "";
+        for (int r = match.route; r >= 0; r = http_router_next_method(&s_router, r)) {
+            size_t len = strlen(allow);
+            snprintf(allow + len, sizeof(allow) - len, "%s%s", len > 0 ? ", " : "",
+                     http_method_str(ROUTES[r].method));
+        }
+        httpd_resp_set_hdr(req, "Allow", allow);
+        ret = send_error_response(req, 405, "Method not allowed");
+    } else {
+        match.query.count = 0;  // Don't let wants_cbor() read a half-parsed query
+        ret = send_error_response(req, 400, "Malformed query string");
+    }
+
+    s_match = NULL;
+    return ret;
+}
+
+/**
+ * httpd URI matcher for the catch-all handlers: every URI matches
+ */
+static bool match_any_uri(const char *reference_uri, const char *uri_to_match, size_t match_upto) {
+    return true;
+}
+
+/**
+ * Register request metrics for all routes
+ *
+ * One loop per metric name, so each family stays contiguous in the registry.
+ * Only done once - the server may be restarted, the registry can't shrink.
+ */
+static void register_route_metrics(void) {
+    if (s_route_metrics_registered) {
+        return;
+    }
+    s_route_metrics_registered = true;
+
+    for (size_t i = 0; i < ROUTE_COUNT; i++) {
+        snprintf(s_route_metrics[i].labels, sizeof(s_route_metrics[i].labels),
+                 "route=\"%s\",method=\"%s\"", ROUTES[i].pattern,
+                 http_method_str(ROUTES[i].method));
+    }
+    for (size_t i = 0; i < ROUTE_COUNT; i++) {
+        s_route_metrics[i].requests = metrics_counter(
+            "geekhouse_http_requests_total", s_route_metrics[i].labels, "HTTP requests handled");
+    }
+    for (size_t i = 0; i < ROUTE_COUNT; i++) {
+        s_route_metrics[i].errors =
+            metrics_counter("geekhouse_http_request_errors_total", s_route_metrics[i].labels,
+                            "HTTP requests whose handler failed");
+    }
+    for (size_t i = 0; i < ROUTE_COUNT; i++) {
+        s_route_metrics[i].latency = metrics_histogram(
+            "geekhouse_http_request_duration_us", s_route_metrics[i].labels,
+            "HTTP handler latency", HTTP_LATENCY_BOUNDS_US,
+            sizeof(HTTP_LATENCY_BOUNDS_US) / sizeof(HTTP_LATENCY_BOUNDS_US[0]));
+    }
+
+    static const char *const FORMAT_LABELS[HTTP_FORMAT_COUNT] = {"format=\"json\"",
+                                                                "format=\"cbor\""};
+    for (int f = 0; f < HTTP_FORMAT_COUNT; f++) {
+        s_encode_stats[f].duration =
+            metrics_histogram("geekhouse_http_encode_us", FORMAT_LABELS[f],
+                              "Response body encode time", HTTP_ENCODE_BOUNDS_US,
+                              sizeof(HTTP_ENCODE_BOUNDS_US) / sizeof(HTTP_ENCODE_BOUNDS_US[0]));
+    }
+}
+
+/**
+ * Compile the route table into the router
+ */
+static esp_err_t build_router(void) {
+    http_router_init(&s_router);
+    for (size_t i = 0; i < ROUTE_COUNT; i++) {
+        size_t m = 0;
+        while (m < DISPATCH_METHOD_COUNT && DISPATCH_METHODS[m] != ROUTES[i].method) {
+            m++;
+        }
+        esp_err_t ret = m < DISPATCH_METHOD_COUNT
+                            ? http_router_add(&s_router, ROUTES[i].method, ROUTES[i].pattern)
+                            : ESP_ERR_NOT_SUPPORTED;  // Would never be dispatched
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Bad route %s %s: %s", http_method_str(ROUTES[i].method),
+                     ROUTES[i].pattern, esp_err_to_name(ret));
+            return ret;
+        }
+        s_route_metrics[i].handler = ROUTES[i].handler;
+        s_route_metrics[i].uri = ROUTES[i].pattern;
+        s_route_metrics[i].method = ROUTES[i].method;
+    }
+    s_route_count = ROUTE_COUNT;
+    return ESP_OK;
+}
+
 esp_err_t http_server_start(void) {
+    if (s_server) {
+        return ESP_OK;  // Already running
+    }
+
+    esp_err_t ret = build_router();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    register_route_metrics();
+
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.uri_match_fn = httpd_uri_match_wildcard;
+    config.uri_match_fn = match_any_uri;
+    config.max_uri_handlers = DISPATCH_METHOD_COUNT;
+    config.stack_size = HTTP_TASK_STACK;
+    http_session_configure(&config);
 
     ESP_LOGI(TAG, "Starting HTTP server on port %d", config.server_port);
-    esp_err_t ret = httpd_start(&s_server, &config);
+    ret = httpd_start(&s_server, &config);
     if (ret != ESP_OK) {
         ESP_LOGE(TAG, "Failed to start HTTP server: %s", esp_err_to_name(ret));
         return ret;
     }
 
-    // Register URI handlers
-    const httpd_uri_t uris[] = {
-        {
-            .uri = "/api",
-            .method = HTTP_GET,
-            .handler = get_api_root_handler,
-        },
-        {
-            .uri = "/api/sensors",
-            .method = HTTP_GET,
-            .handler = get_sensors_handler,
-        },
-        {
-            .uri = "/api/sensors/*",
-            .method = HTTP_GET,
-            .handler = get_sensor_by_id_handler,
-        },
-        {
-            .uri = "/api/leds",
-            .method = HTTP_GET,
-            .handler = get_leds_handler,
-        },
-        {
-            .uri = "/api/leds/*",
-            .method = HTTP_POST,
-            .handler = post_led_handler,
-        },
-        {
-            .uri = "/api/system",
-            .method = HTTP_GET,
-            .handler = get_system_handler,
-        },
-    };
-
-    for (int i = 0; i < sizeof(uris) / sizeof(uris[0]); i++) {
-        httpd_register_uri_handler(s_server, &uris[i]);
-    }
-
-    ESP_LOGI(TAG, "HTTP server started with %d endpoints", (int) (sizeof(uris) / sizeof(uris[0])));
+    // One catch-all handler per answered method
+    for (size_t m = 0; m < DISPATCH_METHOD_COUNT; m++) {
+        httpd_uri_t uri = {
+            .uri = "/*",
+            .method = DISPATCH_METHODS[m],
+            .handler = dispatch_handler,
+        };
+        httpd_register_uri_handler(s_server, &uri);
+    }
+
+    ESP_LOGI(TAG, "HTTP server started with %d endpoints (%d nodes)", (int) ROUTE_COUNT,
+             s_router.node_count);
     return ESP_OK;
 }
 
@@ -0,0 +1,265 @@
+#include "http_session.h"
+
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "lwip/sockets.h"
+#include "metrics.h"
+#include "sdkconfig.h"
+
+static const char *TAG = "HTTP_SESS";
+
+// lwIP sockets the pool must leave to others: httpd's listening and
+// control sockets, one spare (as httpd requires), and the MQTT client
+#ifdef CONFIG_GEEKHOUSE_MQTT
+#define HTTP_SESSION_OTHER_SOCKETS 4
+#else
+#define HTTP_SESSION_OTHER_SOCKETS 3
+#endif
+
+#define HTTP_SESSION_LWIP_SOCKETS (CONFIG_LWIP_MAX_SOCKETS - HTTP_SESSION_OTHER_SOCKETS)
+#define HTTP_SESSION_MAX_SOCKETS                                                                   \
+    (CONFIG_GEEKHOUSE_HTTP_MAX_SOCKETS < HTTP_SESSION_LWIP_SOCKETS                                 \
+         ? CONFIG_GEEKHOUSE_HTTP_MAX_SOCKETS                                                       \
+         : HTTP_SESSION_LWIP_SOCKETS)
+
+#if HTTP_SESSION_LWIP_SOCKETS < HTTP_SESSION_MIN_SOCKETS
+#error "CONFIG_LWIP_MAX_SOCKETS leaves too few sockets for the HTTP server"
+#endif
+
+// One open connection
+// Only touched from the httpd task (open/close callbacks and handlers).
+typedef struct {
+    int fd;             // -1 if the slot is free
+    bool closing;       // Close requested (idle or refused)
+    bool refused;       // Over the per-client limit, never served
+    uint8_t addr[16];   // Client address (IPv4 as v4-mapped IPv6)
+    int64_t last_us;    // Last request (or the connect)
+} http_session_t;
+
+static http_session_t s_sessions[HTTP_SESSION_MAX_SOCKETS];
+
+// Statistics, guarded by s_stats_mux
+static http_session_stats_t s_stats;
+static portMUX_TYPE s_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static bool s_metrics_registered = false;
+
+/**
+ * Get the client address of a socket
+ */
+static void peer_address(int fd, uint8_t addr[16]) {
+    memset(addr, 0, 16);
+    struct sockaddr_storage peer;
+    socklen_t len = sizeof(peer);
+    if (getpeername(fd, (struct sockaddr *) &peer, &len) != 0) {
+        return;
+    }
+    if (peer.ss_family == AF_INET) {
+        addr[10] = 0xff;
+        addr[11] = 0xff;
+        memcpy(&addr[12], &((struct sockaddr_in *) &peer)->sin_addr, 4);
+    }
+#ifdef CONFIG_LWIP_IPV6
+    else if (peer.ss_family == AF_INET6) {
+        memcpy(addr, &((struct sockaddr_in6 *) &peer)->sin6_addr, 16);
+    }
+#endif
+}
+
+static http_session_t *find_session(int fd) {
+    for (int i = 0; i < HTTP_SESSION_MAX_SOCKETS; i++) {
+        if (s_sessions[i].fd == fd) {
+            return &s_sessions[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Ask httpd to close sessions idle for longer than the timeout
+ *
+ * @param except Socket of the caller's own session (not closed)
+ */
+static void close_idle_sessions(httpd_handle_t hd, int64_t now, int except) {
+#if CONFIG_GEEKHOUSE_HTTP_IDLE_TIMEOUT_S > 0
+    const int64_t timeout_us = (int64_t) CONFIG_GEEKHOUSE_HTTP_IDLE_TIMEOUT_S * 1000000;
+    for (int i = 0; i < HTTP_SESSION_MAX_SOCKETS; i++) {
+        http_session_t *s = &s_sessions[i];
+        if (s->fd >= 0 && s->fd != except && !s->closing && now - s->last_us > timeout_us) {
+            if (httpd_sess_trigger_close(hd, s->fd) == ESP_OK) {
+                s->closing = true;
+            }
+        }
+    }
+#endif
+}
+
+/**
+ * httpd open callback: admit the connection unless its client has too many
+ *
+ * Refused connections are closed through httpd rather than by failing
+ * here, so the socket is closed exactly once, by session_close().
+ */
+static esp_err_t session_open(httpd_handle_t hd, int fd) {
+    int64_t now = esp_timer_get_time();
+    close_idle_sessions(hd, now, fd);
+
+    uint8_t addr[16];
+    peer_address(fd, addr);
+    http_session_t *slot = NULL;
+    int same_client = 0;
+    for (int i = 0; i < HTTP_SESSION_MAX_SOCKETS; i++) {
+        http_session_t *s = &s_sessions[i];
+        if (s->fd < 0) {
+            slot = slot != NULL ? slot : s;
+        } else if (!s->closing && memcmp(s->addr, addr, sizeof(addr)) == 0) {
+            same_client++;
+        }
+    }
+
+    bool refused = same_client >= CONFIG_GEEKHOUSE_HTTP_SOCKETS_PER_CLIENT;
+    if (slot != NULL) {
+        slot->fd = fd;
+        slot->closing = refused;
+        slot->refused = refused;
+        slot->last_us = now;
+        memcpy(slot->addr, addr, sizeof(addr));
+    }
+    if (refused || slot == NULL) {
+        httpd_sess_trigger_close(hd, fd);
+        portENTER_CRITICAL(&s_stats_mux);
+        s_stats.rejected++;
+        portEXIT_CRITICAL(&s_stats_mux);
+        return ESP_OK;
+    }
+
+    portENTER_CRITICAL(&s_stats_mux);
+    s_stats.accepted++;
+    s_stats.open++;
+    if (s_stats.open > s_stats.peak_open) {
+        s_stats.peak_open = s_stats.open;
+    }
+    portEXIT_CRITICAL(&s_stats_mux);
+    return ESP_OK;
+}
+
+/**
+ * httpd close callback (with a close_fn set, closing the socket is ours)
+ */
+static void session_close(httpd_handle_t hd, int fd) {
+    http_session_t *s = find_session(fd);
+    if (s != NULL && !s->refused) {
+        portENTER_CRITICAL(&s_stats_mux);
+        s_stats.open--;
+        s_stats.closed++;
+        if (s->closing) {
+            s_stats.idle_closed++;
+        }
+        portEXIT_CRITICAL(&s_stats_mux);
+    }
+    if (s != NULL) {
+        s->fd = -1;
+    }
+    close(fd);
+}
+
+/**
+ * Metrics collector: connection pool and admissions
+ */
+static void session_collector(metrics_writer_t *w, void *arg) {
+    (void) arg;
+    http_session_stats_t stats;
+    http_session_get_stats(&stats);
+
+    metrics_write_family(w, "geekhouse_http_connections", METRIC_GAUGE, "Open HTTP sessions");
+    metrics_write_sample(w, "geekhouse_http_connections", NULL, stats.open);
+    metrics_write_family(w, "geekhouse_http_connections_max", METRIC_GAUGE,
+                         "HTTP socket pool size");
+    metrics_write_sample(w, "geekhouse_http_connections_max", NULL, stats.max_sockets);
+    metrics_write_family(w, "geekhouse_http_connections_accepted_total", METRIC_COUNTER,
+                         "HTTP connections accepted");
+    metrics_write_sample(w, "geekhouse_http_connections_accepted_total", NULL, stats.accepted);
+    metrics_write_family(w, "geekhouse_http_connections_rejected_total", METRIC_COUNTER,
+                         "HTTP connections refused by the per-client limit");
+    metrics_write_sample(w, "geekhouse_http_connections_rejected_total", NULL, stats.rejected);
+    metrics_write_family(w, "geekhouse_http_connections_idle_closed_total", METRIC_COUNTER,
+                         "HTTP sessions closed by the idle timeout");
+    metrics_write_sample(w, "geekhouse_http_connections_idle_closed_total", NULL,
+                         stats.idle_closed);
+}
+
+void http_session_configure(httpd_config_t *config) {
+    size_t free_bytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    size_t reserve = (size_t) CONFIG_GEEKHOUSE_HTTP_HEAP_RESERVE_KB * 1024;
+    size_t by_heap = free_bytes > reserve ? (free_bytes - reserve) / HTTP_SESSION_HEAP_COST : 0;
+    uint16_t sockets = by_heap < HTTP_SESSION_MAX_SOCKETS ? (uint16_t) by_heap
+                                                          : HTTP_SESSION_MAX_SOCKETS;
+    if (sockets < HTTP_SESSION_MIN_SOCKETS) {
+        ESP_LOGW(TAG, "Only %u bytes free, using %d sockets anyway", (unsigned) free_bytes,
+                 HTTP_SESSION_MIN_SOCKETS);
+        sockets = HTTP_SESSION_MIN_SOCKETS;
+    }
+
+    config->max_open_sockets = sockets;
+    config->backlog_conn = HTTP_SESSION_BACKLOG;
+    config->lru_purge_enable = true;
+    config->recv_wait_timeout = HTTP_SESSION_IO_TIMEOUT_S;
+    config->send_wait_timeout = HTTP_SESSION_IO_TIMEOUT_S;
+    config->keep_alive_enable = true;
+    config->keep_alive_idle = HTTP_SESSION_KEEPALIVE_S;
+    config->keep_alive_interval = HTTP_SESSION_PROBE_S;
+    config->keep_alive_count = HTTP_SESSION_PROBES;
+    config->open_fn = session_open;
+    config->close_fn = session_close;
+
+    // A restarted server starts with no sessions
+    for (int i = 0; i < HTTP_SESSION_MAX_SOCKETS; i++) {
+        s_sessions[i].fd = -1;
+    }
+    portENTER_CRITICAL(&s_stats_mux);
+    s_stats.max_sockets = sockets;
+    s_stats.open = 0;
+    portEXIT_CRITICAL(&s_stats_mux);
+
+    if (!s_metrics_registered) {
+        s_metrics_registered = true;
+        metrics_register_collector(session_collector, NULL);
+    }
+    ESP_LOGI(TAG, "%d sockets (%u bytes free, at most %d), %d per client, idle timeout %d s",
+             sockets, (unsigned) free_bytes, HTTP_SESSION_MAX_SOCKETS,
+             CONFIG_GEEKHOUSE_HTTP_SOCKETS_PER_CLIENT, CONFIG_GEEKHOUSE_HTTP_IDLE_TIMEOUT_S);
+}
+
+bool http_session_touch(httpd_req_t *req) {
+    int fd = httpd_req_to_sockfd(req);
+    int64_t now = esp_timer_get_time();
+    http_session_t *s = find_session(fd);
+    if (s != NULL && s->refused) {
+        return false;  // A request that beat the close
+    }
+    if (s != NULL) {
+        s->last_us = now;
+    }
+    close_idle_sessions(req->handle, now, fd);
+
+    portENTER_CRITICAL(&s_stats_mux);
+    s_stats.requests++;
+    portEXIT_CRITICAL(&s_stats_mux);
+    return true;
+}
+
+esp_err_t http_session_get_stats(http_session_stats_t *stats) {
+    if (stats == NULL) {
+        ESP_LOGE(TAG, "Invalid argument: stats is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_stats_mux);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_mux);
+    return ESP_OK;
+}
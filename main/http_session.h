@@ -0,0 +1,77 @@
+#ifndef HTTP_SESSION_H
+#define HTTP_SESSION_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+// HTTP server connection profile
+//
+// http_session_configure() tunes the httpd configuration for several
+// dashboards holding keep-alive connections at once:
+//   - Socket pool sized from the free heap at start: what is left after
+//     CONFIG_GEEKHOUSE_HTTP_HEAP_RESERVE_KB, at HTTP_SESSION_HEAP_COST per
+//     connection, between HTTP_SESSION_MIN_SOCKETS and
+//     CONFIG_GEEKHOUSE_HTTP_MAX_SOCKETS, and never more than lwIP has left
+//   - LRU purge: a new connection to a full pool closes the least recently
+//     used session instead of waiting in the backlog
+//   - TCP keep-alive probes, so sessions of vanished clients get closed
+//   - Sessions idle for CONFIG_GEEKHOUSE_HTTP_IDLE_TIMEOUT_S are closed at
+//     the next connection or request (no timer, so nothing wakes the CPU
+//     while the server is idle)
+//   - Fairness: httpd serves ready sockets in turn, one request each, so a
+//     client's share is bounded by its connections. Each client address
+//     may hold CONFIG_GEEKHOUSE_HTTP_SOCKETS_PER_CLIENT; more are refused.
+//     Socket timeouts of HTTP_SESSION_IO_TIMEOUT_S bound how long a stalled
+//     client can hold the server task.
+
+#define HTTP_SESSION_MIN_SOCKETS  3
+#define HTTP_SESSION_HEAP_COST    6144  // Per connection: PCB, session, TCP buffers
+#define HTTP_SESSION_BACKLOG      8     // Pending connections in the listen queue
+#define HTTP_SESSION_IO_TIMEOUT_S 3     // recv/send wait per call
+#define HTTP_SESSION_KEEPALIVE_S  10    // TCP keep-alive: idle before the first probe,
+#define HTTP_SESSION_PROBE_S      5     // then probe every 5 s,
+#define HTTP_SESSION_PROBES       3     // and close after 3 unanswered
+
+// Connection statistics
+typedef struct {
+    uint16_t max_sockets;   // Pool size chosen at start
+    uint16_t open;          // Sessions now
+    uint16_t peak_open;     // Most sessions at once
+    uint32_t accepted;      // Connections accepted
+    uint32_t rejected;      // Refused: client over its connection limit
+    uint32_t closed;        // Sessions ended, by either side or LRU purge
+    uint32_t idle_closed;   // Of these, closed by the idle timeout
+    uint32_t requests;      // Requests dispatched
+} http_session_stats_t;
+
+/**
+ * Fill in the connection profile of an httpd configuration
+ *
+ * Sizes the socket pool from the heap free right now, so call it just
+ * before httpd_start().
+ *
+ * @param config Configuration (from HTTPD_DEFAULT_CONFIG())
+ */
+void http_session_configure(httpd_config_t *config);
+
+/**
+ * Account for a request and close sessions that have been idle too long
+ *
+ * Call from the httpd task at the start of every request.
+ *
+ * @return false if the connection was refused (answer 503; it is being closed)
+ */
+bool http_session_touch(httpd_req_t *req);
+
+/**
+ * Get connection statistics
+ *
+ * @param[out] stats Statistics
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t http_session_get_stats(http_session_stats_t *stats);
+
+#endif  // HTTP_SESSION_H
@@ -0,0 +1,138 @@
+#include "lock_profiler.h"
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+static const char *TAG = "LOCK_PROF";
+
+#ifdef CONFIG_GEEKHOUSE_LOCK_PROFILING
+
+// Registry of profiled mutexes (append-only)
+static profiled_mutex_t *s_locks[LOCK_PROFILER_MAX];
+static size_t s_lock_count = 0;
+
+// Guards every lock_stats_t update and copy. Failed takes update stats
+// without holding the mutex, and readers must not see half-written 64-bit
+// totals, so a short critical section beats another mutex here.
+static portMUX_TYPE s_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t profiled_mutex_init(profiled_mutex_t *m, const char *name) {
+    if (m == NULL || name == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(m, 0, sizeof(*m));
+    m->stats.name = name;
+    m->sem = xSemaphoreCreateMutex();
+    if (m->sem == NULL) {
+        ESP_LOGE(TAG, "Failed to create mutex %s", name);
+        return ESP_ERR_NO_MEM;
+    }
+
+    portENTER_CRITICAL(&s_stats_mux);
+    bool registered = s_lock_count < LOCK_PROFILER_MAX;
+    if (registered) {
+        s_locks[s_lock_count++] = m;
+    }
+    portEXIT_CRITICAL(&s_stats_mux);
+
+    // Still usable as a plain mutex, just not reported
+    if (!registered) {
+        ESP_LOGW(TAG, "Registry full, %s is not profiled", name);
+    }
+    return ESP_OK;
+}
+
+BaseType_t profiled_mutex_take(profiled_mutex_t *m, TickType_t timeout) {
+    // Fast path: free mutex, no timestamps needed for the wait
+    if (xSemaphoreTake(m->sem, 0) == pdTRUE) {
+        m->taken_at = esp_timer_get_time();
+        portENTER_CRITICAL(&s_stats_mux);
+        m->stats.acquires++;
+        portEXIT_CRITICAL(&s_stats_mux);
+        return pdTRUE;
+    }
+
+    int64_t start = esp_timer_get_time();
+    if (timeout > 0 && xSemaphoreTake(m->sem, timeout) == pdTRUE) {
+        int64_t now = esp_timer_get_time();
+        uint32_t wait_us = (uint32_t) (now - start);
+        m->taken_at = now;
+        portENTER_CRITICAL(&s_stats_mux);
+        m->stats.acquires++;
+        m->stats.contended++;
+        m->stats.wait_total_us += wait_us;
+        if (wait_us > m->stats.wait_max_us) {
+            m->stats.wait_max_us = wait_us;
+        }
+        portEXIT_CRITICAL(&s_stats_mux);
+        return pdTRUE;
+    }
+
+    // Timed out: whoever holds it now is the likely culprit
+    TaskHandle_t holder = xSemaphoreGetMutexHolder(m->sem);
+    const char *owner = holder != NULL ? pcTaskGetName(holder) : "";
+    uint32_t wait_us = (uint32_t) (esp_timer_get_time() - start);
+
+    portENTER_CRITICAL(&s_stats_mux);
+    m->stats.contended++;
+    m->stats.timeouts++;
+    m->stats.wait_total_us += wait_us;
+    if (wait_us > m->stats.wait_max_us) {
+        m->stats.wait_max_us = wait_us;
+    }
+    strncpy(m->stats.timeout_owner, owner, sizeof(m->stats.timeout_owner) - 1);
+    portEXIT_CRITICAL(&s_stats_mux);
+
+    ESP_LOGW(TAG, "%s: timed out after %lu us, held by %s", m->stats.name, wait_us,
+             owner[0] != '\0' ? owner : "(none)");
+    return pdFALSE;
+}
+
+void profiled_mutex_give(profiled_mutex_t *m) {
+    uint32_t hold_us = (uint32_t) (esp_timer_get_time() - m->taken_at);
+
+    // Update before giving: we still own the mutex, so taken_at is ours
+    portENTER_CRITICAL(&s_stats_mux);
+    m->stats.hold_total_us += hold_us;
+    if (hold_us > m->stats.hold_max_us) {
+        m->stats.hold_max_us = hold_us;
+    }
+    portEXIT_CRITICAL(&s_stats_mux);
+
+    xSemaphoreGive(m->sem);
+}
+
+esp_err_t lock_profiler_get_stats(lock_stats_t *stats, size_t max, size_t *count) {
+    if (stats == NULL || count == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_stats_mux);
+    size_t n = s_lock_count < max ? s_lock_count : max;
+    for (size_t i = 0; i < n; i++) {
+        stats[i] = s_locks[i]->stats;
+    }
+    portEXIT_CRITICAL(&s_stats_mux);
+
+    *count = n;
+    return ESP_OK;
+}
+
+#else  // CONFIG_GEEKHOUSE_LOCK_PROFILING
+
+esp_err_t lock_profiler_get_stats(lock_stats_t *stats, size_t max, size_t *count) {
+    (void) stats;
+    (void) max;
+    if (count != NULL) {
+        *count = 0;
+    }
+    ESP_LOGD(TAG, "Lock profiling disabled (CONFIG_GEEKHOUSE_LOCK_PROFILING)");
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif  // CONFIG_GEEKHOUSE_LOCK_PROFILING
@@ -0,0 +1,99 @@
+#ifndef LOCK_PROFILER_H
+#define LOCK_PROFILER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
+
+// Mutex contention profiling (CONFIG_GEEKHOUSE_LOCK_PROFILING)
+//
+// profiled_mutex_t wraps a FreeRTOS mutex. With profiling enabled every
+// take/give records acquire count, contention, wait and hold times, and the
+// task holding the lock when a take times out. With profiling disabled the
+// wrappers are inline and compile to the bare xSemaphore* calls.
+
+#define LOCK_PROFILER_MAX 8  // Profiled mutexes in the registry
+
+// Per-mutex statistics (cumulative since boot)
+typedef struct {
+    const char *name;
+    uint32_t acquires;       // Successful takes
+    uint32_t contended;      // Takes that found the mutex held and had to wait
+    uint32_t timeouts;       // Takes that gave up
+    uint64_t wait_total_us;  // Time spent waiting by contended takes
+    uint32_t wait_max_us;
+    uint64_t hold_total_us;  // Time between take and give
+    uint32_t hold_max_us;
+    char timeout_owner[configMAX_TASK_NAME_LEN];  // Holder at the last timeout ("" if none)
+} lock_stats_t;
+
+#ifdef CONFIG_GEEKHOUSE_LOCK_PROFILING
+
+typedef struct {
+    SemaphoreHandle_t sem;
+    int64_t taken_at;  // Set by the holder
+    lock_stats_t stats;
+} profiled_mutex_t;
+
+/**
+ * Create the mutex and add it to the profiler registry
+ *
+ * @param m Mutex to initialize (must be static - the registry keeps the pointer)
+ * @param name Name shown in reports (must be a string literal)
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the mutex can't be created
+ */
+esp_err_t profiled_mutex_init(profiled_mutex_t *m, const char *name);
+
+/**
+ * Take the mutex, recording wait time and contention
+ *
+ * @param m Mutex
+ * @param timeout Ticks to wait
+ * @return pdTRUE if taken, pdFALSE on timeout (the holder is logged)
+ */
+BaseType_t profiled_mutex_take(profiled_mutex_t *m, TickType_t timeout);
+
+/**
+ * Give the mutex, recording hold time
+ *
+ * @param m Mutex (must be held by the calling task)
+ */
+void profiled_mutex_give(profiled_mutex_t *m);
+
+#else
+
+typedef struct {
+    SemaphoreHandle_t sem;
+} profiled_mutex_t;
+
+static inline esp_err_t profiled_mutex_init(profiled_mutex_t *m, const char *name) {
+    (void) name;
+    m->sem = xSemaphoreCreateMutex();
+    return m->sem != NULL ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+static inline BaseType_t profiled_mutex_take(profiled_mutex_t *m, TickType_t timeout) {
+    return xSemaphoreTake(m->sem, timeout);
+}
+
+static inline void profiled_mutex_give(profiled_mutex_t *m) {
+    xSemaphoreGive(m->sem);
+}
+
+#endif  // CONFIG_GEEKHOUSE_LOCK_PROFILING
+
+/**
+ * Copy statistics of all profiled mutexes
+ *
+ * @param[out] stats Buffer for statistics
+ * @param max Buffer capacity
+ * @param[out] count Number of entries copied
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if profiling is disabled
+ */
+esp_err_t lock_profiler_get_stats(lock_stats_t *stats, size_t max, size_t *count);
+
+#endif  // LOCK_PROFILER_H
@@ -1,24 +1,37 @@
 #include "actuators.h"
+#include "boot.h"
 #include "display_task.h"
+#include "duty_cycle.h"
 #include "esp_err.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
 #include "freertos/projdefs.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
 #include "freertos/timers.h"
+#include "heap_profiler.h"
+#include "metrics.h"
+#include "mqtt_commands.h"
+#include "mqtt_publisher.h"
 #include "network_task.h"
 #include "nvs_flash.h"
+#include "power.h"
 #include "reporter_task.h"
+#include "rules.h"
 #include "sensor_data_shared.h"
 #include "sensor_task.h"
 #include "sensors.h"
+#include "settings.h"
 #include "stats_task.h"
+#include "trace.h"
 #include "wifi_config.h"
 #include "wifi_manager.h"
 
 static const char *TAG = "MAIN";
 
+#define ACTUATOR_TASK_STACK    2048
+#define ACTUATOR_TASK_PRIORITY 6
 #define SENSOR_TASK_STACK      2048
 #define SENSOR_TASK_PRIORITY   5
 #define REPORTER_TASK_STACK    2048
@@ -29,73 +42,181 @@ static const char *TAG = "MAIN";
 #define STATS_TASK_PRIORITY    2
 #define NETWORK_TASK_STACK     4096
 #define NETWORK_TASK_PRIORITY  2
+#define SETTINGS_TASK_STACK    3072
+#define SETTINGS_TASK_PRIORITY 1
+#ifdef CONFIG_GEEKHOUSE_MQTT
+#define MQTT_TASK_STACK        3072
+#define MQTT_TASK_PRIORITY     3
+#define MQTT_CMD_TASK_STACK    3072
+#define MQTT_CMD_TASK_PRIORITY 5
+#define MQTT_TASK_COUNT        2
+#else
+#define MQTT_TASK_STACK     0
+#define MQTT_CMD_TASK_STACK 0
+#define MQTT_TASK_COUNT     0
+#endif
+
+#define APP_TASK_COUNT (7 + MQTT_TASK_COUNT)
+#define APP_TASK_STACK_TOTAL                                                                 \
+    (ACTUATOR_TASK_STACK + SENSOR_TASK_STACK + REPORTER_TASK_STACK + DISPLAY_TASK_STACK + \
+     STATS_TASK_STACK + NETWORK_TASK_STACK + SETTINGS_TASK_STACK + MQTT_TASK_STACK +       \
+     MQTT_CMD_TASK_STACK)
+
+#define SENSOR_QUEUE_LENGTH 10
 
 // Task handles (non-static so other files can access them via extern)
+TaskHandle_t actuator_task_handle = NULL;
 TaskHandle_t sensor_task_handle = NULL;
 TaskHandle_t display_task_handle = NULL;
 TaskHandle_t stats_task_handle = NULL;
 TaskHandle_t reporter_task_handle = NULL;
 TaskHandle_t network_task_handle = NULL;
+TaskHandle_t settings_task_handle = NULL;
+TaskHandle_t mqtt_task_handle = NULL;
+TaskHandle_t mqtt_cmd_task_handle = NULL;
 
-void app_main(void) {
-    ESP_LOGI(TAG, "");
-    ESP_LOGI(TAG, "=== Geekhouse FreeRTOS version ===");
-    ESP_LOGI(TAG, "");
+#ifdef CONFIG_GEEKHOUSE_STATIC_TASKS
+// Static arena for our tasks, the sensor queue and the event group
+// Sized at compile time from the *_TASK_STACK values above, so the RAM they
+// use shows up in the link map and creating them never touches the heap.
+// ESP-IDF stack sizes are in bytes (StackType_t is uint8_t).
+static StackType_t s_stack_arena[APP_TASK_STACK_TOTAL] __attribute__((aligned(16)));
+static StaticTask_t s_task_tcbs[APP_TASK_COUNT];
+static size_t s_stack_used = 0;
+static size_t s_tasks_used = 0;
+
+static uint8_t s_sensor_queue_storage[SENSOR_QUEUE_LENGTH * sizeof(sensor_reading_t)];
+static StaticQueue_t s_sensor_queue_buf;
+static StaticEventGroup_t s_sensor_events_buf;
+#endif
 
-    // Initialize NVS (must be before wifi_config_init)
+/**
+ * Create one of our tasks and report its stack size to stats_task
+ *
+ * With CONFIG_GEEKHOUSE_STATIC_TASKS the stack and TCB are carved from the
+ * static arena instead of the heap.
+ *
+ * @return pdPASS on success
+ */
+static BaseType_t create_task(TaskFunction_t fn, const char *name, uint32_t stack, void *param,
+                              UBaseType_t priority, TaskHandle_t *handle) {
+#ifdef CONFIG_GEEKHOUSE_STATIC_TASKS
+    if (s_tasks_used >= APP_TASK_COUNT || s_stack_used + stack > sizeof(s_stack_arena)) {
+        ESP_LOGE(TAG, "Static task arena exhausted (%s)", name);
+        return pdFAIL;
+    }
+    *handle = xTaskCreateStatic(fn, name, stack, param, priority, &s_stack_arena[s_stack_used],
+                                &s_task_tcbs[s_tasks_used]);
+    if (*handle == NULL) {
+        return pdFAIL;
+    }
+    s_stack_used += stack;
+    s_tasks_used++;
+#else
+    if (xTaskCreate(fn, name, stack, param, priority, handle) != pdPASS) {
+        return pdFAIL;
+    }
+#endif
+    stats_set_stack_size(*handle, stack);
+    return pdPASS;
+}
+
+/**
+ * Metrics collector: sensor queue fill level
+ */
+static void queue_metrics_collector(metrics_writer_t *w, void *arg) {
+    QueueHandle_t queue = (QueueHandle_t) arg;
+
+    metrics_write_family(w, "geekhouse_queue_depth", METRIC_GAUGE, "Items waiting in a queue");
+    metrics_write_sample(w, "geekhouse_queue_depth", "queue=\"sensor\"",
+                         uxQueueMessagesWaiting(queue));
+    metrics_write_family(w, "geekhouse_queue_free", METRIC_GAUGE, "Free slots in a queue");
+    metrics_write_sample(w, "geekhouse_queue_free", "queue=\"sensor\"",
+                         uxQueueSpacesAvailable(queue));
+}
+
+// ===== Init steps =====
+// Each step is one node of the boot graph in app_main(). Steps with no
+// path between them may run at the same time on different workers.
+
+/**
+ * Initialize NVS (must be before settings_init, sensor_init and rules_init)
+ */
+static esp_err_t init_nvs(void) {
     ESP_LOGI(TAG, "Initializing NVS flash...");
-    esp_err_t ret_nvs = nvs_flash_init();
-    if (ret_nvs == ESP_ERR_NVS_NO_FREE_PAGES || ret_nvs == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         // NVS partition was corrupted or wrong version - erase and retry
         ESP_LOGW(TAG, "NVS corrupted, erasing...");
-        ESP_ERROR_CHECK(nvs_flash_erase());
-        ret_nvs = nvs_flash_init();
+        ret = nvs_flash_erase();
+        if (ret == ESP_OK) {
+            ret = nvs_flash_init();
+        }
     }
-    ESP_ERROR_CHECK(ret_nvs);
+    return ret;
+}
 
-    // Initialize WiFi configuration from NVS
-    ESP_LOGI(TAG, "Initializing WiFi configuration...");
-    ESP_ERROR_CHECK(wifi_config_init());
+/**
+ * Load settings (WiFi credentials among them) from NVS
+ */
+static esp_err_t init_settings(void) {
+    ESP_LOGI(TAG, "Loading settings...");
+    esp_err_t ret = settings_init();
+    if (ret != ESP_OK) {
+        return ret;
+    }
 
     // Print current credentials
     char ssid[WIFI_SSID_MAX_LEN + 1];
     wifi_config_get_ssid(ssid, sizeof(ssid));
     ESP_LOGI(TAG, "Configured WiFi SSID: %s", ssid);
+    return ESP_OK;
+}
 
-    // ===== Initialize Drivers =====
-    ESP_LOGI(TAG, "Initializing drivers...");
-    ESP_ERROR_CHECK(led_init());
-    ESP_ERROR_CHECK(sensor_init());
-    ESP_LOGI(TAG, "Drivers initialized successfully");
-    ESP_LOGI(TAG, "");
-
+/**
+ * Create the shared data mutex, sensor queue and application tasks
+ *
+ * Runs as soon as the drivers and rules are ready - it doesn't wait for
+ * WiFi, so sampling starts while the radio is still coming up.
+ */
+static esp_err_t start_app_tasks(void) {
     // Create mutex for shared sensor data
     ESP_LOGI(TAG, "Creating shared data mutex...");
-    g_shared_data_mutex = xSemaphoreCreateMutex();
-    if (g_shared_data_mutex == NULL) {
+    if (profiled_mutex_init(&g_shared_data_mutex, "shared_data") != ESP_OK) {
         ESP_LOGE(TAG, "Failed to create shared data mutex");
-        return;
+        return ESP_ERR_NO_MEM;
     }
 
     // Create event group for sensor coordination
     ESP_LOGI(TAG, "Creating sensor event group...");
+#ifdef CONFIG_GEEKHOUSE_STATIC_TASKS
+    EventGroupHandle_t sensor_events = xEventGroupCreateStatic(&s_sensor_events_buf);
+#else
     EventGroupHandle_t sensor_events = xEventGroupCreate();
+#endif
     if (sensor_events == NULL) {
         ESP_LOGE(TAG, "Failed to create event group");
-        return;
+        return ESP_ERR_NO_MEM;
     }
 
     // ===== Create Queue =====
     // Queue for passing sensor readings from sensor_task to display_task
     // Capacity: 10 items (enough for 5 seconds of sensor readings at 2s interval)
     // Item size: sizeof(sensor_reading_t)
-    ESP_LOGI(TAG, "Creating sensor data queue (capacity: 10)...");
-    QueueHandle_t sensor_queue = xQueueCreate(10, sizeof(sensor_reading_t));
+    ESP_LOGI(TAG, "Creating sensor data queue (capacity: %d)...", SENSOR_QUEUE_LENGTH);
+#ifdef CONFIG_GEEKHOUSE_STATIC_TASKS
+    QueueHandle_t sensor_queue =
+        xQueueCreateStatic(SENSOR_QUEUE_LENGTH, sizeof(sensor_reading_t), s_sensor_queue_storage,
+                           &s_sensor_queue_buf);
+#else
+    QueueHandle_t sensor_queue = xQueueCreate(SENSOR_QUEUE_LENGTH, sizeof(sensor_reading_t));
+#endif
     if (sensor_queue == NULL) {
         ESP_LOGE(TAG, "Failed to create queue - out of memory?");
-        return;  // Fatal error - can't continue
+        return ESP_ERR_NO_MEM;  // Fatal error - can't continue
     }
     ESP_LOGI(TAG, "Queue created successfully");
+    metrics_register_collector(queue_metrics_collector, sensor_queue);
     ESP_LOGI(TAG, "");
 
     // ===== Create Tasks =====
@@ -103,6 +224,17 @@ void app_main(void) {
 
     BaseType_t ret = pdPASS;
 
+    // Actuator task: Owns the LED outputs, applies queued LED commands
+    // Priority: 6 (highest of our tasks) - work is tiny and blink jitter is visible
+    // Stack: 2KB - no logging on the hot path
+    ESP_LOGI(TAG, "  Creating actuator_task (priority: 6, stack: 2KB)...");
+    ret = create_task(actuator_task, "actuator", ACTUATOR_TASK_STACK, NULL, ACTUATOR_TASK_PRIORITY,
+                      &actuator_task_handle);
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create actuator task");
+        return ESP_FAIL;
+    }
+
     // Sensor task: Reads ADC periodically and pushes to queue
     // Priority: 5 (medium) - important but not time-critical
     // Stack: 2KB - needs space for sensor driver calls and logging
@@ -112,7 +244,7 @@ void app_main(void) {
     sensor_params.queue = sensor_queue;
     sensor_params.events = sensor_events;
 
-    ret = xTaskCreate(sensor_task,           // Task function
+    ret = create_task(sensor_task,           // Task function
                       "sensor",              // Task name (for debugging)
                       SENSOR_TASK_STACK,     // Stack size in bytes
                       &sensor_params,        // Parameters (queue and event group handles)
@@ -121,24 +253,24 @@ void app_main(void) {
     );
     if (ret != pdPASS) {
         ESP_LOGE(TAG, "Failed to create sensor task");
-        return;
+        return ESP_FAIL;
     }
 
     // Create reporter task
     ESP_LOGI(TAG, "  Creating reporter_task (priority: 4, stack: 2KB)...");
-    ret = xTaskCreate(reporter_task, "reporter", REPORTER_TASK_STACK,
+    ret = create_task(reporter_task, "reporter", REPORTER_TASK_STACK,
                       sensor_events,  // Pass event group
                       REPORTER_TASK_PRIORITY, &reporter_task_handle);
     if (ret != pdPASS) {
         ESP_LOGE(TAG, "Failed to create reporter task");
-        return;
+        return ESP_FAIL;
     }
 
     // Display task: Receives from queue and prints to console
     // Priority: 4 (lower than sensor) - display is less important than collection
     // Stack: 2KB - moderate for logging
     ESP_LOGI(TAG, "  Creating display_task (priority: 4, stack: 2KB)...");
-    ret = xTaskCreate(display_task,           // Task function
+    ret = create_task(display_task,           // Task function
                       "display",              // Task name (for debugging)
                       DISPLAY_TASK_STACK,     // Stack size in bytes
                       sensor_queue,           // Parameter (same queue)
@@ -147,7 +279,7 @@ void app_main(void) {
     );
     if (ret != pdPASS) {
         ESP_LOGE(TAG, "Failed to create display task");
-        return;
+        return ESP_FAIL;
     }
 
     esp_err_t ret_led = led_blink_start();
@@ -159,7 +291,7 @@ void app_main(void) {
     // Priority: 2 (lowest) - non-critical monitoring
     // Stack: 2KB - needs space for stats gathering and logging
     ESP_LOGI(TAG, "  Creating stats_task (priority: 2, stack: 2KB)...");
-    ret = xTaskCreate(stats_task,           // Task function
+    ret = create_task(stats_task,           // Task function
                       "stats",              // Task name
                       STATS_TASK_STACK,     // Stack size (needs space for buffers)
                       NULL,                 // No parameters
@@ -168,21 +300,157 @@ void app_main(void) {
     );
     if (ret != pdPASS) {
         ESP_LOGE(TAG, "Failed to create stats task");
-        return;
+        return ESP_FAIL;
     }
-    // Initialize WiFi
-    ESP_LOGI(TAG, "Initializing WiFi...");
-    ESP_ERROR_CHECK(wifi_manager_init());
 
-    // Network task: wait for WiFi to be ready and start HTTP server
-    ESP_LOGI(TAG, "Starting network task...");
-    ret = xTaskCreate(network_task, "network", NETWORK_TASK_STACK, NULL, NETWORK_TASK_PRIORITY,
-                      &network_task_handle);
+    // Settings task: Commits changed settings to NVS in batches
+    // Priority: 1 (lowest) - flash writes can wait for everything else
+    // Stack: 3KB - NVS writes are stack-hungry
+    ESP_LOGI(TAG, "  Creating settings_task (priority: 1, stack: 3KB)...");
+    ret = create_task(settings_task, "settings", SETTINGS_TASK_STACK, NULL,
+                      SETTINGS_TASK_PRIORITY, &settings_task_handle);
     if (ret != pdPASS) {
-        ESP_LOGE(TAG, "Failed to start HTTP server");
+        ESP_LOGE(TAG, "Failed to create settings task");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Application tasks created");
+#ifdef CONFIG_GEEKHOUSE_STATIC_TASKS
+    ESP_LOGI(TAG, "Static arena: %d bytes (stacks %d, TCBs %d, queue %d)",
+             (int) (sizeof(s_stack_arena) + sizeof(s_task_tcbs) + sizeof(s_sensor_queue_storage) +
+                    sizeof(s_sensor_queue_buf) + sizeof(s_sensor_events_buf)),
+             (int) sizeof(s_stack_arena), (int) sizeof(s_task_tcbs),
+             (int) (sizeof(s_sensor_queue_storage) + sizeof(s_sensor_queue_buf)));
+#endif
+    return ESP_OK;
+}
+
+/**
+ * Network task: supervise WiFi and run the HTTP server and SNTP while online
+ */
+static esp_err_t start_network_task(void) {
+    ESP_LOGI(TAG, "Starting network task...");
+    if (create_task(network_task, "network", NETWORK_TASK_STACK, NULL, NETWORK_TASK_PRIORITY,
+                    &network_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start network task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/**
+ * MQTT: create the client, the publisher task and the LED command task
+ *
+ * The network supervisor connects the client once online. Nothing to do
+ * unless CONFIG_GEEKHOUSE_MQTT is set.
+ */
+static esp_err_t start_mqtt_task(void) {
+#ifdef CONFIG_GEEKHOUSE_MQTT
+    esp_err_t ret = mqtt_publisher_init();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (create_task(mqtt_publisher_task, "mqtt_pub", MQTT_TASK_STACK, NULL, MQTT_TASK_PRIORITY,
+                    &mqtt_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start MQTT publisher task");
+        return ESP_FAIL;
     }
 
+    ret = mqtt_commands_init();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (create_task(mqtt_commands_task, "mqtt_cmd", MQTT_CMD_TASK_STACK, NULL,
+                    MQTT_CMD_TASK_PRIORITY, &mqtt_cmd_task_handle) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to start MQTT command task");
+        return ESP_FAIL;
+    }
+#endif
+    return ESP_OK;
+}
+
+#ifdef CONFIG_GEEKHOUSE_DUTY_CYCLE
+/**
+ * Network bring-up for a duty-cycle flush: the boot steps WiFi needs
+ */
+static esp_err_t init_duty_cycle_network(void) {
+    esp_err_t ret = init_settings();
+    if (ret == ESP_OK) {
+        ret = wifi_manager_init();
+    }
+    return ret;
+}
+#endif
+
+// Boot graph
+// WiFi bring-up (netif, event loop, PHY calibration) is the slowest step
+// and only needs the settings, so it overlaps with driver setup
+// and task creation. Power management is set up before WiFi and the
+// tasks, so the power locks exist before anything takes them.
+// create_task() isn't thread-safe: every step that creates tasks must
+// depend on STEP_TASKS.
+enum {
+    STEP_POWER,
+    STEP_NVS,
+    STEP_SETTINGS,
+    STEP_LEDS,
+    STEP_SENSORS,
+    STEP_RULES,
+    STEP_TASKS,
+    STEP_WIFI,
+    STEP_MQTT,
+    STEP_NETWORK,
+    STEP_COUNT
+};
+
+static const boot_step_t BOOT_STEPS[STEP_COUNT] = {
+    [STEP_POWER] = {"power", power_init, 0},
+    [STEP_NVS] = {"nvs", init_nvs, 0},
+    [STEP_SETTINGS] = {"settings", init_settings, BOOT_DEP(STEP_NVS)},
+    [STEP_LEDS] = {"leds", led_init, 0},
+    [STEP_SENSORS] = {"sensors", sensor_init, BOOT_DEP(STEP_NVS)},
+    [STEP_RULES] = {"rules", rules_init, BOOT_DEP(STEP_NVS)},
+    [STEP_TASKS] = {"tasks", start_app_tasks,
+                    BOOT_DEP(STEP_LEDS) | BOOT_DEP(STEP_SENSORS) | BOOT_DEP(STEP_RULES) |
+                        BOOT_DEP(STEP_SETTINGS) | BOOT_DEP(STEP_POWER)},
+    [STEP_WIFI] = {"wifi", wifi_manager_init,
+                   BOOT_DEP(STEP_SETTINGS) | BOOT_DEP(STEP_POWER)},
+    [STEP_MQTT] = {"mqtt", start_mqtt_task, BOOT_DEP(STEP_TASKS)},
+    [STEP_NETWORK] = {"network", start_network_task,
+                      BOOT_DEP(STEP_WIFI) | BOOT_DEP(STEP_TASKS) | BOOT_DEP(STEP_MQTT)},
+};
+
+void app_main(void) {
+    ESP_LOGI(TAG, "");
+    ESP_LOGI(TAG, "=== Geekhouse FreeRTOS version ===");
+    ESP_LOGI(TAG, "");
+
+    // Instrumentation first, so the rest of boot is measured
+    int phase = boot_phase_begin("instrumentation");
+
+    // Heap accounting (no-op unless CONFIG_GEEKHOUSE_HEAP_PROFILING is set)
+    // Early, so allocations made during init are charged to their tags.
+    ESP_ERROR_CHECK(heap_profiler_init());
+
+    // Metrics registry (modules register their metrics during init)
+    ESP_ERROR_CHECK(metrics_init());
+
+    // Event tracing (no-op unless CONFIG_GEEKHOUSE_TRACE is set)
+    ESP_ERROR_CHECK(trace_init());
+    boot_phase_end(phase);
+
+#ifdef CONFIG_GEEKHOUSE_DUTY_CYCLE
+    // Battery mode: sample, flush when the batch is full, deep sleep.
+    // None of the tasks below ever start. NVS first, for the calibrations.
+    ESP_ERROR_CHECK(init_nvs());
+    duty_cycle_run(init_duty_cycle_network);
+#endif
+
+    // ===== Initialize drivers, tasks and WiFi =====
+    ESP_ERROR_CHECK(boot_run(BOOT_STEPS, STEP_COUNT));
+
     ESP_LOGI(TAG, "All tasks created successfully");
+    boot_log_timeline();
     ESP_LOGI(TAG, "");
 
     // ===== System Running =====
@@ -0,0 +1,330 @@
+#include "metrics.h"
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+static const char *TAG = "METRICS";
+
+// Render buffer size (one line must fit)
+#define METRICS_WRITE_BUF 256
+
+struct metric {
+    const char *name;
+    const char *labels;
+    const char *help;
+    uint8_t type;  // metric_type_t
+    uint8_t bound_count;
+    const uint32_t *bounds;
+    _Atomic uint32_t *buckets;  // bound_count + 1 counts (not cumulative), last is +Inf
+    _Atomic uint32_t value;     // Counter, gauge (as int32) or histogram count
+    _Atomic uint64_t sum;       // Histogram sum
+};
+
+struct metrics_writer {
+    metrics_flush_t flush;
+    void *ctx;
+    esp_err_t err;
+    size_t len;
+    char buf[METRICS_WRITE_BUF];
+};
+
+typedef struct {
+    metrics_collector_t fn;
+    void *arg;
+} collector_t;
+
+// Registry
+// Entries are only appended, and the count is published after the entry
+// is filled in, so metrics_render() walks it without taking the mutex.
+static struct metric s_metrics[METRICS_MAX];
+static _Atomic uint32_t s_metric_count = 0;
+static _Atomic uint32_t s_buckets[METRICS_BUCKETS_MAX];
+static size_t s_bucket_used = 0;
+static collector_t s_collectors[METRICS_COLLECTORS_MAX];
+static _Atomic uint32_t s_collector_count = 0;
+
+// Serializes registration
+static SemaphoreHandle_t s_metrics_mutex = NULL;
+
+static const char *const TYPE_NAMES[] = {
+    [METRIC_COUNTER] = "counter",
+    [METRIC_GAUGE] = "gauge",
+    [METRIC_HISTOGRAM] = "histogram",
+};
+
+esp_err_t metrics_init(void) {
+    if (s_metrics_mutex != NULL) {
+        return ESP_OK;
+    }
+
+    s_metrics_mutex = xSemaphoreCreateMutex();
+    if (s_metrics_mutex == NULL) {
+        ESP_LOGE(TAG, "Failed to create metrics mutex");
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(TAG, "Metrics registry initialized (%d metrics, %d buckets)", METRICS_MAX,
+             METRICS_BUCKETS_MAX);
+    return ESP_OK;
+}
+
+/**
+ * Append a metric to the registry
+ *
+ * @return New metric, or NULL if the registry (or bucket pool) is full
+ */
+static metric_t *metrics_register(const char *name, const char *labels, const char *help,
+                                  metric_type_t type, const uint32_t *bounds,
+                                  size_t bound_count) {
+    if (name == NULL || s_metrics_mutex == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments or registry not initialized");
+        return NULL;
+    }
+
+    if (xSemaphoreTake(s_metrics_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+        ESP_LOGW(TAG, "Failed to acquire mutex");
+        return NULL;
+    }
+
+    metric_t *m = NULL;
+    uint32_t count = atomic_load(&s_metric_count);
+    if (count >= METRICS_MAX) {
+        ESP_LOGE(TAG, "Registry full, dropping %s", name);
+    } else if (s_bucket_used + bound_count + (bounds ? 1 : 0) > METRICS_BUCKETS_MAX) {
+        ESP_LOGE(TAG, "Bucket pool full, dropping %s", name);
+    } else {
+        m = &s_metrics[count];
+        m->name = name;
+        m->labels = (labels != NULL && labels[0] != '\0') ? labels : NULL;
+        m->help = help;
+        m->type = type;
+        if (bounds != NULL) {
+            m->bounds = bounds;
+            m->bound_count = bound_count;
+            m->buckets = &s_buckets[s_bucket_used];
+            s_bucket_used += bound_count + 1;
+        }
+        // Publish: render only looks at entries below the count
+        atomic_store_explicit(&s_metric_count, count + 1, memory_order_release);
+    }
+
+    xSemaphoreGive(s_metrics_mutex);
+
+    // Registration happens at start-up with fixed arguments, so running out
+    // is a sizing bug: stop on the first boot instead of silently losing the
+    // metric (update functions take NULL without complaint)
+    assert(m != NULL && "metrics registry full, raise METRICS_MAX/METRICS_BUCKETS_MAX");
+    return m;
+}
+
+metric_t *metrics_counter(const char *name, const char *labels, const char *help) {
+    return metrics_register(name, labels, help, METRIC_COUNTER, NULL, 0);
+}
+
+metric_t *metrics_gauge(const char *name, const char *labels, const char *help) {
+    return metrics_register(name, labels, help, METRIC_GAUGE, NULL, 0);
+}
+
+metric_t *metrics_histogram(const char *name, const char *labels, const char *help,
+                            const uint32_t *bounds, size_t bound_count) {
+    if (bounds == NULL || bound_count == 0 || bound_count > UINT8_MAX) {
+        ESP_LOGE(TAG, "Invalid histogram bounds for %s", name ? name : "(null)");
+        return NULL;
+    }
+    return metrics_register(name, labels, help, METRIC_HISTOGRAM, bounds, bound_count);
+}
+
+void metrics_inc(metric_t *m) {
+    if (m != NULL) {
+        atomic_fetch_add_explicit(&m->value, 1, memory_order_relaxed);
+    }
+}
+
+void metrics_add(metric_t *m, uint32_t value) {
+    if (m != NULL) {
+        atomic_fetch_add_explicit(&m->value, value, memory_order_relaxed);
+    }
+}
+
+void metrics_set(metric_t *m, int32_t value) {
+    if (m != NULL) {
+        atomic_store_explicit(&m->value, (uint32_t) value, memory_order_relaxed);
+    }
+}
+
+void metrics_observe(metric_t *m, uint32_t value) {
+    if (m == NULL || m->type != METRIC_HISTOGRAM) {
+        return;
+    }
+
+    // Few buckets, so a linear search beats binary search here
+    size_t i = 0;
+    while (i < m->bound_count && value > m->bounds[i]) {
+        i++;
+    }
+
+    atomic_fetch_add_explicit(&m->buckets[i], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->sum, value, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->value, 1, memory_order_relaxed);
+}
+
+esp_err_t metrics_register_collector(metrics_collector_t fn, void *arg) {
+    if (fn == NULL || s_metrics_mutex == NULL) {
+        ESP_LOGE(TAG, "Invalid collector or registry not initialized");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (xSemaphoreTake(s_metrics_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+        ESP_LOGW(TAG, "Failed to acquire mutex");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    esp_err_t ret = ESP_OK;
+    uint32_t count = atomic_load(&s_collector_count);
+    if (count >= METRICS_COLLECTORS_MAX) {
+        ESP_LOGE(TAG, "Collector table full");
+        ret = ESP_ERR_NO_MEM;
+    } else {
+        s_collectors[count] = (collector_t) {.fn = fn, .arg = arg};
+        atomic_store_explicit(&s_collector_count, count + 1, memory_order_release);
+    }
+
+    xSemaphoreGive(s_metrics_mutex);
+    return ret;
+}
+
+// ---- Rendering ----
+
+static void writer_flush(metrics_writer_t *w) {
+    if (w->err == ESP_OK && w->len > 0) {
+        w->err = w->flush(w->ctx, w->buf, w->len);
+    }
+    w->len = 0;
+}
+
+/**
+ * printf into the output buffer, flushing first if the line doesn't fit
+ */
+static void writer_printf(metrics_writer_t *w, const char *fmt, ...) {
+    if (w->err != ESP_OK) {
+        return;  // Client is gone - don't bother formatting
+    }
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+        va_list args;
+        va_start(args, fmt);
+        int n = vsnprintf(w->buf + w->len, sizeof(w->buf) - w->len, fmt, args);
+        va_end(args);
+
+        if (n < 0) {
+            return;
+        }
+        if (w->len + n < sizeof(w->buf)) {
+            w->len += n;
+            return;
+        }
+        if (w->len == 0) {
+            // Longer than the whole buffer - send what fit
+            w->len = sizeof(w->buf) - 1;
+            return;
+        }
+        writer_flush(w);
+    }
+}
+
+void metrics_write_family(metrics_writer_t *w, const char *name, metric_type_t type,
+                          const char *help) {
+    if (help != NULL) {
+        writer_printf(w, "# HELP %s %s\n", name, help);
+    }
+    writer_printf(w, "# TYPE %s %s\n", name, TYPE_NAMES[type]);
+}
+
+void metrics_write_sample(metrics_writer_t *w, const char *name, const char *labels,
+                          int64_t value) {
+    if (labels != NULL && labels[0] != '\0') {
+        writer_printf(w, "%s{%s} %lld\n", name, labels, (long long) value);
+    } else {
+        writer_printf(w, "%s %lld\n", name, (long long) value);
+    }
+}
+
+/**
+ * Write histogram buckets (cumulative, as Prometheus expects), sum and count
+ */
+static void write_histogram(metrics_writer_t *w, metric_t *m) {
+    const char *sep = m->labels ? "," : "";
+    const char *labels = m->labels ? m->labels : "";
+    uint32_t cumulative = 0;
+
+    for (size_t i = 0; i <= m->bound_count; i++) {
+        cumulative += atomic_load_explicit(&m->buckets[i], memory_order_relaxed);
+        if (i < m->bound_count) {
+            writer_printf(w, "%s_bucket{%s%sle=\"%lu\"} %lu\n", m->name, labels, sep,
+                          m->bounds[i], cumulative);
+        } else {
+            writer_printf(w, "%s_bucket{%s%sle=\"+Inf\"} %lu\n", m->name, labels, sep,
+                          cumulative);
+        }
+    }
+
+    // _count is the +Inf bucket; reading it from there keeps the two consistent
+    uint64_t sum = atomic_load_explicit(&m->sum, memory_order_relaxed);
+    if (m->labels) {
+        writer_printf(w, "%s_sum{%s} %llu\n", m->name, m->labels, (unsigned long long) sum);
+        writer_printf(w, "%s_count{%s} %lu\n", m->name, m->labels, cumulative);
+    } else {
+        writer_printf(w, "%s_sum %llu\n", m->name, (unsigned long long) sum);
+        writer_printf(w, "%s_count %lu\n", m->name, cumulative);
+    }
+}
+
+esp_err_t metrics_render(metrics_flush_t flush, void *ctx) {
+    if (flush == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    metrics_writer_t w = {.flush = flush, .ctx = ctx, .err = ESP_OK, .len = 0};
+
+    // Collectors first, so gauges they refresh are current below
+    uint32_t collectors = atomic_load_explicit(&s_collector_count, memory_order_acquire);
+    for (uint32_t i = 0; i < collectors; i++) {
+        s_collectors[i].fn(&w, s_collectors[i].arg);
+    }
+
+    uint32_t count = atomic_load_explicit(&s_metric_count, memory_order_acquire);
+    const char *family = NULL;
+
+    for (uint32_t i = 0; i < count && w.err == ESP_OK; i++) {
+        metric_t *m = &s_metrics[i];
+
+        // One header per family (consecutive metrics with the same name)
+        if (family == NULL || strcmp(family, m->name) != 0) {
+            metrics_write_family(&w, m->name, m->type, m->help);
+            family = m->name;
+        }
+
+        uint32_t value = atomic_load_explicit(&m->value, memory_order_relaxed);
+        switch (m->type) {
+            case METRIC_COUNTER:
+                metrics_write_sample(&w, m->name, m->labels, value);
+                break;
+            case METRIC_GAUGE:
+                metrics_write_sample(&w, m->name, m->labels, (int32_t) value);
+                break;
+            case METRIC_HISTOGRAM:
+                write_histogram(&w, m);
+                break;
+        }
+    }
+
+    writer_flush(&w);
+    return w.err;
+}
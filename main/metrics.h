@@ -0,0 +1,136 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Registry capacity
+//
+// Sized for what the firmware registers: 18 metrics (55 buckets) from
+// WiFi, network and MQTT, plus 3 per HTTP route (one a histogram of 11
+// buckets) for up to HTTP_MAX_ROUTES (24) routes and 2 encode histograms
+// of 9 buckets - 92 metrics and 337 buckets at most. Running out is a
+// sizing bug and asserts at registration.
+#define METRICS_MAX            96   // Registered metrics (counters, gauges, histograms)
+#define METRICS_BUCKETS_MAX    352  // Histogram buckets shared by all histograms
+#define METRICS_COLLECTORS_MAX 8    // Scrape-time collectors
+
+// Metric types (Prometheus semantics)
+typedef enum {
+    METRIC_COUNTER,    // Only goes up (resets on reboot)
+    METRIC_GAUGE,      // Current value, may go up and down
+    METRIC_HISTOGRAM,  // Observations counted into fixed buckets
+} metric_type_t;
+
+// Registered metric (opaque)
+typedef struct metric metric_t;
+
+// Output stream used while rendering (opaque)
+typedef struct metrics_writer metrics_writer_t;
+
+/**
+ * Scrape-time collector
+ *
+ * Called on every render, before the registry is written. Collectors
+ * either refresh registered gauges or write samples with dynamic labels
+ * (e.g. one per task) through metrics_write_family()/metrics_write_sample().
+ */
+typedef void (*metrics_collector_t)(metrics_writer_t *w, void *arg);
+
+/**
+ * Output callback for metrics_render()
+ *
+ * @return ESP_OK to continue, anything else aborts the render
+ */
+typedef esp_err_t (*metrics_flush_t)(void *ctx, const char *buf, size_t len);
+
+/**
+ * Initialize metrics registry
+ *
+ * Must be called before any metric is registered.
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t metrics_init(void);
+
+/**
+ * Register a counter, gauge or histogram
+ *
+ * Strings are not copied and must stay valid forever (string literals or
+ * static buffers). Metrics sharing a name form one family and must have
+ * distinct labels; register them next to each other so they render under
+ * one HELP/TYPE header.
+ *
+ * A full registry asserts (see METRICS_MAX); if assertions are disabled it
+ * logs an error and returns NULL. All update functions accept NULL and do
+ * nothing, so callers don't need to check.
+ *
+ * @param name Metric name, e.g. "geekhouse_http_requests_total"
+ * @param labels Label pairs without braces, e.g. "route=\"/api\"" (NULL = none)
+ * @param help One-line description
+ * @return Metric handle, or NULL
+ */
+metric_t *metrics_counter(const char *name, const char *labels, const char *help);
+metric_t *metrics_gauge(const char *name, const char *labels, const char *help);
+
+/**
+ * Register a histogram
+ *
+ * @param bounds Upper bucket bounds in ascending order (not copied);
+ *               a final +Inf bucket is added automatically
+ * @param bound_count Number of bounds
+ * @return Metric handle, or NULL if the registry or bucket pool is full
+ *         (asserts, see metrics_counter())
+ */
+metric_t *metrics_histogram(const char *name, const char *labels, const char *help,
+                            const uint32_t *bounds, size_t bound_count);
+
+/**
+ * Update a metric
+ *
+ * Lock-free (single atomic operations), safe from any task.
+ * Histogram observations cost one bucket search plus three atomic adds.
+ */
+void metrics_inc(metric_t *m);
+void metrics_add(metric_t *m, uint32_t value);
+void metrics_set(metric_t *m, int32_t value);
+void metrics_observe(metric_t *m, uint32_t value);
+
+/**
+ * Register a scrape-time collector
+ *
+ * @param fn Collector function
+ * @param arg Passed to fn on every render
+ * @return ESP_OK on success, ESP_ERR_NO_MEM if the collector table is full
+ */
+esp_err_t metrics_register_collector(metrics_collector_t fn, void *arg);
+
+/**
+ * Write a "# HELP" / "# TYPE" header (for collectors)
+ */
+void metrics_write_family(metrics_writer_t *w, const char *name, metric_type_t type,
+                          const char *help);
+
+/**
+ * Write one sample line (for collectors)
+ *
+ * @param labels Label pairs without braces (NULL = none)
+ */
+void metrics_write_sample(metrics_writer_t *w, const char *name, const char *labels,
+                          int64_t value);
+
+/**
+ * Render all metrics in Prometheus text format (version 0.0.4)
+ *
+ * Output is produced through a small fixed buffer and handed to 'flush'
+ * piece by piece, so memory use doesn't grow with the number of metrics.
+ *
+ * @param flush Output callback
+ * @param ctx Passed to flush
+ * @return ESP_OK on success, or the first error returned by flush
+ */
+esp_err_t metrics_render(metrics_flush_t flush, void *ctx);
+
+#endif  // METRICS_H
@@ -0,0 +1,370 @@
+#include "mqtt_commands.h"
+
+#ifdef CONFIG_GEEKHOUSE_MQTT
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "actuators.h"
+#include "cJSON.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "metrics.h"
+#include "mqtt_publisher.h"
+
+static const char *TAG = "MQTT_CMD";
+
+#define MQTT_TOPIC_LEDS      MQTT_TOPIC_PREFIX "/leds/"
+#define MQTT_TOPIC_COMMAND   "/command"
+#define MQTT_TOPIC_SUBSCRIBE MQTT_TOPIC_LEDS "+" MQTT_TOPIC_COMMAND
+
+// Queue entry, copied out of the MQTT event
+typedef struct {
+    int8_t led;  // led_id_t, or -1 to publish the state of every LED
+    bool too_large;
+    uint8_t len;
+    int64_t received_us;
+    char payload[MQTT_CMD_PAYLOAD_MAX];
+} mqtt_cmd_t;
+
+static esp_mqtt_client_handle_t s_client = NULL;
+static QueueHandle_t s_queue = NULL;
+
+// Last correlation id applied per LED (command task only)
+static char s_last_cid[LED_COUNT][MQTT_CMD_CID_MAX + 1];
+
+static mqtt_commands_stats_t s_stats;
+static portMUX_TYPE s_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Metrics
+static metric_t *s_commands_metric = NULL;
+static metric_t *s_rejected_metric = NULL;
+static metric_t *s_latency_metric = NULL;
+
+static const uint32_t LATENCY_BOUNDS_US[] = {200,  500,   1000,  2000,   5000,
+                                             10000, 20000, 50000, 100000, 200000};
+
+/**
+ * Parse the LED id out of "geekhouse/leds/<id>/command" (not NUL-terminated)
+ *
+ * @return true if the topic matches and names a known LED
+ */
+static bool mqtt_cmd_parse_topic(const char *topic, int len, led_id_t *id) {
+    const int prefix_len = sizeof(MQTT_TOPIC_LEDS) - 1;
+    const int suffix_len = sizeof(MQTT_TOPIC_COMMAND) - 1;
+
+    if (topic == NULL || len <= prefix_len + suffix_len ||
+        strncmp(topic, MQTT_TOPIC_LEDS, prefix_len) != 0 ||
+        strncmp(topic + len - suffix_len, MQTT_TOPIC_COMMAND, suffix_len) != 0) {
+        return false;
+    }
+
+    int value = 0;
+    for (int i = prefix_len; i < len - suffix_len; i++) {
+        if (topic[i] < '0' || topic[i] > '9' || value >= LED_COUNT) {
+            return false;
+        }
+        value = value * 10 + (topic[i] - '0');
+    }
+    if (value >= LED_COUNT) {
+        return false;
+    }
+    *id = (led_id_t) value;
+    return true;
+}
+
+/**
+ * Check a correlation id: short and safe to embed in JSON unescaped
+ */
+static bool mqtt_cmd_cid_is_valid(const char *cid) {
+    size_t len = strlen(cid);
+    if (len > MQTT_CMD_CID_MAX) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        char c = cid[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+              c == '_' || c == '.' || c == ':' || c == '-')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void mqtt_cmd_count_rejected(void) {
+    portENTER_CRITICAL(&s_stats_mux);
+    s_stats.rejected++;
+    portEXIT_CRITICAL(&s_stats_mux);
+    metrics_inc(s_rejected_metric);
+}
+
+/**
+ * MQTT event handler (MQTT client task) - copies commands into the queue
+ */
+static void mqtt_cmd_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id,
+                                   void *event_data) {
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t) event_data;
+
+    if (event_id == MQTT_EVENT_CONNECTED) {
+        // Subscriptions don't survive a clean session, renew them on every connect
+        if (esp_mqtt_client_subscribe(s_client, MQTT_TOPIC_SUBSCRIBE, 1) < 0) {
+            ESP_LOGW(TAG, "Failed to subscribe to %s", MQTT_TOPIC_SUBSCRIBE);
+        }
+        mqtt_cmd_t sync = {.led = -1};
+        xQueueSend(s_queue, &sync, 0);
+        return;
+    }
+
+    // Only the first chunk of a message carries the topic
+    if (event_id != MQTT_EVENT_DATA || event->current_data_offset != 0) {
+        return;
+    }
+
+    mqtt_cmd_t cmd = {.received_us = esp_timer_get_time()};
+    led_id_t id;
+    if (!mqtt_cmd_parse_topic(event->topic, event->topic_len, &id)) {
+        ESP_LOGW(TAG, "Ignoring message on %.*s", event->topic_len, event->topic);
+        mqtt_cmd_count_rejected();
+        return;
+    }
+    cmd.led = (int8_t) id;
+    if (event->total_data_len >= MQTT_CMD_PAYLOAD_MAX) {
+        cmd.too_large = true;
+    } else {
+        cmd.len = (uint8_t) event->data_len;
+        memcpy(cmd.payload, event->data, event->data_len);
+    }
+
+    portENTER_CRITICAL(&s_stats_mux);
+    s_stats.received++;
+    portEXIT_CRITICAL(&s_stats_mux);
+
+    if (xQueueSend(s_queue, &cmd, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Command queue full, dropping command for LED %d", id);
+        portENTER_CRITICAL(&s_stats_mux);
+        s_stats.dropped++;
+        portEXIT_CRITICAL(&s_stats_mux);
+        metrics_inc(s_rejected_metric);
+    }
+}
+
+/**
+ * Publish the retained state of one LED
+ */
+static void mqtt_cmd_publish_state(led_id_t id) {
+    bool on = false;
+    uint8_t brightness = 0;
+    led_get_state(id, &on);
+    led_get_brightness(id, &brightness);
+
+    char topic[48];
+    char payload[48];
+    snprintf(topic, sizeof(topic), MQTT_TOPIC_LEDS "%d/state", id);
+    int len = snprintf(payload, sizeof(payload), "{\"state\":%s,\"brightness\":%d}",
+                       on ? "true" : "false", brightness);
+    // QoS 0: PUBACKs for these would land in the publisher's in-flight accounting
+    esp_mqtt_client_publish(s_client, topic, payload, len, 0, 1);
+}
+
+/**
+ * Publish the acknowledgement of a command (error NULL on success)
+ */
+static void mqtt_cmd_publish_ack(led_id_t id, const char *cid, const char *error,
+                                 uint32_t latency_us) {
+    char topic[48];
+    char payload[96];
+    snprintf(topic, sizeof(topic), MQTT_TOPIC_LEDS "%d/ack", id);
+    int len;
+    if (error == NULL) {
+        len = snprintf(payload, sizeof(payload), "{\"cid\":\"%s\",\"ok\":true,\"latency_us\":%lu}",
+                       cid, latency_us);
+    } else {
+        len = snprintf(payload, sizeof(payload), "{\"cid\":\"%s\",\"ok\":false,\"error\":\"%s\"}",
+                       cid, error);
+    }
+    esp_mqtt_client_publish(s_client, topic, payload, len, 0, 0);
+}
+
+/**
+ * Apply a parsed command body
+ *
+ * @return ESP_OK once the LED has been updated, or an error message in *error
+ */
+static esp_err_t mqtt_cmd_apply(led_id_t id, const cJSON *json, const char **error) {
+    const cJSON *action = cJSON_GetObjectItem(json, "action");
+    const cJSON *brightness = cJSON_GetObjectItem(json, "brightness");
+    esp_err_t ret;
+
+    if (cJSON_IsString(action)) {
+        led_action_t led_action;
+        if (led_parse_action(action->valuestring, &led_action) != ESP_OK) {
+            *error = "invalid action (use: on, off, toggle)";
+            return ESP_ERR_INVALID_ARG;
+        }
+        led_batch_t batch = {0};
+        led_batch_add(&batch, id, led_action);
+        ret = led_apply_batch(&batch, NULL);
+    } else if (cJSON_IsNumber(brightness)) {
+        const cJSON *fade_ms = cJSON_GetObjectItem(json, "fade_ms");
+        if (brightness->valueint < 0 || brightness->valueint > LED_BRIGHTNESS_MAX) {
+            *error = "invalid brightness (0-255)";
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (fade_ms != NULL && (!cJSON_IsNumber(fade_ms) || fade_ms->valueint < 0)) {
+            *error = "invalid fade_ms";
+            return ESP_ERR_INVALID_ARG;
+        }
+        ret = led_set_brightness(id, (uint8_t) brightness->valueint,
+                                 fade_ms != NULL ? (uint32_t) fade_ms->valueint : 0);
+    } else {
+        *error = "missing action or brightness";
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (ret != ESP_OK) {
+        *error = esp_err_to_name(ret);
+    }
+    return ret;
+}
+
+/**
+ * Execute one queued command and acknowledge it
+ */
+static void mqtt_cmd_execute(mqtt_cmd_t *cmd) {
+    led_id_t id = (led_id_t) cmd->led;
+    const char *error = NULL;
+    char cid[MQTT_CMD_CID_MAX + 1] = "";
+
+    if (cmd->too_large) {
+        mqtt_cmd_count_rejected();
+        mqtt_cmd_publish_ack(id, cid, "payload too large", 0);
+        return;
+    }
+
+    cJSON *json = cJSON_ParseWithLength(cmd->payload, cmd->len);
+    if (json == NULL) {
+        mqtt_cmd_count_rejected();
+        mqtt_cmd_publish_ack(id, cid, "invalid JSON", 0);
+        return;
+    }
+
+    const cJSON *cid_item = cJSON_GetObjectItem(json, "cid");
+    if (cid_item != NULL) {
+        if (!cJSON_IsString(cid_item) || !mqtt_cmd_cid_is_valid(cid_item->valuestring)) {
+            cJSON_Delete(json);
+            mqtt_cmd_count_rejected();
+            mqtt_cmd_publish_ack(id, cid, "invalid cid", 0);
+            return;
+        }
+        strcpy(cid, cid_item->valuestring);
+    }
+
+    // QoS 1 may deliver a command twice; don't toggle twice
+    if (cid[0] != '\0' && strcmp(cid, s_last_cid[id]) == 0) {
+        cJSON_Delete(json);
+        portENTER_CRITICAL(&s_stats_mux);
+        s_stats.duplicates++;
+        portEXIT_CRITICAL(&s_stats_mux);
+        mqtt_cmd_publish_ack(id, cid, NULL, 0);
+        return;
+    }
+
+    esp_err_t ret = mqtt_cmd_apply(id, json, &error);
+    cJSON_Delete(json);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "LED %d command failed: %s", id, error);
+        mqtt_cmd_count_rejected();
+        mqtt_cmd_publish_ack(id, cid, error, 0);
+        return;
+    }
+
+    // led_apply_batch()/led_set_brightness() return once the GPIO has been written
+    uint32_t latency_us = (uint32_t) (esp_timer_get_time() - cmd->received_us);
+    strcpy(s_last_cid[id], cid);
+
+    portENTER_CRITICAL(&s_stats_mux);
+    s_stats.applied++;
+    s_stats.last_latency_us = latency_us;
+    if (latency_us > s_stats.max_latency_us) {
+        s_stats.max_latency_us = latency_us;
+    }
+    portEXIT_CRITICAL(&s_stats_mux);
+    metrics_inc(s_commands_metric);
+    metrics_observe(s_latency_metric, latency_us);
+
+    mqtt_cmd_publish_state(id);
+    mqtt_cmd_publish_ack(id, cid, NULL, latency_us);
+}
+
+void mqtt_commands_task(void *pvParameters) {
+    (void) pvParameters;
+
+    // Static: keeps the entry off the task stack
+    static mqtt_cmd_t cmd;
+
+    ESP_LOGI(TAG, "Command handler started (%s)", MQTT_TOPIC_SUBSCRIBE);
+
+    while (1) {
+        if (xQueueReceive(s_queue, &cmd, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        if (cmd.led < 0) {
+            // (Re)connected: bring the retained state up to date
+            for (int id = 0; id < LED_COUNT; id++) {
+                mqtt_cmd_publish_state((led_id_t) id);
+            }
+            continue;
+        }
+        mqtt_cmd_execute(&cmd);
+    }
+}
+
+esp_err_t mqtt_commands_init(void) {
+    s_client = mqtt_publisher_get_client();
+    if (s_client == NULL) {
+        ESP_LOGE(TAG, "MQTT client not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    s_queue = xQueueCreate(MQTT_CMD_QUEUE_LENGTH, sizeof(mqtt_cmd_t));
+    if (s_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create command queue");
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_mqtt_client_register_event(s_client, MQTT_EVENT_CONNECTED, mqtt_cmd_event_handler, NULL);
+    esp_mqtt_client_register_event(s_client, MQTT_EVENT_DATA, mqtt_cmd_event_handler, NULL);
+
+    s_commands_metric = metrics_counter("geekhouse_mqtt_commands_total", NULL,
+                                        "LED commands applied from MQTT");
+    s_rejected_metric = metrics_counter("geekhouse_mqtt_commands_rejected_total", NULL,
+                                        "MQTT LED commands rejected or dropped");
+    s_latency_metric = metrics_histogram(
+        "geekhouse_mqtt_command_latency_us", NULL, "MQTT command received to GPIO written",
+        LATENCY_BOUNDS_US, sizeof(LATENCY_BOUNDS_US) / sizeof(LATENCY_BOUNDS_US[0]));
+    return ESP_OK;
+}
+
+esp_err_t mqtt_commands_get_stats(mqtt_commands_stats_t *stats) {
+    if (stats == NULL) {
+        ESP_LOGE(TAG, "Invalid argument: stats is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_stats_mux);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_mux);
+    return ESP_OK;
+}
+
+#else  // !CONFIG_GEEKHOUSE_MQTT
+
+esp_err_t mqtt_commands_get_stats(mqtt_commands_stats_t *stats) {
+    (void) stats;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif  // CONFIG_GEEKHOUSE_MQTT
@@ -0,0 +1,76 @@
+#ifndef MQTT_COMMANDS_H
+#define MQTT_COMMANDS_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+// MQTT LED commands (CONFIG_GEEKHOUSE_MQTT)
+//
+// One wildcard subscription covers every LED:
+//
+//   geekhouse/leds/<id>/command  {"action":"on|off|toggle","cid":"<id>"}
+//                                {"brightness":<0-255>,"fade_ms":<ms>,"cid":"<id>"}
+//
+// Same bodies as POST /api/leds/{id} and PUT /api/leds/{id}. cid is an
+// optional correlation id (up to MQTT_CMD_CID_MAX of [A-Za-z0-9_.:-]),
+// echoed in the acknowledgement:
+//
+//   geekhouse/leds/<id>/ack      {"cid":"<id>","ok":true,"latency_us":<us>}
+//                                {"cid":"<id>","ok":false,"error":"<reason>"}
+//   geekhouse/leds/<id>/state    {"state":true,"brightness":255}  (retained)
+//
+// The MQTT event handler only copies the message into a queue; the command
+// task applies it through the actuator API and publishes state and ack once
+// the GPIO has been written. latency_us is the time from the message
+// arriving at the device to that write. A command repeating the last cid
+// of its LED (a QoS 1 redelivery) is acknowledged again but not re-applied,
+// so toggles stay idempotent. State is also published on every connect.
+// tools/mqtt_bench.py command measures the round trip from a broker client.
+
+#define MQTT_CMD_QUEUE_LENGTH 8
+#define MQTT_CMD_PAYLOAD_MAX  128  // Longer commands are rejected
+#define MQTT_CMD_CID_MAX      32
+
+// Command statistics
+typedef struct {
+    uint32_t received;         // Messages on the command topic
+    uint32_t applied;          // Commands applied to the LEDs
+    uint32_t rejected;         // Invalid commands (bad topic, payload or LED error)
+    uint32_t dropped;          // Messages dropped because the queue was full
+    uint32_t duplicates;       // Redeliveries acknowledged without re-applying
+    uint32_t last_latency_us;  // Message received to GPIO written
+    uint32_t max_latency_us;
+} mqtt_commands_stats_t;
+
+#ifdef CONFIG_GEEKHOUSE_MQTT
+
+/**
+ * Create the command queue and hook into the MQTT client
+ *
+ * Must be called after mqtt_publisher_init().
+ *
+ * @return ESP_OK on success, ESP_ERR_INVALID_STATE if there is no client,
+ *         ESP_ERR_NO_MEM on allocation failure
+ */
+esp_err_t mqtt_commands_init(void);
+
+/**
+ * Command task: applies queued commands and publishes state and acks
+ *
+ * @param pvParameters Unused
+ */
+void mqtt_commands_task(void *pvParameters);
+
+#endif  // CONFIG_GEEKHOUSE_MQTT
+
+/**
+ * Get command statistics
+ *
+ * @param[out] stats Statistics
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if MQTT is disabled
+ */
+esp_err_t mqtt_commands_get_stats(mqtt_commands_stats_t *stats);
+
+#endif  // MQTT_COMMANDS_H
@@ -0,0 +1,604 @@
+#include "mqtt_publisher.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cbor.h"
+#include "esp_log.h"
+
+static const char *TAG = "MQTT_PUB";
+
+/**
+ * Append to a payload, tracking overflow
+ *
+ * @return New length, or size if the output no longer fits
+ */
+static size_t mqtt_append(char *buf, size_t size, size_t len, int written) {
+    if (len >= size || written < 0 || (size_t) written >= size - len) {
+        return size;
+    }
+    return len + written;
+}
+
+size_t mqtt_encode_batch(char *buf, size_t size, const sensor_reading_t *readings, size_t count) {
+    if (buf == NULL || readings == NULL || count == 0 || size == 0) {
+        return 0;
+    }
+
+    uint32_t t0 = readings[0].timestamp;
+    size_t len = mqtt_append(buf, size, 0, snprintf(buf, size, "{\"ts\":%lu,\"r\":[", t0));
+    for (size_t i = 0; i < count && len < size; i++) {
+        const sensor_reading_t *r = &readings[i];
+        len = mqtt_append(buf, size, len,
+                          snprintf(buf + len, size - len, "%s[%d,%lu,%d,%.2f]", i ? "," : "",
+                                   r->id, r->timestamp - t0, r->raw_value, r->calibrated_value));
+    }
+    if (len < size) {
+        len = mqtt_append(buf, size, len, snprintf(buf + len, size - len, "]}"));
+    }
+    return len < size ? len : 0;
+}
+
+size_t mqtt_encode_reading(char *buf, size_t size, const sensor_reading_t *reading) {
+    if (buf == NULL || reading == NULL || size == 0) {
+        return 0;
+    }
+
+    int written = snprintf(buf, size, "{\"ts\":%lu,\"raw\":%d,\"value\":%.2f,\"unit\":\"%s\"}",
+                           reading->timestamp, reading->raw_value, reading->calibrated_value,
+                           reading->unit != NULL ? reading->unit : "");
+    size_t len = mqtt_append(buf, size, 0, written);
+    return len < size ? len : 0;
+}
+
+size_t mqtt_encode_batch_cbor(uint8_t *buf, size_t size, const sensor_reading_t *readings,
+                              size_t count) {
+    if (buf == NULL || readings == NULL || count == 0 || size == 0) {
+        return 0;
+    }
+
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, size, NULL, NULL);
+    uint32_t t0 = readings[0].timestamp;
+    cbor_write_map(&w, 2);
+    cbor_write_text(&w, "ts");
+    cbor_write_uint(&w, t0);
+    cbor_write_text(&w, "r");
+    cbor_write_array(&w, count);
+    for (size_t i = 0; i < count; i++) {
+        const sensor_reading_t *r = &readings[i];
+        cbor_write_array(&w, 4);
+        cbor_write_uint(&w, r->id);
+        cbor_write_uint(&w, r->timestamp - t0);
+        cbor_write_int(&w, r->raw_value);
+        cbor_write_float(&w, r->calibrated_value);
+    }
+
+    size_t len = 0;
+    return cbor_writer_finish(&w, &len) == ESP_OK ? len : 0;
+}
+
+size_t mqtt_encode_reading_cbor(uint8_t *buf, size_t size, const sensor_reading_t *reading) {
+    if (buf == NULL || reading == NULL || size == 0) {
+        return 0;
+    }
+
+    cbor_writer_t w;
+    cbor_writer_init(&w, buf, size, NULL, NULL);
+    cbor_write_map(&w, 4);
+    cbor_write_text(&w, "ts");
+    cbor_write_uint(&w, reading->timestamp);
+    cbor_write_text(&w, "raw");
+    cbor_write_int(&w, reading->raw_value);
+    cbor_write_text(&w, "value");
+    cbor_write_float(&w, reading->calibrated_value);
+    cbor_write_text(&w, "unit");
+    cbor_write_text(&w, reading->unit != NULL ? reading->unit : "");
+
+    size_t len = 0;
+    return cbor_writer_finish(&w, &len) == ESP_OK ? len : 0;
+}
+
+#ifdef CONFIG_GEEKHOUSE_MQTT
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "metrics.h"
+#include "mqtt_client.h"
+#include "telemetry_buffer.h"
+
+#define MQTT_TOPIC_BATCH  MQTT_TOPIC_PREFIX "/sensors/batch"
+#define MQTT_TOPIC_REPLAY MQTT_TOPIC_PREFIX "/sensors/replay"
+#define MQTT_TOPIC_STATUS MQTT_TOPIC_PREFIX "/status"
+#define MQTT_QOS          CONFIG_GEEKHOUSE_MQTT_QOS
+#define MQTT_REPLAY_RATE  CONFIG_GEEKHOUSE_MQTT_REPLAY_RATE
+
+// A QoS 1 publish awaiting PUBACK
+typedef struct {
+    int msg_id;
+    int64_t sent_us;
+    uint16_t readings;
+    uint16_t bytes;
+} mqtt_inflight_t;
+
+static esp_mqtt_client_handle_t s_client = NULL;
+static QueueHandle_t s_queue = NULL;
+static TaskHandle_t s_task = NULL;
+static volatile bool s_connected = false;
+static bool s_started = false;
+
+// In-flight table and statistics (publisher task and MQTT event task)
+static mqtt_inflight_t s_inflight[MQTT_INFLIGHT_MAX];
+static size_t s_inflight_count = 0;
+static int s_status_msg_id = -1;  // Online status publish, not ours to track
+static int s_early_ack_id = -1;   // PUBACK that beat the publisher to the table
+static int64_t s_early_ack_us = 0;
+static mqtt_publisher_stats_t s_stats;
+static portMUX_TYPE s_mqtt_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static int64_t s_next_replay_us = 0;  // Rate limit for draining the buffer (publisher task)
+
+// Metrics
+static metric_t *s_publishes_metric = NULL;
+static metric_t *s_errors_metric = NULL;
+static metric_t *s_readings_metric = NULL;
+static metric_t *s_dropped_metric = NULL;
+static metric_t *s_bytes_metric = NULL;
+static metric_t *s_inflight_metric = NULL;
+static metric_t *s_latency_metric = NULL;
+static metric_t *s_batch_metric = NULL;
+
+static const uint32_t LATENCY_BOUNDS_US[] = {1000,  2000,   5000,   10000,  20000,
+                                             50000, 100000, 200000, 500000, 1000000};
+static const uint32_t BATCH_BOUNDS[] = {1, 2, 4, 8, 16, 32};
+
+/**
+ * Account for a completed publish (inside s_mqtt_mux)
+ */
+static void mqtt_record_locked(uint32_t latency_us, uint32_t readings, uint32_t bytes) {
+    s_stats.publishes++;
+    s_stats.readings += readings;
+    s_stats.bytes += bytes;
+    s_stats.last_latency_us = latency_us;
+    if (latency_us > s_stats.max_latency_us) {
+        s_stats.max_latency_us = latency_us;
+    }
+}
+
+static void mqtt_record_metrics(uint32_t latency_us, uint32_t readings, uint32_t bytes) {
+    metrics_inc(s_publishes_metric);
+    metrics_add(s_readings_metric, readings);
+    metrics_add(s_bytes_metric, bytes);
+    metrics_observe(s_latency_metric, latency_us);
+}
+
+/**
+ * Drop in-flight entries whose PUBACK never came (inside s_mqtt_mux)
+ *
+ * @return Number of entries dropped
+ */
+static uint32_t mqtt_expire_inflight_locked(int64_t now_us) {
+    uint32_t expired = 0;
+    for (size_t i = 0; i < s_inflight_count;) {
+        if (now_us - s_inflight[i].sent_us > (int64_t) MQTT_ACK_TIMEOUT_MS * 1000) {
+            s_inflight[i] = s_inflight[--s_inflight_count];
+            expired++;
+        } else {
+            i++;
+        }
+    }
+    s_stats.errors += expired;
+    return expired;
+}
+
+/**
+ * MQTT event handler (MQTT client task)
+ */
+static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_t event_id,
+                               void *event_data) {
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t) event_data;
+
+    switch ((esp_mqtt_event_id_t) event_id) {
+        case MQTT_EVENT_CONNECTED:
+            ESP_LOGI(TAG, "Connected to %s", CONFIG_GEEKHOUSE_MQTT_BROKER_URL);
+            s_status_msg_id =
+                esp_mqtt_client_publish(s_client, MQTT_TOPIC_STATUS, "{\"online\":true}", 0, 1, 1);
+            s_connected = true;
+            break;
+
+        case MQTT_EVENT_DISCONNECTED:
+            // Unacknowledged QoS 1 publishes stay in the client's outbox and are
+            // resent on reconnect; entries that outlive MQTT_ACK_TIMEOUT_MS expire
+            ESP_LOGW(TAG, "Disconnected from broker");
+            s_connected = false;
+            break;
+
+        case MQTT_EVENT_PUBLISHED: {
+            if (event->msg_id == s_status_msg_id) {
+                break;
+            }
+            int64_t now = esp_timer_get_time();
+            bool found = false;
+            uint32_t latency_us = 0;
+            mqtt_inflight_t entry;
+
+            portENTER_CRITICAL(&s_mqtt_mux);
+            for (size_t i = 0; i < s_inflight_count; i++) {
+                if (s_inflight[i].msg_id == event->msg_id) {
+                    entry = s_inflight[i];
+                    s_inflight[i] = s_inflight[--s_inflight_count];
+                    latency_us = (uint32_t) (now - entry.sent_us);
+                    mqtt_record_locked(latency_us, entry.readings, entry.bytes);
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) {
+                s_early_ack_id = event->msg_id;
+                s_early_ack_us = now;
+            }
+            size_t inflight = s_inflight_count;
+            portEXIT_CRITICAL(&s_mqtt_mux);
+
+            if (found) {
+                mqtt_record_metrics(latency_us, entry.readings, entry.bytes);
+                metrics_set(s_inflight_metric, inflight);
+                if (s_task != NULL) {
+                    xTaskNotifyGive(s_task);  // A slot is free
+                }
+            }
+            break;
+        }
+
+        case MQTT_EVENT_ERROR:
+            ESP_LOGW(TAG, "Client error (transport errno %d)",
+                     event->error_handle != NULL ? event->error_handle->esp_transport_sock_errno
+                                                 : 0);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/**
+ * Wait until a QoS 1 publish may be sent (fewer than MQTT_INFLIGHT_MAX pending)
+ */
+static void mqtt_wait_for_slot(void) {
+    while (true) {
+        portENTER_CRITICAL(&s_mqtt_mux);
+        uint32_t expired = mqtt_expire_inflight_locked(esp_timer_get_time());
+        size_t inflight = s_inflight_count;
+        portEXIT_CRITICAL(&s_mqtt_mux);
+
+        if (expired > 0) {
+            ESP_LOGW(TAG, "%lu publishes not acknowledged", expired);
+            metrics_add(s_errors_metric, expired);
+            metrics_set(s_inflight_metric, inflight);
+        }
+        if (inflight < MQTT_INFLIGHT_MAX) {
+            return;
+        }
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+    }
+}
+
+/**
+ * Publish one payload and account for it
+ *
+ * @return ESP_OK if handed to the client, ESP_ERR_INVALID_SIZE if the payload
+ *         didn't fit (readings lost), ESP_FAIL if the publish failed (retry later)
+ */
+static esp_err_t mqtt_publish(const char *topic, const char *payload, size_t len,
+                              size_t readings) {
+    if (len == 0) {
+        ESP_LOGE(TAG, "Payload doesn't fit %d bytes, %d readings lost", MQTT_PAYLOAD_MAX,
+                 (int) readings);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (MQTT_QOS > 0) {
+        mqtt_wait_for_slot();
+    }
+
+    int64_t start = esp_timer_get_time();
+    int msg_id = esp_mqtt_client_publish(s_client, topic, payload, len, MQTT_QOS, 0);
+    int64_t end = esp_timer_get_time();
+
+    if (msg_id < 0) {
+        ESP_LOGW(TAG, "Publish of %d readings failed", (int) readings);
+        portENTER_CRITICAL(&s_mqtt_mux);
+        s_stats.errors++;
+        portEXIT_CRITICAL(&s_mqtt_mux);
+        metrics_inc(s_errors_metric);
+        return ESP_FAIL;
+    }
+
+    if (MQTT_QOS == 0) {
+        // Fire and forget: the latency is the time to hand it to the socket
+        uint32_t latency_us = (uint32_t) (end - start);
+        portENTER_CRITICAL(&s_mqtt_mux);
+        mqtt_record_locked(latency_us, readings, len);
+        portEXIT_CRITICAL(&s_mqtt_mux);
+        mqtt_record_metrics(latency_us, readings, len);
+        return ESP_OK;
+    }
+
+    // The MQTT task may have processed the PUBACK before we got here
+    bool acked = false;
+    uint32_t latency_us = 0;
+    portENTER_CRITICAL(&s_mqtt_mux);
+    if (s_early_ack_id == msg_id) {
+        s_early_ack_id = -1;
+        latency_us = (uint32_t) (s_early_ack_us - start);
+        mqtt_record_locked(latency_us, readings, len);
+        acked = true;
+    } else {
+        s_inflight[s_inflight_count++] = (mqtt_inflight_t) {
+            .msg_id = msg_id, .sent_us = start, .readings = readings, .bytes = len};
+    }
+    size_t inflight = s_inflight_count;
+    portEXIT_CRITICAL(&s_mqtt_mux);
+
+    if (acked) {
+        mqtt_record_metrics(latency_us, readings, len);
+    }
+    metrics_set(s_inflight_metric, inflight);
+    return ESP_OK;
+}
+
+/**
+ * Publish live readings, keeping them in the store-and-forward buffer if that fails
+ */
+static void mqtt_publish_live(const char *topic, const char *payload, size_t len,
+                              const sensor_reading_t *readings, size_t count) {
+    if (mqtt_publish(topic, payload, len, count) == ESP_FAIL) {
+        for (size_t i = 0; i < count; i++) {
+            telemetry_buffer_push(&readings[i]);
+        }
+    }
+}
+
+/**
+ * Replay one batch from the store-and-forward buffer
+ *
+ * Paced at CONFIG_GEEKHOUSE_MQTT_REPLAY_RATE readings per second and, with
+ * QoS 1, only while at most half the in-flight slots are taken, so live
+ * readings keep flowing while a backlog drains.
+ *
+ * @param batch Scratch space for MQTT_BATCH_MAX readings
+ * @param payload Scratch space for MQTT_PAYLOAD_MAX bytes
+ * @return Ticks to wait before the next replay
+ */
+static TickType_t mqtt_replay(sensor_reading_t *batch, char *payload) {
+    int64_t now = esp_timer_get_time();
+    if (now < s_next_replay_us) {
+        return pdMS_TO_TICKS((s_next_replay_us - now) / 1000) + 1;
+    }
+    if (MQTT_QOS > 0) {
+        portENTER_CRITICAL(&s_mqtt_mux);
+        size_t inflight = s_inflight_count;
+        portEXIT_CRITICAL(&s_mqtt_mux);
+        if (inflight > MQTT_INFLIGHT_MAX / 2) {
+            return pdMS_TO_TICKS(100);
+        }
+    }
+
+    size_t count = telemetry_buffer_peek(batch, MQTT_BATCH_MAX);
+    if (count == 0) {
+        return pdMS_TO_TICKS(100);
+    }
+    size_t len = mqtt_encode_batch_payload(payload, MQTT_PAYLOAD_MAX, batch, count);
+    esp_err_t ret = mqtt_publish(MQTT_TOPIC_REPLAY, payload, len, count);
+    if (ret != ESP_FAIL) {
+        telemetry_buffer_consume(count);
+    }
+
+    uint32_t pause_ms = count * 1000 / MQTT_REPLAY_RATE;
+    s_next_replay_us = now + (int64_t) pause_ms * 1000;
+    return pdMS_TO_TICKS(pause_ms) + 1;
+}
+
+void mqtt_publisher_task(void *pvParameters) {
+    (void) pvParameters;
+
+    // Static: keeps the batch and payload off the task stack
+    static sensor_reading_t batch[MQTT_BATCH_MAX];
+    static char payload[MQTT_PAYLOAD_MAX];
+
+    s_task = xTaskGetCurrentTaskHandle();
+    ESP_LOGI(TAG, "Publisher started (window %d ms, QoS %d)", CONFIG_GEEKHOUSE_MQTT_BATCH_MS,
+             MQTT_QOS);
+
+    while (1) {
+        // Offline: keep readings for later
+        if (!s_connected) {
+            if (xQueueReceive(s_queue, &batch[0], pdMS_TO_TICKS(500)) == pdTRUE) {
+                telemetry_buffer_push(&batch[0]);
+            }
+            continue;
+        }
+
+        // Online: drain the backlog in paced batches between live readings
+        TickType_t wait = pdMS_TO_TICKS(1000);
+        if (telemetry_buffer_pending() > 0) {
+            wait = mqtt_replay(batch, payload);
+        }
+        if (xQueueReceive(s_queue, &batch[0], wait) != pdTRUE) {
+            continue;
+        }
+
+#if CONFIG_GEEKHOUSE_MQTT_BATCH_MS > 0
+        // Coalesce everything that arrives within the window
+        size_t count = 1;
+        TickType_t start = xTaskGetTickCount();
+        TickType_t window = pdMS_TO_TICKS(CONFIG_GEEKHOUSE_MQTT_BATCH_MS);
+        while (count < MQTT_BATCH_MAX) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= window ||
+                xQueueReceive(s_queue, &batch[count], window - elapsed) != pdTRUE) {
+                break;
+            }
+            count++;
+        }
+
+        size_t len = mqtt_encode_batch_payload(payload, sizeof(payload), batch, count);
+        metrics_observe(s_batch_metric, count);
+        mqtt_publish_live(MQTT_TOPIC_BATCH, payload, len, batch, count);
+#else
+        char topic[48];
+        snprintf(topic, sizeof(topic), MQTT_TOPIC_PREFIX "/sensors/%d/value", batch[0].id);
+        size_t len = mqtt_encode_reading_payload(payload, sizeof(payload), &batch[0]);
+        metrics_observe(s_batch_metric, 1);
+        mqtt_publish_live(topic, payload, len, batch, 1);
+#endif
+    }
+}
+
+void mqtt_publisher_on_sample(const sensor_reading_t *reading) {
+    if (s_queue == NULL || reading == NULL) {
+        return;
+    }
+    if (xQueueSend(s_queue, reading, 0) != pdTRUE) {
+        portENTER_CRITICAL(&s_mqtt_mux);
+        s_stats.dropped++;
+        portEXIT_CRITICAL(&s_mqtt_mux);
+        metrics_inc(s_dropped_metric);
+    }
+}
+
+/**
+ * Metrics collector: store-and-forward buffer counters
+ */
+static void mqtt_buffer_collector(metrics_writer_t *w, void *arg) {
+    (void) arg;
+    telemetry_buffer_stats_t stats;
+    telemetry_buffer_get_stats(&stats);
+
+    metrics_write_family(w, "geekhouse_mqtt_buffered_total", METRIC_COUNTER,
+                         "Readings kept for later delivery");
+    metrics_write_sample(w, "geekhouse_mqtt_buffered_total", NULL, stats.buffered);
+    metrics_write_family(w, "geekhouse_mqtt_buffer_dropped_total", METRIC_COUNTER,
+                         "Buffered readings lost to a full buffer");
+    metrics_write_sample(w, "geekhouse_mqtt_buffer_dropped_total", NULL, stats.dropped);
+    metrics_write_family(w, "geekhouse_mqtt_replayed_total", METRIC_COUNTER,
+                         "Buffered readings published after reconnecting");
+    metrics_write_sample(w, "geekhouse_mqtt_replayed_total", NULL, stats.replayed);
+    metrics_write_family(w, "geekhouse_mqtt_buffer_pending", METRIC_GAUGE,
+                         "Readings waiting for delivery");
+    metrics_write_sample(w, "geekhouse_mqtt_buffer_pending", "storage=\"ram\"",
+                         stats.pending_ram);
+    metrics_write_sample(w, "geekhouse_mqtt_buffer_pending", "storage=\"flash\"",
+                         stats.pending_flash);
+}
+
+esp_err_t mqtt_publisher_init(void) {
+    // Store-and-forward buffer, spilling to flash if the partition table has room for it
+    telemetry_flash_t flash;
+    bool have_flash = telemetry_buffer_partition(&flash) == ESP_OK;
+    if (!have_flash) {
+        ESP_LOGW(TAG, "No '%s' partition, buffering in RAM only", TELEMETRY_PARTITION);
+    }
+    esp_err_t ret = telemetry_buffer_init(have_flash ? &flash : NULL);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    s_queue = xQueueCreate(MQTT_QUEUE_LENGTH, sizeof(sensor_reading_t));
+    if (s_queue == NULL) {
+        ESP_LOGE(TAG, "Failed to create reading queue");
+        return ESP_ERR_NO_MEM;
+    }
+
+    const esp_mqtt_client_config_t config = {
+        .broker.address.uri = CONFIG_GEEKHOUSE_MQTT_BROKER_URL,
+        .session.last_will =
+            {
+                .topic = MQTT_TOPIC_STATUS,
+                .msg = "{\"online\":false}",
+                .qos = 1,
+                .retain = 1,
+            },
+        .buffer.out_size = MQTT_PAYLOAD_MAX + 64,  // Payload + topic + fixed header
+    };
+    s_client = esp_mqtt_client_init(&config);
+    if (s_client == NULL) {
+        ESP_LOGE(TAG, "Failed to create MQTT client");
+        return ESP_ERR_NO_MEM;
+    }
+    esp_mqtt_client_register_event(s_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+
+    s_publishes_metric =
+        metrics_counter("geekhouse_mqtt_publishes_total", NULL, "Completed MQTT publishes");
+    s_errors_metric = metrics_counter("geekhouse_mqtt_publish_errors_total", NULL,
+                                      "Failed or unacknowledged MQTT publishes");
+    s_readings_metric =
+        metrics_counter("geekhouse_mqtt_readings_total", NULL, "Sensor readings published");
+    s_dropped_metric = metrics_counter("geekhouse_mqtt_dropped_total", NULL,
+                                       "Sensor readings dropped (publisher queue full)");
+    s_bytes_metric =
+        metrics_counter("geekhouse_mqtt_payload_bytes_total", NULL, "MQTT payload bytes published");
+    s_inflight_metric =
+        metrics_gauge("geekhouse_mqtt_inflight", NULL, "QoS 1 publishes awaiting PUBACK");
+    s_latency_metric = metrics_histogram(
+        "geekhouse_mqtt_publish_latency_us", NULL, "Publish call (QoS 0) or PUBACK round trip",
+        LATENCY_BOUNDS_US, sizeof(LATENCY_BOUNDS_US) / sizeof(LATENCY_BOUNDS_US[0]));
+    s_batch_metric =
+        metrics_histogram("geekhouse_mqtt_batch_readings", NULL, "Readings per MQTT publish",
+                          BATCH_BOUNDS, sizeof(BATCH_BOUNDS) / sizeof(BATCH_BOUNDS[0]));
+    metrics_register_collector(mqtt_buffer_collector, NULL);
+
+    ESP_LOGI(TAG, "MQTT publisher ready (broker %s)", CONFIG_GEEKHOUSE_MQTT_BROKER_URL);
+    return ESP_OK;
+}
+
+esp_err_t mqtt_publisher_start(void) {
+    if (s_client == NULL || s_started) {
+        return ESP_OK;
+    }
+    esp_err_t ret = esp_mqtt_client_start(s_client);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to start MQTT client: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    s_started = true;
+    return ESP_OK;
+}
+
+void mqtt_publisher_stop(void) {
+    if (s_client == NULL || !s_started) {
+        return;
+    }
+    esp_mqtt_client_stop(s_client);
+    s_started = false;
+    s_connected = false;
+    ESP_LOGI(TAG, "MQTT client stopped");
+}
+
+esp_mqtt_client_handle_t mqtt_publisher_get_client(void) {
+    return s_client;
+}
+
+esp_err_t mqtt_publisher_get_stats(mqtt_publisher_stats_t *stats) {
+    if (stats == NULL) {
+        ESP_LOGE(TAG, "Invalid argument: stats is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_mqtt_mux);
+    *stats = s_stats;
+    stats->inflight = s_inflight_count;
+    portEXIT_CRITICAL(&s_mqtt_mux);
+    stats->connected = s_connected;
+    return ESP_OK;
+}
+
+#else  // !CONFIG_GEEKHOUSE_MQTT
+
+esp_err_t mqtt_publisher_get_stats(mqtt_publisher_stats_t *stats) {
+    (void) stats;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif  // CONFIG_GEEKHOUSE_MQTT
@@ -0,0 +1,177 @@
+#ifndef MQTT_PUBLISHER_H
+#define MQTT_PUBLISHER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "sensors.h"
+
+// MQTT telemetry publisher (CONFIG_GEEKHOUSE_MQTT)
+//
+// sensor_task hands every reading to mqtt_publisher_on_sample(), which only
+// queues it. The publisher task coalesces the readings that arrive within
+// CONFIG_GEEKHOUSE_MQTT_BATCH_MS into one payload per publish:
+//
+//   geekhouse/sensors/batch      {"ts":<ms>,"r":[[<id>,<dt ms>,<raw>,<value>],...]}
+//
+// ts is the timestamp of the first reading, dt is relative to it. With a
+// window of 0 every reading is published on its own:
+//
+//   geekhouse/sensors/<id>/value {"ts":<ms>,"raw":<raw>,"value":<value>,"unit":"<unit>"}
+//
+// With CONFIG_GEEKHOUSE_MQTT_CBOR the same structures are sent as CBOR
+// (RFC 8949) on the same topics: a two-sensor batch shrinks to roughly half.
+// Subscribers can tell the formats apart by the first byte ('{' vs a CBOR map).
+//
+// The network supervisor connects the client while online. QoS 1
+// publishes are limited to MQTT_INFLIGHT_MAX awaiting PUBACK; while the
+// limit is reached, readings keep queueing and end up in the next batch.
+// tools/mqtt_bench.py decodes both formats and compares them on a broker.
+//
+// While disconnected, and when a publish fails, readings go into the
+// store-and-forward buffer (telemetry_buffer.h: RAM, then the "telemetry"
+// flash partition). After reconnecting it drains oldest-first, in the batch
+// format but on its own topic, paced at CONFIG_GEEKHOUSE_MQTT_REPLAY_RATE
+// readings per second between live publishes:
+//
+//   geekhouse/sensors/replay     {"ts":<ms>,"r":[[<id>,<dt ms>,<raw>,<value>],...]}
+
+#define MQTT_TOPIC_PREFIX   "geekhouse"
+#define MQTT_QUEUE_LENGTH   32     // Readings waiting for the publisher
+#define MQTT_BATCH_MAX      32     // Readings per payload
+#define MQTT_PAYLOAD_MAX    1024   // Fits MQTT_BATCH_MAX readings
+#define MQTT_INFLIGHT_MAX   8      // QoS 1 publishes awaiting PUBACK
+#define MQTT_ACK_TIMEOUT_MS 10000  // In-flight entry given up after this
+
+// Publisher statistics
+typedef struct {
+    bool connected;
+    uint32_t publishes;        // Successful publishes (QoS 1: acknowledged)
+    uint32_t errors;           // Failed or unacknowledged publishes
+    uint32_t readings;         // Readings published
+    uint32_t dropped;          // Readings dropped because the queue was full
+    uint32_t bytes;            // Payload bytes published
+    uint32_t inflight;         // QoS 1 publishes awaiting PUBACK
+    uint32_t last_latency_us;  // Publish call (QoS 0) or PUBACK round trip (QoS 1)
+    uint32_t max_latency_us;
+} mqtt_publisher_stats_t;
+
+#ifdef CONFIG_GEEKHOUSE_MQTT
+
+#include "mqtt_client.h"
+
+/**
+ * Create the reading queue and the MQTT client (not connected yet)
+ *
+ * @return ESP_OK on success, ESP_ERR_NO_MEM on allocation failure
+ */
+esp_err_t mqtt_publisher_init(void);
+
+/**
+ * Publisher task: coalesces queued readings and publishes them
+ *
+ * @param pvParameters Unused
+ */
+void mqtt_publisher_task(void *pvParameters);
+
+/**
+ * Queue a reading for publishing (never blocks; counted as dropped if full)
+ *
+ * @param reading Reading (copied)
+ */
+void mqtt_publisher_on_sample(const sensor_reading_t *reading);
+
+/**
+ * Connect to the broker (called by the network supervisor when online)
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t mqtt_publisher_start(void);
+
+/**
+ * Disconnect from the broker (called by the network supervisor when offline)
+ */
+void mqtt_publisher_stop(void);
+
+/**
+ * Get the MQTT client (shared with the command handler, see mqtt_commands.h)
+ *
+ * @return Client handle, NULL before mqtt_publisher_init()
+ */
+esp_mqtt_client_handle_t mqtt_publisher_get_client(void);
+
+#else
+
+static inline esp_err_t mqtt_publisher_init(void) {
+    return ESP_OK;
+}
+
+static inline void mqtt_publisher_on_sample(const sensor_reading_t *reading) {
+    (void) reading;
+}
+
+static inline esp_err_t mqtt_publisher_start(void) {
+    return ESP_OK;
+}
+
+static inline void mqtt_publisher_stop(void) {
+}
+
+#endif  // CONFIG_GEEKHOUSE_MQTT
+
+/**
+ * Encode readings as one batch payload (format above)
+ *
+ * @param[out] buf Output buffer
+ * @param size Buffer size
+ * @param readings Readings, oldest first
+ * @param count Number of readings
+ * @return Payload length, 0 if it doesn't fit
+ */
+size_t mqtt_encode_batch(char *buf, size_t size, const sensor_reading_t *readings, size_t count);
+
+/**
+ * Encode one reading as a per-sensor payload (format above)
+ *
+ * @return Payload length, 0 if it doesn't fit
+ */
+size_t mqtt_encode_reading(char *buf, size_t size, const sensor_reading_t *reading);
+
+/**
+ * Encode readings as one batch payload in CBOR (same structure as the JSON)
+ *
+ * @return Payload length, 0 if it doesn't fit
+ */
+size_t mqtt_encode_batch_cbor(uint8_t *buf, size_t size, const sensor_reading_t *readings,
+                              size_t count);
+
+/**
+ * Encode one reading as a per-sensor payload in CBOR
+ *
+ * @return Payload length, 0 if it doesn't fit
+ */
+size_t mqtt_encode_reading_cbor(uint8_t *buf, size_t size, const sensor_reading_t *reading);
+
+// Encoders for the configured payload format (JSON, or CBOR with CONFIG_GEEKHOUSE_MQTT_CBOR)
+#ifdef CONFIG_GEEKHOUSE_MQTT_CBOR
+#define mqtt_encode_batch_payload(buf, size, readings, count) \
+    mqtt_encode_batch_cbor((uint8_t *) (buf), size, readings, count)
+#define mqtt_encode_reading_payload(buf, size, reading) \
+    mqtt_encode_reading_cbor((uint8_t *) (buf), size, reading)
+#else
+#define mqtt_encode_batch_payload   mqtt_encode_batch
+#define mqtt_encode_reading_payload mqtt_encode_reading
+#endif
+
+/**
+ * Get publisher statistics
+ *
+ * @param[out] stats Statistics
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if MQTT is disabled
+ */
+esp_err_t mqtt_publisher_get_stats(mqtt_publisher_stats_t *stats);
+
+#endif  // MQTT_PUBLISHER_H
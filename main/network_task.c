@@ -1,35 +1,207 @@
 #include "network_task.h"
 
+#include <stdbool.h>
+
+#include "boot.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "http_server.h"
+#include "metrics.h"
+#include "mqtt_publisher.h"
 #include "time_sync.h"
 #include "wifi_manager.h"
 
 static const char *TAG = "NETWORK_TASK";
 
+static const char *const STATE_NAMES[] = {
+    [NETWORK_STATE_CONNECTING] = "connecting",
+    [NETWORK_STATE_ONLINE] = "online",
+    [NETWORK_STATE_DEGRADED] = "degraded",
+    [NETWORK_STATE_OFFLINE] = "offline",
+};
+
+static const uint32_t RECOVERY_BOUNDS_MS[] = {1000, 2000, 5000, 10000, 30000, 60000, 300000};
+
+// Supervisor state (written by the network task only, read under s_stats_mux)
+static network_stats_t s_stats = {.state = NETWORK_STATE_CONNECTING};
+static int64_t s_down_since_us = 0;  // Start of the current outage, 0 if none
+static bool s_services_running = false;
+static portMUX_TYPE s_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Metrics
+static metric_t *s_up_metric = NULL;
+static metric_t *s_outages_metric = NULL;
+static metric_t *s_downtime_metric = NULL;
+static metric_t *s_recovery_metric = NULL;
+
+static void network_set_state(network_state_t state) {
+    ESP_LOGI(TAG, "State %s -> %s", STATE_NAMES[s_stats.state], STATE_NAMES[state]);
+    portENTER_CRITICAL(&s_stats_mux);
+    s_stats.state = state;
+    portEXIT_CRITICAL(&s_stats_mux);
+    metrics_set(s_up_metric, state == NETWORK_STATE_ONLINE);
+}
+
+/**
+ * Start the HTTP server, SNTP and MQTT (no-op if already running)
+ */
+static esp_err_t network_start_services(void) {
+    if (s_services_running) {
+        return ESP_OK;
+    }
+
+    ESP_LOGI(TAG, "Starting HTTP server...");
+    esp_err_t ret = http_server_start();
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    boot_milestone(BOOT_MILESTONE_HTTP_READY);
+
+    // Start NTP time sync (resyncs right away after an outage)
+    time_sync_init();
+
+    // Telemetry (no-op unless CONFIG_GEEKHOUSE_MQTT is set)
+    mqtt_publisher_start();
+    s_services_running = true;
+    return ESP_OK;
+}
+
+static void network_stop_services(void) {
+    if (!s_services_running) {
+        return;
+    }
+    ESP_LOGW(TAG, "Connectivity lost for %d ms, stopping services", NETWORK_STOP_GRACE_MS);
+    mqtt_publisher_stop();
+    time_sync_stop();
+    http_server_stop();
+    s_services_running = false;
+}
+
+/**
+ * Close the current outage (if any) and account for its duration
+ */
+static void network_recovered(void) {
+    if (s_down_since_us == 0) {
+        return;
+    }
+    uint32_t elapsed_ms = (uint32_t) ((esp_timer_get_time() - s_down_since_us) / 1000);
+
+    portENTER_CRITICAL(&s_stats_mux);
+    s_down_since_us = 0;
+    s_stats.downtime_ms += elapsed_ms;
+    s_stats.last_recovery_ms = elapsed_ms;
+    if (elapsed_ms > s_stats.max_recovery_ms) {
+        s_stats.max_recovery_ms = elapsed_ms;
+    }
+    portEXIT_CRITICAL(&s_stats_mux);
+
+    metrics_add(s_downtime_metric, elapsed_ms);
+    metrics_observe(s_recovery_metric, elapsed_ms);
+    ESP_LOGI(TAG, "Recovered after %lu ms", elapsed_ms);
+}
+
+static void network_metrics_init(void) {
+    s_up_metric = metrics_gauge("geekhouse_network_up", NULL,
+                                "1 if connected with network services running");
+    s_outages_metric =
+        metrics_counter("geekhouse_network_outages_total", NULL, "Connectivity losses");
+    s_downtime_metric = metrics_counter("geekhouse_network_downtime_ms_total", NULL,
+                                        "Time without connectivity (closed outages)");
+    s_recovery_metric = metrics_histogram(
+        "geekhouse_network_recovery_ms", NULL, "Connectivity loss to services reachable again",
+        RECOVERY_BOUNDS_MS, sizeof(RECOVERY_BOUNDS_MS) / sizeof(RECOVERY_BOUNDS_MS[0]));
+}
+
 void network_task(void *pvParameters) {
-    // Wait for WiFi connection before starting network services
-    ESP_LOGI(TAG, "Waiting for WiFi connection...");
+    (void) pvParameters;
+
+    network_metrics_init();
     EventGroupHandle_t wifi_events = wifi_manager_get_event_group();
-    EventBits_t bits = xEventGroupWaitBits(wifi_events, WIFI_CONNECTED_BIT | WIFI_DISCONNECTED_BIT,
-                                           pdFALSE,              // Don't clear bits
-                                           pdFALSE,              // Wait for ANY bit (OR)
-                                           pdMS_TO_TICKS(30000)  // 30 second timeout
-    );
-
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(TAG, "WiFi connected!");
-
-        // Start HTTP server
-        ESP_LOGI(TAG, "Starting HTTP server...");
-        ESP_ERROR_CHECK(http_server_start());
-        // Start NTP time sync
-        time_sync_init();
-        ESP_LOGI(TAG, "Network task done, deleting self");
-
-    } else {
-        ESP_LOGW(TAG, "WiFi connection timed out, HTTP server not started");
-        ESP_LOGI(TAG, "Network task failed, deleting self");
-    }
-    vTaskDelete(NULL);
-}
\ No newline at end of file
+    ESP_LOGI(TAG, "Waiting for WiFi connection...");
+
+    while (true) {
+        EventBits_t bits;
+
+        switch (s_stats.state) {
+            case NETWORK_STATE_CONNECTING:
+            case NETWORK_STATE_OFFLINE:
+                bits = xEventGroupWaitBits(wifi_events, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE,
+                                           pdMS_TO_TICKS(NETWORK_WAIT_LOG_MS));
+                if (!(bits & WIFI_CONNECTED_BIT)) {
+                    ESP_LOGW(TAG, "Still waiting for WiFi (%s)", STATE_NAMES[s_stats.state]);
+                    break;
+                }
+                boot_milestone(BOOT_MILESTONE_WIFI_CONNECTED);
+
+                if (network_start_services() != ESP_OK) {
+                    ESP_LOGE(TAG, "Service start failed, retrying in %d ms",
+                             NETWORK_START_RETRY_MS);
+                    vTaskDelay(pdMS_TO_TICKS(NETWORK_START_RETRY_MS));
+                    break;
+                }
+                network_recovered();
+                network_set_state(NETWORK_STATE_ONLINE);
+                break;
+
+            case NETWORK_STATE_ONLINE:
+                // Level-triggered: the WiFi manager keeps the bit set while disconnected
+                bits = xEventGroupWaitBits(wifi_events, WIFI_DISCONNECTED_BIT, pdFALSE, pdTRUE,
+                                           portMAX_DELAY);
+                if (!(bits & WIFI_DISCONNECTED_BIT)) {
+                    break;
+                }
+                portENTER_CRITICAL(&s_stats_mux);
+                s_down_since_us = esp_timer_get_time();
+                s_stats.outages++;
+                portEXIT_CRITICAL(&s_stats_mux);
+                metrics_inc(s_outages_metric);
+                network_set_state(NETWORK_STATE_DEGRADED);
+                break;
+
+            case NETWORK_STATE_DEGRADED: {
+                // Keep services through short blips; the listening socket survives them
+                int64_t elapsed_ms = (esp_timer_get_time() - s_down_since_us) / 1000;
+                int64_t remaining_ms = NETWORK_STOP_GRACE_MS - elapsed_ms;
+                if (remaining_ms > 0) {
+                    bits = xEventGroupWaitBits(wifi_events, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE,
+                                               pdMS_TO_TICKS(remaining_ms));
+                    if (bits & WIFI_CONNECTED_BIT) {
+                        network_recovered();
+                        network_set_state(NETWORK_STATE_ONLINE);
+                    }
+                    break;
+                }
+
+                network_stop_services();
+                portENTER_CRITICAL(&s_stats_mux);
+                s_stats.restarts++;
+                portEXIT_CRITICAL(&s_stats_mux);
+                network_set_state(NETWORK_STATE_OFFLINE);
+                break;
+            }
+        }
+    }
+}
+
+esp_err_t network_get_stats(network_stats_t *stats) {
+    if (stats == NULL) {
+        ESP_LOGE(TAG, "Invalid argument: stats is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_stats_mux);
+    *stats = s_stats;
+    int64_t down_since_us = s_down_since_us;
+    portEXIT_CRITICAL(&s_stats_mux);
+
+    if (down_since_us != 0) {
+        stats->downtime_ms += (uint32_t) ((esp_timer_get_time() - down_since_us) / 1000);
+    }
+    return ESP_OK;
+}
+
+const char *network_state_name(network_state_t state) {
+    return state <= NETWORK_STATE_OFFLINE ? STATE_NAMES[state] : "unknown";
+}
@@ -1,6 +1,61 @@
 #ifndef NETWORK_TASK_H
 #define NETWORK_TASK_H
 
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Network supervisor
+//
+// network_task() runs for the lifetime of the device. It follows the WiFi
+// manager's event bits, starts the HTTP server, SNTP and MQTT when an IP
+// address is available, and stops them when connectivity has been gone
+// for longer than NETWORK_STOP_GRACE_MS (shorter blips keep them running).
+// Outages, downtime and recovery time are exported as metrics and in
+// GET /api/system.
+
+#define NETWORK_STOP_GRACE_MS  15000  // Outage length before services are stopped
+#define NETWORK_START_RETRY_MS 5000   // Delay before retrying a failed service start
+#define NETWORK_WAIT_LOG_MS    30000  // Log interval while waiting for WiFi
+
+typedef enum {
+    NETWORK_STATE_CONNECTING,  // Waiting for the first IP address
+    NETWORK_STATE_ONLINE,      // Connected, services running
+    NETWORK_STATE_DEGRADED,    // Connectivity lost, services kept for the grace period
+    NETWORK_STATE_OFFLINE,     // Connectivity lost, services stopped
+} network_state_t;
+
+// Supervisor statistics
+typedef struct {
+    network_state_t state;
+    uint32_t outages;           // Connectivity losses after the first connect
+    uint32_t restarts;          // Outages that outlasted the grace period
+    uint32_t downtime_ms;       // Total time without connectivity (incl. current outage)
+    uint32_t last_recovery_ms;  // Loss to services reachable again, last outage
+    uint32_t max_recovery_ms;   // Longest recovery
+} network_stats_t;
+
+/**
+ * Network supervisor task
+ *
+ * Never returns. Must be started after wifi_manager_init().
+ */
 void network_task(void *pvParameters);
 
-#endif  // NETWORK_TASK_H
\ No newline at end of file
+/**
+ * Get supervisor statistics
+ *
+ * @param[out] stats Statistics
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t network_get_stats(network_stats_t *stats);
+
+/**
+ * Get a state name
+ *
+ * @param state State
+ * @return Name, e.g. "online"
+ */
+const char *network_state_name(network_state_t state);
+
+#endif  // NETWORK_TASK_H
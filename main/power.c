@@ -0,0 +1,234 @@
+#include "power.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "esp_log.h"
+
+static const char *TAG = "POWER";
+
+static const char *const LOCK_NAMES[POWER_LOCK_COUNT] = {"adc", "http", "pwm"};
+static const char *const WAKE_NAMES[POWER_WAKE_COUNT] = {"timer", "wifi", "gpio", "uart",
+                                                         "other"};
+
+const char *power_lock_name(power_lock_t lock) {
+    return lock < POWER_LOCK_COUNT ? LOCK_NAMES[lock] : "?";
+}
+
+const char *power_wake_name(power_wake_t cause) {
+    return cause < POWER_WAKE_COUNT ? WAKE_NAMES[cause] : "?";
+}
+
+#ifdef CONFIG_GEEKHOUSE_POWER_SAVE
+
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "metrics.h"
+
+// What each lock keeps up: CPU_FREQ_MAX also holds the APB clock, and any
+// lock keeps the chip out of light sleep
+static const esp_pm_lock_type_t LOCK_TYPES[POWER_LOCK_COUNT] = {
+    [POWER_LOCK_ADC] = ESP_PM_APB_FREQ_MAX,
+    [POWER_LOCK_HTTP] = ESP_PM_CPU_FREQ_MAX,
+    [POWER_LOCK_PWM] = ESP_PM_APB_FREQ_MAX,
+};
+
+static esp_pm_lock_handle_t s_locks[POWER_LOCK_COUNT];
+static bool s_initialized = false;
+
+// Accounting, guarded by s_power_mux (also taken from the sleep callback)
+static power_stats_t s_stats;
+static int64_t s_start_us = 0;             // power_init time
+static uint32_t s_held[POWER_LOCK_COUNT];  // Outstanding acquires per lock
+static int64_t s_held_since[POWER_LOCK_COUNT];
+static uint32_t s_active = 0;  // Locks with s_held > 0
+static int64_t s_active_since = 0;
+static portMUX_TYPE s_power_mux = portMUX_INITIALIZER_UNLOCKED;
+
+void power_lock_acquire(power_lock_t lock) {
+    if (!s_initialized || lock >= POWER_LOCK_COUNT) {
+        return;
+    }
+    esp_pm_lock_acquire(s_locks[lock]);
+
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_power_mux);
+    s_stats.lock_acquires[lock]++;
+    if (s_held[lock]++ == 0) {
+        s_held_since[lock] = now;
+        if (s_active++ == 0) {
+            s_active_since = now;
+        }
+    }
+    portEXIT_CRITICAL(&s_power_mux);
+}
+
+void power_lock_release(power_lock_t lock) {
+    if (!s_initialized || lock >= POWER_LOCK_COUNT) {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_power_mux);
+    if (s_held[lock] > 0 && --s_held[lock] == 0) {
+        uint32_t held_us = (uint32_t) (now - s_held_since[lock]);
+        s_stats.lock_held_us[lock] += held_us;
+        if (held_us > s_stats.lock_held_max_us[lock]) {
+            s_stats.lock_held_max_us[lock] = held_us;
+        }
+        if (--s_active == 0) {
+            s_stats.active_us += now - s_active_since;
+        }
+    }
+    portEXIT_CRITICAL(&s_power_mux);
+
+    esp_pm_lock_release(s_locks[lock]);
+}
+
+static power_wake_t power_wake_cause(void) {
+    switch (esp_sleep_get_wakeup_cause()) {
+        case ESP_SLEEP_WAKEUP_TIMER:
+            return POWER_WAKE_TIMER;
+        case ESP_SLEEP_WAKEUP_WIFI:
+            return POWER_WAKE_WIFI;
+        case ESP_SLEEP_WAKEUP_GPIO:
+            return POWER_WAKE_GPIO;
+        case ESP_SLEEP_WAKEUP_UART:
+            return POWER_WAKE_UART;
+        default:
+            return POWER_WAKE_OTHER;
+    }
+}
+
+/**
+ * Light sleep exit callback (idle task, scheduler suspended - keep it short)
+ */
+static esp_err_t power_sleep_exit(int64_t slept_us, void *arg) {
+    (void) arg;
+    power_wake_t cause = power_wake_cause();
+
+    portENTER_CRITICAL_SAFE(&s_power_mux);
+    s_stats.sleeps++;
+    s_stats.sleep_us += slept_us;
+    s_stats.wakeups[cause]++;
+    portEXIT_CRITICAL_SAFE(&s_power_mux);
+    return ESP_OK;
+}
+
+/**
+ * Metrics collector: time per power state, wakeups and lock use
+ */
+static void power_collector(metrics_writer_t *w, void *arg) {
+    (void) arg;
+    power_stats_t stats;
+    power_get_stats(&stats);
+
+    metrics_write_family(w, "geekhouse_power_state_us_total", METRIC_COUNTER,
+                         "Time spent per power state");
+    metrics_write_sample(w, "geekhouse_power_state_us_total", "state=\"sleep\"",
+                         (int64_t) stats.sleep_us);
+    metrics_write_sample(w, "geekhouse_power_state_us_total", "state=\"active\"",
+                         (int64_t) stats.active_us);
+    metrics_write_sample(w, "geekhouse_power_state_us_total", "state=\"idle\"",
+                         (int64_t) stats.idle_us);
+
+    metrics_write_family(w, "geekhouse_power_wakeups_total", METRIC_COUNTER,
+                         "Light sleep wakeups by cause");
+    for (int i = 0; i < POWER_WAKE_COUNT; i++) {
+        char labels[24];
+        snprintf(labels, sizeof(labels), "cause=\"%s\"", WAKE_NAMES[i]);
+        metrics_write_sample(w, "geekhouse_power_wakeups_total", labels, stats.wakeups[i]);
+    }
+
+    metrics_write_family(w, "geekhouse_power_lock_held_us_total", METRIC_COUNTER,
+                         "Time a power lock kept clocks up");
+    for (int i = 0; i < POWER_LOCK_COUNT; i++) {
+        char labels[24];
+        snprintf(labels, sizeof(labels), "lock=\"%s\"", LOCK_NAMES[i]);
+        metrics_write_sample(w, "geekhouse_power_lock_held_us_total", labels,
+                             (int64_t) stats.lock_held_us[i]);
+    }
+}
+
+esp_err_t power_init(void) {
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz = CONFIG_GEEKHOUSE_PM_MAX_MHZ,
+        .min_freq_mhz = CONFIG_GEEKHOUSE_PM_MIN_MHZ,
+        .light_sleep_enable = true,
+    };
+    esp_err_t ret = esp_pm_configure(&pm_config);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to configure power management: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    for (int i = 0; i < POWER_LOCK_COUNT; i++) {
+        ret = esp_pm_lock_create(LOCK_TYPES[i], 0, LOCK_NAMES[i], &s_locks[i]);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create %s lock: %s", LOCK_NAMES[i], esp_err_to_name(ret));
+            return ret;
+        }
+    }
+
+    esp_pm_sleep_cbs_register_config_t cbs = {
+        .exit_cb = power_sleep_exit,
+    };
+    ret = esp_pm_light_sleep_register_cbs(&cbs);
+    if (ret != ESP_OK) {
+        // Sleep still works, it just isn't measured
+        ESP_LOGW(TAG, "No light sleep callbacks: %s", esp_err_to_name(ret));
+    }
+
+    s_stats.max_mhz = CONFIG_GEEKHOUSE_PM_MAX_MHZ;
+    s_stats.min_mhz = CONFIG_GEEKHOUSE_PM_MIN_MHZ;
+    s_stats.listen_interval = CONFIG_GEEKHOUSE_WIFI_LISTEN_INTERVAL;
+    s_start_us = esp_timer_get_time();
+    s_initialized = true;
+
+    metrics_register_collector(power_collector, NULL);
+
+    ESP_LOGI(TAG, "DFS %d-%d MHz, automatic light sleep, WiFi listen interval %d",
+             CONFIG_GEEKHOUSE_PM_MIN_MHZ, CONFIG_GEEKHOUSE_PM_MAX_MHZ,
+             CONFIG_GEEKHOUSE_WIFI_LISTEN_INTERVAL);
+    return ESP_OK;
+}
+
+esp_err_t power_get_stats(power_stats_t *stats) {
+    if (stats == NULL) {
+        ESP_LOGE(TAG, "Invalid argument: stats is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&s_power_mux);
+    *stats = s_stats;
+    // Count the time of locks still held
+    for (int i = 0; i < POWER_LOCK_COUNT; i++) {
+        if (s_held[i] > 0) {
+            stats->lock_held_us[i] += now - s_held_since[i];
+        }
+    }
+    if (s_active > 0) {
+        stats->active_us += now - s_active_since;
+    }
+    portEXIT_CRITICAL(&s_power_mux);
+
+    stats->uptime_us = s_initialized ? now - s_start_us : 0;
+    uint64_t accounted = stats->sleep_us + stats->active_us;
+    stats->idle_us = stats->uptime_us > accounted ? stats->uptime_us - accounted : 0;
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t power_get_stats(power_stats_t *stats) {
+    if (stats == NULL) {
+        ESP_LOGE(TAG, "Invalid argument: stats is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif  // CONFIG_GEEKHOUSE_POWER_SAVE
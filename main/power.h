@@ -0,0 +1,122 @@
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+// Power management (CONFIG_GEEKHOUSE_POWER_SAVE)
+//
+// Configures esp_pm for dynamic frequency scaling between
+// CONFIG_GEEKHOUSE_PM_MIN_MHZ and CONFIG_GEEKHOUSE_PM_MAX_MHZ with automatic
+// light sleep: whenever every task is blocked and no PM lock is held, the
+// idle task puts the chip to sleep until the next timer or WiFi beacon.
+// WiFi runs in modem sleep and wakes for every
+// CONFIG_GEEKHOUSE_WIFI_LISTEN_INTERVAL-th beacon (wifi_manager.c), which
+// bounds how long an incoming request waits for the radio.
+//
+// Work that needs full clocks holds a power lock while it runs:
+//   adc   ADC conversions (stable APB clock)
+//   http  HTTP handlers (full CPU speed, no sleep mid-request)
+//   pwm   while a dimmable LED is lit or fading (LEDC stops in light sleep)
+//
+// Uptime is split into three states:
+//   sleep   light sleep, measured by the sleep exit callback
+//   active  at least one of our power locks held
+//   idle    awake otherwise: at the DFS minimum, unless a driver (WiFi)
+//           holds its own lock
+// Light sleep wakeups are counted by cause.
+
+// Power locks held by the application
+typedef enum {
+    POWER_LOCK_ADC = 0,
+    POWER_LOCK_HTTP,
+    POWER_LOCK_PWM,
+    POWER_LOCK_COUNT
+} power_lock_t;
+
+// Light sleep wakeup causes
+typedef enum {
+    POWER_WAKE_TIMER = 0,  // FreeRTOS tick or esp_timer deadline
+    POWER_WAKE_WIFI,       // Beacon or received frame
+    POWER_WAKE_GPIO,
+    POWER_WAKE_UART,
+    POWER_WAKE_OTHER,
+    POWER_WAKE_COUNT
+} power_wake_t;
+
+// Power statistics (cumulative since power_init)
+typedef struct {
+    uint64_t uptime_us;  // Since power_init
+    uint64_t sleep_us;
+    uint64_t active_us;
+    uint64_t idle_us;  // uptime_us - sleep_us - active_us
+    uint32_t sleeps;   // Light sleep entries
+    uint32_t wakeups[POWER_WAKE_COUNT];
+    uint32_t lock_acquires[POWER_LOCK_COUNT];
+    uint64_t lock_held_us[POWER_LOCK_COUNT];
+    uint32_t lock_held_max_us[POWER_LOCK_COUNT];
+    uint16_t max_mhz;
+    uint16_t min_mhz;
+    uint8_t listen_interval;  // WiFi beacons per wakeup
+} power_stats_t;
+
+/**
+ * Get the name of a power lock ("adc", "http", "pwm")
+ */
+const char *power_lock_name(power_lock_t lock);
+
+/**
+ * Get the name of a wakeup cause ("timer", "wifi", "gpio", "uart", "other")
+ */
+const char *power_wake_name(power_wake_t cause);
+
+#ifdef CONFIG_GEEKHOUSE_POWER_SAVE
+
+/**
+ * Enable DFS and automatic light sleep, create the power locks
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t power_init(void);
+
+/**
+ * Keep clocks up until the matching power_lock_release()
+ *
+ * Locks count: each acquire needs its own release. Safe from any task,
+ * not from ISRs. A no-op before power_init().
+ */
+void power_lock_acquire(power_lock_t lock);
+
+/**
+ * Release a power lock taken with power_lock_acquire()
+ */
+void power_lock_release(power_lock_t lock);
+
+#else
+
+static inline esp_err_t power_init(void) {
+    return ESP_OK;
+}
+
+static inline void power_lock_acquire(power_lock_t lock) {
+    (void) lock;
+}
+
+static inline void power_lock_release(power_lock_t lock) {
+    (void) lock;
+}
+
+#endif  // CONFIG_GEEKHOUSE_POWER_SAVE
+
+/**
+ * Get power statistics
+ *
+ * @param[out] stats Statistics
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if stats is NULL,
+ *         ESP_ERR_NOT_SUPPORTED if power saving is disabled
+ */
+esp_err_t power_get_stats(power_stats_t *stats);
+
+#endif  // POWER_H
@@ -45,10 +45,10 @@ void reporter_task(void *pvParameters) {
 
         if ((bits & ALL_SENSORS_READY_BITS) == ALL_SENSORS_READY_BITS) {
             // Read from shared structure
-            if (xSemaphoreTake(g_shared_data_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+            if (profiled_mutex_take(&g_shared_data_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
                 int light = g_shared_sensor_data.light_raw;
                 int water = g_shared_sensor_data.water_raw;
-                xSemaphoreGive(g_shared_data_mutex);
+                profiled_mutex_give(&g_shared_data_mutex);
 
                 // Update statistics
                 if (light < stats.light_min) {
@@ -0,0 +1,390 @@
+#include "rules.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#include "actuators.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "lock_profiler.h"
+#include "nvs.h"
+#include "trace.h"
+
+static const char *TAG = "RULES";
+
+// NVS namespace and keys
+#define NVS_NAMESPACE "rules"
+#define NVS_KEY_RULES "table"
+
+// Version of the stored blob - bump when rule_def_t changes
+#define RULES_BLOB_VERSION 1
+
+// Limits for rule parameters
+#define RULE_RAW_MAX          4095
+#define RULE_DURATION_MAX_MS  3600000
+#define RULE_BLINK_MIN_MS     50
+#define RULE_BLINK_MAX_MS     10000
+
+// Rule compiled for evaluation
+//
+// Both conditions are turned into "value > level" by flipping the sign
+// for RULE_COND_BELOW, so evaluation is one multiply and one compare.
+typedef struct {
+    int8_t sign;          // +1 for ABOVE, -1 for BELOW
+    int32_t enter_level;  // Active when sign * raw > enter_level
+    int32_t exit_level;   // Inactive when sign * raw < exit_level
+    uint32_t duration_ms;
+    rule_action_t enter;
+    rule_action_t exit;
+} compiled_rule_t;
+
+// Runtime state of a rule
+typedef struct {
+    bool active;
+    bool pending;            // Condition changed, waiting for duration_ms
+    uint32_t pending_since;  // Timestamp of the change
+} rule_state_t;
+
+// Stored blob layout (header + count definitions)
+typedef struct {
+    uint8_t version;
+    uint8_t count;
+    rule_def_t defs[RULES_MAX];
+} rules_blob_t;
+
+// Default rule: blink fast while the roof water sensor reads high
+// (same thresholds the blink timer used to hardcode)
+static const rule_def_t DEFAULT_RULES[] = {
+    {.sensor = SENSOR_WATER_ROOF,
+     .cond = RULE_COND_ABOVE,
+     .threshold = 30,
+     .hysteresis = 15,
+     .duration_ms = 0,
+     .enter = {.type = RULE_ACTION_BLINK_PERIOD, .value = 100},
+     .exit = {.type = RULE_ACTION_BLINK_PERIOD, .value = 500}},
+};
+
+// Rule table - all of this is protected by rules_mutex
+static rule_def_t s_defs[RULES_MAX];
+static size_t s_count = 0;
+static compiled_rule_t s_table[RULES_MAX];  // Sorted by sensor
+static rule_state_t s_state[RULES_MAX];
+static uint8_t s_first[SENSOR_COUNT + 1];  // Rules for sensor n: s_first[n]..s_first[n+1]-1
+static rules_stats_t s_stats = {0};
+
+static profiled_mutex_t rules_mutex;
+
+/**
+ * Check an action against actuator capabilities
+ */
+static bool action_is_valid(const rule_action_t *action) {
+    switch (action->type) {
+        case RULE_ACTION_NONE:
+            return true;
+
+        case RULE_ACTION_LED_ON:
+        case RULE_ACTION_LED_OFF:
+            return action->led < LED_COUNT;
+
+        case RULE_ACTION_BRIGHTNESS:
+            return action->led < LED_COUNT && action->value <= LED_BRIGHTNESS_MAX &&
+                   (led_get_info(action->led)->caps & LED_CAP_DIMMABLE);
+
+        case RULE_ACTION_BLINK_PERIOD:
+            return action->value >= RULE_BLINK_MIN_MS && action->value <= RULE_BLINK_MAX_MS;
+
+        default:
+            return false;
+    }
+}
+
+/**
+ * Check a rule definition
+ */
+static bool rule_is_valid(const rule_def_t *def) {
+    return def->sensor < SENSOR_COUNT &&
+           (def->cond == RULE_COND_ABOVE || def->cond == RULE_COND_BELOW) &&
+           def->threshold <= RULE_RAW_MAX && def->hysteresis <= RULE_RAW_MAX &&
+           def->duration_ms <= RULE_DURATION_MAX_MS && action_is_valid(&def->enter) &&
+           action_is_valid(&def->exit);
+}
+
+/**
+ * Run a rule action (called with rules_mutex held)
+ *
+ * Actions are only posted: LED changes to the actuator command ring, blink
+ * periods to the timer command queue. Both are FIFO and never block, so
+ * actions posted under the mutex land in the order the rules fired, and a
+ * reload's exit actions can't be overtaken by an enter action of a sample
+ * evaluated before it.
+ */
+static void run_action(const rule_action_t *action) {
+    led_batch_t batch = {0};
+    esp_err_t ret = ESP_OK;
+
+    switch (action->type) {
+        case RULE_ACTION_LED_ON:
+            led_batch_add(&batch, action->led, LED_ACTION_ON);
+            ret = led_post_batch(&batch);
+            break;
+
+        case RULE_ACTION_LED_OFF:
+            led_batch_add(&batch, action->led, LED_ACTION_OFF);
+            ret = led_post_batch(&batch);
+            break;
+
+        case RULE_ACTION_BRIGHTNESS:
+            ret = led_post_brightness(action->led, (uint8_t) action->value, 0);
+            break;
+
+        case RULE_ACTION_BLINK_PERIOD:
+            ret = led_blink_set_period(action->value);
+            break;
+
+        case RULE_ACTION_NONE:
+        default:
+            break;
+    }
+
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Action %d not posted: %s", action->type, esp_err_to_name(ret));
+        s_stats.actions_dropped++;
+    }
+}
+
+/**
+ * Store rule definitions in NVS as one blob (called with rules_mutex held)
+ */
+static esp_err_t rules_save(const rule_def_t *defs, size_t count) {
+    static rules_blob_t blob;  // Too big for the caller's stack
+    blob.version = RULES_BLOB_VERSION;
+    blob.count = (uint8_t) count;
+    if (count > 0) {
+        memcpy(blob.defs, defs, count * sizeof(rule_def_t));
+    }
+
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS namespace: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    ret = nvs_set_blob(handle, NVS_KEY_RULES, &blob,
+                       offsetof(rules_blob_t, defs) + count * sizeof(rule_def_t));
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store rules: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+esp_err_t rules_init(void) {
+    ESP_LOGI(TAG, "Initializing rule engine...");
+
+    if (rules_mutex.sem == NULL && profiled_mutex_init(&rules_mutex, "rules") != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create mutex");
+        return ESP_FAIL;
+    }
+
+    // Load stored rules
+    static rules_blob_t blob;
+    size_t size = sizeof(blob);
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (ret == ESP_OK) {
+        ret = nvs_get_blob(handle, NVS_KEY_RULES, &blob, &size);
+        nvs_close(handle);
+    }
+
+    if (ret == ESP_OK && blob.version == RULES_BLOB_VERSION && blob.count <= RULES_MAX &&
+        size == offsetof(rules_blob_t, defs) + blob.count * sizeof(rule_def_t)) {
+        ret = rules_load(blob.defs, blob.count, false);
+        if (ret == ESP_OK) {
+            ESP_LOGI(TAG, "Loaded %d rules from NVS", blob.count);
+            return ESP_OK;
+        }
+        ESP_LOGW(TAG, "Stored rules are invalid, using defaults");
+    } else if (ret == ESP_OK || ret == ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGI(TAG, "No stored rules, using defaults");
+    } else {
+        ESP_LOGW(TAG, "Error reading rules from NVS (%s), using defaults", esp_err_to_name(ret));
+    }
+
+    return rules_load(DEFAULT_RULES, sizeof(DEFAULT_RULES) / sizeof(DEFAULT_RULES[0]), false);
+}
+
+esp_err_t rules_load(const rule_def_t *defs, size_t count, bool persist) {
+    // Input validation
+    if ((defs == NULL && count > 0) || count > RULES_MAX) {
+        ESP_LOGE(TAG, "Invalid arguments (defs=%p, count=%d)", defs, (int) count);
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!rule_is_valid(&defs[i])) {
+            ESP_LOGW(TAG, "Rule %d is invalid", (int) i);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    // Compile into a table grouped by sensor (counting sort)
+    compiled_rule_t table[RULES_MAX];
+    uint8_t first[SENSOR_COUNT + 1] = {0};
+
+    for (size_t i = 0; i < count; i++) {
+        first[defs[i].sensor + 1]++;
+    }
+    for (int s = 0; s < SENSOR_COUNT; s++) {
+        first[s + 1] += first[s];
+    }
+
+    uint8_t next[SENSOR_COUNT];
+    memcpy(next, first, sizeof(next));
+    for (size_t i = 0; i < count; i++) {
+        const rule_def_t *def = &defs[i];
+        compiled_rule_t *rule = &table[next[def->sensor]++];
+
+        rule->sign = (def->cond == RULE_COND_ABOVE) ? 1 : -1;
+        rule->enter_level = rule->sign * (int32_t) def->threshold;
+        rule->exit_level = rule->enter_level - (int32_t) def->hysteresis;
+        rule->duration_ms = def->duration_ms;
+        rule->enter = def->enter;
+        rule->exit = def->exit;
+    }
+
+    if (profiled_mutex_take(&rules_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+        ESP_LOGW(TAG, "Failed to acquire mutex");
+        return ESP_ERR_TIMEOUT;
+    }
+
+    // Store before the swap, under the mutex: what is in NVS is always what
+    // was installed last, and a table that fails to store isn't installed
+    if (persist) {
+        esp_err_t ret = rules_save(defs, count);
+        if (ret != ESP_OK) {
+            profiled_mutex_give(&rules_mutex);
+            return ret;
+        }
+    }
+
+    // Swap in the new table
+
+    // Undo what active rules did (e.g. a fast blink) before they are forgotten.
+    // Posted under the mutex, after any action of an earlier sample.
+    int exits = 0;
+    for (size_t i = 0; i < s_count; i++) {
+        if (s_state[i].active) {
+            run_action(&s_table[i].exit);
+            exits++;
+        }
+    }
+
+    if (count > 0) {  // defs may be NULL for an empty table
+        memcpy(s_defs, defs, count * sizeof(rule_def_t));
+        memcpy(s_table, table, count * sizeof(compiled_rule_t));
+    }
+    memcpy(s_first, first, sizeof(s_first));
+    memset(s_state, 0, sizeof(s_state));
+    s_count = count;
+
+    profiled_mutex_give(&rules_mutex);
+
+    ESP_LOGI(TAG, "Installed %d rules (%d exit actions run)", (int) count, exits);
+    return ESP_OK;
+}
+
+size_t rules_get(rule_def_t *defs, size_t max) {
+    if (defs == NULL) {
+        return 0;
+    }
+
+    if (profiled_mutex_take(&rules_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+        ESP_LOGW(TAG, "Failed to acquire mutex");
+        return 0;
+    }
+
+    size_t count = s_count < max ? s_count : max;
+    memcpy(defs, s_defs, count * sizeof(rule_def_t));
+
+    profiled_mutex_give(&rules_mutex);
+    return count;
+}
+
+void rules_on_sample(sensor_id_t id, int raw, uint32_t timestamp_ms) {
+    if (id >= SENSOR_COUNT || rules_mutex.sem == NULL) {
+        return;
+    }
+
+    TRACE_SPAN_BEGIN(TRACE_SPAN_RULES);
+    if (profiled_mutex_take(&rules_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+        ESP_LOGW(TAG, "Failed to acquire mutex");
+        TRACE_SPAN_END(TRACE_SPAN_RULES);
+        return;
+    }
+
+    int64_t start = esp_timer_get_time();
+
+    // Only the rules that reference this sensor
+    for (int i = s_first[id]; i < s_first[id + 1]; i++) {
+        const compiled_rule_t *rule = &s_table[i];
+        rule_state_t *state = &s_state[i];
+
+        int32_t value = rule->sign * raw;
+        bool want_active =
+            state->active ? !(value < rule->exit_level) : (value > rule->enter_level);
+
+        if (want_active == state->active) {
+            // Condition back where it was - cancel any pending change
+            state->pending = false;
+            continue;
+        }
+
+        // Condition must hold for duration_ms before the rule switches
+        if (!state->pending) {
+            state->pending = true;
+            state->pending_since = timestamp_ms;
+        }
+        if (timestamp_ms - state->pending_since >= rule->duration_ms) {
+            state->active = want_active;
+            state->pending = false;
+            // Debug level: logging holds the mutex (and counts into eval time)
+            ESP_LOGD(TAG, "Sensor %d raw=%d: rule %d %s", id, raw, i,
+                     want_active ? "enters" : "exits");
+            run_action(want_active ? &rule->enter : &rule->exit);
+            s_stats.transitions++;
+        }
+    }
+
+    uint32_t elapsed = (uint32_t) (esp_timer_get_time() - start);
+    s_stats.frames++;
+    s_stats.rules_checked += s_first[id + 1] - s_first[id];
+    s_stats.last_eval_us = elapsed;
+    if (elapsed > s_stats.max_eval_us) {
+        s_stats.max_eval_us = elapsed;
+    }
+
+    profiled_mutex_give(&rules_mutex);
+    TRACE_SPAN_END(TRACE_SPAN_RULES);
+}
+
+void rules_get_stats(rules_stats_t *stats) {
+    if (stats == NULL) {
+        return;
+    }
+
+    if (profiled_mutex_take(&rules_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+        ESP_LOGW(TAG, "Failed to acquire mutex");
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+
+    *stats = s_stats;
+
+    profiled_mutex_give(&rules_mutex);
+}
@@ -0,0 +1,117 @@
+#ifndef RULES_H
+#define RULES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sensors.h"
+
+// Maximum number of rules in the table
+#define RULES_MAX 16
+
+// Condition that makes a rule active
+typedef enum {
+    RULE_COND_ABOVE = 0,  // raw > threshold, inactive again below threshold - hysteresis
+    RULE_COND_BELOW = 1,  // raw < threshold, inactive again above threshold + hysteresis
+} rule_cond_t;
+
+// What a rule does when it becomes active or inactive
+typedef enum {
+    RULE_ACTION_NONE = 0,
+    RULE_ACTION_LED_ON = 1,        // led = LED id
+    RULE_ACTION_LED_OFF = 2,       // led = LED id
+    RULE_ACTION_BRIGHTNESS = 3,    // led = LED id, value = 0-255
+    RULE_ACTION_BLINK_PERIOD = 4,  // value = blink period in ms
+} rule_action_type_t;
+
+// Rule action (4 bytes)
+typedef struct {
+    uint8_t type;  // rule_action_type_t
+    uint8_t led;   // led_id_t for LED actions
+    uint16_t value;
+} rule_action_t;
+
+// Rule definition - what clients send and what is stored in NVS
+//
+// "If sensor crosses threshold (with hysteresis) for duration_ms,
+//  run 'enter'; when it crosses back for duration_ms, run 'exit'."
+typedef struct {
+    uint8_t sensor;  // sensor_id_t
+    uint8_t cond;    // rule_cond_t
+    uint16_t threshold;
+    uint16_t hysteresis;
+    uint32_t duration_ms;
+    rule_action_t enter;
+    rule_action_t exit;
+} rule_def_t;
+
+// Rule engine statistics
+typedef struct {
+    uint32_t frames;           // Sensor samples evaluated
+    uint32_t rules_checked;    // Rule evaluations across all frames
+    uint32_t transitions;      // Rules that changed active state
+    uint32_t last_eval_us;     // Cost of the last frame
+    uint32_t max_eval_us;      // Worst-case cost of a frame
+    uint32_t actions_dropped;  // Actions not posted (actuator queue full)
+} rules_stats_t;
+
+/**
+ * Initialize rule engine
+ *
+ * Loads rules from NVS. On first boot, installs the default rule
+ * (fast blink while the water sensor reads high).
+ *
+ * Must be called after nvs_flash_init().
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t rules_init(void);
+
+/**
+ * Validate, compile and install a new rule table
+ *
+ * Rules are compiled into a per-sensor table, so a sample only touches
+ * the rules that reference its sensor. All rules restart as inactive:
+ * the exit actions of rules that were active run first, so nothing they
+ * set (a fast blink, an LED left on) outlives them.
+ *
+ * @param defs Rule definitions
+ * @param count Number of rules (0-RULES_MAX)
+ * @param persist Store the rules in NVS (if that fails, nothing is installed)
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if a rule is invalid,
+ *         ESP_ERR_TIMEOUT if the table is busy, or the NVS error if storing failed
+ */
+esp_err_t rules_load(const rule_def_t *defs, size_t count, bool persist);
+
+/**
+ * Get the installed rule definitions
+ *
+ * @param[out] defs Buffer for definitions
+ * @param max Buffer capacity
+ * @return Number of rules copied
+ */
+size_t rules_get(rule_def_t *defs, size_t max);
+
+/**
+ * Feed a new sensor sample to the rule engine
+ *
+ * Evaluates only the rules that reference this sensor and posts
+ * the actions of rules that change state to the actuators (without
+ * waiting for them). Called by sensor_task.
+ *
+ * @param id Sensor that produced the sample
+ * @param raw Raw ADC value
+ * @param timestamp_ms Sample time (milliseconds since boot)
+ */
+void rules_on_sample(sensor_id_t id, int raw, uint32_t timestamp_ms);
+
+/**
+ * Get rule engine statistics
+ *
+ * @param[out] stats Statistics snapshot
+ */
+void rules_get_stats(rules_stats_t *stats);
+
+#endif  // RULES_H
@@ -3,6 +3,7 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "lock_profiler.h"
 
 // Shared sensor data structure
 typedef struct {
@@ -15,6 +16,6 @@ typedef struct {
 
 // Global shared data (protected by mutex)
 extern shared_sensor_data_t g_shared_sensor_data;
-extern SemaphoreHandle_t g_shared_data_mutex;
+extern profiled_mutex_t g_shared_data_mutex;
 
 #endif  // SENSOR_DATA_SHARED_H
@@ -1,12 +1,17 @@
 #include "sensor_task.h"
 
+#include "boot.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
+#include "mqtt_publisher.h"
 #include "reporter_task.h"
+#include "rules.h"
 #include "sensor_data_shared.h"
 #include "sensors.h"
+#include "settings.h"
+#include "trace.h"
 
 static const char *TAG = "SENSOR_TASK";
 
@@ -18,12 +23,14 @@ void sensor_task(void *pvParameters) {
     sensor_reading_t reading;
 
     ESP_LOGI(TAG, "Sensor task started");
-    ESP_LOGI(TAG, "Reading sensors every 2 seconds...");
+    ESP_LOGI(TAG, "Reading sensors every %lu ms...",
+             (unsigned long) settings_get_u32(SETTING_SENSOR_PERIOD_MS));
 
     // Task loop - runs forever
     // FreeRTOS will preempt us when other tasks need CPU
     while (1) {
         // Read light sensor
+        TRACE_SPAN_BEGIN(TRACE_SPAN_SENSOR_READ);
         if (sensor_read(SENSOR_LIGHT_ROOF, &reading) == ESP_OK) {
             // Try to send to queue with 100ms timeout
             // If queue is full, this will block for up to 100ms
@@ -32,20 +39,26 @@ void sensor_task(void *pvParameters) {
                 ESP_LOGW(TAG, "Queue full, dropping light reading");
             }
             // Update shared data structure
-            if (xSemaphoreTake(g_shared_data_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+            if (profiled_mutex_take(&g_shared_data_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
                 g_shared_sensor_data.light_raw = reading.raw_value;
                 g_shared_sensor_data.light_calibrated = reading.calibrated_value;
                 g_shared_sensor_data.timestamp = reading.timestamp;
-                xSemaphoreGive(g_shared_data_mutex);
+                profiled_mutex_give(&g_shared_data_mutex);
 
                 // Signal that light sensor has new data
                 xEventGroupSetBits(events, LIGHT_SENSOR_READY_BIT);
+                boot_milestone(BOOT_MILESTONE_FIRST_SAMPLE);
             }
+            // Let automation rules react to the new sample, queue it for MQTT
+            rules_on_sample(SENSOR_LIGHT_ROOF, reading.raw_value, reading.timestamp);
+            mqtt_publisher_on_sample(&reading);
         } else {
             ESP_LOGE(TAG, "Failed to read light sensor");
         }
+        TRACE_SPAN_END(TRACE_SPAN_SENSOR_READ);
 
         // Read water sensor
+        TRACE_SPAN_BEGIN(TRACE_SPAN_SENSOR_READ);
         if (sensor_read(SENSOR_WATER_ROOF, &reading) == ESP_OK) {
             // Try to send to queue with 100ms timeout
             if (xQueueSend(queue, &reading, pdMS_TO_TICKS(100)) != pdTRUE) {
@@ -53,22 +66,26 @@ void sensor_task(void *pvParameters) {
                 ESP_LOGW(TAG, "Queue full, dropping water reading");
             }
             // Update shared data structure
-            if (xSemaphoreTake(g_shared_data_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
+            if (profiled_mutex_take(&g_shared_data_mutex, pdMS_TO_TICKS(100)) == pdTRUE) {
                 g_shared_sensor_data.water_raw = reading.raw_value;
                 g_shared_sensor_data.water_calibrated = reading.calibrated_value;
-                xSemaphoreGive(g_shared_data_mutex);
+                profiled_mutex_give(&g_shared_data_mutex);
 
                 // Signal that water sensor has new data
                 xEventGroupSetBits(events, WATER_SENSOR_READY_BIT);
             }
+            // Let automation rules react to the new sample, queue it for MQTT
+            rules_on_sample(SENSOR_WATER_ROOF, reading.raw_value, reading.timestamp);
+            mqtt_publisher_on_sample(&reading);
         } else {
             ESP_LOGE(TAG, "Failed to read water sensor");
         }
+        TRACE_SPAN_END(TRACE_SPAN_SENSOR_READ);
 
-        // Wait 2 seconds before next reading
+        // Wait for the next reading (sensor.period_ms, 2 seconds by default)
         // vTaskDelay() puts this task to sleep, allowing other tasks to run
-        // The FreeRTOS scheduler will wake us up after 2 seconds
-        vTaskDelay(pdMS_TO_TICKS(2000));
+        // The period is read each time, so a change applies from the next sleep
+        vTaskDelay(pdMS_TO_TICKS(settings_get_u32(SETTING_SENSOR_PERIOD_MS)));
     }
 
     // Note: This task never exits. If it did, we'd need vTaskDelete(NULL) here.
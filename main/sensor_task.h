@@ -12,7 +12,7 @@
  * Task parameters:
  * - Priority: 5 (medium)
  * - Stack: 4KB
- * - Period: 2 seconds
+ * - Period: sensor.period_ms setting (2 seconds by default)
  *
  * @param pvParameters Queue handle (QueueHandle_t) for sensor readings
  */
@@ -1,61 +1,122 @@
 #include "sensors.h"
 
-#include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
 
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "lock_profiler.h"
+#include "nvs.h"
+#include "power.h"
 
 static const char *TAG = "SENSORS";
 
+// NVS namespace of the stored calibrations (one blob per sensor: "calib<id>")
+#define NVS_NAMESPACE "sensors"
+
 // ADC handle (oneshot mode)
 static adc_oneshot_unit_handle_t adc_handle = NULL;
 
 // Mutex for thread-safe sensor operations
-static SemaphoreHandle_t sensor_mutex = NULL;
+static profiled_mutex_t sensor_mutex;
 
 // Static sensor info array
-// This stores configuration and metadata for each sensor
-static sensor_info_t sensors[SENSOR_COUNT] = {
+// This stores metadata for each sensor (read-only)
+static const sensor_info_t sensors[SENSOR_COUNT] = {
     [SENSOR_LIGHT_ROOF] = {.type = SENSOR_TYPE_LIGHT,
                            .channel = ADC_CHANNEL_0,  // GPIO0
-                           .location = "roof",
-                           .calib = {.type = CALIB_NONE, .unit = "raw"}},
+                           .location = "roof"},
     [SENSOR_WATER_ROOF] = {.type = SENSOR_TYPE_WATER,
                            .channel = ADC_CHANNEL_1,  // GPIO1
-                           .location = "roof",
-                           .calib = {.type = CALIB_NONE, .unit = "raw"}}};
+                           .location = "roof"}};
+
+// Current calibration per sensor
+// sensor_read() copies it without a lock: writers bump the sequence count
+// before and after changing it (odd = in progress), and a reader that saw
+// it change copies again. Writers are serialized by calib_mutex, so
+// calibration changes never hold up the ADC.
+static calibration_t s_calib[SENSOR_COUNT] = {
+    [SENSOR_LIGHT_ROOF] = {.type = CALIB_NONE, .unit = "raw"},
+    [SENSOR_WATER_ROOF] = {.type = CALIB_NONE, .unit = "raw"}};
+static atomic_uint s_calib_seq[SENSOR_COUNT];
+static portMUX_TYPE s_calib_mux = portMUX_INITIALIZER_UNLOCKED;
+static profiled_mutex_t calib_mutex;
+
+// Units referenced by calibrations (append-only, readings keep pointers)
+static char s_units[SENSOR_UNITS_MAX][CALIB_UNIT_MAX];
+static size_t s_unit_count = 0;
 
 /**
- * Apply linear calibration: y = mx + b
- *
- * @param raw Raw ADC value (0-4095)
- * @param calib Calibration parameters
- * @return Calibrated value
+ * Copy a sensor's calibration, retrying if a change overlapped
  */
-static float apply_linear_calibration(int raw, const linear_calib_t *calib) {
-    return calib->m * raw + calib->b;
+static void calib_read(sensor_id_t id, calibration_t *calib) {
+    unsigned seq;
+    do {
+        seq = atomic_load_explicit(&s_calib_seq[id], memory_order_acquire);
+        *calib = s_calib[id];
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) || seq != atomic_load_explicit(&s_calib_seq[id], memory_order_relaxed));
 }
 
 /**
- * Apply polynomial calibration: y = ax^2 + bx + c
+ * Find or add a unit in the unit table (caller holds calib_mutex)
  *
- * @param raw Raw ADC value (0-4095)
- * @param calib Calibration parameters
- * @return Calibrated value
+ * @return Static copy of the unit, or NULL if the table is full
  */
-static float apply_polynomial_calibration(int raw, const poly_calib_t *calib) {
-    float x = (float) raw;
-    return calib->a * x * x + calib->b * x + calib->c;
+static const char *calib_intern_unit(const char *unit) {
+    if (strcmp(unit, "raw") == 0) {
+        return "raw";
+    }
+    for (size_t i = 0; i < s_unit_count; i++) {
+        if (strcmp(s_units[i], unit) == 0) {
+            return s_units[i];
+        }
+    }
+    if (s_unit_count == SENSOR_UNITS_MAX) {
+        return NULL;
+    }
+    strncpy(s_units[s_unit_count], unit, CALIB_UNIT_MAX - 1);
+    return s_units[s_unit_count++];
+}
+
+/**
+ * Load a sensor's stored calibration, if there is one
+ */
+static void calib_load(nvs_handle_t handle, sensor_id_t id) {
+    char key[16];
+    snprintf(key, sizeof(key), "calib%d", id);
+
+    uint8_t blob[CALIB_BLOB_MAX];
+    size_t len = sizeof(blob);
+    esp_err_t ret = nvs_get_blob(handle, key, blob, &len);
+    if (ret == ESP_ERR_NVS_NOT_FOUND) {
+        return;
+    }
+
+    calibration_t calib;
+    char unit[CALIB_UNIT_MAX];
+    if (ret == ESP_OK) {
+        ret = calibration_decode(blob, len, &calib, unit);
+    }
+    if (ret == ESP_OK) {
+        ret = sensor_set_calibration(id, &calib);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Stored calibration of sensor %d unusable (%s), using raw values", id,
+                 esp_err_to_name(ret));
+    }
 }
 
 esp_err_t sensor_init(void) {
     ESP_LOGI(TAG, "Initializing sensor driver...");
 
-    // Create mutex for thread safety
-    sensor_mutex = xSemaphoreCreateMutex();
-    if (sensor_mutex == NULL) {
+    // Create mutexes for thread safety
+    if (profiled_mutex_init(&sensor_mutex, "sensor") != ESP_OK ||
+        profiled_mutex_init(&calib_mutex, "calib") != ESP_OK) {
         ESP_LOGE(TAG, "Failed to create mutex");
         return ESP_FAIL;
     }
@@ -90,6 +151,22 @@ esp_err_t sensor_init(void) {
     ESP_LOGI(TAG, "  Light sensor: GPIO0/CH0 (%s)", sensors[SENSOR_LIGHT_ROOF].location);
     ESP_LOGI(TAG, "  Water sensor: GPIO1/CH1 (%s)", sensors[SENSOR_WATER_ROOF].location);
 
+    // Stored calibrations
+    nvs_handle_t handle;
+    ret = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (ret == ESP_OK) {
+        for (int i = 0; i < SENSOR_COUNT; i++) {
+            calib_load(handle, (sensor_id_t) i);
+        }
+        nvs_close(handle);
+    } else if (ret != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "No stored calibrations (%s)", esp_err_to_name(ret));
+    }
+    for (int i = 0; i < SENSOR_COUNT; i++) {
+        ESP_LOGI(TAG, "  Sensor %d calibration: %s (%s)", i,
+                 calibration_type_name(s_calib[i].type), s_calib[i].unit);
+    }
+
     return ESP_OK;
 }
 
@@ -101,41 +178,30 @@ esp_err_t sensor_read(sensor_id_t id, sensor_reading_t *reading) {
     }
 
     // Take mutex to protect ADC access
-    if (xSemaphoreTake(sensor_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+    if (profiled_mutex_take(&sensor_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
         ESP_LOGW(TAG, "Failed to acquire mutex");
         return ESP_ERR_TIMEOUT;
     }
 
-    // Read raw ADC value
+    // Read raw ADC value (APB clock held up for the conversion)
     int raw_value;
+    power_lock_acquire(POWER_LOCK_ADC);
     esp_err_t ret = adc_oneshot_read(adc_handle, sensors[id].channel, &raw_value);
+    power_lock_release(POWER_LOCK_ADC);
     if (ret != ESP_OK) {
-        xSemaphoreGive(sensor_mutex);
+        profiled_mutex_give(&sensor_mutex);
         ESP_LOGE(TAG, "Failed to read ADC channel %d: %s", sensors[id].channel,
                  esp_err_to_name(ret));
         return ret;
     }
 
     // Release mutex early (calibration doesn't need it)
-    xSemaphoreGive(sensor_mutex);
-
-    // Apply calibration
-    float calibrated_value;
-    switch (sensors[id].calib.type) {
-        case CALIB_LINEAR:
-            calibrated_value = apply_linear_calibration(raw_value, &sensors[id].calib.linear);
-            break;
+    profiled_mutex_give(&sensor_mutex);
 
-        case CALIB_POLYNOMIAL:
-            calibrated_value = apply_polynomial_calibration(raw_value, &sensors[id].calib.poly);
-            break;
-
-        case CALIB_NONE:
-        default:
-            // No calibration - just use raw value
-            calibrated_value = (float) raw_value;
-            break;
-    }
+    // Apply calibration (a consistent copy, even while it is being changed)
+    calibration_t calib;
+    calib_read(id, &calib);
+    float calibrated_value = calibration_apply(&calib, raw_value);
 
     // Get timestamp in milliseconds since boot
     uint32_t timestamp = (uint32_t) (esp_timer_get_time() / 1000);
@@ -144,7 +210,7 @@ esp_err_t sensor_read(sensor_id_t id, sensor_reading_t *reading) {
     reading->id = id;
     reading->raw_value = raw_value;
     reading->calibrated_value = calibrated_value;
-    reading->unit = sensors[id].calib.unit;
+    reading->unit = calib.unit;
     reading->timestamp = timestamp;
 
     ESP_LOGD(TAG, "Sensor %d read: raw=%d, calib=%.2f %s, time=%lu ms", id, raw_value,
@@ -153,27 +219,92 @@ esp_err_t sensor_read(sensor_id_t id, sensor_reading_t *reading) {
     return ESP_OK;
 }
 
-esp_err_t sensor_set_calibration(sensor_id_t id, const calibration_t *calib) {
+/**
+ * Store a calibration in NVS as a blob (caller holds calib_mutex)
+ */
+static esp_err_t calib_save(sensor_id_t id, const calibration_t *calib) {
+    uint8_t blob[CALIB_BLOB_MAX];
+    size_t len = calibration_encode(calib, blob);
+    char key[16];
+    snprintf(key, sizeof(key), "calib%d", id);
+
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS namespace: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    ret = nvs_set_blob(handle, key, blob, len);
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    nvs_close(handle);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to store calibration: %s", esp_err_to_name(ret));
+    }
+    return ret;
+}
+
+/**
+ * Validate a calibration, optionally store it, and swap it in
+ */
+static esp_err_t calib_install(sensor_id_t id, const calibration_t *calib, bool persist) {
     // Input validation
-    if (id >= SENSOR_COUNT || calib == NULL) {
+    if (id >= SENSOR_COUNT || calibration_validate(calib) != ESP_OK) {
         ESP_LOGE(TAG, "Invalid arguments (id=%d, calib=%p)", id, calib);
         return ESP_ERR_INVALID_ARG;
     }
 
-    // Take mutex to protect sensor config
-    if (xSemaphoreTake(sensor_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+    // Serialize writers (readers don't wait for this)
+    if (profiled_mutex_take(&calib_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
         ESP_LOGW(TAG, "Failed to acquire mutex");
         return ESP_ERR_TIMEOUT;
     }
 
-    // Copy calibration config
-    sensors[id].calib = *calib;
+    calibration_t next = *calib;
+    next.unit = calib_intern_unit(calib->unit);
+    esp_err_t ret = ESP_OK;
+    if (next.unit == NULL) {
+        ESP_LOGW(TAG, "Too many distinct units, reboot to reuse them");
+        ret = ESP_ERR_NO_MEM;
+    } else if (persist) {
+        ret = calib_save(id, &next);
+    }
+    if (ret != ESP_OK) {
+        profiled_mutex_give(&calib_mutex);
+        return ret;
+    }
+
+    // Swap it in
+    portENTER_CRITICAL(&s_calib_mux);
+    atomic_fetch_add_explicit(&s_calib_seq[id], 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    s_calib[id] = next;
+    atomic_fetch_add_explicit(&s_calib_seq[id], 1, memory_order_release);
+    portEXIT_CRITICAL(&s_calib_mux);
+
+    profiled_mutex_give(&calib_mutex);
+
+    ESP_LOGI(TAG, "Sensor %d calibration updated: type=%s, unit=%s%s", id,
+             calibration_type_name(next.type), next.unit, persist ? " (stored)" : "");
+    return ESP_OK;
+}
 
-    // Release mutex
-    xSemaphoreGive(sensor_mutex);
+esp_err_t sensor_set_calibration(sensor_id_t id, const calibration_t *calib) {
+    return calib_install(id, calib, false);
+}
 
-    ESP_LOGI(TAG, "Sensor %d calibration updated: type=%d, unit=%s", id, calib->type, calib->unit);
+esp_err_t sensor_save_calibration(sensor_id_t id, const calibration_t *calib) {
+    return calib_install(id, calib, true);
+}
 
+esp_err_t sensor_get_calibration(sensor_id_t id, calibration_t *calib) {
+    if (id >= SENSOR_COUNT || calib == NULL) {
+        ESP_LOGE(TAG, "Invalid arguments (id=%d, calib=%p)", id, calib);
+        return ESP_ERR_INVALID_ARG;
+    }
+    calib_read(id, calib);
     return ESP_OK;
 }
 
@@ -186,6 +317,6 @@ const sensor_info_t *sensor_get_info(sensor_id_t id) {
 
     // Return pointer to static info
     // No mutex needed - basic info is read-only
-    // (calibration can change, but callers should handle that)
+    // (calibration can change: use sensor_get_calibration())
     return &sensors[id];
 }
@@ -1,6 +1,7 @@
 #ifndef SENSORS_H
 #define SENSORS_H
 
+#include "calibration.h"
 #include "esp_adc/adc_oneshot.h"
 #include "esp_err.h"
 
@@ -17,42 +18,15 @@ typedef enum {
     SENSOR_COUNT = 2
 } sensor_id_t;
 
-// Calibration type
-typedef enum {
-    CALIB_LINEAR,      // y = mx + b
-    CALIB_POLYNOMIAL,  // y = ax^2 + bx + c
-    CALIB_NONE         // Raw value only
-} calib_type_t;
-
-// Linear calibration params
-typedef struct {
-    float m;  // slope
-    float b;  // intercept
-} linear_calib_t;
-
-// Polynomial calibration params
-typedef struct {
-    float a;  // x^2 coefficient
-    float b;  // x coefficient
-    float c;  // constant
-} poly_calib_t;
-
-// Calibration configuration
-typedef struct {
-    calib_type_t type;
-    union {
-        linear_calib_t linear;
-        poly_calib_t poly;
-    };
-    const char *unit;  // e.g., "lux", "%"
-} calibration_t;
+// Distinct calibration units kept until reboot (readings point at them)
+#define SENSOR_UNITS_MAX 16
 
 // Sensor reading (for queue)
 typedef struct {
     sensor_id_t id;
     int raw_value;  // 0-4095 (12-bit ADC)
     float calibrated_value;
-    const char *unit;
+    const char *unit;    // Static storage, stays valid after calibration changes
     uint32_t timestamp;  // milliseconds since boot
 } sensor_reading_t;
 
@@ -60,15 +34,15 @@ typedef struct {
 typedef struct {
     sensor_type_t type;
     adc_channel_t channel;
-    calibration_t calib;
     const char *location;
 } sensor_info_t;
 
 /**
  * Initialize all sensors
  *
- * Sets up ADC1 unit and configures all channels.
- * Default calibration is CALIB_NONE.
+ * Sets up ADC1 unit and configures all channels, then loads each
+ * sensor's calibration from NVS (CALIB_NONE if none is stored or NVS
+ * isn't initialized).
  *
  * @return ESP_OK on success
  */
@@ -89,12 +63,38 @@ esp_err_t sensor_read(sensor_id_t id, sensor_reading_t *reading);
 /**
  * Set calibration for sensor
  *
+ * Validated, then swapped in without blocking sensor_read(): a read uses
+ * either the old or the new calibration, never a mix. Not persisted.
+ *
  * @param id Sensor identifier
- * @param calib Calibration configuration
- * @return ESP_OK on success
+ * @param calib Calibration configuration (the unit string is copied)
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if calib is invalid,
+ *         ESP_ERR_NO_MEM if SENSOR_UNITS_MAX distinct units are in use
  */
 esp_err_t sensor_set_calibration(sensor_id_t id, const calibration_t *calib);
 
+/**
+ * Set calibration for sensor and store it in NVS
+ *
+ * Like sensor_set_calibration(), but only applied once stored, so the
+ * sensor keeps it across reboots.
+ *
+ * @param id Sensor identifier
+ * @param calib Calibration configuration
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if calib is invalid,
+ *         or the NVS error
+ */
+esp_err_t sensor_save_calibration(sensor_id_t id, const calibration_t *calib);
+
+/**
+ * Get the current calibration of a sensor
+ *
+ * @param id Sensor identifier
+ * @param[out] calib Calibration (unit points to static storage)
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if id or calib is invalid
+ */
+esp_err_t sensor_get_calibration(sensor_id_t id, calibration_t *calib);
+
 /**
  * Get sensor info
  *
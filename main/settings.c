@@ -0,0 +1,485 @@
+#include "settings.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lock_profiler.h"
+#include "metrics.h"
+#include "nvs.h"
+#include "wifi_config.h"
+
+static const char *TAG = "SETTINGS";
+
+// NVS namespaces and keys
+#define NVS_NAMESPACE        "settings"
+#define NVS_KEY_VERSION      "version"
+#define NVS_LEGACY_NAMESPACE "wifi_config"  // Schema version 1
+#define NVS_LEGACY_KEY_SSID  "ssid"
+
+// RAM copy of all settings
+typedef struct {
+    char wifi_ssid[WIFI_SSID_MAX_LEN + 1];
+    char wifi_password[WIFI_PASSWORD_MAX_LEN + 1];
+    uint32_t sensor_period_ms;
+    uint32_t log_level;
+} settings_values_t;
+
+#define SETTING_STR(field, max_len)                                                      \
+    .type = SETTING_TYPE_STR, .offset = offsetof(settings_values_t, field),             \
+    .size = sizeof(((settings_values_t *) 0)->field), .min = 0, .max = (max_len)
+#define SETTING_U32(field, lo, hi)                                                       \
+    .type = SETTING_TYPE_U32, .offset = offsetof(settings_values_t, field),             \
+    .size = sizeof(uint32_t), .min = (lo), .max = (hi)
+
+static const setting_def_t SCHEMA[SETTING_COUNT] = {
+    [SETTING_WIFI_SSID] = {.name = "wifi.ssid",
+                           .nvs_key = "ssid",
+                           SETTING_STR(wifi_ssid, WIFI_SSID_MAX_LEN),
+                           .default_str = CONFIG_GEEKHOUSE_WIFI_SSID,
+                           .applies = "reconnect"},
+    [SETTING_WIFI_PASSWORD] = {.name = "wifi.password",
+                               .nvs_key = "password",
+                               SETTING_STR(wifi_password, WIFI_PASSWORD_MAX_LEN),
+                               .default_str = CONFIG_GEEKHOUSE_WIFI_PASSWORD,
+                               .secret = true,
+                               .applies = "reconnect"},
+    [SETTING_SENSOR_PERIOD_MS] = {.name = "sensor.period_ms",
+                                  .nvs_key = "period_ms",
+                                  SETTING_U32(sensor_period_ms, 100, 60000),
+                                  .default_u32 = 2000,
+                                  .applies = "live"},
+    [SETTING_LOG_LEVEL] = {.name = "log.level",
+                           .nvs_key = "log_level",
+                           SETTING_U32(log_level, ESP_LOG_NONE, ESP_LOG_VERBOSE),
+                           .default_u32 = CONFIG_LOG_DEFAULT_LEVEL,
+                           .applies = "live"},
+};
+
+// Values, published with a sequence counter: odd while a write is in progress
+static settings_values_t s_values;
+static atomic_uint s_seq = 0;
+static portMUX_TYPE s_values_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Writers (settings_update) are serialized by s_write_mutex
+static profiled_mutex_t s_write_mutex;
+static bool s_initialized = false;
+
+// Keys waiting for the settings task (bit per setting_key_t)
+static atomic_uint s_dirty = 0;
+static bool s_write_version = false;  // Commit the schema version with the next batch
+static TaskHandle_t s_task = NULL;
+
+// Statistics, guarded by s_stats_mux
+static settings_stats_t s_stats;
+static portMUX_TYPE s_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+const setting_def_t *settings_get_def(setting_key_t key) {
+    return key < SETTING_COUNT ? &SCHEMA[key] : NULL;
+}
+
+setting_key_t settings_find(const char *name) {
+    for (int i = 0; i < SETTING_COUNT; i++) {
+        if (strcmp(SCHEMA[i].name, name) == 0) {
+            return (setting_key_t) i;
+        }
+    }
+    return SETTING_COUNT;
+}
+
+/**
+ * Copy a field out of the RAM copy, retrying if a write overlapped
+ */
+static void settings_read(const setting_def_t *def, void *out) {
+    unsigned seq;
+    do {
+        seq = atomic_load_explicit(&s_seq, memory_order_acquire);
+        memcpy(out, (const uint8_t *) &s_values + def->offset, def->size);
+        atomic_thread_fence(memory_order_acquire);
+    } while ((seq & 1) || seq != atomic_load_explicit(&s_seq, memory_order_relaxed));
+}
+
+uint32_t settings_get_u32(setting_key_t key) {
+    if (key >= SETTING_COUNT || SCHEMA[key].type != SETTING_TYPE_U32) {
+        return 0;
+    }
+    uint32_t value;
+    settings_read(&SCHEMA[key], &value);
+    return value;
+}
+
+esp_err_t settings_get_str(setting_key_t key, char *buf, size_t len) {
+    if (key >= SETTING_COUNT || SCHEMA[key].type != SETTING_TYPE_STR || buf == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    char value[SETTINGS_STR_MAX + 1];
+    settings_read(&SCHEMA[key], value);
+    size_t value_len = strlen(value);
+    if (value_len >= len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(buf, value, value_len + 1);
+    return ESP_OK;
+}
+
+/**
+ * Store values in the RAM copy as one write (caller holds s_write_mutex or is settings_init)
+ */
+static void settings_store(const setting_update_t *updates, size_t count) {
+    portENTER_CRITICAL(&s_values_mux);
+    atomic_fetch_add_explicit(&s_seq, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (size_t i = 0; i < count; i++) {
+        const setting_def_t *def = &SCHEMA[updates[i].key];
+        uint8_t *field = (uint8_t *) &s_values + def->offset;
+        if (def->type == SETTING_TYPE_STR) {
+            memset(field, 0, def->size);
+            memcpy(field, updates[i].str, strlen(updates[i].str));
+        } else {
+            memcpy(field, &updates[i].u32, sizeof(uint32_t));
+        }
+    }
+    atomic_fetch_add_explicit(&s_seq, 1, memory_order_release);
+    portEXIT_CRITICAL(&s_values_mux);
+}
+
+/**
+ * Make a key take effect, for keys that aren't read on every use
+ */
+static void settings_apply(setting_key_t key) {
+    if (key == SETTING_LOG_LEVEL) {
+        esp_log_level_set("*", (esp_log_level_t) settings_get_u32(SETTING_LOG_LEVEL));
+    }
+}
+
+esp_err_t settings_validate(const setting_update_t *update) {
+    if (update == NULL || update->key >= SETTING_COUNT) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    const setting_def_t *def = &SCHEMA[update->key];
+    if (def->type == SETTING_TYPE_STR) {
+        if (update->str == NULL) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        size_t len = strnlen(update->str, def->max + 1);
+        return len >= def->min && len <= def->max ? ESP_OK : ESP_ERR_INVALID_ARG;
+    }
+    return update->u32 >= def->min && update->u32 <= def->max ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t settings_update(const setting_update_t *updates, size_t count) {
+    if (updates == NULL && count > 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (settings_validate(&updates[i]) != ESP_OK) {
+            ESP_LOGW(TAG, "Rejected value for %s",
+                     updates[i].key < SETTING_COUNT ? SCHEMA[updates[i].key].name : "?");
+            portENTER_CRITICAL(&s_stats_mux);
+            s_stats.rejected++;
+            portEXIT_CRITICAL(&s_stats_mux);
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    bool locked = s_initialized && profiled_mutex_take(&s_write_mutex, portMAX_DELAY) == pdTRUE;
+    settings_store(updates, count);
+    uint32_t dirty = 0;
+    for (size_t i = 0; i < count; i++) {
+        dirty |= 1u << updates[i].key;
+    }
+    for (int i = 0; i < SETTING_COUNT; i++) {
+        if (dirty & (1u << i)) {
+            settings_apply((setting_key_t) i);
+        }
+    }
+    if (locked) {
+        profiled_mutex_give(&s_write_mutex);
+    }
+
+    atomic_fetch_or(&s_dirty, dirty);
+    portENTER_CRITICAL(&s_stats_mux);
+    s_stats.updates++;
+    portEXIT_CRITICAL(&s_stats_mux);
+
+    if (s_task != NULL) {
+        xTaskNotifyGive(s_task);
+    }
+    return ESP_OK;
+}
+
+/**
+ * Write the dirty keys to NVS in one transaction
+ */
+static esp_err_t settings_commit(void) {
+    uint32_t dirty = atomic_exchange(&s_dirty, 0);
+    if (dirty == 0 && !s_write_version) {
+        return ESP_OK;
+    }
+
+    int64_t start = esp_timer_get_time();
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    bool opened = ret == ESP_OK;
+    uint32_t written = 0;
+    for (int i = 0; i < SETTING_COUNT && ret == ESP_OK; i++) {
+        if (!(dirty & (1u << i))) {
+            continue;
+        }
+        if (SCHEMA[i].type == SETTING_TYPE_STR) {
+            char value[SETTINGS_STR_MAX + 1];
+            settings_read(&SCHEMA[i], value);
+            ret = nvs_set_str(handle, SCHEMA[i].nvs_key, value);
+        } else {
+            ret = nvs_set_u32(handle, SCHEMA[i].nvs_key, settings_get_u32((setting_key_t) i));
+        }
+        written++;
+    }
+    if (ret == ESP_OK && s_write_version) {
+        ret = nvs_set_u8(handle, NVS_KEY_VERSION, SETTINGS_SCHEMA_VERSION);
+    }
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    if (opened) {
+        nvs_close(handle);
+    }
+    uint32_t elapsed_us = (uint32_t) (esp_timer_get_time() - start);
+
+    portENTER_CRITICAL(&s_stats_mux);
+    if (ret == ESP_OK) {
+        s_stats.commits++;
+        s_stats.keys_written += written;
+        s_stats.last_commit_us = elapsed_us;
+        if (elapsed_us > s_stats.max_commit_us) {
+            s_stats.max_commit_us = elapsed_us;
+        }
+    } else {
+        s_stats.commit_failures++;
+    }
+    portEXIT_CRITICAL(&s_stats_mux);
+
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Commit failed: %s", esp_err_to_name(ret));
+        atomic_fetch_or(&s_dirty, dirty);  // Retried later
+        return ret;
+    }
+    s_write_version = false;
+    ESP_LOGI(TAG, "Committed %lu keys in %lu us", (unsigned long) written,
+             (unsigned long) elapsed_us);
+    return ESP_OK;
+}
+
+void settings_task(void *pvParameters) {
+    (void) pvParameters;
+    s_task = xTaskGetCurrentTaskHandle();
+
+    while (1) {
+        if (atomic_load(&s_dirty) == 0) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+
+        // Coalesce: wait for writes to pause, but not forever
+        TickType_t first = xTaskGetTickCount();
+        while (xTaskGetTickCount() - first < pdMS_TO_TICKS(SETTINGS_COMMIT_MAX_MS) &&
+               ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SETTINGS_COMMIT_DELAY_MS)) > 0) {
+        }
+
+        if (settings_commit() != ESP_OK) {
+            vTaskDelay(pdMS_TO_TICKS(SETTINGS_RETRY_MS));
+        }
+    }
+}
+
+/**
+ * Migration 1 -> 2: credentials from the "wifi_config" namespace
+ */
+static esp_err_t migrate_wifi_config(nvs_handle_t handle) {
+    nvs_handle_t legacy;
+    esp_err_t ret = nvs_open(NVS_LEGACY_NAMESPACE, NVS_READONLY, &legacy);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    static const struct {
+        const char *legacy_key;
+        setting_key_t key;
+    } KEYS[] = {{NVS_LEGACY_KEY_SSID, SETTING_WIFI_SSID}, {"password", SETTING_WIFI_PASSWORD}};
+    for (size_t i = 0; i < sizeof(KEYS) / sizeof(KEYS[0]) && ret == ESP_OK; i++) {
+        char value[SETTINGS_STR_MAX + 1];
+        size_t len = sizeof(value);
+        ret = nvs_get_str(legacy, KEYS[i].legacy_key, value, &len);
+        if (ret == ESP_OK) {
+            ret = nvs_set_str(handle, SCHEMA[KEYS[i].key].nvs_key, value);
+        } else if (ret == ESP_ERR_NVS_NOT_FOUND) {
+            ret = ESP_OK;  // Default then
+        }
+    }
+    nvs_close(legacy);
+    return ret;
+}
+
+// Migration from version i + 1 to i + 2
+static esp_err_t (*const MIGRATIONS[SETTINGS_SCHEMA_VERSION - 1])(nvs_handle_t handle) = {
+    migrate_wifi_config,
+};
+
+/**
+ * Find the stored layout version (0: nothing stored)
+ */
+static uint8_t settings_stored_version(nvs_handle_t handle) {
+    uint8_t version = 0;
+    if (nvs_get_u8(handle, NVS_KEY_VERSION, &version) == ESP_OK) {
+        return version;
+    }
+
+    nvs_handle_t legacy;
+    if (nvs_open(NVS_LEGACY_NAMESPACE, NVS_READONLY, &legacy) == ESP_OK) {
+        size_t len = 0;
+        if (nvs_get_str(legacy, NVS_LEGACY_KEY_SSID, NULL, &len) == ESP_OK) {
+            version = 1;
+        }
+        nvs_close(legacy);
+    }
+    return version;
+}
+
+/**
+ * Bring the stored layout up to SETTINGS_SCHEMA_VERSION
+ */
+static esp_err_t settings_migrate(nvs_handle_t handle, uint8_t version) {
+    for (uint8_t v = version; v < SETTINGS_SCHEMA_VERSION; v++) {
+        esp_err_t ret = MIGRATIONS[v - 1](handle);
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Migration %d -> %d failed: %s", v, v + 1, esp_err_to_name(ret));
+            return ret;
+        }
+        ESP_LOGI(TAG, "Migrated settings from version %d to %d", v, v + 1);
+    }
+    esp_err_t ret = nvs_set_u8(handle, NVS_KEY_VERSION, SETTINGS_SCHEMA_VERSION);
+    if (ret == ESP_OK) {
+        ret = nvs_commit(handle);
+    }
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    // Only drop the old layout once the new one is committed
+    nvs_handle_t legacy;
+    if (version == 1 && nvs_open(NVS_LEGACY_NAMESPACE, NVS_READWRITE, &legacy) == ESP_OK) {
+        if (nvs_erase_all(legacy) == ESP_OK) {
+            nvs_commit(legacy);
+        }
+        nvs_close(legacy);
+    }
+    return ESP_OK;
+}
+
+/**
+ * Load one key from NVS into the RAM copy, keeping the default if unusable
+ */
+static void settings_load(nvs_handle_t handle, setting_key_t key) {
+    const setting_def_t *def = &SCHEMA[key];
+    setting_update_t update = {.key = key};
+    char value[SETTINGS_STR_MAX + 1];
+    esp_err_t ret;
+
+    if (def->type == SETTING_TYPE_STR) {
+        size_t len = sizeof(value);
+        ret = nvs_get_str(handle, def->nvs_key, value, &len);
+        update.str = value;
+    } else {
+        ret = nvs_get_u32(handle, def->nvs_key, &update.u32);
+    }
+
+    if (ret == ESP_OK && settings_validate(&update) == ESP_OK) {
+        settings_store(&update, 1);
+    } else if (ret != ESP_ERR_NVS_NOT_FOUND) {
+        ESP_LOGW(TAG, "Stored %s unusable (%s), using default", def->name,
+                 ret == ESP_OK ? "out of range" : esp_err_to_name(ret));
+    }
+}
+
+/**
+ * Metrics collector: commits and keys waiting for one
+ */
+static void settings_collector(metrics_writer_t *w, void *arg) {
+    (void) arg;
+    settings_stats_t stats;
+    settings_get_stats(&stats);
+
+    metrics_write_family(w, "geekhouse_settings_commits_total", METRIC_COUNTER,
+                         "Settings NVS transactions");
+    metrics_write_sample(w, "geekhouse_settings_commits_total", NULL, stats.commits);
+    metrics_write_family(w, "geekhouse_settings_commit_failures_total", METRIC_COUNTER,
+                         "Settings NVS transactions that failed");
+    metrics_write_sample(w, "geekhouse_settings_commit_failures_total", NULL,
+                         stats.commit_failures);
+    metrics_write_family(w, "geekhouse_settings_pending", METRIC_GAUGE,
+                         "Changed settings not committed yet");
+    metrics_write_sample(w, "geekhouse_settings_pending", NULL, stats.pending);
+}
+
+esp_err_t settings_init(void) {
+    // Defaults first, so every key has a valid value whatever NVS holds
+    for (int i = 0; i < SETTING_COUNT; i++) {
+        setting_update_t update = {.key = (setting_key_t) i,
+                                   .u32 = SCHEMA[i].default_u32,
+                                   .str = SCHEMA[i].default_str};
+        settings_store(&update, 1);
+    }
+
+    if (s_write_mutex.sem == NULL && profiled_mutex_init(&s_write_mutex, "settings") != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create mutex");
+        return ESP_FAIL;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to open NVS namespace: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    uint8_t version = settings_stored_version(handle);
+    s_stats.schema_version = SETTINGS_SCHEMA_VERSION;
+    s_stats.loaded_version = version;
+    if (version == 0) {
+        ESP_LOGI(TAG, "No stored settings, using defaults");
+        s_write_version = true;  // With the first change
+    } else if (version > SETTINGS_SCHEMA_VERSION) {
+        // Written by newer firmware: read what we know, leave the version alone
+        ESP_LOGW(TAG, "Settings version %d is newer than %d", version, SETTINGS_SCHEMA_VERSION);
+    } else if (version < SETTINGS_SCHEMA_VERSION) {
+        // On failure the old layout stays and the migration runs again next boot
+        settings_migrate(handle, version);
+    }
+
+    for (int i = 0; i < SETTING_COUNT; i++) {
+        settings_load(handle, (setting_key_t) i);
+        settings_apply((setting_key_t) i);
+    }
+    nvs_close(handle);
+
+    s_initialized = true;
+    metrics_register_collector(settings_collector, NULL);
+    ESP_LOGI(TAG, "Loaded %d settings (schema version %d)", SETTING_COUNT,
+             SETTINGS_SCHEMA_VERSION);
+    return ESP_OK;
+}
+
+esp_err_t settings_get_stats(settings_stats_t *stats) {
+    if (stats == NULL) {
+        ESP_LOGE(TAG, "Invalid argument: stats is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_stats_mux);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_mux);
+    stats->pending = __builtin_popcount(atomic_load(&s_dirty));
+    return ESP_OK;
+}
@@ -0,0 +1,167 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+// Device settings (GET/PATCH /api/config)
+//
+// Typed keys with defaults and ranges, loaded from NVS once by
+// settings_init() into a RAM copy. Readers copy values out of RAM without
+// taking a lock: writers publish through a sequence counter, and a reader
+// that overlapped a write simply reads again.
+//
+// settings_update() validates and applies a set of changes at once, then
+// marks the keys dirty. The settings task commits them to NVS after writes
+// have paused for SETTINGS_COMMIT_DELAY_MS (at most SETTINGS_COMMIT_MAX_MS
+// after the first one), all dirty keys in one nvs_commit(). A failed commit
+// keeps the keys dirty and is retried after SETTINGS_RETRY_MS.
+//
+// The NVS layout carries a schema version. Older layouts are migrated at
+// boot, before the values are loaded:
+//   1  "wifi_config" namespace with ssid/password (before this module)
+//   2  "settings" namespace, one NVS entry per key
+// Values that are missing, of the wrong type or out of range fall back to
+// their default.
+
+#define SETTINGS_SCHEMA_VERSION 2
+#define SETTINGS_STR_MAX        64  // Longest string value
+#ifndef SETTINGS_COMMIT_DELAY_MS
+#define SETTINGS_COMMIT_DELAY_MS 2000  // Quiet time before committing
+#endif
+#ifndef SETTINGS_COMMIT_MAX_MS
+#define SETTINGS_COMMIT_MAX_MS 10000  // Longest a change waits for its commit
+#endif
+#ifndef SETTINGS_RETRY_MS
+#define SETTINGS_RETRY_MS 30000  // After a failed commit
+#endif
+
+// Settings keys
+typedef enum {
+    SETTING_WIFI_SSID = 0,
+    SETTING_WIFI_PASSWORD,
+    SETTING_SENSOR_PERIOD_MS,
+    SETTING_LOG_LEVEL,
+    SETTING_COUNT
+} setting_key_t;
+
+typedef enum {
+    SETTING_TYPE_STR,
+    SETTING_TYPE_U32,
+} setting_type_t;
+
+// Schema entry of one key
+typedef struct {
+    const char *name;     // API name, e.g. "sensor.period_ms"
+    const char *nvs_key;  // NVS entry (15 characters at most)
+    setting_type_t type;
+    uint16_t offset;  // Into the RAM copy
+    uint16_t size;    // Bytes in the RAM copy (strings: max length + 1)
+    uint32_t min;     // Value (U32) or length (STR) range
+    uint32_t max;
+    uint32_t default_u32;
+    const char *default_str;
+    bool secret;          // Never reported back (GET shows only whether it is set)
+    const char *applies;  // When a change takes effect: "live" or "reconnect" (next WiFi reconnect)
+} setting_def_t;
+
+// One change for settings_update()
+typedef struct {
+    setting_key_t key;
+    uint32_t u32;     // SETTING_TYPE_U32
+    const char *str;  // SETTING_TYPE_STR
+} setting_update_t;
+
+// Settings statistics
+typedef struct {
+    uint8_t schema_version;  // SETTINGS_SCHEMA_VERSION
+    uint8_t loaded_version;  // Layout found in NVS at boot (0: none)
+    uint32_t updates;        // Accepted settings_update() calls
+    uint32_t rejected;       // Refused by validation
+    uint32_t pending;        // Keys changed but not committed yet
+    uint32_t commits;        // NVS transactions
+    uint32_t commit_failures;
+    uint32_t keys_written;
+    uint32_t last_commit_us;
+    uint32_t max_commit_us;
+} settings_stats_t;
+
+/**
+ * Load settings from NVS, migrating older layouts
+ *
+ * Must be called after nvs_flash_init(). Until then every getter returns
+ * the defaults.
+ *
+ * @return ESP_OK on success (also when NVS holds no settings)
+ */
+esp_err_t settings_init(void);
+
+/**
+ * Settings task: commits changed keys to NVS in batches
+ *
+ * @param pvParameters Unused
+ */
+void settings_task(void *pvParameters);
+
+/**
+ * Get the schema entry of a key
+ *
+ * @return Schema entry, or NULL if key is invalid
+ */
+const setting_def_t *settings_get_def(setting_key_t key);
+
+/**
+ * Look up a key by its API name
+ *
+ * @return Key, or SETTING_COUNT if there is none
+ */
+setting_key_t settings_find(const char *name);
+
+/**
+ * Get a numeric setting (lock-free)
+ *
+ * @return Value, or 0 if key isn't a SETTING_TYPE_U32 key
+ */
+uint32_t settings_get_u32(setting_key_t key);
+
+/**
+ * Get a string setting (lock-free)
+ *
+ * @param[out] buf Buffer, NUL-terminated on success
+ * @param len Buffer length
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if key isn't a string
+ *         key, ESP_ERR_INVALID_SIZE if buf is too small
+ */
+esp_err_t settings_get_str(setting_key_t key, char *buf, size_t len);
+
+/**
+ * Check one change against the schema
+ *
+ * @return ESP_OK if settings_update() would accept it
+ */
+esp_err_t settings_validate(const setting_update_t *update);
+
+/**
+ * Validate and apply changes, then schedule their commit
+ *
+ * Either all changes are applied or none. Readers see them right away;
+ * NVS follows within SETTINGS_COMMIT_MAX_MS.
+ *
+ * @param updates Changes
+ * @param count Number of changes
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if any change is invalid
+ */
+esp_err_t settings_update(const setting_update_t *updates, size_t count);
+
+/**
+ * Get settings statistics
+ *
+ * @param[out] stats Statistics
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t settings_get_stats(settings_stats_t *stats);
+
+#endif  // SETTINGS_H
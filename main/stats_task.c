@@ -1,107 +1,384 @@
 #include "stats_task.h"
 
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
 #include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "freertos_hooks.h"
+#include "heap_profiler.h"
+#include "lock_profiler.h"
+#include "metrics.h"
+#include "power.h"
 
 static const char *TAG = "STATS_TASK";
 
 // Threshold for warning (bytes)
 #define STACK_WARNING_THRESHOLD 512
 
-// Buffer sizes for task statistics
-#define STATS_BUFFER_SIZE 1024
+// Context switches per task, incremented by traceTASK_SWITCHED_IN()
+volatile uint32_t g_task_switch_count[TASK_SWITCH_SLOTS];
+
+// Configured stack size per task, indexed like g_task_switch_count (0 = unknown)
+static uint32_t s_stack_size[TASK_SWITCH_SLOTS];
 
-// External task handles (defined in main.c)
-extern TaskHandle_t sensor_task_handle;
-extern TaskHandle_t display_task_handle;
-extern TaskHandle_t stats_task_handle;
-extern TaskHandle_t reporter_task_handle;
+// Snapshot buffers (stats_task only)
+// Preallocated, so taking a snapshot never touches the heap.
+static TaskStatus_t s_snapshot[TASK_STATS_MAX];
+static task_stats_t s_scratch[TASK_STATS_MAX];
+static uint32_t s_prev_switches[TASK_SWITCH_SLOTS];
+static uint32_t s_prev_total_runtime = 0;
+static TickType_t s_prev_tick = 0;
+static bool s_have_baseline = false;
 
-// Forward declaration of helper function
-static void check_task_stack(TaskHandle_t handle, const char *name);
+// Latest results (read by HTTP and metrics, protected by s_stats_mutex)
+static task_stats_t s_tasks[TASK_STATS_MAX];
+static size_t s_task_count = 0;
+static uint32_t s_interval_ms = 0;
+static bool s_ready = false;  // Two snapshots taken
+static profiled_mutex_t s_stats_mutex;
+
+// Forward declaration of helper functions
+static void stats_take_snapshot(void);
+static void stats_log(void);
+static void stats_log_stacks(void);
+static void stats_log_locks(void);
+static void stats_log_power(void);
+static void stats_metrics_collector(metrics_writer_t *w, void *arg);
 
 void stats_task(void *pvParameters) {
     (void) pvParameters;
 
-    // Allocate buffers for statistics strings
-    // These are large, so allocate from heap rather than stack
-    char *task_list_buffer = malloc(STATS_BUFFER_SIZE);
-    char *cpu_stats_buffer = malloc(STATS_BUFFER_SIZE);
-
-    if (task_list_buffer == NULL || cpu_stats_buffer == NULL) {
-        ESP_LOGE(TAG, "Failed to allocate statistics buffers");
+    if (profiled_mutex_init(&s_stats_mutex, "stats") != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create stats mutex");
         vTaskDelete(NULL);
         return;
     }
 
+    // Heap and per-task figures for GET /metrics
+    metrics_register_collector(stats_metrics_collector, NULL);
+
     ESP_LOGI(TAG, "Statistics task started");
-    ESP_LOGI(TAG, "Printing task stats every 10 seconds...");
+    ESP_LOGI(TAG, "Sampling task stats every %d seconds...", STATS_INTERVAL_MS / 1000);
     ESP_LOGI(TAG, "");
 
+    // Baseline, so the first interval only covers the first interval
+    stats_take_snapshot();
+
+    TickType_t last_wake = xTaskGetTickCount();
     while (1) {
-        // Wait 10 seconds before printing stats
-        vTaskDelay(pdMS_TO_TICKS(10000));
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(STATS_INTERVAL_MS));
+
+        stats_take_snapshot();
+        stats_log();
+    }
+}
+
+/**
+ * Find a task in the previous results by task number
+ */
+static const task_stats_t *stats_find_prev(uint32_t number) {
+    for (size_t i = 0; i < s_task_count; i++) {
+        if (s_tasks[i].number == number) {
+            return &s_tasks[i];
+        }
+    }
+    return NULL;
+}
+
+void stats_set_stack_size(TaskHandle_t task, uint32_t stack_bytes) {
+    if (task == NULL) {
+        return;
+    }
+    s_stack_size[uxTaskGetTaskNumber(task) & (TASK_SWITCH_SLOTS - 1)] = stack_bytes;
+}
+
+/**
+ * Recommended stack: deepest use so far plus headroom, rounded up
+ *
+ * Only as good as the workload that ran - exercise every path (HTTP
+ * endpoints, WiFi reconnects, rule actions) before trusting it.
+ */
+static uint32_t stats_recommend_stack(uint32_t size, uint32_t free) {
+    if (size == 0 || free > size) {
+        return 0;
+    }
+    uint32_t used = size - free;
+    uint32_t rec = used + used * STACK_HEADROOM_PERCENT / 100;
+    rec = (rec + STACK_ROUND_BYTES - 1) / STACK_ROUND_BYTES * STACK_ROUND_BYTES;
+    return rec < STACK_MIN_BYTES ? STACK_MIN_BYTES : rec;
+}
+
+/**
+ * Snapshot all tasks and compute per-interval figures against the last snapshot
+ *
+ * Results go to s_scratch first and are published in one copy, so readers
+ * only hold the mutex for a memcpy.
+ */
+static void stats_take_snapshot(void) {
+    uint32_t total_runtime = 0;
+    UBaseType_t count = uxTaskGetSystemState(s_snapshot, TASK_STATS_MAX, &total_runtime);
+    TickType_t now = xTaskGetTickCount();
+
+    if (count == 0) {
+        ESP_LOGW(TAG, "More than %d tasks, not sampled", TASK_STATS_MAX);
+        return;
+    }
+
+    uint32_t delta_total = total_runtime - s_prev_total_runtime;
+    uint32_t interval_ms = pdTICKS_TO_MS(now - s_prev_tick);
+
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t *status = &s_snapshot[i];
+        task_stats_t *t = &s_scratch[i];
+        const task_stats_t *prev = stats_find_prev(status->xTaskNumber);
+
+        // Start from the previous window shifted by one (or empty for new tasks)
+        if (prev != NULL) {
+            memcpy(&t->cpu_x100[1], &prev->cpu_x100[0],
+                   (TASK_STATS_WINDOW - 1) * sizeof(t->cpu_x100[0]));
+            memcpy(&t->switches_per_s[1], &prev->switches_per_s[0],
+                   (TASK_STATS_WINDOW - 1) * sizeof(t->switches_per_s[0]));
+            t->samples = prev->samples < TASK_STATS_WINDOW ? prev->samples + 1 : TASK_STATS_WINDOW;
+            t->stack_delta = (int32_t) status->usStackHighWaterMark - (int32_t) prev->stack_free;
+        } else {
+            // New task: everything it did happened during this interval
+            memset(t, 0, sizeof(*t));
+            t->samples = 1;
+        }
+
+        strncpy(t->name, status->pcTaskName, sizeof(t->name) - 1);
+        t->name[sizeof(t->name) - 1] = '\0';
+        t->number = status->xTaskNumber;
+        t->priority = status->uxCurrentPriority;
+        t->state = status->eCurrentState;
+        t->stack_free = status->usStackHighWaterMark;
+        t->stack_size = s_stack_size[status->xTaskNumber & (TASK_SWITCH_SLOTS - 1)];
+        t->stack_recommended = stats_recommend_stack(t->stack_size, t->stack_free);
+
+        // Run time counters wrap; unsigned subtraction handles one wrap per interval
+        uint32_t delta_runtime = status->ulRunTimeCounter - (prev ? prev->runtime_us : 0);
+        t->runtime_us = status->ulRunTimeCounter;
+        t->cpu_x100[0] =
+            delta_total > 0 ? (uint16_t) ((uint64_t) delta_runtime * 10000 / delta_total) : 0;
+
+        uint32_t slot = status->xTaskNumber & (TASK_SWITCH_SLOTS - 1);
+        uint32_t switches = g_task_switch_count[slot] - s_prev_switches[slot];
+        uint32_t rate = interval_ms > 0 ? switches * 1000 / interval_ms : 0;
+        t->switches_per_s[0] = rate > UINT16_MAX ? UINT16_MAX : rate;
+    }
+
+    for (int i = 0; i < TASK_SWITCH_SLOTS; i++) {
+        s_prev_switches[i] = g_task_switch_count[i];
+    }
+    s_prev_total_runtime = total_runtime;
+    s_prev_tick = now;
+    bool ready = s_have_baseline;
+    s_have_baseline = true;
 
-        ESP_LOGI(TAG, "");
-        ESP_LOGI(TAG, "========== TASK STATISTICS ==========");
-        ESP_LOGI(TAG, "");
+    // Publish
+    profiled_mutex_take(&s_stats_mutex, portMAX_DELAY);
+    memcpy(s_tasks, s_scratch, count * sizeof(task_stats_t));
+    s_task_count = count;
+    s_interval_ms = interval_ms;
+    s_ready = ready;
+    profiled_mutex_give(&s_stats_mutex);
+}
+
+/**
+ * Log a one-line summary per task
+ *
+ * Reads s_tasks without the mutex - stats_task is its only writer.
+ */
+static void stats_log(void) {
+    ESP_LOGI(TAG, "");
+    ESP_LOGI(TAG, "========== TASK STATISTICS (%lu ms) ==========", s_interval_ms);
+    ESP_LOGI(TAG, "Name               CPU   Sw/s  Stack free");
+
+    for (size_t i = 0; i < s_task_count; i++) {
+        const task_stats_t *t = &s_tasks[i];
+        if (t->stack_free < STACK_WARNING_THRESHOLD) {
+            ESP_LOGW(TAG, "%-16s %3u.%02u%% %6u  %5lu (%+ld) ⚠️", t->name, t->cpu_x100[0] / 100,
+                     t->cpu_x100[0] % 100, t->switches_per_s[0], t->stack_free, t->stack_delta);
+        } else {
+            ESP_LOGI(TAG, "%-16s %3u.%02u%% %6u  %5lu (%+ld)", t->name, t->cpu_x100[0] / 100,
+                     t->cpu_x100[0] % 100, t->switches_per_s[0], t->stack_free, t->stack_delta);
+        }
+    }
+
+    stats_log_stacks();
+    stats_log_locks();
+    stats_log_power();
+
+    // Print free heap size and fragmentation
+    heap_summary_t heap;
+    heap_profiler_get_summary(&heap);
+    ESP_LOGI(TAG, "Free heap: %lu bytes (minimum since boot: %lu bytes)", heap.free_bytes,
+             heap.min_free_bytes);
+    ESP_LOGI(TAG, "Largest free block: %lu bytes (fragmentation %lu.%02lu%%)",
+             heap.largest_free_block, heap.fragmentation_x100 / 100, heap.fragmentation_x100 % 100);
+    ESP_LOGI(TAG, "=====================================");
+}
 
-        // Get task state information
-        // Format: Name  State  Priority  Stack  TaskNum
-        ESP_LOGI(TAG, "Task States (X=Running, B=Blocked, R=Ready, S=Suspended, D=Deleted):");
-        vTaskList(task_list_buffer);
-        ESP_LOGI(TAG, "\nName            State  Prio     Stack   Num\n%s", task_list_buffer);
+/**
+ * Log the stack sizing report for the tasks we created
+ *
+ * Stacks can't shrink at runtime; apply the recommendations to the
+ * *_TASK_STACK values in main.c after running a representative workload.
+ */
+static void stats_log_stacks(void) {
+    uint32_t total_size = 0;
+    uint32_t total_rec = 0;
 
-        ESP_LOGI(TAG, "");
+    ESP_LOGI(TAG, "Stack            Size  Used  Recommended");
+    for (size_t i = 0; i < s_task_count; i++) {
+        const task_stats_t *t = &s_tasks[i];
+        if (t->stack_size == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%-16s %5lu %5lu  %5lu", t->name, t->stack_size,
+                 t->stack_size - t->stack_free, t->stack_recommended);
+        total_size += t->stack_size;
+        total_rec += t->stack_recommended;
+    }
+
+    if (total_size > 0) {
+        ESP_LOGI(TAG, "Stacks: %lu bytes configured, %lu recommended, %ld reclaimable", total_size,
+                 total_rec, (int32_t) (total_size - total_rec));
+    }
+}
 
-        // Check individual task stacks with warnings
-        ESP_LOGI(TAG, "Stack Analysis:");
-        check_task_stack(sensor_task_handle, "sensor");
-        check_task_stack(display_task_handle, "display");
-        check_task_stack(stats_task_handle, "stats");
-        check_task_stack(reporter_task_handle, "reporter");
+/**
+ * Log mutex contention (only when CONFIG_GEEKHOUSE_LOCK_PROFILING is set)
+ */
+static void stats_log_locks(void) {
+    static lock_stats_t locks[LOCK_PROFILER_MAX];
+    size_t count = 0;
+    if (lock_profiler_get_stats(locks, LOCK_PROFILER_MAX, &count) != ESP_OK || count == 0) {
+        return;
+    }
+
+    ESP_LOGI(TAG, "Lock           Acquires Contended Timeouts  Wait avg/max us  Hold avg/max us");
+    for (size_t i = 0; i < count; i++) {
+        const lock_stats_t *l = &locks[i];
+        uint32_t wait_avg = l->contended > 0 ? (uint32_t) (l->wait_total_us / l->contended) : 0;
+        uint32_t hold_avg = l->acquires > 0 ? (uint32_t) (l->hold_total_us / l->acquires) : 0;
+        if (l->timeouts > 0) {
+            ESP_LOGW(TAG, "%-14s %8lu %9lu %8lu %8lu/%-8lu %8lu/%-8lu last holder: %s", l->name,
+                     l->acquires, l->contended, l->timeouts, wait_avg, l->wait_max_us, hold_avg,
+                     l->hold_max_us, l->timeout_owner);
+        } else {
+            ESP_LOGI(TAG, "%-14s %8lu %9lu %8lu %8lu/%-8lu %8lu/%-8lu", l->name, l->acquires,
+                     l->contended, l->timeouts, wait_avg, l->wait_max_us, hold_avg,
+                     l->hold_max_us);
+        }
+    }
+}
 
-        ESP_LOGI(TAG, "");
+/**
+ * Log time per power state and wakeups (only when CONFIG_GEEKHOUSE_POWER_SAVE is set)
+ */
+static void stats_log_power(void) {
+    power_stats_t power;
+    if (power_get_stats(&power) != ESP_OK || power.uptime_us == 0) {
+        return;
+    }
 
-        // Get CPU usage statistics
-        // Format: Name  AbsTime  %%Time
-        ESP_LOGI(TAG, "CPU Usage:");
-        vTaskGetRunTimeStats(cpu_stats_buffer);
-        ESP_LOGI(TAG, "\n%s", cpu_stats_buffer);
+    uint32_t total = 0;
+    for (int i = 0; i < POWER_WAKE_COUNT; i++) {
+        total += power.wakeups[i];
+    }
+    ESP_LOGI(TAG, "Power: sleep %lu.%02lu%%, active %lu.%02lu%%, idle %lu.%02lu%%, %lu wakeups",
+             (uint32_t) (power.sleep_us * 100 / power.uptime_us),
+             (uint32_t) (power.sleep_us * 10000 / power.uptime_us % 100),
+             (uint32_t) (power.active_us * 100 / power.uptime_us),
+             (uint32_t) (power.active_us * 10000 / power.uptime_us % 100),
+             (uint32_t) (power.idle_us * 100 / power.uptime_us),
+             (uint32_t) (power.idle_us * 10000 / power.uptime_us % 100), total);
+}
 
-        ESP_LOGI(TAG, "");
+size_t stats_get_tasks(task_stats_t *tasks, size_t max, uint32_t *interval_ms) {
+    if (tasks == NULL || s_stats_mutex.sem == NULL) {
+        return 0;
+    }
 
-        // Print free heap size
-        ESP_LOGI(TAG, "Free heap: %lu bytes", esp_get_free_heap_size());
-        ESP_LOGI(TAG, "Minimum free heap (since boot): %lu bytes",
-                 esp_get_minimum_free_heap_size());
+    if (profiled_mutex_take(&s_stats_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+        ESP_LOGW(TAG, "Failed to acquire mutex");
+        return 0;
+    }
 
-        ESP_LOGI(TAG, "");
-        ESP_LOGI(TAG, "=====================================");
-        ESP_LOGI(TAG, "");
+    size_t count = 0;
+    if (s_ready) {
+        count = s_task_count < max ? s_task_count : max;
+        memcpy(tasks, s_tasks, count * sizeof(task_stats_t));
+        if (interval_ms != NULL) {
+            *interval_ms = s_interval_ms;
+        }
     }
 
-    // Cleanup (never reached, but good practice)
-    free(task_list_buffer);
-    free(cpu_stats_buffer);
-    vTaskDelete(NULL);
+    profiled_mutex_give(&s_stats_mutex);
+    return count;
 }
 
-// Helper function to check and report stack usage
-static void check_task_stack(TaskHandle_t handle, const char *name) {
-    if (handle == NULL) {
-        ESP_LOGW(TAG, "  %s: handle is NULL", name);
+/**
+ * Metrics collector: heap, uptime and per-task CPU time / stack / switches
+ *
+ * Runs in the HTTP server task on every scrape. Per-task figures come from
+ * the latest snapshot, so a scrape doesn't walk the task list or allocate.
+ * Task names are dynamic, so samples are written directly.
+ */
+static void stats_metrics_collector(metrics_writer_t *w, void *arg) {
+    (void) arg;
+
+    metrics_write_family(w, "geekhouse_uptime_seconds", METRIC_GAUGE, "Time since boot");
+    metrics_write_sample(w, "geekhouse_uptime_seconds", NULL, esp_timer_get_time() / 1000000);
+
+    metrics_write_family(w, "geekhouse_heap_free_bytes", METRIC_GAUGE, "Free heap");
+    metrics_write_sample(w, "geekhouse_heap_free_bytes", NULL, esp_get_free_heap_size());
+    metrics_write_family(w, "geekhouse_heap_min_free_bytes", METRIC_GAUGE,
+                         "Lowest free heap since boot");
+    metrics_write_sample(w, "geekhouse_heap_min_free_bytes", NULL,
+                         esp_get_minimum_free_heap_size());
+    metrics_write_family(w, "geekhouse_heap_largest_free_block_bytes", METRIC_GAUGE,
+                         "Largest allocatable block");
+    metrics_write_sample(w, "geekhouse_heap_largest_free_block_bytes", NULL,
+                         heap_caps_get_largest_free_block(MALLOC_CAP_8BIT));
+
+    if (profiled_mutex_take(&s_stats_mutex, pdMS_TO_TICKS(100)) != pdTRUE) {
+        ESP_LOGW(TAG, "Failed to acquire mutex");
         return;
     }
 
-    // Get high water mark (minimum free stack in bytes)
-    UBaseType_t free_stack = uxTaskGetStackHighWaterMark(handle);
+    char labels[32];
+
+    // Run time counter is in microseconds and wraps; Prometheus treats the wrap as a reset
+    metrics_write_family(w, "geekhouse_task_runtime_us_total", METRIC_COUNTER,
+                         "CPU time used by each task");
+    for (size_t i = 0; i < s_task_count; i++) {
+        snprintf(labels, sizeof(labels), "task=\"%s\"", s_tasks[i].name);
+        metrics_write_sample(w, "geekhouse_task_runtime_us_total", labels, s_tasks[i].runtime_us);
+    }
+
+    metrics_write_family(w, "geekhouse_task_context_switches_total", METRIC_COUNTER,
+                         "Times each task was switched in");
+    for (size_t i = 0; i < s_task_count; i++) {
+        snprintf(labels, sizeof(labels), "task=\"%s\"", s_tasks[i].name);
+        metrics_write_sample(w, "geekhouse_task_context_switches_total", labels,
+                             g_task_switch_count[s_tasks[i].number & (TASK_SWITCH_SLOTS - 1)]);
+    }
 
-    // Log with appropriate level
-    if (free_stack < STACK_WARNING_THRESHOLD) {
-        ESP_LOGW(TAG, "  ⚠️  %s: only %u bytes free!", name, free_stack);
-    } else {
-        ESP_LOGI(TAG, "  %s: %u bytes free", name, free_stack);
+    metrics_write_family(w, "geekhouse_task_stack_free_bytes", METRIC_GAUGE,
+                         "Lowest free stack of each task since it started");
+    for (size_t i = 0; i < s_task_count; i++) {
+        snprintf(labels, sizeof(labels), "task=\"%s\"", s_tasks[i].name);
+        metrics_write_sample(w, "geekhouse_task_stack_free_bytes", labels,
+                             s_tasks[i].stack_free);
     }
-}
\ No newline at end of file
+
+    profiled_mutex_give(&s_stats_mutex);
+}
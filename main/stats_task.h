@@ -1,21 +1,75 @@
 #ifndef STATS_TASK_H
 #define STATS_TASK_H
 
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+// Sampling interval and history
+#define STATS_INTERVAL_MS 10000
+#define TASK_STATS_MAX    24  // Tasks tracked per snapshot
+#define TASK_STATS_WINDOW 6   // Intervals kept per task (1 minute at 10 s)
+
+// Stack sizing: recommended = deepest use + headroom, rounded up
+#define STACK_HEADROOM_PERCENT 25
+#define STACK_ROUND_BYTES      256
+#define STACK_MIN_BYTES        1024
+
+// Per-task statistics, computed from two consecutive snapshots
+// Window arrays are newest first; entries older than the task are 0.
+typedef struct {
+    char name[configMAX_TASK_NAME_LEN];
+    uint32_t number;      // FreeRTOS task number (unique per task)
+    uint8_t priority;     // Current priority
+    uint8_t state;        // eTaskState
+    uint8_t samples;      // Valid entries in the window arrays
+    uint32_t runtime_us;  // Cumulative run time (wraps)
+    uint32_t stack_free;  // Stack high-water mark (bytes never used)
+    int32_t stack_delta;  // High-water mark change in the last interval (< 0 = grew deeper)
+    uint32_t stack_size;         // Configured stack (0 = not created by us, unknown)
+    uint32_t stack_recommended;  // Suggested stack for the load seen so far (0 = unknown)
+    uint16_t cpu_x100[TASK_STATS_WINDOW];        // CPU usage per interval, percent * 100
+    uint16_t switches_per_s[TASK_STATS_WINDOW];  // Context switches into the task per second
+} task_stats_t;
+
 /**
  * Statistics monitoring task
  *
- * Periodically prints task statistics including:
- * - Task states (Running, Blocked, Ready, Suspended, Deleted)
- * - Stack high water mark (minimum free stack)
- * - CPU usage percentage
+ * Every STATS_INTERVAL_MS, snapshots all tasks with uxTaskGetSystemState()
+ * into preallocated arrays and computes per-interval CPU usage,
+ * context-switch rates and stack high-water mark changes. Nothing is
+ * allocated after startup. Logs a one-line summary per task.
  *
  * Task parameters:
  * - Priority: 2 (low - monitoring shouldn't interfere)
- * - Stack: 4KB (needs space for formatted strings)
+ * - Stack: 2KB
  * - Period: 10 seconds
  *
  * @param pvParameters Unused (NULL)
  */
 void stats_task(void *pvParameters);
 
+/**
+ * Record a task's configured stack size, for the stack sizing report
+ *
+ * Tasks not registered here (ESP-IDF's own) are reported without a
+ * recommendation.
+ *
+ * @param task Task handle
+ * @param stack_bytes Stack size the task was created with
+ */
+void stats_set_stack_size(TaskHandle_t task, uint32_t stack_bytes);
+
+/**
+ * Get per-task statistics from the latest interval
+ *
+ * @param[out] tasks Buffer for task statistics
+ * @param max Buffer capacity
+ * @param[out] interval_ms Length of the latest interval (optional, may be NULL)
+ * @return Number of tasks copied (0 until two snapshots have been taken)
+ */
+size_t stats_get_tasks(task_stats_t *tasks, size_t max, uint32_t *interval_ms);
+
 #endif  // STATS_TASK_H
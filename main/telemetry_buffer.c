@@ -0,0 +1,298 @@
+#include "telemetry_buffer.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "freertos/FreeRTOS.h"
+
+static const char *TAG = "TELEMETRY_BUF";
+
+// Reading as stored in flash (the unit pointer is not kept)
+typedef struct {
+    uint32_t timestamp;
+    float value;
+    int16_t raw;
+    uint8_t id;
+    uint8_t reserved;
+} telemetry_record_t;
+
+#define TELEMETRY_CHUNK_MAX TELEMETRY_RAM_CAPACITY  // Records per flash read/write
+
+// RAM ring (newest readings)
+static sensor_reading_t s_ram[TELEMETRY_RAM_CAPACITY];
+static size_t s_ram_head = 0;  // Oldest reading
+static size_t s_ram_count = 0;
+
+// Flash log: record positions are free-running counters, head - tail are pending
+static telemetry_flash_t s_flash;
+static bool s_flash_enabled = false;
+static size_t s_per_sector = 0;  // Records per sector
+static uint32_t s_capacity = 0;  // Records in the whole log
+static uint32_t s_flash_head = 0;
+static uint32_t s_flash_tail = 0;
+
+static telemetry_record_t s_chunk[TELEMETRY_CHUNK_MAX];
+static bool s_peeked_flash = false;  // Source of the last peek
+
+static telemetry_buffer_stats_t s_stats;
+static portMUX_TYPE s_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static size_t telemetry_offset(uint32_t pos) {
+    uint32_t slot = pos % s_capacity;
+    return (slot / s_per_sector) * s_flash.sector_size +
+           (slot % s_per_sector) * sizeof(telemetry_record_t);
+}
+
+static void telemetry_update_pending(void) {
+    portENTER_CRITICAL(&s_stats_mux);
+    s_stats.pending_ram = s_ram_count;
+    s_stats.pending_flash = s_flash_head - s_flash_tail;
+    portEXIT_CRITICAL(&s_stats_mux);
+}
+
+static void telemetry_count(uint32_t *counter, uint32_t n) {
+    portENTER_CRITICAL(&s_stats_mux);
+    *counter += n;
+    portEXIT_CRITICAL(&s_stats_mux);
+}
+
+/**
+ * Append records to the flash log, erasing (and dropping) the oldest sector when full
+ *
+ * @return ESP_OK on success
+ */
+static esp_err_t telemetry_flash_append(const telemetry_record_t *records, size_t count) {
+    while (count > 0) {
+        size_t in_sector = s_flash_head % s_per_sector;
+        if (in_sector == 0) {
+            // The sector about to be reused holds the oldest records
+            uint32_t pending = s_flash_head - s_flash_tail;
+            if (pending > s_capacity - s_per_sector) {
+                uint32_t lost = pending - (s_capacity - s_per_sector);
+                s_flash_tail += lost;
+                telemetry_count(&s_stats.dropped, lost);
+                ESP_LOGW(TAG, "Flash log full, dropped %lu oldest readings", lost);
+            }
+            size_t sector = telemetry_offset(s_flash_head);
+            esp_err_t ret = s_flash.erase(s_flash.ctx, sector, s_flash.sector_size);
+            if (ret != ESP_OK) {
+                ESP_LOGE(TAG, "Erase at 0x%x failed: %s", (unsigned) sector, esp_err_to_name(ret));
+                return ret;
+            }
+        }
+
+        size_t n = s_per_sector - in_sector;
+        if (n > count) {
+            n = count;
+        }
+        esp_err_t ret = s_flash.write(s_flash.ctx, telemetry_offset(s_flash_head), records,
+                                      n * sizeof(telemetry_record_t));
+        if (ret != ESP_OK) {
+            ESP_LOGE(TAG, "Write failed: %s", esp_err_to_name(ret));
+            return ret;
+        }
+        s_flash_head += n;
+        records += n;
+        count -= n;
+    }
+    return ESP_OK;
+}
+
+/**
+ * Move the whole RAM ring to the flash log
+ *
+ * Readings leave RAM once they are in flash, also when a later sector of
+ * the same spill fails: keeping them would replay them twice.
+ *
+ * @return ESP_OK on success (RAM is empty afterwards)
+ */
+static esp_err_t telemetry_spill(void) {
+    for (size_t i = 0; i < s_ram_count; i++) {
+        const sensor_reading_t *r = &s_ram[(s_ram_head + i) % TELEMETRY_RAM_CAPACITY];
+        s_chunk[i] = (telemetry_record_t) {.timestamp = r->timestamp,
+                                           .value = r->calibrated_value,
+                                           .raw = (int16_t) r->raw_value,
+                                           .id = (uint8_t) r->id};
+    }
+
+    uint32_t head = s_flash_head;
+    esp_err_t ret = telemetry_flash_append(s_chunk, s_ram_count);
+    size_t written = s_flash_head - head;
+    s_ram_head = (s_ram_head + written) % TELEMETRY_RAM_CAPACITY;
+    s_ram_count -= written;
+    if (ret != ESP_OK) {
+        telemetry_count(&s_stats.flash_errors, 1);
+        return ret;
+    }
+    telemetry_count(&s_stats.spills, 1);
+    return ESP_OK;
+}
+
+void telemetry_buffer_push(const sensor_reading_t *reading) {
+    if (reading == NULL) {
+        return;
+    }
+
+    if (s_ram_count == TELEMETRY_RAM_CAPACITY && s_flash_enabled) {
+        telemetry_spill();  // Even a failed one may have moved some readings
+    }
+    if (s_ram_count == TELEMETRY_RAM_CAPACITY) {
+        // No room anywhere: the oldest RAM reading makes way
+        s_ram_head = (s_ram_head + 1) % TELEMETRY_RAM_CAPACITY;
+        s_ram_count--;
+        telemetry_count(&s_stats.dropped, 1);
+    }
+
+    sensor_reading_t *slot = &s_ram[(s_ram_head + s_ram_count) % TELEMETRY_RAM_CAPACITY];
+    *slot = *reading;
+    slot->unit = NULL;
+    s_ram_count++;
+    telemetry_count(&s_stats.buffered, 1);
+    telemetry_update_pending();
+}
+
+size_t telemetry_buffer_peek(sensor_reading_t *readings, size_t max) {
+    if (readings == NULL || max == 0) {
+        return 0;
+    }
+
+    // Flash holds the older readings, drain it first
+    uint32_t flash_pending = s_flash_head - s_flash_tail;
+    if (flash_pending > 0) {
+        size_t n = s_per_sector - s_flash_tail % s_per_sector;  // Stay within one sector
+        if (n > flash_pending) {
+            n = flash_pending;
+        }
+        if (n > max) {
+            n = max;
+        }
+        if (n > TELEMETRY_CHUNK_MAX) {
+            n = TELEMETRY_CHUNK_MAX;
+        }
+
+        esp_err_t ret = s_flash.read(s_flash.ctx, telemetry_offset(s_flash_tail), s_chunk,
+                                     n * sizeof(telemetry_record_t));
+        if (ret == ESP_OK) {
+            for (size_t i = 0; i < n; i++) {
+                readings[i] = (sensor_reading_t) {.id = (sensor_id_t) s_chunk[i].id,
+                                                  .raw_value = s_chunk[i].raw,
+                                                  .calibrated_value = s_chunk[i].value,
+                                                  .timestamp = s_chunk[i].timestamp};
+            }
+            s_peeked_flash = true;
+            return n;
+        }
+
+        // Unreadable: give the records up rather than getting stuck on them
+        ESP_LOGE(TAG, "Read failed (%s), dropping %d readings", esp_err_to_name(ret), (int) n);
+        s_flash_tail += n;
+        telemetry_count(&s_stats.flash_errors, 1);
+        telemetry_count(&s_stats.dropped, n);
+        telemetry_update_pending();
+        return 0;
+    }
+
+    size_t n = s_ram_count < max ? s_ram_count : max;
+    for (size_t i = 0; i < n; i++) {
+        readings[i] = s_ram[(s_ram_head + i) % TELEMETRY_RAM_CAPACITY];
+    }
+    s_peeked_flash = false;
+    return n;
+}
+
+void telemetry_buffer_consume(size_t count) {
+    if (s_peeked_flash) {
+        uint32_t pending = s_flash_head - s_flash_tail;
+        s_flash_tail += count < pending ? count : pending;
+    } else {
+        if (count > s_ram_count) {
+            count = s_ram_count;
+        }
+        s_ram_head = (s_ram_head + count) % TELEMETRY_RAM_CAPACITY;
+        s_ram_count -= count;
+    }
+    telemetry_count(&s_stats.replayed, count);
+    telemetry_update_pending();
+}
+
+size_t telemetry_buffer_pending(void) {
+    return s_ram_count + (s_flash_head - s_flash_tail);
+}
+
+static esp_err_t partition_read(void *ctx, size_t offset, void *dst, size_t len) {
+    return esp_partition_read((const esp_partition_t *) ctx, offset, dst, len);
+}
+
+static esp_err_t partition_write(void *ctx, size_t offset, const void *src, size_t len) {
+    return esp_partition_write((const esp_partition_t *) ctx, offset, src, len);
+}
+
+static esp_err_t partition_erase(void *ctx, size_t offset, size_t len) {
+    return esp_partition_erase_range((const esp_partition_t *) ctx, offset, len);
+}
+
+esp_err_t telemetry_buffer_partition(telemetry_flash_t *flash) {
+    if (flash == NULL) {
+        ESP_LOGE(TAG, "Invalid argument: flash is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    const esp_partition_t *part = esp_partition_find_first(
+        ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, TELEMETRY_PARTITION);
+    if (part == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    *flash = (telemetry_flash_t) {
+        .read = partition_read,
+        .write = partition_write,
+        .erase = partition_erase,
+        .size = part->size - part->size % part->erase_size,
+        .sector_size = part->erase_size,
+        .ctx = (void *) part,
+    };
+    return ESP_OK;
+}
+
+esp_err_t telemetry_buffer_init(const telemetry_flash_t *flash) {
+    s_ram_head = 0;
+    s_ram_count = 0;
+    s_flash_head = 0;
+    s_flash_tail = 0;
+    s_flash_enabled = false;
+    memset(&s_stats, 0, sizeof(s_stats));
+
+    if (flash == NULL) {
+        ESP_LOGI(TAG, "RAM only (%d readings)", TELEMETRY_RAM_CAPACITY);
+        return ESP_OK;
+    }
+    if (flash->read == NULL || flash->write == NULL || flash->erase == NULL ||
+        flash->sector_size < sizeof(telemetry_record_t) || flash->size < flash->sector_size) {
+        ESP_LOGE(TAG, "Invalid flash backend");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    s_flash = *flash;
+    s_per_sector = flash->sector_size / sizeof(telemetry_record_t);
+    s_capacity = (flash->size / flash->sector_size) * s_per_sector;
+    s_flash_enabled = true;
+    s_stats.flash_capacity = s_capacity;
+
+    ESP_LOGI(TAG, "RAM %d + flash %lu readings (%d KB)", TELEMETRY_RAM_CAPACITY, s_capacity,
+             (int) (flash->size / 1024));
+    return ESP_OK;
+}
+
+esp_err_t telemetry_buffer_get_stats(telemetry_buffer_stats_t *stats) {
+    if (stats == NULL) {
+        ESP_LOGE(TAG, "Invalid argument: stats is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_stats_mux);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_mux);
+    return ESP_OK;
+}
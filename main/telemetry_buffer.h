@@ -0,0 +1,107 @@
+#ifndef TELEMETRY_BUFFER_H
+#define TELEMETRY_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "sensors.h"
+
+// Store-and-forward buffer for telemetry that couldn't be delivered
+//
+// Readings go into a RAM ring first. When it fills, its whole content is
+// appended to a log in the "telemetry" flash partition (if the partition
+// table has one), so the flash always holds the oldest readings and RAM the
+// newest. Draining is oldest-first: flash, then RAM. When the flash log is
+// full, its oldest sector is erased and the readings in it are dropped.
+//
+// Sectors are erased lazily right before they are written, so init is
+// fast. Timestamps are relative to boot, so the log starts empty on every
+// boot and readings from a previous boot are not replayed.
+//
+// The buffer is not thread-safe: one task owns it (the MQTT publisher).
+// Only telemetry_buffer_get_stats() may be called from other tasks.
+//
+// Flash access goes through telemetry_flash_t, so the buffer can run
+// against a file-backed stand-in on a host.
+
+#define TELEMETRY_RAM_CAPACITY 64  // Readings held in RAM before spilling to flash
+#define TELEMETRY_PARTITION    "telemetry"
+
+// Flash backend (offsets in bytes from the start of the log area)
+typedef struct {
+    esp_err_t (*read)(void *ctx, size_t offset, void *dst, size_t len);
+    esp_err_t (*write)(void *ctx, size_t offset, const void *src, size_t len);
+    esp_err_t (*erase)(void *ctx, size_t offset, size_t len);  // Whole sectors
+    size_t size;         // Log area size, a multiple of sector_size
+    size_t sector_size;  // Erase unit
+    void *ctx;
+} telemetry_flash_t;
+
+// Buffer statistics
+typedef struct {
+    uint32_t buffered;        // Readings taken into the buffer
+    uint32_t dropped;         // Readings lost to a full buffer
+    uint32_t replayed;        // Readings drained from the buffer
+    uint32_t spills;          // RAM ring flushes to flash
+    uint32_t flash_errors;    // Failed flash reads, writes or erases
+    uint32_t pending_ram;     // Readings waiting in RAM
+    uint32_t pending_flash;   // Readings waiting in flash
+    uint32_t flash_capacity;  // Readings the flash log holds, 0 without a partition
+} telemetry_buffer_stats_t;
+
+/**
+ * Initialize the buffer
+ *
+ * @param flash Flash backend (copied), NULL for RAM only
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if the backend geometry is unusable
+ */
+esp_err_t telemetry_buffer_init(const telemetry_flash_t *flash);
+
+/**
+ * Get the backend for the "telemetry" partition
+ *
+ * @param[out] flash Backend
+ * @return ESP_OK on success, ESP_ERR_NOT_FOUND if the partition table has none
+ */
+esp_err_t telemetry_buffer_partition(telemetry_flash_t *flash);
+
+/**
+ * Add a reading (spills to flash, or drops the oldest, when RAM is full)
+ *
+ * @param reading Reading (copied; the unit is not kept)
+ */
+void telemetry_buffer_push(const sensor_reading_t *reading);
+
+/**
+ * Copy out the oldest readings without removing them
+ *
+ * Returns readings from one storage (flash or RAM) per call.
+ *
+ * @param[out] readings Output, oldest first
+ * @param max Capacity of readings
+ * @return Number of readings copied, 0 if empty
+ */
+size_t telemetry_buffer_peek(sensor_reading_t *readings, size_t max);
+
+/**
+ * Remove readings returned by the last telemetry_buffer_peek()
+ *
+ * @param count Number of readings delivered (at most the peeked count)
+ */
+void telemetry_buffer_consume(size_t count);
+
+/**
+ * Get the number of readings waiting
+ */
+size_t telemetry_buffer_pending(void);
+
+/**
+ * Get buffer statistics
+ *
+ * @param[out] stats Statistics
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t telemetry_buffer_get_stats(telemetry_buffer_stats_t *stats);
+
+#endif  // TELEMETRY_BUFFER_H
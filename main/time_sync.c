@@ -27,6 +27,9 @@ static void time_sync_notification_cb(struct timeval *tv) {
 }
 
 esp_err_t time_sync_init(void) {
+    if (esp_sntp_enabled()) {
+        return ESP_OK;
+    }
     ESP_LOGI(TAG, "Initializing SNTP...");
 
     // Set timezone (change to your timezone)
@@ -49,6 +52,13 @@ esp_err_t time_sync_init(void) {
     return ESP_OK;
 }
 
+void time_sync_stop(void) {
+    if (esp_sntp_enabled()) {
+        esp_sntp_stop();
+        ESP_LOGI(TAG, "SNTP stopped");
+    }
+}
+
 bool time_sync_is_synced(void) {
     return s_time_synced;
 }
@@ -11,12 +11,20 @@
  * Configures the SNTP client to sync from pool.ntp.org.
  * Time sync happens asynchronously after this call returns.
  *
- * Must be called after WiFi is connected.
+ * Must be called after WiFi is connected. May be called again after
+ * time_sync_stop(), which restarts the client and resyncs right away.
  *
  * @return ESP_OK on success
  */
 esp_err_t time_sync_init(void);
 
+/**
+ * Stop the SNTP client (e.g. while offline)
+ *
+ * The clock keeps running; time_sync_is_synced() stays true.
+ */
+void time_sync_stop(void);
+
 /**
  * Check if time has been synchronized
  *
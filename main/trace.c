@@ -0,0 +1,180 @@
+#include "trace.h"
+
+#include <string.h>
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+static const char *TAG = "TRACE";
+
+#ifdef CONFIG_GEEKHOUSE_TRACE
+
+#define TRACE_EVENTS       CONFIG_GEEKHOUSE_TRACE_EVENTS
+#define TRACE_MASK         (TRACE_EVENTS - 1)
+#define TRACE_TASKS_MAX    24
+#define TRACE_NAME_LEN     16
+#define TRACE_CALIBRATIONS 1000
+
+_Static_assert((TRACE_EVENTS & TRACE_MASK) == 0, "CONFIG_GEEKHOUSE_TRACE_EVENTS: power of two");
+_Static_assert(sizeof(trace_event_t) == 16, "Trace event must stay 16 bytes");
+
+// Dump header
+#define TRACE_MAGIC   0x52544847  // "GHTR"
+#define TRACE_VERSION 1
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t event_size;
+    uint32_t event_count;   // Events in this dump
+    uint32_t total_events;  // Events recorded since boot (older ones were overwritten)
+    uint16_t task_count;
+    uint16_t span_count;
+    uint32_t overhead_ns;  // Measured cost of one event
+} trace_header_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t handle;
+    char name[TRACE_NAME_LEN];
+} trace_task_name_t;
+
+static const char SPAN_NAMES[TRACE_SPAN_COUNT][TRACE_NAME_LEN] = {
+    [TRACE_SPAN_SENSOR_READ] = "sensor_read",
+    [TRACE_SPAN_RULES] = "rules",
+    [TRACE_SPAN_LED_APPLY] = "led_apply",
+    [TRACE_SPAN_HTTP] = "http",
+};
+
+// Event ring
+// s_head counts every event ever recorded; the slot is s_head & TRACE_MASK.
+static trace_event_t s_ring[TRACE_EVENTS];
+static uint32_t s_head = 0;
+static volatile bool s_enabled = false;
+static uint32_t s_overhead_ns = 0;
+
+// Dump scratch (only used by trace_dump, which runs in the HTTP server task)
+static TaskStatus_t s_status[TRACE_TASKS_MAX];
+static trace_task_name_t s_names[TRACE_TASKS_MAX];
+
+/**
+ * Append one event
+ *
+ * Called from kernel hooks with interrupts already masked, from tasks and
+ * from ISRs. Masking interrupts for the few instructions that claim and
+ * fill the slot is the cheapest way to keep events whole on a single core
+ * without atomic instructions.
+ */
+static inline void IRAM_ATTR trace_write(uint8_t type, uint32_t task, uint32_t obj, uint16_t arg) {
+    if (!s_enabled) {
+        return;  // Cheap early out; checked again with interrupts masked
+    }
+
+    UBaseType_t irq = portSET_INTERRUPT_MASK_FROM_ISR();
+    // trace_dump() may have paused recording since the check above
+    if (s_enabled) {
+        trace_event_t *e = &s_ring[s_head++ & TRACE_MASK];
+        e->timestamp_us = (uint32_t) esp_timer_get_time();
+        e->type = type;
+        e->reserved = 0;
+        e->arg = arg;
+        e->task = task;
+        e->obj = obj;
+    }
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(irq);
+}
+
+void IRAM_ATTR trace_record(uint8_t type, uint32_t obj, uint16_t arg) {
+    trace_write(type, (uint32_t) (uintptr_t) xTaskGetCurrentTaskHandle(), obj, arg);
+}
+
+void IRAM_ATTR trace_record_isr(uint8_t type, uint32_t obj, uint16_t arg) {
+    trace_write(type, 0, obj, arg);
+}
+
+esp_err_t trace_init(void) {
+    s_enabled = true;
+
+    // Measure the cost of one event, then start from an empty ring
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < TRACE_CALIBRATIONS; i++) {
+        trace_record(TRACE_EVT_SPAN_BEGIN, 0, TRACE_SPAN_COUNT);
+    }
+    int64_t elapsed_us = esp_timer_get_time() - start;
+    s_overhead_ns = (uint32_t) (elapsed_us * 1000 / TRACE_CALIBRATIONS);
+
+    UBaseType_t irq = portSET_INTERRUPT_MASK_FROM_ISR();
+    s_head = 0;
+    portCLEAR_INTERRUPT_MASK_FROM_ISR(irq);
+
+    ESP_LOGI(TAG, "Tracing enabled: %d events (%d KB), %lu ns per event", TRACE_EVENTS,
+             (int) (sizeof(s_ring) / 1024), s_overhead_ns);
+    return ESP_OK;
+}
+
+esp_err_t trace_dump(trace_flush_t flush, void *ctx) {
+    if (flush == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Pause recording - writers check s_enabled again with interrupts
+    // masked, so once this store lands no writer is active
+    s_enabled = false;
+
+    uint32_t head = s_head;
+    uint32_t count = head < TRACE_EVENTS ? head : TRACE_EVENTS;
+
+    // Task names, so the decoder can label handles
+    UBaseType_t task_count = uxTaskGetSystemState(s_status, TRACE_TASKS_MAX, NULL);
+    for (UBaseType_t i = 0; i < task_count; i++) {
+        s_names[i].handle = (uint32_t) (uintptr_t) s_status[i].xHandle;
+        strncpy(s_names[i].name, s_status[i].pcTaskName, TRACE_NAME_LEN);
+    }
+
+    trace_header_t header = {.magic = TRACE_MAGIC,
+                             .version = TRACE_VERSION,
+                             .event_size = sizeof(trace_event_t),
+                             .event_count = count,
+                             .total_events = head,
+                             .task_count = task_count,
+                             .span_count = TRACE_SPAN_COUNT,
+                             .overhead_ns = s_overhead_ns};
+
+    esp_err_t ret = flush(ctx, (const char *) &header, sizeof(header));
+    if (ret == ESP_OK && task_count > 0) {
+        ret = flush(ctx, (const char *) s_names, task_count * sizeof(trace_task_name_t));
+    }
+    if (ret == ESP_OK) {
+        ret = flush(ctx, (const char *) SPAN_NAMES, sizeof(SPAN_NAMES));
+    }
+
+    // Events, oldest first: the ring may wrap, so up to two slices
+    uint32_t first = (head - count) & TRACE_MASK;
+    uint32_t first_len = count < TRACE_EVENTS - first ? count : TRACE_EVENTS - first;
+    if (ret == ESP_OK && first_len > 0) {
+        ret = flush(ctx, (const char *) &s_ring[first], first_len * sizeof(trace_event_t));
+    }
+    if (ret == ESP_OK && count > first_len) {
+        ret = flush(ctx, (const char *) &s_ring[0], (count - first_len) * sizeof(trace_event_t));
+    }
+
+    s_enabled = true;
+    return ret;
+}
+
+#else  // CONFIG_GEEKHOUSE_TRACE
+
+esp_err_t trace_init(void) {
+    ESP_LOGD(TAG, "Tracing disabled (CONFIG_GEEKHOUSE_TRACE)");
+    return ESP_OK;
+}
+
+esp_err_t trace_dump(trace_flush_t flush, void *ctx) {
+    (void) flush;
+    (void) ctx;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+#endif  // CONFIG_GEEKHOUSE_TRACE
@@ -0,0 +1,73 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "freertos_hooks.h"
+
+// Event tracing (CONFIG_GEEKHOUSE_TRACE)
+//
+// Fixed-size binary events from the kernel hooks in freertos_hooks.h and
+// from TRACE_SPAN_* go into a RAM ring that overwrites the oldest entries.
+// GET /api/trace downloads the ring; tools/trace2perfetto.py turns the dump
+// into Chrome/Perfetto JSON. With tracing disabled all hooks compile to nothing.
+
+// Custom spans (names are included in the dump)
+typedef enum {
+    TRACE_SPAN_SENSOR_READ,  // sensor_task: read and publish one sample
+    TRACE_SPAN_RULES,        // rules_on_sample()
+    TRACE_SPAN_LED_APPLY,    // actuator_task: apply one drained batch
+    TRACE_SPAN_HTTP,         // One HTTP handler
+    TRACE_SPAN_COUNT
+} trace_span_t;
+
+// One event (16 bytes, little endian in the dump)
+typedef struct {
+    uint32_t timestamp_us;  // esp_timer time, low 32 bits
+    uint8_t type;           // trace_event_type_t
+    uint8_t reserved;
+    uint16_t arg;
+    uint32_t task;  // Task handle that was running (0 = ISR)
+    uint32_t obj;   // Queue / task handle, depending on type
+} trace_event_t;
+
+#ifdef CONFIG_GEEKHOUSE_TRACE
+#define TRACE_SPAN_BEGIN(span) trace_record(TRACE_EVT_SPAN_BEGIN, 0, (span))
+#define TRACE_SPAN_END(span)   trace_record(TRACE_EVT_SPAN_END, 0, (span))
+#else
+#define TRACE_SPAN_BEGIN(span) ((void) 0)
+#define TRACE_SPAN_END(span)   ((void) 0)
+#endif
+
+/**
+ * Output callback for trace_dump()
+ *
+ * @return ESP_OK to continue, anything else aborts the dump
+ */
+typedef esp_err_t (*trace_flush_t)(void *ctx, const char *buf, size_t len);
+
+/**
+ * Initialize tracing
+ *
+ * Measures the cost of one event (logged, and stored in the dump header)
+ * and starts recording. Does nothing when tracing is disabled.
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t trace_init(void);
+
+/**
+ * Dump the ring, oldest event first
+ *
+ * Recording is paused while dumping. Layout: header, task name table,
+ * span name table, events (see tools/trace2perfetto.py).
+ *
+ * @param flush Output callback
+ * @param ctx Passed to flush
+ * @return ESP_OK on success, ESP_ERR_NOT_SUPPORTED if tracing is disabled
+ */
+esp_err_t trace_dump(trace_flush_t flush, void *ctx);
+
+#endif  // TRACE_H
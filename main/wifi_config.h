@@ -7,17 +7,8 @@
 #define WIFI_SSID_MAX_LEN     32
 #define WIFI_PASSWORD_MAX_LEN 64
 
-/**
- * Initialize WiFi configuration
- *
- * Opens NVS namespace "wifi_config". If no credentials are stored,
- * writes the Kconfig defaults (CONFIG_GEEKHOUSE_WIFI_SSID/PASSWORD).
- *
- * Must be called after nvs_flash_init().
- *
- * @return ESP_OK on success
- */
-esp_err_t wifi_config_init(void);
+// WiFi credentials, kept by the settings store (settings.h: wifi.ssid and
+// wifi.password). The getters copy from RAM; settings_init() must have run.
 
 /**
  * Get stored WiFi SSID
@@ -38,13 +29,16 @@ esp_err_t wifi_config_get_ssid(char *ssid, size_t len);
 esp_err_t wifi_config_get_password(char *password, size_t len);
 
 /**
- * Update WiFi credentials in NVS
+ * Update WiFi credentials
  *
- * New values persist across reboots. Takes effect on next WiFi connection.
+ * Both change together; the settings task commits them to NVS shortly
+ * after. The current connection is kept: the WiFi manager uses the new
+ * credentials from its next reconnect on (a changed SSID also drops the
+ * cached AP, so that attempt scans).
  *
  * @param ssid New SSID
  * @param password New password
- * @return ESP_OK on success
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if a value is too long
  */
 esp_err_t wifi_config_set_credentials(const char *ssid, const char *password);
 
@@ -5,13 +5,247 @@
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_netif.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
+#include "metrics.h"
+#include "nvs.h"
 #include "wifi_config.h"
 
 static const char *TAG = "WIFI_MGR";
 
+// NVS namespace and key of the connection cache
+#define NVS_NAMESPACE "wifi_cache"
+#define NVS_KEY_CACHE "last"
+
+#define WIFI_CACHE_VERSION 1
+
+// Last good connection (what a fast connect needs)
+typedef struct {
+    uint8_t version;
+    uint8_t channel;
+    uint8_t bssid[6];
+    char ssid[WIFI_SSID_MAX_LEN + 1];  // Cache is only used for this SSID
+    esp_netif_ip_info_t ip_info;
+    uint32_t dns;
+} wifi_cache_t;
+
 static EventGroupHandle_t s_wifi_event_group;
+static esp_netif_t *s_sta_netif = NULL;
+static esp_timer_handle_t s_reconnect_timer = NULL;
+
+static wifi_cache_t s_cache;
+static bool s_cache_valid = false;
+
+// Connection state (event task only)
 static int s_retry_count = 0;
+static bool s_fast_attempt = false;     // Current attempt uses the cached BSSID/channel
+static bool s_dhcp_stopped = false;     // Cached lease applied, DHCP client off
+static int64_t s_connect_start_us = 0;  // Start of the current outage, 0 while connected
+static bool s_connected_once = false;
+
+static wifi_manager_stats_t s_stats;
+static portMUX_TYPE s_stats_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Metrics
+static metric_t *s_disconnects_metric = NULL;
+static metric_t *s_boot_time_metric = NULL;
+static metric_t *s_reconnect_time_metric = NULL;
+
+static const uint32_t TIME_TO_IP_BOUNDS_MS[] = {250, 500, 1000, 2000, 4000, 8000, 16000, 32000};
+
+/**
+ * Load the connection cache, valid only if it was saved for this SSID
+ */
+static void wifi_cache_load(const char *ssid) {
+    nvs_handle_t handle;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;  // Nothing cached yet
+    }
+    size_t size = sizeof(s_cache);
+    esp_err_t ret = nvs_get_blob(handle, NVS_KEY_CACHE, &s_cache, &size);
+    nvs_close(handle);
+
+    s_cache_valid = ret == ESP_OK && size == sizeof(s_cache) &&
+                    s_cache.version == WIFI_CACHE_VERSION && s_cache.channel >= 1 &&
+                    s_cache.channel <= 14 && strcmp(s_cache.ssid, ssid) == 0;
+}
+
+/**
+ * Save the connection cache (skipped if unchanged, to spare the flash)
+ */
+static void wifi_cache_save(const wifi_cache_t *cache) {
+    if (s_cache_valid && memcmp(cache, &s_cache, sizeof(s_cache)) == 0) {
+        return;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret == ESP_OK) {
+        ret = nvs_set_blob(handle, NVS_KEY_CACHE, cache, sizeof(*cache));
+        if (ret == ESP_OK) {
+            ret = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to save connection cache: %s", esp_err_to_name(ret));
+        return;
+    }
+
+    s_cache = *cache;
+    s_cache_valid = true;
+    ESP_LOGI(TAG, "Cached AP %02x:%02x:%02x:%02x:%02x:%02x on channel %d", cache->bssid[0],
+             cache->bssid[1], cache->bssid[2], cache->bssid[3], cache->bssid[4],
+             cache->bssid[5], cache->channel);
+}
+
+/**
+ * Point the next attempt at the cached AP, or at a full scan
+ *
+ * Credentials are read from the settings store every time, so changed
+ * ones are used from the next reconnect on. A changed SSID retires the
+ * cache, which belongs to the old network, and forces a full scan.
+ */
+static void wifi_apply_config(bool fast) {
+    wifi_config_t cfg;
+    char ssid[WIFI_SSID_MAX_LEN + 1];
+    char password[WIFI_PASSWORD_MAX_LEN + 1];
+    if (esp_wifi_get_config(WIFI_IF_STA, &cfg) != ESP_OK ||
+        wifi_config_get_ssid(ssid, sizeof(ssid)) != ESP_OK ||
+        wifi_config_get_password(password, sizeof(password)) != ESP_OK) {
+        return;
+    }
+    // Not NUL-terminated at full length, as the driver expects
+    memset(cfg.sta.ssid, 0, sizeof(cfg.sta.ssid));
+    memcpy(cfg.sta.ssid, ssid, strlen(ssid));
+    memset(cfg.sta.password, 0, sizeof(cfg.sta.password));
+    memcpy(cfg.sta.password, password, strlen(password));
+
+    if (s_cache_valid && strcmp(s_cache.ssid, ssid) != 0) {
+        ESP_LOGI(TAG, "SSID changed to %s, dropping cached AP", ssid);
+        s_cache_valid = false;
+    }
+    fast = fast && s_cache_valid;
+
+    if (fast) {
+        // Direct connect: no scan, probe only the cached channel
+        cfg.sta.bssid_set = true;
+        memcpy(cfg.sta.bssid, s_cache.bssid, sizeof(cfg.sta.bssid));
+        cfg.sta.channel = s_cache.channel;
+        cfg.sta.scan_method = WIFI_FAST_SCAN;
+    } else {
+        // Any AP with this SSID on any channel, strongest first
+        cfg.sta.bssid_set = false;
+        cfg.sta.channel = 0;
+        cfg.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        cfg.sta.sort_method = WIFI_CONNECT_AP_BY_SIGNAL;
+    }
+    esp_wifi_set_config(WIFI_IF_STA, &cfg);
+    s_fast_attempt = fast;
+}
+
+/**
+ * Reconnect timer callback (esp_timer task)
+ */
+static void wifi_reconnect_cb(void *arg) {
+    (void) arg;
+    esp_wifi_connect();
+}
+
+/**
+ * Backoff before the given retry: exponential, capped, half jittered
+ */
+static uint32_t wifi_backoff_ms(int retry) {
+    int shift = retry > 1 ? retry - 1 : 0;
+    uint32_t cap = WIFI_BACKOFF_MAX_MS;
+    if (shift < 16 && (WIFI_BACKOFF_MIN_MS << shift) < WIFI_BACKOFF_MAX_MS) {
+        cap = WIFI_BACKOFF_MIN_MS << shift;
+    }
+    return cap / 2 + esp_random() % (cap / 2 + 1);
+}
+
+/**
+ * Reuse the cached lease if we associated with the cached AP
+ *
+ * Setting a static address makes esp_netif post IP_EVENT_STA_GOT_IP
+ * right away, skipping the DHCP exchange. Any other AP gets DHCP.
+ */
+static void wifi_apply_ip(const uint8_t *bssid) {
+#ifdef CONFIG_GEEKHOUSE_WIFI_REUSE_IP
+    if (s_cache_valid && s_cache.ip_info.ip.addr != 0 &&
+        memcmp(bssid, s_cache.bssid, sizeof(s_cache.bssid)) == 0) {
+        if (!s_dhcp_stopped && esp_netif_dhcpc_stop(s_sta_netif) == ESP_OK) {
+            s_dhcp_stopped = true;
+        }
+        if (s_dhcp_stopped) {
+            esp_netif_set_ip_info(s_sta_netif, &s_cache.ip_info);
+            if (s_cache.dns != 0) {
+                esp_netif_dns_info_t dns = {0};
+                dns.ip.u_addr.ip4.addr = s_cache.dns;
+                dns.ip.type = ESP_IPADDR_TYPE_V4;
+                esp_netif_set_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+            }
+            ESP_LOGI(TAG, "Reusing cached lease " IPSTR, IP2STR(&s_cache.ip_info.ip));
+            return;
+        }
+    }
+#else
+    (void) bssid;
+#endif
+    if (s_dhcp_stopped) {
+        esp_netif_dhcpc_start(s_sta_netif);
+        s_dhcp_stopped = false;
+    }
+}
+
+/**
+ * Record time-to-IP after an outage (or boot)
+ */
+static void wifi_record_time_to_ip(void) {
+    uint32_t elapsed_ms = (uint32_t) ((esp_timer_get_time() - s_connect_start_us) / 1000);
+    bool boot = !s_connected_once;
+    s_connected_once = true;
+    s_connect_start_us = 0;
+
+    metrics_observe(boot ? s_boot_time_metric : s_reconnect_time_metric, elapsed_ms);
+    ESP_LOGI(TAG, "Time to IP: %lu ms (%s, %s, %s)", elapsed_ms, boot ? "boot" : "after AP loss",
+             s_fast_attempt ? "cached AP" : "full scan", s_dhcp_stopped ? "cached lease" : "DHCP");
+
+    portENTER_CRITICAL(&s_stats_mux);
+    s_stats.connects++;
+    s_stats.fast_connects += s_fast_attempt ? 1 : 0;
+    s_stats.retries = 0;
+    s_stats.last_time_to_ip_ms = elapsed_ms;
+    if (boot) {
+        s_stats.boot_time_to_ip_ms = elapsed_ms;
+    }
+    s_stats.cached_lease = s_dhcp_stopped;
+    portEXIT_CRITICAL(&s_stats_mux);
+}
+
+/**
+ * Refresh the cache with the AP and lease we just got an address from
+ */
+static void wifi_update_cache(const esp_netif_ip_info_t *ip_info) {
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) {
+        return;
+    }
+    wifi_cache_t cache;
+    memset(&cache, 0, sizeof(cache));  // Compared with memcmp, padding included
+    cache.version = WIFI_CACHE_VERSION;
+    cache.channel = ap_info.primary;
+    cache.ip_info = *ip_info;
+    memcpy(cache.bssid, ap_info.bssid, sizeof(cache.bssid));
+    // The SSID of this AP, not the setting: that may have changed since we connected
+    memcpy(cache.ssid, ap_info.ssid, sizeof(cache.ssid) - 1);
+    esp_netif_dns_info_t dns;
+    if (esp_netif_get_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK) {
+        cache.dns = dns.ip.u_addr.ip4.addr;
+    }
+    wifi_cache_save(&cache);
+}
 
 /**
  * WiFi and IP event handler
@@ -25,33 +259,52 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
         switch (event_id) {
             case WIFI_EVENT_STA_START:
                 // WiFi driver started - initiate connection
-                ESP_LOGI(TAG, "WiFi started, connecting...");
+                ESP_LOGI(TAG, "WiFi started, connecting%s...",
+                         s_fast_attempt ? " to cached AP" : "");
                 esp_wifi_connect();
                 break;
 
-            case WIFI_EVENT_STA_CONNECTED:
+            case WIFI_EVENT_STA_CONNECTED: {
                 // Associated with AP, waiting for IP
-                ESP_LOGI(TAG, "Connected to AP, waiting for IP...");
-                s_retry_count = 0;
+                wifi_event_sta_connected_t *event = (wifi_event_sta_connected_t *) event_data;
+                ESP_LOGI(TAG, "Connected to AP on channel %d, waiting for IP...", event->channel);
+                wifi_apply_ip(event->bssid);
                 break;
+            }
 
             case WIFI_EVENT_STA_DISCONNECTED: {
-                // Lost connection - attempt reconnect
+                // Lost connection - reconnect after a backoff
                 wifi_event_sta_disconnected_t *event = (wifi_event_sta_disconnected_t *) event_data;
                 ESP_LOGW(TAG, "Disconnected (reason: %d)", event->reason);
+                metrics_inc(s_disconnects_metric);
 
                 // Signal disconnected
                 xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+                xEventGroupSetBits(s_wifi_event_group, WIFI_DISCONNECTED_BIT);
+                if (s_connect_start_us == 0) {
+                    s_connect_start_us = esp_timer_get_time();  // AP loss: outage starts now
+                }
 
-                if (s_retry_count < WIFI_MAX_RETRIES) {
-                    s_retry_count++;
-                    ESP_LOGI(TAG, "Reconnecting (attempt %d/%d)...", s_retry_count,
-                             WIFI_MAX_RETRIES);
-                    esp_wifi_connect();
-                } else {
-                    ESP_LOGE(TAG, "Max retries reached, giving up");
-                    xEventGroupSetBits(s_wifi_event_group, WIFI_DISCONNECTED_BIT);
+                // Cached AP first (it may just have rebooted), then scan for any
+                s_retry_count++;
+                bool fast = s_cache_valid && s_retry_count < WIFI_FAST_CONNECT_ATTEMPTS;
+                if (s_fast_attempt && !fast) {
+                    ESP_LOGW(TAG, "Cached AP unreachable, falling back to full scan");
+                    portENTER_CRITICAL(&s_stats_mux);
+                    s_stats.fallbacks++;
+                    portEXIT_CRITICAL(&s_stats_mux);
                 }
+                wifi_apply_config(fast);
+
+                portENTER_CRITICAL(&s_stats_mux);
+                s_stats.retries = s_retry_count;
+                portEXIT_CRITICAL(&s_stats_mux);
+
+                uint32_t delay_ms = wifi_backoff_ms(s_retry_count);
+                ESP_LOGI(TAG, "Reconnecting in %lu ms (attempt %d, %s)...", delay_ms,
+                         s_retry_count, s_fast_attempt ? "cached AP" : "full scan");
+                esp_timer_stop(s_reconnect_timer);
+                esp_timer_start_once(s_reconnect_timer, (uint64_t) delay_ms * 1000);
                 break;
             }
 
@@ -66,13 +319,44 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base, int32_t e
             ESP_LOGI(TAG, "Gateway: " IPSTR, IP2STR(&event->ip_info.gw));
             ESP_LOGI(TAG, "Netmask: " IPSTR, IP2STR(&event->ip_info.netmask));
 
+            s_retry_count = 0;
+            if (s_connect_start_us != 0) {
+                wifi_record_time_to_ip();
+            }
+            wifi_update_cache(&event->ip_info);
+
             // Signal connected
             xEventGroupClearBits(s_wifi_event_group, WIFI_DISCONNECTED_BIT);
             xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+        } else if (event_id == IP_EVENT_STA_LOST_IP) {
+            // Still associated, but the lease expired - the DHCP client keeps trying
+            ESP_LOGW(TAG, "Lost IP address");
+            if (s_connect_start_us == 0) {
+                s_connect_start_us = esp_timer_get_time();
+            }
+            xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+            xEventGroupSetBits(s_wifi_event_group, WIFI_DISCONNECTED_BIT);
         }
     }
 }
 
+/**
+ * Metrics collector: signal strength of the current AP
+ *
+ * Nothing is written while disconnected, so the series goes stale
+ * instead of reporting a made-up value.
+ */
+static void wifi_metrics_collector(metrics_writer_t *w, void *arg) {
+    (void) arg;
+
+    wifi_ap_record_t ap_info;
+    if (esp_wifi_sta_get_ap_info(&ap_info) != ESP_OK) {
+        return;
+    }
+    metrics_write_family(w, "geekhouse_wifi_rssi_dbm", METRIC_GAUGE, "Signal strength of the AP");
+    metrics_write_sample(w, "geekhouse_wifi_rssi_dbm", NULL, ap_info.rssi);
+}
+
 esp_err_t wifi_manager_init(void) {
     esp_err_t ret = ESP_OK;
 
@@ -83,6 +367,26 @@ esp_err_t wifi_manager_init(void) {
         return ESP_ERR_NO_MEM;
     }
 
+    const esp_timer_create_args_t timer_args = {
+        .callback = wifi_reconnect_cb,
+        .name = "wifi_reconnect",
+    };
+    ret = esp_timer_create(&timer_args, &s_reconnect_timer);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create reconnect timer: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    s_disconnects_metric = metrics_counter("geekhouse_wifi_disconnects_total", NULL,
+                                           "Station disconnect events");
+    s_boot_time_metric = metrics_histogram(
+        "geekhouse_wifi_time_to_ip_ms", "after=\"boot\"", "Time from start or AP loss to an IP",
+        TIME_TO_IP_BOUNDS_MS, sizeof(TIME_TO_IP_BOUNDS_MS) / sizeof(TIME_TO_IP_BOUNDS_MS[0]));
+    s_reconnect_time_metric = metrics_histogram(
+        "geekhouse_wifi_time_to_ip_ms", "after=\"ap_loss\"", "Time from start or AP loss to an IP",
+        TIME_TO_IP_BOUNDS_MS, sizeof(TIME_TO_IP_BOUNDS_MS) / sizeof(TIME_TO_IP_BOUNDS_MS[0]));
+    metrics_register_collector(wifi_metrics_collector, NULL);
+
     // Initialize TCP/IP stack
     ESP_ERROR_CHECK(esp_netif_init());
 
@@ -90,7 +394,7 @@ esp_err_t wifi_manager_init(void) {
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
     // Create default WiFi station network interface
-    esp_netif_create_default_wifi_sta();
+    s_sta_netif = esp_netif_create_default_wifi_sta();
 
     // Initialize WiFi with default config
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
@@ -101,6 +405,8 @@ esp_err_t wifi_manager_init(void) {
                                                         &wifi_event_handler, NULL, NULL));
     ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP,
                                                         &wifi_event_handler, NULL, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_LOST_IP,
+                                                        &wifi_event_handler, NULL, NULL));
 
     // Load credentials from NVS
     char ssid[WIFI_SSID_MAX_LEN + 1] = {0};
@@ -131,11 +437,26 @@ esp_err_t wifi_manager_init(void) {
     strncpy((char *) wifi_cfg.sta.ssid, ssid, sizeof(wifi_cfg.sta.ssid) - 1);
     strncpy((char *) wifi_cfg.sta.password, password, sizeof(wifi_cfg.sta.password) - 1);
 
+#ifdef CONFIG_GEEKHOUSE_POWER_SAVE
+    // Modem sleep: wake the radio for every listen_interval-th beacon only.
+    // Trades request latency (up to listen_interval beacon periods) for
+    // current; the AP buffers frames for us in between.
+    wifi_cfg.sta.listen_interval = CONFIG_GEEKHOUSE_WIFI_LISTEN_INTERVAL;
+#endif
+
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_cfg));
+#ifdef CONFIG_GEEKHOUSE_POWER_SAVE
+    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_MAX_MODEM));
+#endif
+
+    // Go straight to the last good AP if we know it
+    wifi_cache_load(ssid);
+    wifi_apply_config(s_cache_valid);
 
     // Start WiFi (triggers WIFI_EVENT_STA_START → connect)
     ESP_LOGI(TAG, "Starting WiFi (SSID: %s)...", ssid);
+    s_connect_start_us = esp_timer_get_time();
     ESP_ERROR_CHECK(esp_wifi_start());
 
     return ESP_OK;
@@ -152,3 +473,15 @@ bool wifi_manager_is_connected(void) {
     EventBits_t bits = xEventGroupGetBits(s_wifi_event_group);
     return (bits & WIFI_CONNECTED_BIT) != 0;
 }
+
+esp_err_t wifi_manager_get_stats(wifi_manager_stats_t *stats) {
+    if (stats == NULL) {
+        ESP_LOGE(TAG, "Invalid argument: stats is NULL");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&s_stats_mux);
+    *stats = s_stats;
+    portEXIT_CRITICAL(&s_stats_mux);
+    return ESP_OK;
+}
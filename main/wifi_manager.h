@@ -1,24 +1,50 @@
 #ifndef WIFI_MANAGER_H
 #define WIFI_MANAGER_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "esp_err.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
 
 // Event group bits for WiFi status
 #define WIFI_CONNECTED_BIT    BIT0  // Connected and got IP
-#define WIFI_DISCONNECTED_BIT BIT1  // Disconnected or failed
+#define WIFI_DISCONNECTED_BIT BIT1  // Not connected, reconnecting in the background
+
+// Reconnect backoff: the delay doubles per failed attempt up to the
+// maximum, and a random half of it is added as jitter so devices that
+// lost the same AP don't retry in lockstep. Retries never stop.
+#define WIFI_BACKOFF_MIN_MS 500
+#define WIFI_BACKOFF_MAX_MS 60000
 
-// Maximum connection retries before giving up
-#define WIFI_MAX_RETRIES 10
+// Attempts on the cached BSSID/channel before falling back to a full scan
+#define WIFI_FAST_CONNECT_ATTEMPTS 2
+
+// Connection statistics
+typedef struct {
+    uint32_t connects;            // Times an IP address was obtained
+    uint32_t fast_connects;       // ... of which via the cached BSSID/channel
+    uint32_t fallbacks;           // Fast connects abandoned for a full scan
+    uint32_t retries;             // Failed attempts since the last connect
+    uint32_t boot_time_to_ip_ms;  // From esp_wifi_start() to the first IP (0 = not yet)
+    uint32_t last_time_to_ip_ms;  // From the last AP loss (or boot) to an IP
+    bool cached_lease;            // Current IP was reused from the cache (no DHCP)
+} wifi_manager_stats_t;
 
 /**
  * Initialize and start WiFi in station mode
  *
- * Reads credentials from NVS (wifi_config module), initializes
+ * Reads credentials from the settings (wifi_config module), initializes
  * the WiFi driver, and begins connection attempts.
  *
- * Must be called after wifi_config_init().
+ * The BSSID, channel and IP configuration of the last good connection
+ * are cached in NVS. If the cache matches the configured SSID, the first
+ * attempts go straight to that AP on its channel instead of scanning
+ * (and, with CONFIG_GEEKHOUSE_WIFI_REUSE_IP, skip DHCP), then fall back
+ * to a full scan. Disconnects are retried forever with backoff.
+ *
+ * Must be called after settings_init().
  *
  * @return ESP_OK on success
  */
@@ -44,4 +70,12 @@ EventGroupHandle_t wifi_manager_get_event_group(void);
  */
 bool wifi_manager_is_connected(void);
 
+/**
+ * Get connection statistics
+ *
+ * @param[out] stats Statistics
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG if stats is NULL
+ */
+esp_err_t wifi_manager_get_stats(wifi_manager_stats_t *stats);
+
 #endif  // WIFI_MANAGER_H
@@ -0,0 +1,801 @@
+// Fuzzing the URI router (http_router.c) against a reference model
+//
+// Random route tables and requests go through the router and through a
+// model that keeps path prefixes as strings in a flat list and searches it
+// linearly. Both must agree exactly: the status of every add, and the
+// status, route, captures and query parameters of every match. Random
+// bytes go through every entry point as well, for the sanitizers.
+//
+// The same source builds with the firmware's table size, where tables fill
+// up and adds hit the limits, and with HTTP_ROUTER_MAX_ROUTES and
+// HTTP_ROUTER_MAX_NODES raised for hundreds of resources.
+//
+//   fuzz_http_router [seed [rounds]]
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "http_router.h"
+#include "test_util.h"
+
+TEST_MAIN_FAILURES;
+
+#define PATTERN_MAX 600
+#define URI_MAX     1024
+#define PATTERNS    (2 * HTTP_ROUTER_MAX_ROUTES)  // Add attempts per round
+#define REQUESTS    (8 * HTTP_ROUTER_MAX_ROUTES)  // Requests per round
+#define ROUNDS      (HTTP_ROUTER_MAX_ROUTES > 64 ? 40 : 1000)
+#define METHODS     4
+#define CAPTURE     "\x01"  // Capture segment in a model key (no literal has it)
+
+static uint32_t s_rng;
+
+static uint32_t rnd(uint32_t n) {
+    s_rng ^= s_rng << 13;
+    s_rng ^= s_rng >> 17;
+    s_rng ^= s_rng << 5;
+    return s_rng % n;
+}
+
+// ---- Model ----
+
+// One path prefix: "" for the root, then "/" + literal or CAPTURE per segment
+typedef struct {
+    char key[PATTERN_MAX];
+    int capture;  // Node of the capture child, -1 if none
+    const char *capture_name;
+    size_t capture_name_len;
+    http_param_type_t capture_type;
+} model_node_t;
+
+typedef struct {
+    int node;
+    int method;
+    const char *pattern;
+} model_route_t;
+
+static struct {
+    model_node_t nodes[HTTP_ROUTER_MAX_NODES];
+    int node_count;
+    model_route_t routes[HTTP_ROUTER_MAX_ROUTES];
+    int route_count;
+} s_model;
+
+static void model_init(void) {
+    s_model.nodes[0] = (model_node_t) {.key = "", .capture = -1};
+    s_model.node_count = 1;
+    s_model.route_count = 0;
+}
+
+static int model_find(const char *key) {
+    for (int i = 0; i < s_model.node_count; i++) {
+        if (strcmp(s_model.nodes[i].key, key) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// A pattern segment as the header documents it
+typedef enum { SEG_INVALID, SEG_LITERAL, SEG_CAPTURE } seg_kind_t;
+
+static seg_kind_t model_segment(const char *s, size_t len, const char **name, size_t *name_len,
+                                http_param_type_t *type) {
+    if (len == 0 || len > HTTP_ROUTER_SEGMENT_MAX) {
+        return SEG_INVALID;
+    }
+    if (s[0] != '{') {
+        for (size_t i = 0; i < len; i++) {
+            if (s[i] == '{' || s[i] == '}' || s[i] == '?') {
+                return SEG_INVALID;
+            }
+        }
+        return SEG_LITERAL;
+    }
+    if (len < 3 || s[len - 1] != '}') {
+        return SEG_INVALID;
+    }
+    const char *inner = s + 1;
+    size_t inner_len = len - 2;
+    const char *colon = memchr(inner, ':', inner_len);
+    *name = inner;
+    *name_len = colon != NULL ? (size_t) (colon - inner) : inner_len;
+    if (*name_len == 0) {
+        return SEG_INVALID;
+    }
+    for (size_t i = 0; i < *name_len; i++) {
+        char c = inner[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+              c == '_')) {
+            return SEG_INVALID;
+        }
+    }
+    *type = HTTP_PARAM_STR;
+    if (colon != NULL) {
+        size_t type_len = inner_len - *name_len - 1;
+        if (type_len == 3 && strncmp(colon + 1, "int", 3) == 0) {
+            *type = HTTP_PARAM_INT;
+        } else if (type_len != 3 || strncmp(colon + 1, "str", 3) != 0) {
+            return SEG_INVALID;
+        }
+    }
+    return SEG_CAPTURE;
+}
+
+static esp_err_t model_add(int method, const char *pattern) {
+    if (pattern[0] != '/') {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // Check and count new prefixes first, like the router
+    char key[PATTERN_MAX] = "";
+    int node = 0;  // -1 once past the existing prefixes
+    int added = 0;
+    int params = 0;
+    const char *p = pattern;
+    while (pattern[1] != '\0' && *p != '\0') {
+        const char *seg = p + 1;
+        const char *end = strchr(seg, '/');
+        end = end != NULL ? end : seg + strlen(seg);
+        p = end;
+
+        const char *name = NULL;
+        size_t name_len = 0;
+        http_param_type_t type = HTTP_PARAM_STR;
+        seg_kind_t kind = model_segment(seg, (size_t) (end - seg), &name, &name_len, &type);
+        if (kind == SEG_INVALID) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (kind == SEG_CAPTURE) {
+            if (++params > HTTP_ROUTER_MAX_PARAMS) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            const model_node_t *n = node >= 0 ? &s_model.nodes[node] : NULL;
+            if (n != NULL && n->capture >= 0 &&
+                (n->capture_type != type || n->capture_name_len != name_len ||
+                 strncmp(n->capture_name, name, name_len) != 0)) {
+                return ESP_ERR_INVALID_STATE;
+            }
+            strcat(key, "/" CAPTURE);
+        } else {
+            strcat(key, "/");
+            strncat(key, seg, (size_t) (end - seg));
+        }
+        node = node >= 0 ? model_find(key) : -1;
+        added += node < 0;
+    }
+
+    if (added == 0) {
+        for (int r = 0; r < s_model.route_count; r++) {
+            if (s_model.routes[r].node == node && s_model.routes[r].method == method) {
+                return ESP_ERR_INVALID_STATE;
+            }
+        }
+    }
+    if (s_model.node_count + added > HTTP_ROUTER_MAX_NODES ||
+        s_model.route_count >= HTTP_ROUTER_MAX_ROUTES) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    // Add the new prefixes
+    key[0] = '\0';
+    node = 0;
+    p = pattern;
+    while (pattern[1] != '\0' && *p != '\0') {
+        const char *seg = p + 1;
+        const char *end = strchr(seg, '/');
+        end = end != NULL ? end : seg + strlen(seg);
+        p = end;
+
+        const char *name = NULL;
+        size_t name_len = 0;
+        http_param_type_t type = HTTP_PARAM_STR;
+        seg_kind_t kind = model_segment(seg, (size_t) (end - seg), &name, &name_len, &type);
+        if (kind == SEG_CAPTURE) {
+            strcat(key, "/" CAPTURE);
+        } else {
+            strcat(key, "/");
+            strncat(key, seg, (size_t) (end - seg));
+        }
+        int child = model_find(key);
+        if (child < 0) {
+            child = s_model.node_count++;
+            s_model.nodes[child] = (model_node_t) {.capture = -1};
+            strcpy(s_model.nodes[child].key, key);
+            if (kind == SEG_CAPTURE) {
+                model_node_t *n = &s_model.nodes[node];
+                n->capture = child;
+                n->capture_name = name;
+                n->capture_name_len = name_len;
+                n->capture_type = type;
+            }
+        }
+        node = child;
+    }
+    s_model.routes[s_model.route_count++] = (model_route_t) {node, method, pattern};
+    return ESP_OK;
+}
+
+// Parsed query string, decoded into separate buffers
+typedef struct {
+    int count;
+    char key[HTTP_ROUTER_MAX_QUERY][HTTP_ROUTER_QUERY_BUF];
+    char value[HTTP_ROUTER_MAX_QUERY][HTTP_ROUTER_QUERY_BUF];
+} model_query_t;
+
+static int hex_digit(char c) {
+    const char *digits = "0123456789abcdef";
+    char lower = (c >= 'A' && c <= 'F') ? (char) (c - 'A' + 'a') : c;
+    const char *d = lower != '\0' ? strchr(digits, lower) : NULL;
+    return d != NULL ? (int) (d - digits) : -1;
+}
+
+/**
+ * Percent-decode one key or value; used counts the router's shared buffer
+ */
+static esp_err_t model_decode(const char *s, size_t len, char *out, size_t *used) {
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = s[i];
+        if (c == '+') {
+            c = ' ';
+        } else if (c == '%') {
+            if (len - i < 3) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            int hi = hex_digit(s[i + 1]);
+            int lo = hex_digit(s[i + 2]);
+            if (hi < 0 || lo < 0 || hi * 16 + lo == 0) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            c = (char) (hi * 16 + lo);
+            i += 2;
+        }
+        if (*used + n + 1 >= HTTP_ROUTER_QUERY_BUF) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        out[n++] = c;
+    }
+    out[n] = '\0';
+    *used += n + 1;
+    return ESP_OK;
+}
+
+static esp_err_t model_query(const char *q, size_t len, model_query_t *out) {
+    out->count = 0;
+    size_t used = 0;
+    size_t start = 0;
+    while (start < len) {
+        size_t end = start;
+        while (end < len && q[end] != '&') {
+            end++;
+        }
+        if (end > start) {
+            if (out->count == HTTP_ROUTER_MAX_QUERY) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            size_t eq = start;
+            while (eq < end && q[eq] != '=') {
+                eq++;
+            }
+            esp_err_t ret = model_decode(q + start, eq - start, out->key[out->count], &used);
+            if (ret == ESP_OK && eq < end) {
+                ret = model_decode(q + eq + 1, end - eq - 1, out->value[out->count], &used);
+            } else {
+                out->value[out->count][0] = '\0';
+            }
+            if (ret != ESP_OK) {
+                return ret;
+            }
+            out->count++;
+        }
+        start = end + 1;
+    }
+    return ESP_OK;
+}
+
+typedef struct {
+    int route;
+    int param_count;
+    http_param_t params[HTTP_ROUTER_MAX_PARAMS];
+    model_query_t query;
+} model_match_t;
+
+static bool model_int(const char *s, size_t len, int32_t *out) {
+    if (len == 0 || len > 10 || strspn(s, "0123456789") < len) {
+        return false;
+    }
+    char digits[11];
+    memcpy(digits, s, len);
+    digits[len] = '\0';
+    long long value = strtoll(digits, NULL, 10);
+    *out = (int32_t) value;
+    return value <= INT32_MAX;
+}
+
+static esp_err_t model_match(int method, const char *uri, model_match_t *m) {
+    m->route = -1;
+    m->param_count = 0;
+    m->query.count = 0;
+    if (uri[0] != '/') {
+        return ESP_ERR_NOT_FOUND;
+    }
+    size_t path_len = strcspn(uri, "?");
+
+    char key[URI_MAX] = "";
+    int node = 0;
+    if (path_len > 1) {
+        size_t pos = 0;
+        while (pos < path_len) {
+            const char *seg = uri + pos + 1;
+            size_t len = 0;
+            while (pos + 1 + len < path_len && seg[len] != '/') {
+                len++;
+            }
+            pos += 1 + len;
+            if (len == 0) {
+                return ESP_ERR_NOT_FOUND;
+            }
+
+            // A literal first, then the capture; no backtracking
+            size_t key_len = strlen(key);
+            key[key_len] = '/';
+            memcpy(&key[key_len + 1], seg, len);
+            key[key_len + 1 + len] = '\0';
+            int child = model_find(key);
+            if (child >= 0) {
+                node = child;
+                continue;
+            }
+            const model_node_t *n = &s_model.nodes[node];
+            if (n->capture < 0 || m->param_count == HTTP_ROUTER_MAX_PARAMS) {
+                return ESP_ERR_NOT_FOUND;
+            }
+            http_param_t *param = &m->params[m->param_count++];
+            *param = (http_param_t) {.name = n->capture_name,
+                                     .name_len = (uint8_t) n->capture_name_len,
+                                     .type = n->capture_type,
+                                     .str = seg,
+                                     .len = (uint16_t) len};
+            if (param->type == HTTP_PARAM_INT && !model_int(seg, len, &param->i)) {
+                return ESP_ERR_NOT_FOUND;
+            }
+            strcpy(&key[key_len], "/" CAPTURE);
+            node = n->capture;
+        }
+    }
+
+    for (int r = 0; r < s_model.route_count; r++) {
+        if (s_model.routes[r].node == node && m->route < 0) {
+            m->route = r;  // First route of the path
+        }
+        if (s_model.routes[r].node == node && s_model.routes[r].method == method) {
+            m->route = r;
+            if (uri[path_len] == '?') {
+                const char *q = uri + path_len + 1;
+                return model_query(q, strlen(q), &m->query);
+            }
+            return ESP_OK;
+        }
+    }
+    return m->route >= 0 ? ESP_ERR_NOT_SUPPORTED : ESP_ERR_NOT_FOUND;
+}
+
+// ---- Router under test ----
+
+static http_router_t s_router;
+static char s_patterns[PATTERNS][PATTERN_MAX];  // Live as long as the router
+
+// Outcomes seen, so the generators can't quietly stop reaching one
+static struct {
+    int add_ok, add_invalid, add_conflict, add_full;
+    int match_ok, match_not_found, match_method, match_bad_query, match_big_query;
+} s_seen;
+
+static void count_add(esp_err_t ret) {
+    s_seen.add_ok += ret == ESP_OK;
+    s_seen.add_invalid += ret == ESP_ERR_INVALID_ARG;
+    s_seen.add_conflict += ret == ESP_ERR_INVALID_STATE;
+    s_seen.add_full += ret == ESP_ERR_NO_MEM;
+}
+
+static void count_match(esp_err_t ret) {
+    s_seen.match_ok += ret == ESP_OK;
+    s_seen.match_not_found += ret == ESP_ERR_NOT_FOUND;
+    s_seen.match_method += ret == ESP_ERR_NOT_SUPPORTED;
+    s_seen.match_bad_query += ret == ESP_ERR_INVALID_ARG;
+    s_seen.match_big_query += ret == ESP_ERR_INVALID_SIZE;
+}
+
+static void fail(const char *what, const char *input, esp_err_t got, esp_err_t want) {
+    fprintf(stderr, "%s \"%.200s\": got %s, model %s\n", what, input, esp_err_to_name(got),
+            esp_err_to_name(want));
+    g_test_failures++;
+}
+
+static bool same_query(const http_query_t *got, const model_query_t *want) {
+    if (got->count != want->count) {
+        return false;
+    }
+    for (int i = 0; i < want->count; i++) {
+        if (strcmp(got->items[i].key, want->key[i]) != 0 ||
+            strcmp(got->items[i].value, want->value[i]) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void check_add(int method, const char *pattern) {
+    static http_router_t before;
+    memcpy(&before, &s_router, sizeof(before));
+    esp_err_t got = http_router_add(&s_router, method, pattern);
+    esp_err_t want = model_add(method, pattern);
+    count_add(got);
+    if (got != want) {
+        fail("add", pattern, got, want);
+    } else if (got != ESP_OK && memcmp(&before, &s_router, sizeof(s_router)) != 0) {
+        fail("failed add changed the router", pattern, got, want);
+    }
+}
+
+static void check_match(int method, const char *uri) {
+    http_match_t got;
+    model_match_t want;
+    esp_err_t got_ret = http_router_match(&s_router, method, uri, &got);
+    esp_err_t want_ret = model_match(method, uri, &want);
+    count_match(got_ret);
+    if (got_ret != want_ret) {
+        fail("match", uri, got_ret, want_ret);
+        return;
+    }
+    if (got.route != want.route) {
+        fprintf(stderr, "match \"%.200s\": route %d, model %d\n", uri, got.route, want.route);
+        g_test_failures++;
+        return;
+    }
+    if (got_ret != ESP_OK) {
+        return;
+    }
+    CHECK_EQ(got.param_count, want.param_count);
+    for (int i = 0; i < want.param_count && i < got.param_count; i++) {
+        const http_param_t *g = &got.params[i];
+        const http_param_t *w = &want.params[i];
+        CHECK(g->name_len == w->name_len && strncmp(g->name, w->name, w->name_len) == 0);
+        CHECK(g->type == w->type && g->str == w->str && g->len == w->len);
+        CHECK(g->type != HTTP_PARAM_INT || g->i == w->i);
+    }
+    if (!same_query(&got.query, &want.query)) {
+        fprintf(stderr, "match \"%.200s\": query differs\n", uri);
+        g_test_failures++;
+    }
+}
+
+/**
+ * Edges sorted by (parent, segment), and one node per edge or capture
+ */
+static void check_invariants(void) {
+    CHECK_EQ(s_router.node_count, s_model.node_count);
+    CHECK_EQ(s_router.route_count, s_model.route_count);
+    int captures = 0;
+    for (int i = 0; i < s_router.node_count; i++) {
+        captures += s_router.nodes[i].capture >= 0;
+    }
+    CHECK_EQ(1 + s_router.edge_count + captures, s_router.node_count);
+    for (int i = 1; i < s_router.edge_count; i++) {
+        const http_router_edge_t *a = &s_router.edges[i - 1];
+        const http_router_edge_t *b = &s_router.edges[i];
+        int c = memcmp(a->segment, b->segment, a->len < b->len ? a->len : b->len);
+        CHECK(a->parent < b->parent ||
+              (a->parent == b->parent && (c < 0 || (c == 0 && a->len < b->len))));
+    }
+}
+
+// ---- Generators ----
+
+static const char *const LITERALS[] = {"api", "sensors", "leds", "config", "history",
+                                       "12",  "0",       "a",    "b"};
+static const char *const CAPTURES[] = {"{id:int}", "{id}", "{name}", "{name:str}", "{n:int}"};
+static const char *const MALFORMED[] = {"",      "{",        "}",     "{}",     "{id:float}",
+                                        "{id",   "a{b}",     "{a-b}", "a?b",    "{:int}",
+                                        "{id:}", "{id:int:x}", "{a}}", "{{a}"};
+static const char *const INTS[] = {"0",  "7",          "12",          "007", "2147483647",
+                                   "-1", "2147483648", "99999999999", "1a",  "1 "};
+
+#define PICK(table) (table[rnd(sizeof(table) / sizeof(table[0]))])
+
+static void gen_literal(char *out) {
+    if (rnd(2) == 0) {
+        strcpy(out, PICK(LITERALS));
+        return;
+    }
+    static const char chars[] = "abcxyz019._-";
+    size_t len = 1 + rnd(3);
+    for (size_t i = 0; i < len; i++) {
+        out[i] = chars[rnd(sizeof(chars) - 1)];
+    }
+    out[len] = '\0';
+}
+
+static void gen_pattern(char *out) {
+    uint32_t r = rnd(100);
+    if (r < 2) {
+        strcpy(out, "/");
+        return;
+    }
+    out[0] = '\0';
+    if (r >= 4) {
+        strcat(out, "/");  // Otherwise no leading '/'
+    }
+    int depth = 1 + (int) rnd(6);
+    for (int i = 0; i < depth; i++) {
+        if (i > 0) {
+            strcat(out, "/");
+        }
+        uint32_t kind = rnd(100);
+        if (kind < 60) {
+            gen_literal(out + strlen(out));
+        } else if (kind < 92) {
+            strcat(out, PICK(CAPTURES));
+        } else if (kind < 98 || strlen(out) + HTTP_ROUTER_SEGMENT_MAX + 100 > PATTERN_MAX) {
+            strcat(out, PICK(MALFORMED));
+        } else {
+            size_t len = strlen(out);
+            size_t seg = HTTP_ROUTER_SEGMENT_MAX + rnd(2);  // Longest, or too long
+            memset(out + len, 'L', seg);
+            out[len + seg] = '\0';
+        }
+    }
+}
+
+static void gen_query(char *out, size_t size) {
+    out[0] = '\0';
+    if (rnd(2) == 0) {
+        // Noise
+        static const char chars[] = "ab=&%+20fGx";
+        size_t len = rnd(160);
+        for (size_t i = 0; i < len && i + 1 < size; i++) {
+            out[i] = chars[rnd(sizeof(chars) - 1)];
+            out[i + 1] = '\0';
+        }
+        return;
+    }
+    static const char *const keys[] = {"a", "format", "x%20y", "k+1", "", "%4", "long_key"};
+    static const char *const values[] = {"1", "on", "a+b", "%41%42", "%00", "%zz", "", "%C3%A9"};
+    int items = (int) rnd(HTTP_ROUTER_MAX_QUERY + 3);
+    for (int i = 0; i < items && strlen(out) + 100 < size; i++) {
+        strcat(out, i > 0 ? (rnd(5) == 0 ? "&&" : "&") : "");
+        strcat(out, PICK(keys));
+        if (rnd(4) != 0) {
+            strcat(out, "=");
+            strcat(out, PICK(values));
+        }
+        if (rnd(6) == 0) {
+            size_t len = strlen(out);
+            size_t run = rnd(60);  // Long values, to fill the buffer
+            memset(out + len, 'v', run);
+            out[len + run] = '\0';
+        }
+    }
+}
+
+/**
+ * A request for a known route, often mangled, or noise
+ */
+static void gen_request(char *out) {
+    out[0] = '\0';
+    if (s_model.route_count == 0 || rnd(10) == 0) {
+        static const char chars[] = "/ab1{}?&=%+";
+        size_t len = rnd(20);
+        for (size_t i = 0; i < len; i++) {
+            out[i] = chars[rnd(sizeof(chars) - 1)];
+        }
+        out[len] = '\0';
+    } else {
+        const char *p = s_model.routes[rnd((uint32_t) s_model.route_count)].pattern;
+        while (*p != '\0') {
+            if (*p != '{') {
+                size_t len = strlen(out);
+                out[len] = *p++;
+                out[len + 1] = '\0';
+                continue;
+            }
+            const char *close = strchr(p, '}');
+            bool is_int = close - p > 4 && strncmp(close - 4, ":int", 4) == 0;
+            if (is_int || rnd(4) == 0) {
+                strcat(out, PICK(INTS));
+            } else {
+                gen_literal(out + strlen(out));
+            }
+            p = close + 1;
+        }
+        switch (rnd(8)) {
+            case 0:
+                strcat(out, "/");
+                break;
+            case 1:
+                strcat(out, "/x");
+                break;
+            case 2:
+                if (strrchr(out, '/') != out) {
+                    *strrchr(out, '/') = '\0';
+                }
+                break;
+            case 3:
+                memmove(out + 1, out, strlen(out) + 1);  // "//..."
+                break;
+            default:
+                break;
+        }
+    }
+    if (rnd(3) == 0) {
+        strcat(out, "?");
+        gen_query(out + strlen(out), 200);
+    }
+}
+
+// ---- Fuzzing ----
+
+static void fuzz_round(void) {
+    http_router_init(&s_router);
+    model_init();
+    for (int i = 0; i < PATTERNS; i++) {
+        if (s_model.route_count > 0 && rnd(4) == 0) {
+            // Another method for a known path, so the route table fills too
+            strcpy(s_patterns[i], s_model.routes[rnd((uint32_t) s_model.route_count)].pattern);
+        } else {
+            gen_pattern(s_patterns[i]);
+        }
+        check_add((int) rnd(METHODS), s_patterns[i]);
+    }
+    check_invariants();
+
+    char uri[URI_MAX];
+    for (int i = 0; i < REQUESTS; i++) {
+        gen_request(uri);
+        check_match((int) rnd(METHODS), uri);
+    }
+}
+
+static void check_query(const char *q) {
+    http_query_t got;
+    static model_query_t want;
+    esp_err_t got_ret = http_query_parse(q, strlen(q), &got);
+    esp_err_t want_ret = model_query(q, strlen(q), &want);
+    if (got_ret != want_ret) {
+        fail("query", q, got_ret, want_ret);
+    } else if (got_ret == ESP_OK && !same_query(&got, &want)) {
+        fprintf(stderr, "query \"%s\": parameters differ\n", q);
+        g_test_failures++;
+    }
+}
+
+static void fuzz_query(int iterations) {
+    // Every length around a full buffer, with and without '=', escaped or not
+    char q[3 * HTTP_ROUTER_QUERY_BUF + 16];
+    for (int n = HTTP_ROUTER_QUERY_BUF - 16; n <= HTTP_ROUTER_QUERY_BUF + 4; n++) {
+        strcpy(q, "k=");
+        memset(q + 2, 'v', (size_t) n);
+        q[2 + n] = '\0';
+        check_query(q);
+        q[1] = 'k';  // Key only
+        check_query(q);
+        strcpy(q, "a=1&");
+        for (int i = 0; i < n - 8; i++) {
+            strcat(q, "%41");
+        }
+        check_query(q);
+    }
+
+    for (int i = 0; i < iterations; i++) {
+        gen_query(q, 256);
+        check_query(q);
+    }
+}
+
+/**
+ * Random bytes through every entry point: only the sanitizers judge
+ */
+static void fuzz_bytes(int iterations) {
+    http_router_init(&s_router);
+    for (int i = 0; i < iterations; i++) {
+        // Exactly-sized copies, so reads past the end are caught
+        size_t len = rnd(48);
+        char *s = malloc(len + 1);
+        for (size_t j = 0; j < len; j++) {
+            s[j] = rnd(2) == 0 ? "/{}:?&=%+ai"[rnd(11)] : (char) (1 + rnd(255));
+        }
+        s[len] = '\0';
+        if (len > 0 && rnd(2) == 0) {
+            s[0] = '/';
+        }
+
+        int slot = i % PATTERNS;
+        if (slot == 0) {
+            http_router_init(&s_router);  // The patterns are about to be reused
+        }
+        memcpy(s_patterns[slot], s, len + 1);
+        http_router_add(&s_router, (int) rnd(METHODS), s_patterns[slot]);
+
+        http_match_t match;
+        if (http_router_match(&s_router, (int) rnd(METHODS), s, &match) == ESP_OK) {
+            int32_t value;
+            size_t str_len;
+            http_match_get_int(&match, "id", &value);
+            http_match_get_str(&match, "name", &str_len);
+            http_query_get(&match.query, "a");
+        }
+        http_query_t query;
+        http_query_parse(s, len, &query);  // Stray NULs included
+        free(s);
+    }
+}
+
+#if HTTP_ROUTER_MAX_ROUTES >= 256
+/**
+ * Hundreds of resources: every one routes, and the table fills exactly
+ */
+static void test_many_resources(void) {
+    static char patterns[HTTP_ROUTER_MAX_ROUTES][32];
+    http_router_init(&s_router);
+    // Two routes per resource; nodes: root, "api", then name, id capture, "config"
+    int resources = HTTP_ROUTER_MAX_ROUTES / 2;
+    if ((HTTP_ROUTER_MAX_NODES - 2) / 3 < resources) {
+        resources = (HTTP_ROUTER_MAX_NODES - 2) / 3;
+    }
+    int added = 0;
+    for (int i = 0; i < resources; i++) {
+        snprintf(patterns[added], sizeof(patterns[0]), "/api/r%d/{id:int}", i);
+        CHECK_EQ(http_router_add(&s_router, 0, patterns[added++]), ESP_OK);
+        snprintf(patterns[added], sizeof(patterns[0]), "/api/r%d/{id:int}/config", i);
+        CHECK_EQ(http_router_add(&s_router, 1, patterns[added++]), ESP_OK);
+    }
+    CHECK_EQ(http_router_add(&s_router, 0, "/api/one_more/{id:int}"), ESP_ERR_NO_MEM);
+
+    char uri[64];
+    http_match_t match;
+    int32_t id = 0;
+    for (int i = 0; i < resources; i++) {
+        snprintf(uri, sizeof(uri), "/api/r%d/%d/config?format=cbor", i, i * 7919);
+        CHECK_EQ(http_router_match(&s_router, 1, uri, &match), ESP_OK);
+        CHECK_EQ(match.route, 2 * i + 1);
+        CHECK(http_match_get_int(&match, "id", &id) && id == i * 7919);
+        snprintf(uri, sizeof(uri), "/api/r%d/%d", i, i);
+        CHECK_EQ(http_router_match(&s_router, 0, uri, &match), ESP_OK);
+        CHECK_EQ(match.route, 2 * i);
+    }
+    CHECK_EQ(http_router_match(&s_router, 0, "/api/r9999/1", &match), ESP_ERR_NOT_FOUND);
+    fprintf(stderr, "%d resources: %u routes, %u nodes\n", resources, s_router.route_count,
+            s_router.node_count);
+}
+#endif
+
+int main(int argc, char **argv) {
+    uint32_t seed = argc > 1 ? (uint32_t) strtoul(argv[1], NULL, 0) : 49;
+    int rounds = argc > 2 ? atoi(argv[2]) : ROUNDS;
+    s_rng = seed != 0 ? seed : 1;
+    fprintf(stderr, "seed %lu, %d rounds, %d routes, %d nodes\n", (unsigned long) seed, rounds,
+            HTTP_ROUTER_MAX_ROUTES, HTTP_ROUTER_MAX_NODES);
+
+#if HTTP_ROUTER_MAX_ROUTES >= 256
+    test_many_resources();
+#endif
+    for (int i = 0; i < rounds && g_test_failures == 0; i++) {
+        fuzz_round();
+    }
+    fuzz_query(20000);
+    fuzz_bytes(20000);
+
+    fprintf(stderr, "add: %d ok, %d invalid, %d conflicting, %d full\n", s_seen.add_ok,
+            s_seen.add_invalid, s_seen.add_conflict, s_seen.add_full);
+    fprintf(stderr, "match: %d ok, %d not found, %d wrong method, %d bad query, %d big query\n",
+            s_seen.match_ok, s_seen.match_not_found, s_seen.match_method, s_seen.match_bad_query,
+            s_seen.match_big_query);
+    if (rounds >= ROUNDS) {
+        CHECK(s_seen.add_ok > 0 && s_seen.add_invalid > 0 && s_seen.add_conflict > 0);
+        CHECK(s_seen.add_full > 0 || HTTP_ROUTER_MAX_ROUTES >= 256);  // Filled above
+        CHECK(s_seen.match_ok > 0 && s_seen.match_not_found > 0 && s_seen.match_method > 0);
+        CHECK(s_seen.match_bad_query > 0 && s_seen.match_big_query > 0);
+    }
+    return test_report("fuzz_http_router");
+}
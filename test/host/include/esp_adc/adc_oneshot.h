@@ -0,0 +1,14 @@
+#ifndef HOST_ADC_ONESHOT_H
+#define HOST_ADC_ONESHOT_H
+
+// Host stand-in for ESP-IDF's esp_adc/adc_oneshot.h (types only)
+
+typedef enum {
+    ADC_CHANNEL_0,
+    ADC_CHANNEL_1,
+    ADC_CHANNEL_2,
+    ADC_CHANNEL_3,
+    ADC_CHANNEL_4,
+} adc_channel_t;
+
+#endif  // HOST_ADC_ONESHOT_H
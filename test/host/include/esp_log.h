@@ -0,0 +1,43 @@
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+
+// Host stand-in for ESP-IDF's esp_log.h
+//
+// Errors and warnings go to stderr; info and below only with
+// GEEKHOUSE_TEST_VERBOSE set in the environment. esp_log_level_set()
+// doesn't filter, it is only recorded for esp_log_level_get().
+
+#include <stdio.h>
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+esp_log_level_t esp_log_level_get(const char *tag);
+
+int host_log_verbose(void);
+
+#define HOST_LOG(level, tag, fmt, ...) fprintf(stderr, level " (%s) " fmt "\n", tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, fmt, ...) HOST_LOG("E", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) HOST_LOG("W", tag, fmt, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)                                                                    \
+    do {                                                                                           \
+        if (host_log_verbose()) {                                                                  \
+            HOST_LOG("I", tag, fmt, ##__VA_ARGS__);                                                \
+        }                                                                                          \
+    } while (0)
+#define ESP_LOGD(tag, fmt, ...)                                                                    \
+    do {                                                                                           \
+        if (host_log_verbose() > 1) {                                                              \
+            HOST_LOG("D", tag, fmt, ##__VA_ARGS__);                                                \
+        }                                                                                          \
+    } while (0)
+
+#endif  // HOST_ESP_LOG_H
@@ -0,0 +1,13 @@
+#ifndef HOST_ESP_TIMER_H
+#define HOST_ESP_TIMER_H
+
+// Host stand-in for ESP-IDF's esp_timer.h
+
+#include <stdint.h>
+
+/**
+ * Microseconds since the test started (CLOCK_MONOTONIC)
+ */
+int64_t esp_timer_get_time(void);
+
+#endif  // HOST_ESP_TIMER_H
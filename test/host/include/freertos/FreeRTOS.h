@@ -0,0 +1,49 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+// Host stand-in for FreeRTOS on POSIX threads (see support/host_freertos.c)
+//
+// Just enough of the kernel API for the modules under test: tasks are
+// threads (priorities are ignored), notifications and mutexes are built on
+// condition variables, software timers run in one service thread like the
+// timer daemon, and critical sections take one process-wide lock, as
+// masking interrupts does on the single-core ESP32-C3.
+
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE ((BaseType_t) 0)
+#define pdTRUE  ((BaseType_t) 1)
+#define pdFAIL  pdFALSE
+#define pdPASS  pdTRUE
+
+#define portMAX_DELAY ((TickType_t) 0xffffffffUL)
+
+#define configTICK_RATE_HZ                    CONFIG_FREERTOS_HZ
+#define configMAX_TASK_NAME_LEN               16
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES CONFIG_FREERTOS_TASK_NOTIFICATION_ARRAY_ENTRIES
+
+#define portTICK_PERIOD_MS ((TickType_t) 1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)  ((TickType_t) (((uint64_t) (ms) * configTICK_RATE_HZ) / 1000U))
+
+// Critical sections: one global lock, the mux is only type-checked
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+
+void host_enter_critical(void);
+void host_exit_critical(void);
+
+#define portENTER_CRITICAL(mux)     ((void) (mux), host_enter_critical())
+#define portEXIT_CRITICAL(mux)      ((void) (mux), host_exit_critical())
+#define portENTER_CRITICAL_ISR(mux) ((void) (mux), host_enter_critical())
+#define portEXIT_CRITICAL_ISR(mux)  ((void) (mux), host_exit_critical())
+
+#endif  // HOST_FREERTOS_H
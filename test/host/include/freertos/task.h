@@ -0,0 +1,34 @@
+#ifndef HOST_FREERTOS_TASK_H
+#define HOST_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+/**
+ * Start a task on its own thread (stack size and priority are ignored)
+ */
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *created);
+
+/**
+ * End the calling task (NULL or its own handle; other tasks can't be deleted)
+ */
+void vTaskDelete(TaskHandle_t task);
+
+/**
+ * Handle of the calling thread (the main thread gets one on first use)
+ */
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+
+uint32_t ulTaskNotifyTakeIndexed(UBaseType_t index, BaseType_t clear, TickType_t timeout);
+BaseType_t xTaskNotifyGiveIndexed(TaskHandle_t task, UBaseType_t index);
+
+#define ulTaskNotifyTake(clear, timeout) ulTaskNotifyTakeIndexed(0, (clear), (timeout))
+#define xTaskNotifyGive(task)            xTaskNotifyGiveIndexed((task), 0)
+
+#endif  // HOST_FREERTOS_TASK_H
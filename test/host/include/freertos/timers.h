@@ -0,0 +1,21 @@
+#ifndef HOST_FREERTOS_TIMERS_H
+#define HOST_FREERTOS_TIMERS_H
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_timer *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+
+// All callbacks run one after the other in a single service thread, so a
+// callback that blocks delays every other timer, as in the timer daemon.
+// Block times of the timer commands are ignored (there is no command queue).
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+                           void *id, TimerCallbackFunction_t callback);
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t block);
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t block);
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t block);
+TickType_t xTimerGetPeriod(TimerHandle_t timer);
+void *pvTimerGetTimerID(TimerHandle_t timer);
+
+#endif  // HOST_FREERTOS_TIMERS_H
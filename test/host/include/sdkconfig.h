@@ -0,0 +1,13 @@
+#ifndef HOST_SDKCONFIG_H
+#define HOST_SDKCONFIG_H
+
+// Host build configuration: every optional GEEKHOUSE feature off
+// (no tracing, lock profiling or power management), as in sdkconfig.defaults
+
+#define CONFIG_FREERTOS_HZ                              1000
+#define CONFIG_FREERTOS_TASK_NOTIFICATION_ARRAY_ENTRIES 2
+#define CONFIG_LOG_DEFAULT_LEVEL                        3  // Info
+#define CONFIG_GEEKHOUSE_WIFI_SSID                      "myssid"
+#define CONFIG_GEEKHOUSE_WIFI_PASSWORD                  "mypassword"
+
+#endif  // HOST_SDKCONFIG_H
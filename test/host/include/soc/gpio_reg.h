@@ -0,0 +1,9 @@
+#ifndef HOST_SOC_GPIO_REG_H
+#define HOST_SOC_GPIO_REG_H
+
+// Host stand-in for ESP-IDF's soc/gpio_reg.h (ESP32-C3 addresses)
+
+#define GPIO_OUT_W1TS_REG 0x60004008
+#define GPIO_OUT_W1TC_REG 0x6000400C
+
+#endif  // HOST_SOC_GPIO_REG_H
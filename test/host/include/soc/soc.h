@@ -0,0 +1,13 @@
+#ifndef HOST_SOC_H
+#define HOST_SOC_H
+
+// Host stand-in for ESP-IDF's soc/soc.h
+//
+// Register writes compile, but must never run on the host: code that
+// touches registers is replaced by the tests (see led_gpio_write()).
+
+#include <stdint.h>
+
+#define REG_WRITE(reg, val) (*(volatile uint32_t *) (uintptr_t) (reg) = (uint32_t) (val))
+
+#endif  // HOST_SOC_H
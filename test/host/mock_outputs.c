@@ -0,0 +1,78 @@
+#include "mock_outputs.h"
+
+#include <time.h>
+
+#include "actuators.h"
+#include "driver/ledc.h"
+#include "test_util.h"
+
+TaskHandle_t actuator_task_handle = NULL;
+
+_Atomic uint32_t g_mock_gpio_out = 0;
+_Atomic uint32_t g_mock_gpio_writes = 0;
+_Atomic uint32_t g_mock_ledc_duty = 0;
+_Atomic uint32_t g_mock_ledc_writes = 0;
+_Atomic uint32_t g_mock_write_us = 0;
+
+static _Atomic int s_gpio_writers = 0;
+
+/**
+ * Sleep for the configured write time (the caller blocks, the CPU doesn't)
+ */
+static void write_delay(void) {
+    uint32_t us = atomic_load(&g_mock_write_us);
+    if (us > 0) {
+        struct timespec ts = {.tv_sec = us / 1000000, .tv_nsec = (long) (us % 1000000) * 1000};
+        nanosleep(&ts, NULL);
+    }
+}
+
+void led_gpio_write(uint32_t set_pins, uint32_t clear_pins) {
+    // Only one writer at a time, and every on/off LED pin is set or cleared
+    CHECK_EQ(atomic_fetch_add(&s_gpio_writers, 1), 0);
+    CHECK_EQ(set_pins & clear_pins, 0);
+    CHECK_EQ(set_pins | clear_pins, MOCK_YELLOW_PIN);
+
+    write_delay();
+    uint32_t out = atomic_load(&g_mock_gpio_out);
+    atomic_store(&g_mock_gpio_out, (out | set_pins) & ~clear_pins);
+    atomic_fetch_add(&g_mock_gpio_writes, 1);
+    atomic_fetch_sub(&s_gpio_writers, 1);
+}
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *config) {
+    return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *config) {
+    CHECK_EQ(config->channel, LEDC_CHANNEL_0);
+    return ESP_OK;
+}
+
+esp_err_t ledc_fade_func_install(int intr_alloc_flags) {
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty_and_update(ledc_mode_t mode, ledc_channel_t channel, uint32_t duty,
+                                   uint32_t hpoint) {
+    CHECK_EQ(channel, LEDC_CHANNEL_0);
+    atomic_fetch_add(&g_mock_ledc_writes, 1);
+    write_delay();
+    atomic_store(&g_mock_ledc_duty, duty);
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_fade_time_and_start(ledc_mode_t mode, ledc_channel_t channel,
+                                       uint32_t target_duty, uint32_t fade_ms,
+                                       ledc_fade_mode_t fade_mode) {
+    CHECK_EQ(channel, LEDC_CHANNEL_0);
+    CHECK_EQ(fade_mode, LEDC_FADE_NO_WAIT);  // Never block the actuator task
+    atomic_fetch_add(&g_mock_ledc_writes, 1);
+    write_delay();
+    atomic_store(&g_mock_ledc_duty, target_duty);
+    return ESP_OK;
+}
+
+esp_err_t ledc_fade_stop(ledc_mode_t mode, ledc_channel_t channel) {
+    return ESP_OK;
+}
@@ -0,0 +1,26 @@
+#ifndef MOCK_OUTPUTS_H
+#define MOCK_OUTPUTS_H
+
+// Mocked LED outputs for tests that link actuators.c
+//
+// Replaces led_gpio_write() and the LEDC driver with a GPIO output register
+// and one LEDC duty. Each write can be made to take time, like a driver call
+// that waits for the peripheral.
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define MOCK_YELLOW_PIN (1u << 2)  // GPIO of LED_YELLOW_ROOF
+
+extern TaskHandle_t actuator_task_handle;
+
+extern _Atomic uint32_t g_mock_gpio_out;     // GPIO output register
+extern _Atomic uint32_t g_mock_gpio_writes;  // led_gpio_write() calls
+extern _Atomic uint32_t g_mock_ledc_duty;    // LEDC channel 0 duty (fades jump to the target)
+extern _Atomic uint32_t g_mock_ledc_writes;  // LEDC duty writes started
+extern _Atomic uint32_t g_mock_write_us;     // Time each register or duty write takes
+
+#endif  // MOCK_OUTPUTS_H
@@ -0,0 +1,118 @@
+// Host stand-ins for the small ESP-IDF services the modules under test use
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "driver/gpio.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_timer.h"
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK:
+            return "ESP_OK";
+        case ESP_FAIL:
+            return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:
+            return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:
+            return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE:
+            return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:
+            return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:
+            return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED:
+            return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:
+            return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_VERSION:
+            return "ESP_ERR_INVALID_VERSION";
+        case ESP_ERR_NVS_NOT_FOUND:
+            return "ESP_ERR_NVS_NOT_FOUND";
+        case ESP_ERR_NVS_TYPE_MISMATCH:
+            return "ESP_ERR_NVS_TYPE_MISMATCH";
+        default:
+            return "ERROR";
+    }
+}
+
+static int64_t s_start_us;
+
+static int64_t monotonic_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// Time starts at 0 when the test starts, as it does at boot
+__attribute__((constructor)) static void host_timer_init(void) {
+    s_start_us = monotonic_us();
+}
+
+int64_t esp_timer_get_time(void) {
+    return monotonic_us() - s_start_us;
+}
+
+int host_log_verbose(void) {
+    static int level = -1;
+    if (level < 0) {
+        const char *env = getenv("GEEKHOUSE_TEST_VERBOSE");
+        level = env != NULL ? atoi(env) : 0;
+    }
+    return level;
+}
+
+// Only the default level ("*"); per-tag levels aren't kept
+static esp_log_level_t s_log_level = ESP_LOG_INFO;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+    if (tag != NULL && tag[0] == '*' && tag[1] == '\0') {
+        s_log_level = level;
+    }
+}
+
+esp_log_level_t esp_log_level_get(const char *tag) {
+    (void) tag;
+    return s_log_level;
+}
+
+esp_err_t gpio_config(const gpio_config_t *config) {
+    return config != NULL ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype,
+                                                const char *label) {
+    (void) type;
+    (void) subtype;
+    (void) label;
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t offset, void *dst, size_t len) {
+    (void) part;
+    (void) offset;
+    (void) dst;
+    (void) len;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t offset, const void *src,
+                              size_t len) {
+    (void) part;
+    (void) offset;
+    (void) src;
+    (void) len;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t offset, size_t len) {
+    (void) part;
+    (void) offset;
+    (void) len;
+    return ESP_ERR_NOT_SUPPORTED;
+}
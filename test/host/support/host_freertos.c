@@ -0,0 +1,365 @@
+// FreeRTOS stand-in on POSIX threads (see include/freertos/FreeRTOS.h)
+
+#define _GNU_SOURCE  // PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+#define US_PER_TICK (1000000 / configTICK_RATE_HZ)
+
+struct host_task {
+    pthread_t thread;
+    char name[configMAX_TASK_NAME_LEN];
+    TaskFunction_t fn;
+    void *arg;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify[configTASK_NOTIFICATION_ARRAY_ENTRIES];
+    struct host_task *next;
+};
+
+struct host_mutex {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool held;
+};
+
+struct host_timer {
+    const char *name;
+    TimerCallbackFunction_t callback;
+    void *id;
+    bool auto_reload;
+    bool active;
+    TickType_t period;
+    int64_t expiry_us;
+    struct host_timer *next;
+};
+
+static __thread struct host_task *t_self = NULL;
+
+// Every task ever created: a deleted task's thread ends but its record
+// stays, so a stale handle (say, a waiter that timed out) is safe to notify
+static struct host_task *s_tasks = NULL;
+static pthread_mutex_t s_tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t s_critical = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+// Timer service: all timers, guarded by s_timer_lock
+static pthread_mutex_t s_timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_timer_cond;
+static struct host_timer *s_timers = NULL;
+static pthread_t s_timer_thread;
+static bool s_timer_started = false;
+
+static void init_cond(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static struct timespec abs_time_us(int64_t us) {
+    // esp_timer_get_time() counts from the first call, CLOCK_MONOTONIC doesn't
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t wait_us = us - esp_timer_get_time();
+    if (wait_us < 0) {
+        wait_us = 0;
+    }
+    int64_t ns = now.tv_nsec + (wait_us % 1000000) * 1000;
+    struct timespec ts = {.tv_sec = now.tv_sec + wait_us / 1000000 + ns / 1000000000,
+                          .tv_nsec = ns % 1000000000};
+    return ts;
+}
+
+/**
+ * Wait on a condition until woken or the deadline (esp_timer_get_time()) passes
+ *
+ * @param deadline_us Deadline, or -1 to wait for ever
+ *
+ * @return false on timeout
+ */
+static bool wait_ticks(pthread_cond_t *cond, pthread_mutex_t *lock, int64_t deadline_us) {
+    if (deadline_us < 0) {
+        pthread_cond_wait(cond, lock);
+        return true;
+    }
+    struct timespec ts = abs_time_us(deadline_us);
+    return pthread_cond_timedwait(cond, lock, &ts) != ETIMEDOUT;
+}
+
+static int64_t deadline_of(TickType_t timeout) {
+    return timeout == portMAX_DELAY ? -1 : esp_timer_get_time() + (int64_t) timeout * US_PER_TICK;
+}
+
+void host_enter_critical(void) {
+    pthread_mutex_lock(&s_critical);
+}
+
+void host_exit_critical(void) {
+    pthread_mutex_unlock(&s_critical);
+}
+
+// ---- Tasks ----
+
+static struct host_task *task_new(const char *name) {
+    struct host_task *task = calloc(1, sizeof(*task));
+    if (task == NULL) {
+        abort();
+    }
+    snprintf(task->name, sizeof(task->name), "%s", name);
+    pthread_mutex_init(&task->lock, NULL);
+    init_cond(&task->cond);
+
+    pthread_mutex_lock(&s_tasks_lock);
+    task->next = s_tasks;
+    s_tasks = task;
+    pthread_mutex_unlock(&s_tasks_lock);
+    return task;
+}
+
+static void *task_main(void *arg) {
+    struct host_task *task = arg;
+    t_self = task;
+    task->fn(task->arg);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *created) {
+    (void) stack_depth;
+    (void) priority;
+    struct host_task *task = task_new(name);
+    task->fn = fn;
+    task->arg = arg;
+    if (created != NULL) {
+        *created = task;  // Before the task runs, as on a real kernel
+    }
+    if (pthread_create(&task->thread, NULL, task_main, task) != 0) {
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task != NULL && task != xTaskGetCurrentTaskHandle()) {
+        abort();  // Only a task deleting itself is supported
+    }
+    pthread_exit(NULL);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (t_self == NULL) {
+        t_self = task_new("main");
+        t_self->thread = pthread_self();
+    }
+    return t_self;
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t) (esp_timer_get_time() / US_PER_TICK);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    int64_t us = (int64_t) ticks * US_PER_TICK;
+    struct timespec ts = {.tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000};
+    while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+    }
+}
+
+uint32_t ulTaskNotifyTakeIndexed(UBaseType_t index, BaseType_t clear, TickType_t timeout) {
+    struct host_task *self = xTaskGetCurrentTaskHandle();
+    if (index >= configTASK_NOTIFICATION_ARRAY_ENTRIES) {
+        abort();  // configASSERT on the target
+    }
+    int64_t deadline = deadline_of(timeout);
+
+    pthread_mutex_lock(&self->lock);
+    while (self->notify[index] == 0 && timeout != 0) {
+        if (!wait_ticks(&self->cond, &self->lock, deadline)) {
+            break;
+        }
+    }
+    uint32_t value = self->notify[index];
+    if (value > 0) {
+        self->notify[index] = clear ? 0 : value - 1;
+    }
+    pthread_mutex_unlock(&self->lock);
+    return value;
+}
+
+BaseType_t xTaskNotifyGiveIndexed(TaskHandle_t task, UBaseType_t index) {
+    if (task == NULL || index >= configTASK_NOTIFICATION_ARRAY_ENTRIES) {
+        abort();
+    }
+    pthread_mutex_lock(&task->lock);
+    task->notify[index]++;
+    pthread_cond_broadcast(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+// ---- Mutexes ----
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    struct host_mutex *mutex = calloc(1, sizeof(*mutex));
+    if (mutex == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&mutex->lock, NULL);
+    init_cond(&mutex->cond);
+    return mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t timeout) {
+    int64_t deadline = deadline_of(timeout);
+    pthread_mutex_lock(&mutex->lock);
+    while (mutex->held) {
+        if (timeout == 0 || !wait_ticks(&mutex->cond, &mutex->lock, deadline)) {
+            break;
+        }
+    }
+    BaseType_t taken = !mutex->held;
+    mutex->held = true;
+    pthread_mutex_unlock(&mutex->lock);
+    return taken ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex) {
+    pthread_mutex_lock(&mutex->lock);
+    mutex->held = false;
+    pthread_cond_signal(&mutex->cond);
+    pthread_mutex_unlock(&mutex->lock);
+    return pdTRUE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t mutex) {
+    pthread_mutex_destroy(&mutex->lock);
+    pthread_cond_destroy(&mutex->cond);
+    free(mutex);
+}
+
+// ---- Software timers ----
+
+/**
+ * Timer service thread: runs expired callbacks in expiry order
+ *
+ * Auto-reload timers are re-armed from their expected expiry, not from the
+ * time the callback ran, and missed periods are caught up one callback at
+ * a time, as the FreeRTOS timer daemon does.
+ */
+static void *timer_service(void *arg) {
+    (void) arg;
+    t_self = task_new("Tmr Svc");
+    t_self->thread = pthread_self();
+
+    pthread_mutex_lock(&s_timer_lock);
+    for (;;) {
+        struct host_timer *first = NULL;
+        for (struct host_timer *t = s_timers; t != NULL; t = t->next) {
+            if (t->active && (first == NULL || t->expiry_us < first->expiry_us)) {
+                first = t;
+            }
+        }
+        if (first == NULL) {
+            pthread_cond_wait(&s_timer_cond, &s_timer_lock);
+            continue;
+        }
+        if (first->expiry_us > esp_timer_get_time()) {
+            wait_ticks(&s_timer_cond, &s_timer_lock, first->expiry_us);
+            continue;  // Woken early, or the timers changed: look again
+        }
+
+        if (first->auto_reload) {
+            first->expiry_us += (int64_t) first->period * US_PER_TICK;
+        } else {
+            first->active = false;
+        }
+        pthread_mutex_unlock(&s_timer_lock);
+        first->callback(first);
+        pthread_mutex_lock(&s_timer_lock);
+    }
+    return NULL;
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload,
+                           void *id, TimerCallbackFunction_t callback) {
+    if (period == 0 || callback == NULL) {
+        return NULL;
+    }
+    struct host_timer *timer = calloc(1, sizeof(*timer));
+    if (timer == NULL) {
+        return NULL;
+    }
+    *timer = (struct host_timer) {.name = name,
+                                  .callback = callback,
+                                  .id = id,
+                                  .auto_reload = auto_reload != 0,
+                                  .period = period};
+
+    pthread_mutex_lock(&s_timer_lock);
+    if (!s_timer_started) {
+        init_cond(&s_timer_cond);
+        pthread_create(&s_timer_thread, NULL, timer_service, NULL);
+        pthread_detach(s_timer_thread);
+        s_timer_started = true;
+    }
+    timer->next = s_timers;
+    s_timers = timer;
+    pthread_mutex_unlock(&s_timer_lock);
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t block) {
+    (void) block;
+    pthread_mutex_lock(&s_timer_lock);
+    timer->active = true;
+    timer->expiry_us = esp_timer_get_time() + (int64_t) timer->period * US_PER_TICK;
+    pthread_cond_signal(&s_timer_cond);
+    pthread_mutex_unlock(&s_timer_lock);
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t block) {
+    (void) block;
+    pthread_mutex_lock(&s_timer_lock);
+    timer->active = false;
+    pthread_cond_signal(&s_timer_cond);
+    pthread_mutex_unlock(&s_timer_lock);
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t block) {
+    if (period == 0) {
+        return pdFAIL;
+    }
+    pthread_mutex_lock(&s_timer_lock);
+    timer->period = period;
+    pthread_mutex_unlock(&s_timer_lock);
+    // Changing the period also (re)starts the timer from now
+    return xTimerStart(timer, block);
+}
+
+TickType_t xTimerGetPeriod(TimerHandle_t timer) {
+    pthread_mutex_lock(&s_timer_lock);
+    TickType_t period = timer->period;
+    pthread_mutex_unlock(&s_timer_lock);
+    return period;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer) {
+    return timer->id;
+}
@@ -0,0 +1,218 @@
+// In-memory NVS (see include/nvs.h)
+//
+// One flat table of namespace/key -> typed value. Commits are immediate,
+// so a module that re-reads after "reboot" sees what it last wrote. As in
+// NVS, reading a key as another type than it was written fails.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nvs.h"
+
+#define HOST_NVS_ENTRIES    32
+#define HOST_NVS_NAMESPACES 8
+#define HOST_NVS_NAME_LEN   16  // NVS keys and namespaces: 15 characters at most
+
+typedef enum { HOST_NVS_U8, HOST_NVS_U32, HOST_NVS_STR, HOST_NVS_BLOB } host_nvs_type_t;
+
+typedef struct {
+    bool used;
+    nvs_handle_t ns;
+    char key[HOST_NVS_NAME_LEN];
+    host_nvs_type_t type;
+    void *value;
+    size_t length;  // Strings: including the NUL
+} host_nvs_entry_t;
+
+static char s_namespaces[HOST_NVS_NAMESPACES][HOST_NVS_NAME_LEN];
+static host_nvs_entry_t s_entries[HOST_NVS_ENTRIES];
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static int s_fail_writes;  // Fail the next n nvs_set_*() calls
+
+static bool name_ok(const char *name) {
+    return name != NULL && name[0] != '\0' && strlen(name) < HOST_NVS_NAME_LEN;
+}
+
+static host_nvs_entry_t *find_entry(nvs_handle_t handle, const char *key) {
+    for (int i = 0; i < HOST_NVS_ENTRIES; i++) {
+        if (s_entries[i].used && s_entries[i].ns == handle && strcmp(s_entries[i].key, key) == 0) {
+            return &s_entries[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *handle) {
+    (void) mode;
+    if (!name_ok(name) || handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    esp_err_t ret = ESP_ERR_NVS_NO_FREE_PAGES;
+    for (int i = 0; i < HOST_NVS_NAMESPACES; i++) {
+        if (s_namespaces[i][0] == '\0' || strcmp(s_namespaces[i], name) == 0) {
+            strcpy(s_namespaces[i], name);
+            *handle = (nvs_handle_t) i + 1;  // Handle 0 is never valid
+            ret = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+/**
+ * Copy a value out; out == NULL only queries the length
+ */
+static esp_err_t get_value(nvs_handle_t handle, const char *key, host_nvs_type_t type, void *out,
+                           size_t *length) {
+    if (!name_ok(key) || length == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    esp_err_t ret = ESP_OK;
+    host_nvs_entry_t *entry = find_entry(handle, key);
+    if (entry == NULL) {
+        ret = ESP_ERR_NVS_NOT_FOUND;
+    } else if (entry->type != type) {
+        ret = ESP_ERR_NVS_TYPE_MISMATCH;
+    } else if (out == NULL) {
+        *length = entry->length;  // Size query
+    } else if (*length < entry->length) {
+        ret = type == HOST_NVS_STR ? ESP_ERR_NVS_INVALID_LENGTH : ESP_ERR_INVALID_SIZE;
+    } else {
+        memcpy(out, entry->value, entry->length);
+        *length = entry->length;
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ret;
+}
+
+static esp_err_t set_value(nvs_handle_t handle, const char *key, host_nvs_type_t type,
+                           const void *value, size_t length) {
+    if (!name_ok(key) || (value == NULL && length > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    void *copy = malloc(length > 0 ? length : 1);
+    if (copy == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, value, length);
+
+    pthread_mutex_lock(&s_lock);
+    if (s_fail_writes > 0) {
+        s_fail_writes--;
+        pthread_mutex_unlock(&s_lock);
+        free(copy);
+        return ESP_FAIL;
+    }
+    host_nvs_entry_t *entry = find_entry(handle, key);
+    for (int i = 0; entry == NULL && i < HOST_NVS_ENTRIES; i++) {
+        if (!s_entries[i].used) {
+            entry = &s_entries[i];
+            *entry = (host_nvs_entry_t) {.used = true, .ns = handle};
+            strcpy(entry->key, key);
+        }
+    }
+    esp_err_t ret = ESP_ERR_NVS_NO_FREE_PAGES;
+    if (entry != NULL) {
+        free(entry->value);
+        entry->type = type;
+        entry->value = copy;
+        entry->length = length;
+        copy = NULL;
+        ret = ESP_OK;
+    }
+    pthread_mutex_unlock(&s_lock);
+    free(copy);
+    return ret;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *length) {
+    return get_value(handle, key, HOST_NVS_BLOB, out, length);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    return set_value(handle, key, HOST_NVS_BLOB, value, length);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out, size_t *length) {
+    return get_value(handle, key, HOST_NVS_STR, out, length);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value) {
+    if (value == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return set_value(handle, key, HOST_NVS_STR, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t handle, const char *key, uint8_t *out) {
+    size_t length = sizeof(*out);
+    return out != NULL ? get_value(handle, key, HOST_NVS_U8, out, &length) : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t handle, const char *key, uint8_t value) {
+    return set_value(handle, key, HOST_NVS_U8, &value, sizeof(value));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t handle, const char *key, uint32_t *out) {
+    size_t length = sizeof(*out);
+    return out != NULL ? get_value(handle, key, HOST_NVS_U32, out, &length) : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t handle, const char *key, uint32_t value) {
+    return set_value(handle, key, HOST_NVS_U32, &value, sizeof(value));
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    if (!name_ok(key)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&s_lock);
+    host_nvs_entry_t *entry = find_entry(handle, key);
+    if (entry != NULL) {
+        free(entry->value);
+        *entry = (host_nvs_entry_t) {0};
+    }
+    pthread_mutex_unlock(&s_lock);
+    return entry != NULL ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle) {
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < HOST_NVS_ENTRIES; i++) {
+        if (s_entries[i].used && s_entries[i].ns == handle) {
+            free(s_entries[i].value);
+            s_entries[i] = (host_nvs_entry_t) {0};
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    (void) handle;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+    (void) handle;
+}
+
+void host_nvs_erase_all(void) {
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < HOST_NVS_ENTRIES; i++) {
+        free(s_entries[i].value);
+        s_entries[i] = (host_nvs_entry_t) {0};
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+void host_nvs_fail_writes(int count) {
+    pthread_mutex_lock(&s_lock);
+    s_fail_writes = count;
+    pthread_mutex_unlock(&s_lock);
+}
@@ -0,0 +1,221 @@
+// actuators.c against a mocked GPIO output register and LEDC channel
+// (mock_outputs.c)
+//
+// Several tasks drive the LEDs at once through every entry point
+// (led_apply_batch, led_on/led_off/led_toggle, led_post_batch and
+// led_set_brightness). The mocks check every register write as it happens,
+// and once the ring has drained, that the register, the LEDC duty and
+// led_get_state_mask() agree and no toggle was lost.
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#include "actuators.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mock_outputs.h"
+#include "test_util.h"
+
+TEST_MAIN_FAILURES;
+
+#define ROUNDS       8
+#define WORKERS      4
+#define ITERATIONS   500    // Per worker and round
+#define ROUND_MAX_MS 30000  // Sanitizers are slow, but a round takes well under a second
+
+// Main task: workers notify it (index 0) as they finish
+static TaskHandle_t s_main_task = NULL;
+
+// Yellow toggles that made it into the ring (the final state's parity)
+static _Atomic uint32_t s_yellow_toggles = 0;
+
+/**
+ * Count a yellow toggle if its command was queued
+ *
+ * A waiting call that timed out was still queued; only a full ring drops it.
+ */
+static void count_toggle(esp_err_t ret) {
+    CHECK(ret == ESP_OK || ret == ESP_ERR_TIMEOUT || ret == ESP_ERR_NO_MEM);
+    if (ret != ESP_ERR_NO_MEM) {
+        atomic_fetch_add(&s_yellow_toggles, 1);
+    }
+}
+
+static void worker(void *arg) {
+    unsigned seed = (unsigned) (uintptr_t) arg;
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        led_batch_t batch = {0};
+        uint32_t mask = 0;
+
+        switch (rand_r(&seed) % 6) {
+            case 0:  // Both LEDs in one batch, waiting for it
+                led_batch_add(&batch, LED_YELLOW_ROOF, LED_ACTION_TOGGLE);
+                led_batch_add(&batch, LED_WHITE_GARDEN,
+                              rand_r(&seed) % 2 ? LED_ACTION_ON : LED_ACTION_OFF);
+                count_toggle(led_apply_batch(&batch, &mask));
+                break;
+            case 1:  // Fire and forget, as the blink timer does
+                led_batch_add(&batch, LED_YELLOW_ROOF, LED_ACTION_TOGGLE);
+                led_batch_add(&batch, LED_WHITE_GARDEN, LED_ACTION_TOGGLE);
+                count_toggle(led_post_batch(&batch));
+                break;
+            case 2:
+                count_toggle(led_toggle(LED_YELLOW_ROOF));
+                break;
+            case 3:
+                led_batch_add(&batch, LED_YELLOW_ROOF, LED_ACTION_TOGGLE);
+                led_batch_add(&batch, LED_YELLOW_ROOF, LED_ACTION_TOGGLE);  // Cancels out
+                led_batch_add(&batch, LED_WHITE_GARDEN, LED_ACTION_ON);
+                CHECK(led_apply_batch(&batch, NULL) != ESP_ERR_INVALID_ARG);
+                break;
+            case 4: {
+                esp_err_t ret = rand_r(&seed) % 2 ? led_on(LED_WHITE_GARDEN)
+                                                  : led_off(LED_WHITE_GARDEN);
+                CHECK(ret != ESP_ERR_INVALID_ARG);
+                break;
+            }
+            default: {
+                uint8_t level = (uint8_t) (rand_r(&seed) % (LED_BRIGHTNESS_MAX + 1));
+                uint32_t fade_ms = rand_r(&seed) % 2 ? 0 : 200;
+                esp_err_t ret = led_set_brightness(LED_WHITE_GARDEN, level, fade_ms);
+                CHECK(ret != ESP_ERR_INVALID_ARG);
+                break;
+            }
+        }
+    }
+    xTaskNotifyGive(s_main_task);
+    vTaskDelete(NULL);  // Tasks never return
+}
+
+/**
+ * Wait until everything queued so far has been applied
+ */
+static void drain(void) {
+    led_batch_t nothing = {0};
+    for (int tries = 0; tries < 50; tries++) {
+        if (led_apply_batch(&nothing, NULL) == ESP_OK) {
+            return;
+        }
+    }
+    CHECK(!"actuator task never drained the ring");
+}
+
+/**
+ * Register, LEDC duty and the reported state must all agree
+ */
+static void check_outputs(void) {
+    uint32_t state = 0;
+    CHECK_EQ(led_get_state_mask(&state), ESP_OK);
+    CHECK_EQ((atomic_load(&g_mock_gpio_out) & MOCK_YELLOW_PIN) != 0,
+             (state & LED_MASK(LED_YELLOW_ROOF)) != 0);
+    CHECK_EQ(atomic_load(&g_mock_ledc_duty) != 0, (state & LED_MASK(LED_WHITE_GARDEN)) != 0);
+}
+
+/**
+ * A batch takes at most a ringful, however fast producers refill the ring
+ *
+ * The actuator task is held in the LEDC write of a brightness command it
+ * has just popped while the ring is filled again behind it.
+ */
+static void test_batch_cap(void) {
+    led_stats_t before;
+    led_get_stats(&before);
+    uint32_t ledc_writes = atomic_load(&g_mock_ledc_writes);
+    atomic_store(&g_mock_write_us, 200000);
+    CHECK_EQ(led_post_brightness(LED_WHITE_GARDEN, LED_BRIGHTNESS_MAX, 0), ESP_OK);
+    for (int waited = 0; atomic_load(&g_mock_ledc_writes) == ledc_writes && waited < 1000;
+         waited++) {
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    CHECK(atomic_load(&g_mock_ledc_writes) != ledc_writes);
+
+    led_batch_t batch = {0};
+    led_batch_add(&batch, LED_YELLOW_ROOF, LED_ACTION_TOGGLE);
+    for (int i = 0; i < 16; i++) {
+        count_toggle(led_post_batch(&batch));
+    }
+    CHECK_EQ(led_post_batch(&batch), ESP_ERR_NO_MEM);  // 16 behind the one being applied
+    atomic_store(&g_mock_write_us, 0);
+
+    // The brightness and 15 batches, then the last batch
+    led_stats_t stats;
+    for (int waited = 0; waited < 1000; waited++) {
+        led_get_stats(&stats);
+        if (stats.batches >= before.batches + 2) {
+            break;
+        }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+    vTaskDelay(pdMS_TO_TICKS(10));  // Nothing else is coming
+    led_get_stats(&stats);
+    CHECK_EQ(stats.commands, before.commands + 17);
+    CHECK_EQ(stats.batches, before.batches + 2);
+    CHECK_EQ(stats.max_batch, 16);
+}
+
+int main(void) {
+    CHECK_EQ(led_init(), ESP_OK);
+
+    // led_init() writes the outputs directly: yellow off, white (dimmable) on
+    uint32_t state = 0;
+    led_get_state_mask(&state);
+    CHECK_EQ(state, LED_MASK(LED_WHITE_GARDEN));
+    CHECK_EQ(atomic_load(&g_mock_gpio_writes), 1);
+    check_outputs();
+
+    CHECK_EQ(xTaskCreate(actuator_task, "actuator", 4096, NULL, 5, &actuator_task_handle), pdPASS);
+
+    // Single-threaded sanity: each call lands before it returns
+    CHECK_EQ(led_on(LED_YELLOW_ROOF), ESP_OK);
+    CHECK_EQ(atomic_load(&g_mock_gpio_out) & MOCK_YELLOW_PIN, MOCK_YELLOW_PIN);
+    CHECK_EQ(led_set_brightness(LED_WHITE_GARDEN, 0, 0), ESP_OK);
+    CHECK_EQ(atomic_load(&g_mock_ledc_duty), 0);
+    CHECK_EQ(led_off(LED_YELLOW_ROOF), ESP_OK);
+    CHECK_EQ(atomic_load(&g_mock_gpio_out) & MOCK_YELLOW_PIN, 0);
+    check_outputs();
+
+    // Concurrent producers, in rounds: a lost or doubled toggle shows up as
+    // the wrong parity in half the rounds
+    s_main_task = xTaskGetCurrentTaskHandle();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < WORKERS; i++) {
+            uintptr_t seed = (uintptr_t) (round * WORKERS + i + 1);
+            CHECK_EQ(xTaskCreate(worker, "worker", 4096, (void *) seed, 5, NULL), pdPASS);
+        }
+        int done = 0;
+        while (done < WORKERS && ulTaskNotifyTake(pdFALSE, pdMS_TO_TICKS(ROUND_MAX_MS)) > 0) {
+            done++;
+        }
+        if (done < WORKERS) {
+            CHECK(!"workers never finished");
+            return test_report("test_actuators");
+        }
+        drain();
+        check_outputs();
+
+        // Yellow started off; only toggles moved it
+        led_get_state_mask(&state);
+        uint32_t toggles = atomic_load(&s_yellow_toggles);
+        CHECK_EQ((state & LED_MASK(LED_YELLOW_ROOF)) != 0, toggles % 2);
+    }
+
+    test_batch_cap();
+    drain();
+    check_outputs();
+    led_get_state_mask(&state);
+    CHECK_EQ((state & LED_MASK(LED_YELLOW_ROOF)) != 0, atomic_load(&s_yellow_toggles) % 2);
+
+    led_stats_t stats;
+    led_get_stats(&stats);
+    CHECK(stats.batches > 0);
+    CHECK(stats.batches <= stats.commands);
+    CHECK(stats.max_batch <= 16);  // The ring size
+    fprintf(stderr, "%lu commands (%lu dropped) in %lu batches (max %lu), %lu GPIO writes, "
+            "max latency %lu us\n",
+            (unsigned long) stats.commands, (unsigned long) stats.dropped,
+            (unsigned long) stats.batches, (unsigned long) stats.max_batch,
+            (unsigned long) atomic_load(&g_mock_gpio_writes), (unsigned long) stats.max_latency_us);
+
+    return test_report("test_actuators");
+}
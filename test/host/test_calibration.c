@@ -0,0 +1,282 @@
+// Sensor calibration (calibration.c): evaluation against reference values,
+// the stored blob format, and malformed blobs as they might come out of NVS
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "calibration.h"
+#include "test_util.h"
+
+TEST_MAIN_FAILURES;
+
+#define REL_TOL 1e-5  // float evaluation against double references
+
+static const calibration_t NONE = {.type = CALIB_NONE, .unit = "raw"};
+static const calibration_t LINEAR = {
+    .type = CALIB_LINEAR, .linear = {.m = 0.025f, .b = -12.5f}, .unit = "C"};
+static const calibration_t POLY = {
+    .type = CALIB_POLYNOMIAL, .poly = {.a = 2e-5f, .b = 0.5f, .c = -3.0f}, .unit = "lux"};
+// A soil probe: dry below 800, wet above 3200, steeper in the middle
+static const calibration_t PIECEWISE = {
+    .type = CALIB_PIECEWISE,
+    .piecewise = {.count = 4,
+                  .points = {{800, 0.0f}, {1600, 10.0f}, {2400, 70.0f}, {3200, 100.0f}}},
+    .unit = "%"};
+
+static void check_value(const calibration_t *calib, int raw, double want) {
+    double got = calibration_apply(calib, raw);
+    if (fabs(got - want) > REL_TOL * fmax(1.0, fabs(want))) {
+        fprintf(stderr, "%s raw %d: got %.6f, expected %.6f\n",
+                calibration_type_name(calib->type), raw, got, want);
+        g_test_failures++;
+    }
+}
+
+/**
+ * calibration_apply() against the formulas, over the whole ADC range
+ */
+static void test_reference_values(void) {
+    for (int raw = 0; raw <= CALIB_RAW_MAX; raw++) {
+        check_value(&NONE, raw, raw);
+        check_value(&LINEAR, raw, 0.025 * raw - 12.5);
+        check_value(&POLY, raw, 2e-5 * raw * raw + 0.5 * raw - 3.0);
+    }
+    check_value(&LINEAR, 500, 0.0);
+    check_value(&POLY, 1000, 517.0);
+    check_value(&POLY, CALIB_RAW_MAX, 2e-5 * 4095.0 * 4095.0 + 0.5 * 4095.0 - 3.0);
+
+    // Piecewise: the points themselves, interpolation, clamping at both ends
+    check_value(&PIECEWISE, 800, 0.0);
+    check_value(&PIECEWISE, 1600, 10.0);
+    check_value(&PIECEWISE, 2400, 70.0);
+    check_value(&PIECEWISE, 3200, 100.0);
+    check_value(&PIECEWISE, 1200, 5.0);
+    check_value(&PIECEWISE, 1601, 10.075);
+    check_value(&PIECEWISE, 2000, 40.0);
+    check_value(&PIECEWISE, 3000, 92.5);
+    check_value(&PIECEWISE, 0, 0.0);
+    check_value(&PIECEWISE, 799, 0.0);
+    check_value(&PIECEWISE, 3201, 100.0);
+    check_value(&PIECEWISE, CALIB_RAW_MAX, 100.0);
+    check_value(&PIECEWISE, -5, 0.0);  // Out of ADC range still clamps
+    check_value(&PIECEWISE, 5000, 100.0);
+
+    // Monotonic tables stay monotonic between the points
+    float prev = calibration_apply(&PIECEWISE, 0);
+    for (int raw = 1; raw <= CALIB_RAW_MAX; raw++) {
+        float v = calibration_apply(&PIECEWISE, raw);
+        CHECK(v >= prev);
+        prev = v;
+    }
+
+    // Decreasing values and a table covering the whole range
+    const calibration_t inverted = {
+        .type = CALIB_PIECEWISE,
+        .piecewise = {.count = 2, .points = {{0, 50.0f}, {CALIB_RAW_MAX, -50.0f}}},
+        .unit = "x"};
+    check_value(&inverted, 0, 50.0);
+    check_value(&inverted, CALIB_RAW_MAX, -50.0);
+    check_value(&inverted, 1000, 50.0 - 100.0 * 1000 / CALIB_RAW_MAX);
+}
+
+/**
+ * Encode, decode, and check the decoded calibration behaves the same
+ */
+static void check_round_trip(const calibration_t *calib, size_t want_len) {
+    uint8_t buf[CALIB_BLOB_MAX];
+    CHECK_EQ(calibration_validate(calib), ESP_OK);
+    size_t len = calibration_encode(calib, buf);
+    CHECK_EQ(len, want_len);
+
+    calibration_t decoded;
+    char unit[CALIB_UNIT_MAX];
+    CHECK_EQ(calibration_decode(buf, len, &decoded, unit), ESP_OK);
+    CHECK_EQ(decoded.type, calib->type);
+    CHECK(decoded.unit == unit);
+    CHECK(strcmp(decoded.unit, calib->unit) == 0);
+    for (int raw = -1; raw <= CALIB_RAW_MAX + 1; raw++) {
+        CHECK(calibration_apply(&decoded, raw) == calibration_apply(calib, raw));
+    }
+
+    // The blob is canonical: encoding the decoded calibration gives it back
+    uint8_t again[CALIB_BLOB_MAX];
+    CHECK_EQ(calibration_encode(&decoded, again), len);
+    CHECK(memcmp(buf, again, len) == 0);
+}
+
+static void test_round_trips(void) {
+    const size_t header = 2 + CALIB_UNIT_MAX;
+    check_round_trip(&NONE, header);
+    check_round_trip(&LINEAR, header + 8);
+    check_round_trip(&POLY, header + 12);
+    check_round_trip(&PIECEWISE, header + 1 + 4 * 6);
+
+    // Largest table, longest unit, extreme values
+    calibration_t full = {.type = CALIB_PIECEWISE, .unit = "1234567"};
+    full.piecewise.count = CALIB_PIECEWISE_MAX;
+    for (int i = 0; i < CALIB_PIECEWISE_MAX; i++) {
+        full.piecewise.points[i] = (calib_point_t) {.raw = (uint16_t) (i * 585),
+                                                    .value = i % 2 ? -3.4e38f : 1e-38f};
+    }
+    check_round_trip(&full, CALIB_BLOB_MAX);
+
+    // Type names round-trip too (the HTTP API uses them)
+    for (int t = 0; t < CALIB_TYPE_COUNT; t++) {
+        CHECK_EQ(calibration_type_from_name(calibration_type_name((calib_type_t) t)), t);
+    }
+    CHECK_EQ(calibration_type_from_name("cubic"), CALIB_TYPE_COUNT);
+}
+
+/**
+ * The stored format is fixed: blobs written by older firmware must still decode
+ */
+static void test_blob_layout(void) {
+    static const uint8_t linear_blob[] = {
+        CALIB_BLOB_VERSION, CALIB_LINEAR, 'C', 0, 0, 0, 0, 0, 0, 0,
+        0xcd, 0xcc, 0xcc, 0x3c,  // m = 0.025f
+        0x00, 0x00, 0x48, 0xc1,  // b = -12.5f
+    };
+    uint8_t buf[CALIB_BLOB_MAX];
+    CHECK_EQ(calibration_encode(&LINEAR, buf), sizeof(linear_blob));
+    CHECK(memcmp(buf, linear_blob, sizeof(linear_blob)) == 0);
+
+    static const uint8_t piecewise_blob[] = {
+        CALIB_BLOB_VERSION, CALIB_PIECEWISE, '%', 0, 0, 0, 0, 0, 0, 0, 2,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00,  // raw 0, 0.0f
+        0xff, 0x0f, 0x00, 0x00, 0xc8, 0x42,  // raw 4095, 100.0f
+    };
+    calibration_t calib;
+    char unit[CALIB_UNIT_MAX];
+    CHECK_EQ(calibration_decode(piecewise_blob, sizeof(piecewise_blob), &calib, unit), ESP_OK);
+    CHECK_EQ(calib.type, CALIB_PIECEWISE);
+    CHECK_EQ(calib.piecewise.count, 2);
+    CHECK(strcmp(unit, "%") == 0);
+    check_value(&calib, 4095, 100.0);
+    check_value(&calib, 2048, 100.0 * 2048 / 4095);
+}
+
+static esp_err_t decode(const uint8_t *buf, size_t len) {
+    calibration_t calib;
+    char unit[CALIB_UNIT_MAX];
+    return calibration_decode(buf, len, &calib, unit);
+}
+
+/**
+ * Malformed blobs are rejected, whatever NVS hands back
+ */
+static void test_malformed(void) {
+    const calibration_t *all[] = {&NONE, &LINEAR, &POLY, &PIECEWISE};
+    for (size_t c = 0; c < sizeof(all) / sizeof(all[0]); c++) {
+        uint8_t buf[CALIB_BLOB_MAX + 1];
+        size_t len = calibration_encode(all[c], buf);
+
+        // Every truncation, and trailing bytes
+        for (size_t n = 0; n < len; n++) {
+            CHECK_EQ(decode(buf, n), ESP_ERR_INVALID_ARG);
+        }
+        buf[len] = 0;
+        CHECK_EQ(decode(buf, len + 1), ESP_ERR_INVALID_ARG);
+
+        // Another version is reported as such, not as garbage
+        buf[0] = CALIB_BLOB_VERSION + 1;
+        CHECK_EQ(decode(buf, len), ESP_ERR_INVALID_VERSION);
+        buf[0] = CALIB_BLOB_VERSION;
+
+        // Unknown type, empty unit
+        buf[1] = CALIB_TYPE_COUNT;
+        CHECK_EQ(decode(buf, len), ESP_ERR_INVALID_ARG);
+        buf[1] = (uint8_t) all[c]->type;
+        buf[2] = '\0';
+        CHECK_EQ(decode(buf, len), ESP_ERR_INVALID_ARG);
+    }
+
+    // Coefficients that aren't numbers
+    uint8_t buf[CALIB_BLOB_MAX];
+    size_t len = calibration_encode(&POLY, buf);
+    const float nan = NAN, inf = INFINITY;
+    memcpy(&buf[len - 4], &nan, sizeof(float));
+    CHECK_EQ(decode(buf, len), ESP_ERR_INVALID_ARG);
+    memcpy(&buf[len - 4], &inf, sizeof(float));
+    CHECK_EQ(decode(buf, len), ESP_ERR_INVALID_ARG);
+
+    // Piecewise tables: bad counts, raw values out of order or out of range
+    const size_t count_at = 2 + CALIB_UNIT_MAX;
+    const size_t point_at = count_at + 1;
+    len = calibration_encode(&PIECEWISE, buf);
+    uint8_t bad[CALIB_BLOB_MAX];
+    for (uint8_t count = 0; count < 2; count++) {
+        memcpy(bad, buf, count_at);
+        bad[count_at] = count;
+        memcpy(&bad[point_at], &buf[point_at], count * 6u);
+        CHECK_EQ(decode(bad, point_at + count * 6u), ESP_ERR_INVALID_ARG);
+    }
+    memcpy(bad, buf, len);
+    bad[count_at] = CALIB_PIECEWISE_MAX + 1;
+    CHECK_EQ(decode(bad, len), ESP_ERR_INVALID_ARG);
+    // More points than the table holds, with a length to match
+    uint8_t big[CALIB_BLOB_MAX + 6] = {0};
+    memcpy(big, buf, point_at);
+    big[count_at] = CALIB_PIECEWISE_MAX + 1;
+    for (int i = 0; i <= CALIB_PIECEWISE_MAX; i++) {
+        uint16_t raw = (uint16_t) (i * 100);
+        memcpy(&big[point_at + i * 6], &raw, sizeof(raw));
+    }
+    CHECK_EQ(decode(big, sizeof(big)), ESP_ERR_INVALID_ARG);
+    memcpy(bad, buf, len);
+    memcpy(&bad[point_at + 6], &bad[point_at], sizeof(uint16_t));  // Repeated raw
+    CHECK_EQ(decode(bad, len), ESP_ERR_INVALID_ARG);
+    memcpy(bad, buf, len);
+    bad[point_at + 3 * 6] = 0x00;  // Last raw 4096
+    bad[point_at + 3 * 6 + 1] = 0x10;
+    CHECK_EQ(decode(bad, len), ESP_ERR_INVALID_ARG);
+
+    // A unit filling all its bytes is cut short, not read past
+    memcpy(bad, buf, len);
+    memset(&bad[2], 'u', CALIB_UNIT_MAX);
+    calibration_t calib;
+    char unit[CALIB_UNIT_MAX];
+    CHECK_EQ(calibration_decode(bad, len, &calib, unit), ESP_OK);
+    CHECK_EQ(strlen(calib.unit), CALIB_UNIT_MAX - 1);
+}
+
+/**
+ * Random corruption: decode never reads out of bounds (ASan watches), and
+ * whatever it accepts is a valid calibration
+ */
+static void test_corruption(void) {
+    const calibration_t *all[] = {&LINEAR, &POLY, &PIECEWISE};
+    unsigned seed = 48;
+    int accepted = 0;
+    for (int iter = 0; iter < 20000; iter++) {
+        uint8_t buf[CALIB_BLOB_MAX];
+        size_t len = calibration_encode(all[iter % 3], buf);
+        int flips = 1 + rand_r(&seed) % 3;
+        for (int i = 0; i < flips; i++) {
+            buf[rand_r(&seed) % len] ^= (uint8_t) (1u << (rand_r(&seed) % 8));
+        }
+        size_t cut = rand_r(&seed) % 4 == 0 ? (size_t) rand_r(&seed) % len : len;
+
+        // Exactly-sized copy so ASan catches reads past the blob
+        uint8_t *blob = malloc(cut > 0 ? cut : 1);
+        memcpy(blob, buf, cut);
+        calibration_t calib;
+        char unit[CALIB_UNIT_MAX];
+        if (calibration_decode(blob, cut, &calib, unit) == ESP_OK) {
+            CHECK_EQ(calibration_validate(&calib), ESP_OK);
+            accepted++;
+        }
+        free(blob);
+    }
+    // Flips in values and unit padding are legitimately accepted
+    CHECK(accepted > 0);
+}
+
+int main(void) {
+    test_reference_values();
+    test_round_trips();
+    test_blob_layout();
+    test_malformed();
+    test_corruption();
+    return test_report("test_calibration");
+}
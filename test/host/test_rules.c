@@ -0,0 +1,325 @@
+// Rule engine (rules.c) replaying sensor traces against mocked actuators
+//
+// Each trace frame is one sample with the actuator outputs expected after
+// it. Also covers reloading the rules while some are active (their exit
+// actions must run) and the evaluation cost per frame.
+
+#include <string.h>
+
+#include "actuators.h"
+#include "nvs.h"
+#include "rules.h"
+#include "test_util.h"
+
+TEST_MAIN_FAILURES;
+
+#define BLINK_DEFAULT_MS 500
+#define FRAME_MAX_US     1000  // Generous: the target takes a few us
+
+// ---- Mocked actuators: just the outputs ----
+
+static const led_info_t LEDS[LED_COUNT] = {
+    [LED_YELLOW_ROOF] = {.gpio = 2, .caps = LED_CAP_ONOFF, .ledc_channel = -1},
+    [LED_WHITE_GARDEN] = {.gpio = 3, .caps = LED_CAP_ONOFF | LED_CAP_DIMMABLE, .ledc_channel = 0},
+};
+
+static uint32_t s_blink_ms = BLINK_DEFAULT_MS;
+static bool s_led_on[LED_COUNT];
+static uint8_t s_brightness[LED_COUNT];
+static int s_actions = 0;
+static bool s_ring_full = false;  // Posting fails as with a full command ring
+
+esp_err_t led_batch_add(led_batch_t *batch, led_id_t id, led_action_t action) {
+    if (action == LED_ACTION_ON) {
+        batch->on_mask |= LED_MASK(id);
+    } else if (action == LED_ACTION_OFF) {
+        batch->off_mask |= LED_MASK(id);
+    }
+    return ESP_OK;
+}
+
+esp_err_t led_post_batch(const led_batch_t *batch) {
+    if (s_ring_full) {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < LED_COUNT; i++) {
+        if (batch->on_mask & LED_MASK(i)) {
+            s_led_on[i] = true;
+        } else if (batch->off_mask & LED_MASK(i)) {
+            s_led_on[i] = false;
+        }
+    }
+    s_actions++;
+    return ESP_OK;
+}
+
+esp_err_t led_post_brightness(led_id_t id, uint8_t brightness, uint32_t fade_ms) {
+    if (s_ring_full) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_brightness[id] = brightness;
+    s_led_on[id] = brightness > 0;
+    s_actions++;
+    return ESP_OK;
+}
+
+esp_err_t led_blink_set_period(uint32_t period_ms) {
+    s_blink_ms = period_ms;
+    s_actions++;
+    return ESP_OK;
+}
+
+const led_info_t *led_get_info(led_id_t id) {
+    return id < LED_COUNT ? &LEDS[id] : NULL;
+}
+
+// ---- Traces ----
+
+// One sample and the outputs expected after it
+typedef struct {
+    uint32_t t_ms;
+    uint8_t sensor;
+    int raw;
+    uint32_t blink_ms;   // Expected blink period
+    bool yellow;         // Expected yellow LED state
+    uint8_t brightness;  // Expected white LED brightness
+} frame_t;
+
+#define W SENSOR_WATER_ROOF
+#define L SENSOR_LIGHT_ROOF
+
+// The default rule plus two light rules:
+//   water > 30 (hysteresis 15)             blink 100 ms, back to 500 ms
+//   light < 1000 (hysteresis 100) for 2 s  yellow on, off
+//   light > 3000 (hysteresis 200)          white at 40, back to 200
+static const rule_def_t RULES[] = {
+    {.sensor = W,
+     .cond = RULE_COND_ABOVE,
+     .threshold = 30,
+     .hysteresis = 15,
+     .enter = {.type = RULE_ACTION_BLINK_PERIOD, .value = 100},
+     .exit = {.type = RULE_ACTION_BLINK_PERIOD, .value = 500}},
+    {.sensor = L,
+     .cond = RULE_COND_BELOW,
+     .threshold = 1000,
+     .hysteresis = 100,
+     .duration_ms = 2000,
+     .enter = {.type = RULE_ACTION_LED_ON, .led = LED_YELLOW_ROOF},
+     .exit = {.type = RULE_ACTION_LED_OFF, .led = LED_YELLOW_ROOF}},
+    {.sensor = L,
+     .cond = RULE_COND_ABOVE,
+     .threshold = 3000,
+     .hysteresis = 200,
+     .enter = {.type = RULE_ACTION_BRIGHTNESS, .led = LED_WHITE_GARDEN, .value = 40},
+     .exit = {.type = RULE_ACTION_BRIGHTNESS, .led = LED_WHITE_GARDEN, .value = 200}},
+};
+#define RULE_COUNT (sizeof(RULES) / sizeof(RULES[0]))
+
+// A shower on the roof at dusk, then a sunny morning
+static const frame_t TRACE[] = {
+    // Dry; water noise below the threshold changes nothing
+    {0, W, 10, 500, false, 0},
+    {0, L, 2000, 500, false, 0},
+    {500, W, 30, 500, false, 0},  // Not above 30 yet
+    // Rain: enter at 31, stay active through the hysteresis band
+    {1000, W, 31, 100, false, 0},
+    {1500, W, 16, 100, false, 0},
+    {2000, W, 15, 100, false, 0},  // Exits below 15, not at it
+    {2500, W, 29, 100, false, 0},
+    {3000, W, 14, 500, false, 0},  // Dry again
+    {3500, W, 20, 500, false, 0},  // Inside the band but inactive: stays off
+    // Dusk: light must stay below 1000 for 2 s
+    {4000, L, 900, 500, false, 0},
+    {5000, L, 950, 500, false, 0},
+    {5500, L, 1050, 500, false, 0},  // Above 1000 again: the 2 s start over
+    {5999, L, 999, 500, false, 0},
+    {7000, L, 800, 500, false, 0},
+    {7999, L, 800, 500, true, 0},  // 2 s since 5999
+    {8500, W, 200, 100, true, 0},  // Rain at night
+    // Dawn: light must stay above 1100 for 2 s to switch the LED off
+    {9000, L, 1200, 100, true, 0},
+    {10000, L, 1000, 100, true, 0},  // Dipped back: the pending exit is cancelled
+    {10500, L, 1150, 100, true, 0},
+    {12499, L, 1500, 100, true, 0},
+    {12500, L, 1600, 100, false, 0},
+    // Sunny morning: the other light rule, no duration
+    {13000, L, 3001, 100, false, 40},
+    {13500, L, 2801, 100, false, 40},  // Above 3000 - 200
+    {14000, L, 2799, 100, false, 200},
+    {14500, W, 0, 500, false, 200},
+};
+#define FRAME_COUNT (sizeof(TRACE) / sizeof(TRACE[0]))
+
+static void reset_outputs(void) {
+    s_blink_ms = BLINK_DEFAULT_MS;
+    memset(s_led_on, 0, sizeof(s_led_on));
+    memset(s_brightness, 0, sizeof(s_brightness));
+    s_actions = 0;
+}
+
+/**
+ * Feed a trace and check the outputs after every frame
+ *
+ * @return Rules checked in total (only those of each frame's sensor)
+ */
+static uint32_t replay(const frame_t *trace, size_t count, const int rules_per_sensor[]) {
+    uint32_t checked = 0;
+    for (size_t i = 0; i < count; i++) {
+        const frame_t *f = &trace[i];
+        rules_on_sample((sensor_id_t) f->sensor, f->raw, f->t_ms);
+        checked += rules_per_sensor[f->sensor];
+
+        if (s_blink_ms != f->blink_ms || s_led_on[LED_YELLOW_ROOF] != f->yellow ||
+            s_brightness[LED_WHITE_GARDEN] != f->brightness) {
+            fprintf(stderr, "frame %zu (t=%lu sensor %d raw %d): blink %lu yellow %d white %u, "
+                    "expected %lu %d %u\n",
+                    i, (unsigned long) f->t_ms, f->sensor, f->raw, (unsigned long) s_blink_ms,
+                    s_led_on[LED_YELLOW_ROOF], s_brightness[LED_WHITE_GARDEN],
+                    (unsigned long) f->blink_ms, f->yellow, f->brightness);
+            g_test_failures++;
+        }
+    }
+    return checked;
+}
+
+static void test_trace(void) {
+    reset_outputs();
+    CHECK_EQ(rules_load(RULES, RULE_COUNT, false), ESP_OK);
+
+    rules_stats_t before, after;
+    rules_get_stats(&before);
+    const int per_sensor[SENSOR_COUNT] = {[L] = 2, [W] = 1};
+    uint32_t checked = replay(TRACE, FRAME_COUNT, per_sensor);
+    rules_get_stats(&after);
+
+    // Cost per frame: only the frame's sensor's rules, and quickly
+    CHECK_EQ(after.frames - before.frames, FRAME_COUNT);
+    CHECK_EQ(after.rules_checked - before.rules_checked, checked);
+    CHECK(after.max_eval_us < FRAME_MAX_US);
+    CHECK_EQ(after.transitions - before.transitions, 8);
+    fprintf(stderr, "trace: %zu frames, %lu rules checked, %lu transitions, max %lu us/frame\n",
+            FRAME_COUNT, (unsigned long) checked,
+            (unsigned long) (after.transitions - before.transitions),
+            (unsigned long) after.max_eval_us);
+}
+
+/**
+ * Reloading while rules are active runs their exit actions
+ */
+static void test_reload_runs_exits(void) {
+    reset_outputs();
+    CHECK_EQ(rules_load(RULES, RULE_COUNT, false), ESP_OK);
+
+    // Raining and dark: the fast blink and the yellow LED are on
+    rules_on_sample(W, 100, 0);
+    rules_on_sample(L, 500, 0);
+    rules_on_sample(L, 500, 2000);
+    CHECK_EQ(s_blink_ms, 100);
+    CHECK(s_led_on[LED_YELLOW_ROOF]);
+
+    // A table without the water rule: the blink must not stay fast
+    CHECK_EQ(rules_load(&RULES[1], 2, false), ESP_OK);
+    CHECK_EQ(s_blink_ms, BLINK_DEFAULT_MS);
+    CHECK(!s_led_on[LED_YELLOW_ROOF]);
+
+    // New rules start inactive and enter on the next sample
+    rules_on_sample(L, 500, 3000);
+    CHECK(!s_led_on[LED_YELLOW_ROOF]);  // Duration starts over
+    rules_on_sample(L, 500, 5000);
+    CHECK(s_led_on[LED_YELLOW_ROOF]);
+
+    // Inactive rules have nothing to undo
+    rules_on_sample(L, 2000, 5000);
+    rules_on_sample(L, 2000, 7000);
+    CHECK(!s_led_on[LED_YELLOW_ROOF]);
+    int actions = s_actions;
+    CHECK_EQ(rules_load(NULL, 0, false), ESP_OK);
+    CHECK_EQ(s_actions, actions);
+
+    // An invalid table changes nothing, active rules stay active
+    CHECK_EQ(rules_load(RULES, 1, false), ESP_OK);
+    rules_on_sample(W, 100, 8000);
+    CHECK_EQ(s_blink_ms, 100);
+    rule_def_t bad = RULES[0];
+    bad.enter.value = 1;  // Below the minimum blink period
+    CHECK_EQ(rules_load(&bad, 1, false), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(s_blink_ms, 100);
+    rules_on_sample(W, 0, 8500);
+    CHECK_EQ(s_blink_ms, BLINK_DEFAULT_MS);
+}
+
+/**
+ * A full actuator queue loses the action but never blocks the engine
+ */
+static void test_queue_full(void) {
+    reset_outputs();
+    CHECK_EQ(rules_load(RULES, 1, false), ESP_OK);
+    rules_stats_t before, after;
+    rules_get_stats(&before);
+
+    s_ring_full = true;
+    rules_on_sample(W, 100, 0);  // Enters, blink period still posts (timer queue)
+    rules_on_sample(W, 0, 500);
+    CHECK_EQ(rules_load(&RULES[1], 1, false), ESP_OK);
+    rules_on_sample(L, 500, 1000);
+    rules_on_sample(L, 500, 3000);  // Yellow on: not posted
+    CHECK(!s_led_on[LED_YELLOW_ROOF]);
+    s_ring_full = false;
+
+    rules_get_stats(&after);
+    CHECK_EQ(after.actions_dropped - before.actions_dropped, 1);
+    CHECK_EQ(after.transitions - before.transitions, 3);
+
+    // The rule is active regardless, and its exit goes through
+    int actions = s_actions;
+    rules_on_sample(L, 2000, 4000);
+    rules_on_sample(L, 2000, 6000);
+    CHECK_EQ(s_actions, actions + 1);
+    CHECK(!s_led_on[LED_YELLOW_ROOF]);
+    rules_get_stats(&after);
+    CHECK_EQ(after.transitions - before.transitions, 4);
+}
+
+/**
+ * Persisted rules come back at init, defaults otherwise
+ */
+static void test_persist(void) {
+    reset_outputs();
+    rule_def_t defs[RULES_MAX];
+    CHECK_EQ(rules_load(&RULES[1], 2, true), ESP_OK);
+
+    // Reboot: the stored table comes back
+    CHECK_EQ(rules_init(), ESP_OK);
+    CHECK_EQ(rules_get(defs, RULES_MAX), 2);
+    CHECK(memcmp(defs, &RULES[1], 2 * sizeof(rule_def_t)) == 0);
+
+    // A table that can't be stored isn't installed either
+    host_nvs_fail_writes(1);
+    CHECK(rules_load(&RULES[0], 1, true) != ESP_OK);
+    CHECK_EQ(rules_get(defs, RULES_MAX), 2);
+    CHECK(memcmp(defs, &RULES[1], 2 * sizeof(rule_def_t)) == 0);
+    CHECK_EQ(rules_init(), ESP_OK);
+    CHECK_EQ(rules_get(defs, RULES_MAX), 2);
+
+    // Erased NVS: back to the default rule
+    host_nvs_erase_all();
+    CHECK_EQ(rules_init(), ESP_OK);
+    CHECK_EQ(rules_get(defs, RULES_MAX), 1);
+    CHECK(memcmp(defs, &RULES[0], sizeof(rule_def_t)) == 0);
+}
+
+int main(void) {
+    // First boot: the default rule (the water rule of RULES)
+    host_nvs_erase_all();
+    CHECK_EQ(rules_init(), ESP_OK);
+    rule_def_t defs[RULES_MAX];
+    CHECK_EQ(rules_get(defs, RULES_MAX), 1);
+    CHECK(memcmp(&defs[0], &RULES[0], sizeof(rule_def_t)) == 0);
+
+    test_trace();
+    test_reload_runs_exits();
+    test_queue_full();
+    test_persist();
+
+    return test_report("test_rules");
+}
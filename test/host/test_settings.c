@@ -0,0 +1,274 @@
+// Settings store (settings.c) over the in-memory NVS
+//
+// Runs the real settings task, with the commit delays shortened by the
+// build (CMakeLists.txt). Covers first boot, batched commits, all-or-none
+// updates as PATCH /api/config makes them, a commit that fails and is
+// retried, reboots over stored and damaged values, and the migration from
+// the "wifi_config" layout of schema version 1.
+
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "metrics.h"
+#include "nvs.h"
+#include "sdkconfig.h"
+#include "settings.h"
+#include "test_util.h"
+
+TEST_MAIN_FAILURES;
+
+#define WAIT_MAX_MS 3000  // For a commit, many times the configured delays
+
+// ---- Mocked metrics: the collector's last samples ----
+
+static metrics_collector_t s_collector;
+static int64_t s_pending_sample = -1;
+
+esp_err_t metrics_register_collector(metrics_collector_t fn, void *arg) {
+    s_collector = fn;
+    return ESP_OK;
+}
+
+void metrics_write_family(metrics_writer_t *w, const char *name, metric_type_t type,
+                          const char *help) {
+}
+
+void metrics_write_sample(metrics_writer_t *w, const char *name, const char *labels,
+                          int64_t value) {
+    if (strcmp(name, "geekhouse_settings_pending") == 0) {
+        s_pending_sample = value;
+    }
+}
+
+// ---- Helpers ----
+
+static settings_stats_t stats(void) {
+    settings_stats_t s;
+    CHECK_EQ(settings_get_stats(&s), ESP_OK);
+    return s;
+}
+
+/**
+ * Wait for the settings task to reach `commits` commits with nothing pending
+ */
+static bool wait_committed(uint32_t commits) {
+    for (int waited = 0; waited < WAIT_MAX_MS; waited += 5) {
+        settings_stats_t s = stats();
+        if (s.commits >= commits && s.pending == 0) {
+            return true;
+        }
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    return false;
+}
+
+static nvs_handle_t open_ns(const char *name) {
+    nvs_handle_t handle = 0;
+    CHECK_EQ(nvs_open(name, NVS_READWRITE, &handle), ESP_OK);
+    return handle;
+}
+
+static uint32_t stored_u32(const char *key) {
+    uint32_t value = 0;
+    CHECK_EQ(nvs_get_u32(open_ns("settings"), key, &value), ESP_OK);
+    return value;
+}
+
+static bool str_is(setting_key_t key, const char *want) {
+    char value[SETTINGS_STR_MAX + 1];
+    return settings_get_str(key, value, sizeof(value)) == ESP_OK && strcmp(value, want) == 0;
+}
+
+// ---- Tests ----
+
+/**
+ * Nothing stored: defaults, and the schema version goes out with the first commit
+ */
+static void test_first_boot(void) {
+    host_nvs_erase_all();
+    CHECK_EQ(settings_init(), ESP_OK);
+    CHECK(str_is(SETTING_WIFI_SSID, CONFIG_GEEKHOUSE_WIFI_SSID));
+    CHECK(str_is(SETTING_WIFI_PASSWORD, CONFIG_GEEKHOUSE_WIFI_PASSWORD));
+    CHECK_EQ(settings_get_u32(SETTING_SENSOR_PERIOD_MS), 2000);
+    CHECK_EQ(settings_get_u32(SETTING_LOG_LEVEL), CONFIG_LOG_DEFAULT_LEVEL);
+    CHECK_EQ(esp_log_level_get("*"), CONFIG_LOG_DEFAULT_LEVEL);
+    settings_stats_t s = stats();
+    CHECK_EQ(s.loaded_version, 0);
+    CHECK_EQ(s.schema_version, SETTINGS_SCHEMA_VERSION);
+    uint8_t version;
+    CHECK_EQ(nvs_get_u8(open_ns("settings"), "version", &version), ESP_ERR_NVS_NOT_FOUND);
+
+    CHECK(settings_find("sensor.period_ms") == SETTING_SENSOR_PERIOD_MS);
+    CHECK(settings_find("sensor.period") == SETTING_COUNT);
+    CHECK(settings_get_def(SETTING_COUNT) == NULL);
+}
+
+/**
+ * A burst of changes applies at once and reaches NVS in one commit
+ */
+static void test_batched_commit(void) {
+    uint32_t commits = stats().commits;
+    for (uint32_t period = 1000; period <= 5000; period += 1000) {
+        setting_update_t update = {.key = SETTING_SENSOR_PERIOD_MS, .u32 = period};
+        CHECK_EQ(settings_update(&update, 1), ESP_OK);
+        CHECK_EQ(settings_get_u32(SETTING_SENSOR_PERIOD_MS), period);  // Readers see it now
+    }
+    setting_update_t level = {.key = SETTING_LOG_LEVEL, .u32 = ESP_LOG_DEBUG};
+    CHECK_EQ(settings_update(&level, 1), ESP_OK);
+    CHECK_EQ(esp_log_level_get("*"), ESP_LOG_DEBUG);  // Applied live
+
+    CHECK(stats().pending == 2);
+    s_collector(NULL, NULL);
+    CHECK_EQ(s_pending_sample, 2);
+
+    CHECK(wait_committed(commits + 1));
+    settings_stats_t s = stats();
+    CHECK_EQ(s.commits, commits + 1);
+    CHECK_EQ(s.keys_written, 2);
+    CHECK_EQ(stored_u32("period_ms"), 5000);
+    CHECK_EQ(stored_u32("log_level"), ESP_LOG_DEBUG);
+    uint8_t version = 0;
+    CHECK_EQ(nvs_get_u8(open_ns("settings"), "version", &version), ESP_OK);
+    CHECK_EQ(version, SETTINGS_SCHEMA_VERSION);
+}
+
+/**
+ * One bad change in a set refuses the whole set, as PATCH /api/config relies on
+ */
+static void test_all_or_none(void) {
+    settings_stats_t before = stats();
+    const char *long_ssid = "0123456789012345678901234567890123";  // 34 > 32
+    setting_update_t updates[] = {
+        {.key = SETTING_WIFI_SSID, .str = "garden"},
+        {.key = SETTING_SENSOR_PERIOD_MS, .u32 = 700},
+        {.key = SETTING_LOG_LEVEL, .u32 = ESP_LOG_VERBOSE + 1},
+    };
+    CHECK_EQ(settings_update(updates, 3), ESP_ERR_INVALID_ARG);
+    updates[2] = (setting_update_t) {.key = SETTING_WIFI_PASSWORD, .str = NULL};
+    CHECK_EQ(settings_update(updates, 3), ESP_ERR_INVALID_ARG);
+    updates[2] = (setting_update_t) {.key = SETTING_WIFI_SSID, .str = long_ssid};
+    CHECK_EQ(settings_update(updates, 3), ESP_ERR_INVALID_ARG);
+    updates[2] = (setting_update_t) {.key = SETTING_COUNT, .u32 = 1};
+    CHECK_EQ(settings_update(updates, 3), ESP_ERR_INVALID_ARG);
+
+    CHECK(str_is(SETTING_WIFI_SSID, CONFIG_GEEKHOUSE_WIFI_SSID));
+    CHECK_EQ(settings_get_u32(SETTING_SENSOR_PERIOD_MS), 5000);
+    settings_stats_t s = stats();
+    CHECK_EQ(s.rejected, before.rejected + 4);
+    CHECK_EQ(s.updates, before.updates);
+    CHECK_EQ(s.pending, 0);
+
+    // Limits are inclusive; the string buffer must fit the value
+    setting_update_t edge = {.key = SETTING_SENSOR_PERIOD_MS, .u32 = 60000};
+    CHECK_EQ(settings_validate(&edge), ESP_OK);
+    edge.u32 = 60001;
+    CHECK_EQ(settings_validate(&edge), ESP_ERR_INVALID_ARG);
+    char small[4];
+    CHECK_EQ(settings_get_str(SETTING_WIFI_SSID, small, sizeof(small)), ESP_ERR_INVALID_SIZE);
+    CHECK_EQ(settings_get_str(SETTING_SENSOR_PERIOD_MS, small, sizeof(small)),
+             ESP_ERR_INVALID_ARG);
+}
+
+/**
+ * A failed commit keeps its keys dirty and is retried after SETTINGS_RETRY_MS
+ */
+static void test_commit_retry(void) {
+    settings_stats_t before = stats();
+    setting_update_t updates[] = {
+        {.key = SETTING_WIFI_SSID, .str = "garden"},
+        {.key = SETTING_WIFI_PASSWORD, .str = "hunter22"},
+    };
+    host_nvs_fail_writes(1);
+    int64_t start = esp_timer_get_time();
+    CHECK_EQ(settings_update(updates, 2), ESP_OK);
+    CHECK(str_is(SETTING_WIFI_SSID, "garden"));
+
+    for (int waited = 0; stats().commit_failures == before.commit_failures; waited += 5) {
+        if (waited >= WAIT_MAX_MS) {
+            CHECK(!"commit never attempted");
+            return;
+        }
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    settings_stats_t s = stats();
+    CHECK_EQ(s.commit_failures, before.commit_failures + 1);
+    CHECK_EQ(s.pending, 2);
+
+    CHECK(wait_committed(before.commits + 1));
+    CHECK(esp_timer_get_time() - start >= SETTINGS_RETRY_MS * 1000);
+    s = stats();
+    CHECK_EQ(s.commits, before.commits + 1);
+    CHECK_EQ(s.commit_failures, before.commit_failures + 1);
+    CHECK_EQ(s.keys_written, before.keys_written + 2);
+
+    char value[SETTINGS_STR_MAX + 1];
+    size_t len = sizeof(value);
+    CHECK_EQ(nvs_get_str(open_ns("settings"), "password", value, &len), ESP_OK);
+    CHECK(strcmp(value, "hunter22") == 0);
+}
+
+/**
+ * Reboot: stored values come back; unusable ones fall back to their default
+ */
+static void test_reboot(void) {
+    CHECK_EQ(settings_init(), ESP_OK);
+    CHECK_EQ(stats().loaded_version, SETTINGS_SCHEMA_VERSION);
+    CHECK(str_is(SETTING_WIFI_SSID, "garden"));
+    CHECK(str_is(SETTING_WIFI_PASSWORD, "hunter22"));
+    CHECK_EQ(settings_get_u32(SETTING_SENSOR_PERIOD_MS), 5000);
+    CHECK_EQ(esp_log_level_get("*"), ESP_LOG_DEBUG);
+
+    // Out of range, and stored as the wrong type
+    nvs_handle_t handle = open_ns("settings");
+    CHECK_EQ(nvs_set_u32(handle, "period_ms", 5), ESP_OK);
+    CHECK_EQ(nvs_set_str(handle, "log_level", "debug"), ESP_OK);
+    CHECK_EQ(settings_init(), ESP_OK);
+    CHECK_EQ(settings_get_u32(SETTING_SENSOR_PERIOD_MS), 2000);
+    CHECK_EQ(settings_get_u32(SETTING_LOG_LEVEL), CONFIG_LOG_DEFAULT_LEVEL);
+    CHECK(str_is(SETTING_WIFI_SSID, "garden"));
+}
+
+/**
+ * Schema version 1: credentials move from "wifi_config", which is then erased
+ */
+static void test_migration(void) {
+    host_nvs_erase_all();
+    nvs_handle_t legacy = open_ns("wifi_config");
+    CHECK_EQ(nvs_set_str(legacy, "ssid", "attic"), ESP_OK);
+    CHECK_EQ(nvs_set_str(legacy, "password", "s3cret"), ESP_OK);
+
+    // A failed migration leaves the old layout to try again next boot
+    host_nvs_fail_writes(1);
+    CHECK_EQ(settings_init(), ESP_OK);
+    CHECK(str_is(SETTING_WIFI_SSID, CONFIG_GEEKHOUSE_WIFI_SSID));
+    size_t len = 0;
+    CHECK_EQ(nvs_get_str(legacy, "ssid", NULL, &len), ESP_OK);
+
+    CHECK_EQ(settings_init(), ESP_OK);
+    CHECK_EQ(stats().loaded_version, 1);
+    CHECK(str_is(SETTING_WIFI_SSID, "attic"));
+    CHECK(str_is(SETTING_WIFI_PASSWORD, "s3cret"));
+    CHECK_EQ(nvs_get_str(legacy, "ssid", NULL, &len), ESP_ERR_NVS_NOT_FOUND);
+    uint8_t version = 0;
+    CHECK_EQ(nvs_get_u8(open_ns("settings"), "version", &version), ESP_OK);
+    CHECK_EQ(version, SETTINGS_SCHEMA_VERSION);
+
+    // And the next boot reads the new layout
+    CHECK_EQ(settings_init(), ESP_OK);
+    CHECK_EQ(stats().loaded_version, SETTINGS_SCHEMA_VERSION);
+    CHECK(str_is(SETTING_WIFI_SSID, "attic"));
+}
+
+int main(void) {
+    test_first_boot();
+    CHECK_EQ(xTaskCreate(settings_task, "settings", 4096, NULL, 2, NULL), pdPASS);
+    test_batched_commit();
+    test_all_or_none();
+    test_commit_retry();
+    test_reboot();
+    test_migration();
+    return test_report("test_settings");
+}
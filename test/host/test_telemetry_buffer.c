@@ -0,0 +1,338 @@
+// Telemetry store-and-forward (telemetry_buffer.c) over a file-backed flash
+//
+// The file behaves like NOR flash: erase sets sectors to 0xff and a write
+// to bytes that aren't erased fails the test, so a missing erase shows up
+// even though a file would happily take the data. Covers an outage that
+// spills to flash, a log that wraps, a reboot over a dirty log, and flash
+// failures, including one halfway through a spill.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "telemetry_buffer.h"
+#include "test_util.h"
+
+TEST_MAIN_FAILURES;
+
+#define SECTOR_SIZE  4096
+#define SECTORS      4
+#define RECORD_SIZE  12  // telemetry_record_t
+#define PER_SECTOR   (SECTOR_SIZE / RECORD_SIZE)
+#define CAPACITY     (SECTORS * PER_SECTOR)
+#define BATCH        10  // Readings per publish, as MQTT_BATCH_MAX
+
+// ---- File-backed flash ----
+
+typedef struct {
+    FILE *file;
+    int erases;
+    int fail_writes;  // Fail the next n writes
+    int pass_writes;  // ... after letting this many through
+    int fail_reads;   // Fail the next n reads
+} file_flash_t;
+
+static esp_err_t file_read(void *ctx, size_t offset, void *dst, size_t len) {
+    file_flash_t *f = ctx;
+    CHECK(offset + len <= SECTOR_SIZE * SECTORS);
+    if (f->fail_reads > 0) {
+        f->fail_reads--;
+        return ESP_FAIL;
+    }
+    fseek(f->file, (long) offset, SEEK_SET);
+    return fread(dst, 1, len, f->file) == len ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t file_write(void *ctx, size_t offset, const void *src, size_t len) {
+    file_flash_t *f = ctx;
+    CHECK(offset + len <= SECTOR_SIZE * SECTORS);
+    CHECK(offset / SECTOR_SIZE == (offset + len - 1) / SECTOR_SIZE);  // One sector per write
+    if (f->fail_writes > 0 && f->pass_writes > 0) {
+        f->pass_writes--;
+    } else if (f->fail_writes > 0) {
+        f->fail_writes--;
+        return ESP_FAIL;
+    }
+
+    uint8_t old[SECTOR_SIZE];
+    fseek(f->file, (long) offset, SEEK_SET);
+    CHECK(fread(old, 1, len, f->file) == len);
+    for (size_t i = 0; i < len; i++) {
+        if (old[i] != 0xff) {
+            fprintf(stderr, "write to unerased flash at 0x%zx\n", offset + i);
+            g_test_failures++;
+            return ESP_FAIL;
+        }
+    }
+    fseek(f->file, (long) offset, SEEK_SET);
+    return fwrite(src, 1, len, f->file) == len ? ESP_OK : ESP_FAIL;
+}
+
+static esp_err_t file_erase(void *ctx, size_t offset, size_t len) {
+    file_flash_t *f = ctx;
+    CHECK(offset % SECTOR_SIZE == 0 && len % SECTOR_SIZE == 0);
+    CHECK(offset + len <= SECTOR_SIZE * SECTORS);
+    uint8_t erased[SECTOR_SIZE];
+    memset(erased, 0xff, sizeof(erased));
+    fseek(f->file, (long) offset, SEEK_SET);
+    for (size_t done = 0; done < len; done += SECTOR_SIZE) {
+        fwrite(erased, 1, SECTOR_SIZE, f->file);
+    }
+    f->erases++;
+    return ESP_OK;
+}
+
+static file_flash_t s_file;
+
+static telemetry_flash_t file_backend(void) {
+    return (telemetry_flash_t) {.read = file_read,
+                                .write = file_write,
+                                .erase = file_erase,
+                                .size = SECTOR_SIZE * SECTORS,
+                                .sector_size = SECTOR_SIZE,
+                                .ctx = &s_file};
+}
+
+/**
+ * A partition as it comes from the factory or an old firmware: not erased
+ */
+static void file_flash_open(void) {
+    s_file = (file_flash_t) {.file = tmpfile()};
+    CHECK(s_file.file != NULL);
+    uint8_t junk[SECTOR_SIZE];
+    memset(junk, 0x5a, sizeof(junk));
+    for (int i = 0; i < SECTORS; i++) {
+        fwrite(junk, 1, sizeof(junk), s_file.file);
+    }
+}
+
+// ---- Readings ----
+
+// Reading n of a test run: everything derives from n, so order can be checked
+static sensor_reading_t reading(uint32_t n) {
+    return (sensor_reading_t) {.id = (sensor_id_t) (n % SENSOR_COUNT),
+                               .raw_value = (int) (n % 4096),
+                               .calibrated_value = (float) n * 0.5f,
+                               .unit = "lux",
+                               .timestamp = n * 100};
+}
+
+static void push_range(uint32_t first, uint32_t count) {
+    for (uint32_t n = first; n < first + count; n++) {
+        sensor_reading_t r = reading(n);
+        telemetry_buffer_push(&r);
+    }
+}
+
+/**
+ * Drain everything in publish-sized batches and check it is first..first+count-1
+ */
+static void drain_expect(uint32_t first, uint32_t count) {
+    sensor_reading_t batch[BATCH];
+    uint32_t next = first;
+    size_t n;
+    while ((n = telemetry_buffer_peek(batch, BATCH)) > 0) {
+        for (size_t i = 0; i < n; i++, next++) {
+            sensor_reading_t want = reading(next);
+            if (batch[i].timestamp != want.timestamp || batch[i].id != want.id ||
+                batch[i].raw_value != want.raw_value ||
+                batch[i].calibrated_value != want.calibrated_value) {
+                fprintf(stderr, "reading %lu: got timestamp %lu\n", (unsigned long) next,
+                        (unsigned long) batch[i].timestamp);
+                g_test_failures++;
+                return;
+            }
+            CHECK(batch[i].unit == NULL);  // Units are not kept
+        }
+        telemetry_buffer_consume(n);
+    }
+    CHECK_EQ(next, first + count);
+    CHECK_EQ(telemetry_buffer_pending(), 0);
+}
+
+static telemetry_buffer_stats_t stats(void) {
+    telemetry_buffer_stats_t s;
+    CHECK_EQ(telemetry_buffer_get_stats(&s), ESP_OK);
+    return s;
+}
+
+// ---- Tests ----
+
+/**
+ * Outage: RAM fills, spills to flash, everything replays oldest-first
+ */
+static void test_outage(void) {
+    file_flash_open();
+    telemetry_flash_t flash = file_backend();
+    CHECK_EQ(telemetry_buffer_init(&flash), ESP_OK);
+    CHECK_EQ(stats().flash_capacity, CAPACITY);
+    CHECK_EQ(s_file.erases, 0);  // Erased lazily, not at init
+
+    push_range(0, 1000);
+    telemetry_buffer_stats_t s = stats();
+    CHECK_EQ(s.buffered, 1000);
+    CHECK_EQ(s.dropped, 0);
+    CHECK_EQ(s.spills, (1000 - 1) / TELEMETRY_RAM_CAPACITY);
+    CHECK_EQ(s.pending_flash, s.spills * TELEMETRY_RAM_CAPACITY);
+    CHECK_EQ(s.pending_ram, 1000 - s.pending_flash);
+    CHECK_EQ(s_file.erases, (s.pending_flash + PER_SECTOR - 1) / PER_SECTOR);
+
+    // A publish that only got part of a batch out
+    sensor_reading_t batch[BATCH];
+    CHECK_EQ(telemetry_buffer_peek(batch, BATCH), BATCH);
+    telemetry_buffer_consume(3);
+    CHECK_EQ(stats().replayed, 3);
+
+    drain_expect(3, 997);
+    s = stats();
+    CHECK_EQ(s.replayed, 1000);
+    CHECK_EQ(s.pending_flash, 0);
+    CHECK_EQ(s.pending_ram, 0);
+}
+
+/**
+ * Long outage: the log wraps and drops its oldest sectors, the newest survive
+ */
+static void test_wrap(void) {
+    file_flash_open();
+    telemetry_flash_t flash = file_backend();
+    CHECK_EQ(telemetry_buffer_init(&flash), ESP_OK);
+
+    const uint32_t total = 3 * CAPACITY;
+    push_range(0, total);
+    telemetry_buffer_stats_t s = stats();
+    uint32_t pending = s.pending_flash + s.pending_ram;
+    CHECK_EQ(s.buffered, total);
+    CHECK_EQ(s.dropped + pending, total);
+    // Whole sectors go at a time, so between 3 and 4 sectors stay pending
+    CHECK(s.pending_flash > CAPACITY - PER_SECTOR);
+    CHECK(s.pending_flash <= CAPACITY);
+    CHECK_EQ(s.flash_errors, 0);
+
+    // Newest readings, still in order and without gaps
+    drain_expect(total - pending, pending);
+    s = stats();
+    CHECK_EQ(s.replayed + s.dropped, s.buffered);
+}
+
+/**
+ * Reboot over a log with undelivered readings
+ *
+ * Timestamps count from boot, so readings of an earlier boot are not
+ * replayed (see telemetry_buffer.h): the log starts empty, and new
+ * readings are written over the dirty sectors after erasing them.
+ */
+static void test_reboot(void) {
+    file_flash_open();
+    telemetry_flash_t flash = file_backend();
+    CHECK_EQ(telemetry_buffer_init(&flash), ESP_OK);
+    push_range(0, 1500);  // Mostly in flash, part of the way into sector 5 of 4
+    CHECK(stats().pending_flash > 0);
+
+    // Reboot: same flash, fresh buffer
+    CHECK_EQ(telemetry_buffer_init(&flash), ESP_OK);
+    telemetry_buffer_stats_t s = stats();
+    CHECK_EQ(telemetry_buffer_pending(), 0);
+    CHECK_EQ(s.buffered, 0);
+    CHECK_EQ(s.pending_flash, 0);
+
+    // The next outage replays exactly its own readings
+    push_range(100000, 700);
+    CHECK(stats().pending_flash > PER_SECTOR);  // Into a second dirty sector
+    drain_expect(100000, 700);
+    CHECK_EQ(stats().flash_errors, 0);
+}
+
+/**
+ * Flash failures lose readings but never wedge the buffer
+ */
+static void test_flash_errors(void) {
+    file_flash_open();
+    telemetry_flash_t flash = file_backend();
+    CHECK_EQ(telemetry_buffer_init(&flash), ESP_OK);
+
+    // A failed spill keeps RAM full: the oldest reading makes way
+    push_range(0, TELEMETRY_RAM_CAPACITY);
+    s_file.fail_writes = 1;
+    push_range(TELEMETRY_RAM_CAPACITY, 1);
+    telemetry_buffer_stats_t s = stats();
+    CHECK_EQ(s.flash_errors, 1);
+    CHECK_EQ(s.dropped, 1);
+    CHECK_EQ(s.pending_ram, TELEMETRY_RAM_CAPACITY);
+
+    // The next spill works, including the sector the failed one erased
+    push_range(TELEMETRY_RAM_CAPACITY + 1, 1);
+    s = stats();
+    CHECK_EQ(s.spills, 1);
+    CHECK_EQ(s.pending_flash, TELEMETRY_RAM_CAPACITY);
+
+    // An unreadable chunk is dropped rather than retried for ever
+    sensor_reading_t batch[BATCH];
+    s_file.fail_reads = 1;
+    CHECK_EQ(telemetry_buffer_peek(batch, BATCH), 0);
+    s = stats();
+    CHECK_EQ(s.flash_errors, 2);
+    CHECK_EQ(s.dropped, 1 + BATCH);
+    drain_expect(1 + BATCH, TELEMETRY_RAM_CAPACITY + 1 - BATCH);
+}
+
+/**
+ * A spill that fails in its second sector keeps only what didn't reach flash
+ */
+static void test_partial_spill(void) {
+    file_flash_open();
+    telemetry_flash_t flash = file_backend();
+    CHECK_EQ(telemetry_buffer_init(&flash), ESP_OK);
+
+    // Spills until the next one straddles the end of sector 0
+    uint32_t spills = PER_SECTOR / TELEMETRY_RAM_CAPACITY;
+    uint32_t first_part = PER_SECTOR - spills * TELEMETRY_RAM_CAPACITY;
+    CHECK(first_part > 0);
+    push_range(0, (spills + 1) * TELEMETRY_RAM_CAPACITY);
+    CHECK_EQ(stats().spills, spills);
+
+    // Sector 0 takes its part, the write into sector 1 fails
+    s_file.pass_writes = 1;
+    s_file.fail_writes = 1;
+    push_range((spills + 1) * TELEMETRY_RAM_CAPACITY, 1);
+    telemetry_buffer_stats_t s = stats();
+    CHECK_EQ(s.flash_errors, 1);
+    CHECK_EQ(s.dropped, 0);  // RAM had room again
+    CHECK_EQ(s.pending_flash, PER_SECTOR);
+    CHECK_EQ(s.pending_ram, TELEMETRY_RAM_CAPACITY - first_part + 1);
+
+    // Each reading exactly once, the retry included
+    push_range((spills + 1) * TELEMETRY_RAM_CAPACITY + 1, TELEMETRY_RAM_CAPACITY);
+    CHECK_EQ(stats().flash_errors, 1);
+    drain_expect(0, (spills + 2) * TELEMETRY_RAM_CAPACITY + 1);
+}
+
+/**
+ * Without a partition only the RAM ring buffers, dropping its oldest
+ */
+static void test_ram_only(void) {
+    CHECK_EQ(telemetry_buffer_init(NULL), ESP_OK);
+    CHECK_EQ(stats().flash_capacity, 0);
+    push_range(0, TELEMETRY_RAM_CAPACITY + 36);
+    telemetry_buffer_stats_t s = stats();
+    CHECK_EQ(s.dropped, 36);
+    CHECK_EQ(s.spills, 0);
+    drain_expect(36, TELEMETRY_RAM_CAPACITY);
+
+    telemetry_flash_t bad = file_backend();
+    bad.size = SECTOR_SIZE / 2;  // Smaller than a sector
+    CHECK_EQ(telemetry_buffer_init(&bad), ESP_ERR_INVALID_ARG);
+    bad = file_backend();
+    bad.erase = NULL;
+    CHECK_EQ(telemetry_buffer_init(&bad), ESP_ERR_INVALID_ARG);
+    CHECK_EQ(telemetry_buffer_get_stats(NULL), ESP_ERR_INVALID_ARG);
+}
+
+int main(void) {
+    test_outage();
+    test_wrap();
+    test_reboot();
+    test_flash_errors();
+    test_partial_spill();
+    test_ram_only();
+    return test_report("test_telemetry_buffer");
+}
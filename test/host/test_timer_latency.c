@@ -0,0 +1,180 @@
+// Timer service latency under HTTP-style LED load, before and after the
+// blink timer stopped waiting for the LEDs
+//
+// A 5 ms probe timer shares the timer service with a 10 ms blink timer
+// while four tasks hammer led_apply_batch()/led_set_brightness() the way
+// HTTP handlers do. Every register and duty write takes WRITE_COST_US, like
+// a driver call waiting for the peripheral. The probe's lateness against its
+// schedule is what every other software timer in the system would see.
+//   no blink  the load alone, for reference
+//   before    the blink callback toggles with led_apply_batch() and waits until
+//             it has been applied, as the callback did when it took the LED mutex
+//   after     the real blink timer (led_blink_start), which only posts a batch
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "actuators.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+#include "mock_outputs.h"
+#include "test_util.h"
+
+TEST_MAIN_FAILURES;
+
+#define WRITE_COST_US    500
+#define LOAD_TASKS       4
+#define PHASE_MS         1500
+#define PROBE_PERIOD_MS  5
+#define BLINK_PERIOD_MS  10
+#define AFTER_MAX_LATE_US 20000  // Generous: host scheduling, sanitizers
+
+// Results of one phase
+typedef struct {
+    int64_t probe_start_us;
+    int64_t probe_max_late_us;
+    int64_t probe_total_late_us;
+    uint32_t probe_ticks;
+    int64_t blink_max_us;  // Longest blink callback (before only)
+} phase_t;
+
+static phase_t s_phase;
+static _Atomic bool s_load_on = false;
+static _Atomic uint32_t s_load_calls = 0;
+
+/**
+ * Probe timer: how late it runs against its schedule
+ *
+ * The timer service re-arms from the expected expiry, so tick n is due
+ * PROBE_PERIOD_MS after tick n - 1 was due, however late that one ran.
+ */
+static void probe_callback(TimerHandle_t timer) {
+    int64_t now = esp_timer_get_time();
+    if (s_phase.probe_ticks == 0) {
+        s_phase.probe_start_us = now;  // The schedule starts at the first tick
+    }
+    int64_t late_us = now - s_phase.probe_start_us -
+                      (int64_t) s_phase.probe_ticks * PROBE_PERIOD_MS * 1000;
+    if (late_us > s_phase.probe_max_late_us) {
+        s_phase.probe_max_late_us = late_us;
+    }
+    s_phase.probe_total_late_us += late_us > 0 ? late_us : 0;
+    s_phase.probe_ticks++;
+}
+
+/**
+ * Blink callback of the old design: wait until the toggle is applied
+ */
+static void blocking_blink_callback(TimerHandle_t timer) {
+    int64_t start = esp_timer_get_time();
+    led_batch_t batch = {.toggle_mask = LED_MASK(LED_YELLOW_ROOF) | LED_MASK(LED_WHITE_GARDEN)};
+    led_apply_batch(&batch, NULL);
+    int64_t took_us = esp_timer_get_time() - start;
+    if (took_us > s_phase.blink_max_us) {
+        s_phase.blink_max_us = took_us;
+    }
+}
+
+/**
+ * HTTP handler stand-in: LED requests back to back
+ */
+static void load_task(void *arg) {
+    unsigned seed = (unsigned) (uintptr_t) arg;
+    for (;;) {
+        if (!atomic_load(&s_load_on)) {
+            vTaskDelay(pdMS_TO_TICKS(1));
+            continue;
+        }
+        if (rand_r(&seed) % 2) {
+            led_batch_t batch = {0};
+            led_batch_add(&batch, LED_YELLOW_ROOF, rand_r(&seed) % 2 ? LED_ACTION_ON
+                                                                     : LED_ACTION_OFF);
+            led_apply_batch(&batch, NULL);
+        } else {
+            led_set_brightness(LED_WHITE_GARDEN, (uint8_t) (rand_r(&seed) % 256), 100);
+        }
+        atomic_fetch_add(&s_load_calls, 1);
+    }
+}
+
+static phase_t run_phase(TimerHandle_t probe, TimerHandle_t blink) {
+    // The timer service owns s_phase while the probe runs
+    xTimerStop(probe, 0);
+    vTaskDelay(pdMS_TO_TICKS(2 * PROBE_PERIOD_MS));
+    s_phase = (phase_t) {0};
+
+    atomic_store(&s_load_on, true);
+    xTimerStart(probe, 0);
+    if (blink != NULL) {
+        xTimerStart(blink, 0);
+    }
+    vTaskDelay(pdMS_TO_TICKS(PHASE_MS));
+    if (blink != NULL) {
+        xTimerStop(blink, 0);
+    }
+    xTimerStop(probe, 0);
+    atomic_store(&s_load_on, false);
+    vTaskDelay(pdMS_TO_TICKS(50));  // Let the timer service and the load settle
+    return s_phase;
+}
+
+static void report(const char *name, const phase_t *phase) {
+    uint32_t ticks = phase->probe_ticks > 0 ? phase->probe_ticks : 1;
+    fprintf(stderr, "%-9s probe: %4lu ticks, lateness max %6lld us, mean %5lld us", name,
+            (unsigned long) phase->probe_ticks, (long long) phase->probe_max_late_us,
+            (long long) (phase->probe_total_late_us / ticks));
+    if (phase->blink_max_us > 0) {
+        fprintf(stderr, ", blink callback max %lld us", (long long) phase->blink_max_us);
+    }
+    fprintf(stderr, "\n");
+}
+
+int main(void) {
+    CHECK_EQ(led_init(), ESP_OK);
+    CHECK_EQ(xTaskCreate(actuator_task, "actuator", 4096, NULL, 6, &actuator_task_handle),
+             pdPASS);
+    for (int i = 0; i < LOAD_TASKS; i++) {
+        CHECK_EQ(xTaskCreate(load_task, "httpd", 4096, (void *) (uintptr_t) (i + 1), 5, NULL),
+                 pdPASS);
+    }
+    atomic_store(&g_mock_write_us, WRITE_COST_US);
+
+    TimerHandle_t probe = xTimerCreate("probe", pdMS_TO_TICKS(PROBE_PERIOD_MS), pdTRUE, NULL,
+                                       probe_callback);
+    TimerHandle_t old_blink = xTimerCreate("old_blink", pdMS_TO_TICKS(BLINK_PERIOD_MS), pdTRUE,
+                                           NULL, blocking_blink_callback);
+    CHECK(probe != NULL && old_blink != NULL);
+
+    phase_t idle = run_phase(probe, NULL);
+    phase_t before = run_phase(probe, old_blink);
+
+    // After: the real blink timer
+    CHECK_EQ(led_blink_start(), ESP_OK);
+    CHECK_EQ(led_blink_set_period(BLINK_PERIOD_MS), ESP_OK);
+    phase_t after = run_phase(probe, NULL);
+
+    report("no blink", &idle);
+    report("before", &before);
+    report("after", &after);
+
+    led_stats_t stats;
+    led_get_stats(&stats);
+    fprintf(stderr, "%lu load calls, %lu LED commands, post-to-apply max %lu us, "
+            "blink timer late max %lu us\n",
+            (unsigned long) atomic_load(&s_load_calls), (unsigned long) stats.commands,
+            (unsigned long) stats.max_latency_us, (unsigned long) stats.timer_max_late_us);
+
+    // The old callback holds the timer service for at least one output write
+    CHECK(before.blink_max_us >= WRITE_COST_US);
+    // The posting callback never waits for the outputs, so the service keeps time
+    CHECK(after.probe_ticks > 0);
+    CHECK(after.probe_max_late_us < AFTER_MAX_LATE_US);
+    CHECK(stats.timer_max_late_us < AFTER_MAX_LATE_US);
+    // Posting never lost a blink: the actuator task kept up with the ring
+    CHECK_EQ(stats.dropped, 0);
+
+    return test_report("test_timer_latency");
+}
@@ -0,0 +1,51 @@
+#ifndef TEST_UTIL_H
+#define TEST_UTIL_H
+
+// Minimal checks for the host tests: a failed CHECK prints where and why
+// and counts; main() returns test_failures() so ctest sees the result.
+
+#include <stdio.h>
+
+extern int g_test_failures;
+
+#define CHECK(cond)                                                                                \
+    do {                                                                                           \
+        if (!(cond)) {                                                                             \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond);              \
+            g_test_failures++;                                                                     \
+        }                                                                                          \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                             \
+    do {                                                                                           \
+        long long _a = (long long) (a), _b = (long long) (b);                                      \
+        if (_a != _b) {                                                                            \
+            fprintf(stderr, "%s:%d: CHECK failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__,  \
+                    #a, #b, _a, _b);                                                               \
+            g_test_failures++;                                                                     \
+        }                                                                                          \
+    } while (0)
+
+#define CHECK_NEAR(a, b, tol)                                                                      \
+    do {                                                                                           \
+        double _a = (a), _b = (b);                                                                 \
+        if (!(_a - _b <= (tol) && _b - _a <= (tol))) {                                             \
+            fprintf(stderr, "%s:%d: CHECK failed: %s ~ %s (%g vs %g)\n", __FILE__, __LINE__, #a,   \
+                    #b, _a, _b);                                                                   \
+            g_test_failures++;                                                                     \
+        }                                                                                          \
+    } while (0)
+
+// Define once per test program
+#define TEST_MAIN_FAILURES int g_test_failures = 0
+
+/**
+ * Print a summary and give main()'s exit status
+ */
+static inline int test_report(const char *name) {
+    fprintf(stderr, "%s: %s (%d failed checks)\n", name, g_test_failures ? "FAIL" : "ok",
+            g_test_failures);
+    return g_test_failures ? 1 : 0;
+}
+
+#endif  // TEST_UTIL_H
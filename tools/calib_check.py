@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""Round-trip sensor calibrations through a Geekhouse device and check the output.
+
+    tools/calib_check.py http://<device> [--sensor 0] [--samples 3] [--verify-only]
+
+For each calibration type, PUTs a calibration to /api/sensors/<id>/config,
+checks that the response and a following GET return it unchanged, then
+reads /api/sensors/<id> and compares calibrated_value with the value this
+script computes from raw_value (same formulas as main/calibration.c, at
+float32 tolerance). Invalid calibrations must be refused with 400. The
+calibration found at the start is put back at the end.
+
+--verify-only skips the round trips and only checks the readings against
+the current calibration: run it after a reboot to see that the stored one
+was loaded.
+"""
+
+import argparse
+import json
+import sys
+import urllib.error
+import urllib.request
+
+TESTS = [
+    {"type": "linear", "m": 100 / 4095, "b": 0, "unit": "%"},
+    {"type": "polynomial", "a": 0.00001, "b": 0.1, "c": -3, "unit": "lux"},
+    {"type": "piecewise", "points": [[100, 0], [2048, 40], [4000, 100]], "unit": "%"},
+    {"type": "none"},
+]
+
+INVALID = [
+    {"type": "cubic", "unit": "x"},
+    {"type": "linear", "m": 1, "unit": "%"},
+    {"type": "linear", "m": 1, "b": 0, "unit": "toolongu"},
+    {"type": "linear", "m": 1, "b": 0},
+    {"type": "piecewise", "points": [[0, 0]], "unit": "%"},
+    {"type": "piecewise", "points": [[10, 0], [10, 1]], "unit": "%"},
+    {"type": "piecewise", "points": [[0, 0], [4096, 1]], "unit": "%"},
+    {"type": "piecewise", "points": [[i, i] for i in range(9)], "unit": "%"},
+]
+
+
+def request(method, url, body=None):
+    """Return (status, parsed JSON body or None)."""
+    data = json.dumps(body).encode() if body is not None else None
+    req = urllib.request.Request(url, data=data, method=method)
+    if data is not None:
+        req.add_header("Content-Type", "application/json")
+    try:
+        with urllib.request.urlopen(req, timeout=5) as resp:
+            return resp.status, json.loads(resp.read())
+    except urllib.error.HTTPError as e:
+        e.read()
+        return e.code, None
+
+
+def reference(calib, raw):
+    """Calibrated value for raw, as main/calibration.c computes it."""
+    kind = calib["type"]
+    if kind == "linear":
+        return calib["m"] * raw + calib["b"]
+    if kind == "polynomial":
+        return calib["a"] * raw * raw + calib["b"] * raw + calib["c"]
+    if kind == "piecewise":
+        points = calib["points"]
+        if raw <= points[0][0]:
+            return points[0][1]
+        for (r0, v0), (r1, v1) in zip(points, points[1:]):
+            if raw <= r1:
+                return v0 + (raw - r0) / (r1 - r0) * (v1 - v0)
+        return points[-1][1]
+    return float(raw)
+
+
+def close(a, b):
+    """Equal within float32 rounding (values and coefficients are stored as float)."""
+    return abs(a - b) <= 1e-5 * max(1.0, abs(a), abs(b))
+
+
+def same_calibration(expected, actual):
+    expected = dict(expected, unit=expected.get("unit", "raw"))
+    if set(expected) != set(actual):
+        return False
+    for key, value in expected.items():
+        if key == "points":
+            flat = [x for point in value for x in point]
+            got = [x for point in actual[key] for x in point]
+            if len(flat) != len(got) or not all(close(a, b) for a, b in zip(flat, got)):
+                return False
+        elif isinstance(value, str):
+            if value != actual[key]:
+                return False
+        elif not close(value, actual[key]):
+            return False
+    return True
+
+
+def check_readings(base, sensor, calib, samples):
+    """Compare the device's calibrated values with the reference; return failures."""
+    failures = 0
+    for _ in range(samples):
+        status, reading = request("GET", "%s/api/sensors/%d" % (base, sensor))
+        if status != 200 or "raw_value" not in reading:
+            print("  reading failed (%s)" % status)
+            failures += 1
+            continue
+        expected = reference(calib, reading["raw_value"])
+        ok = close(reading["calibrated_value"], expected) and reading["unit"] == calib["unit"]
+        print("  raw %4d -> %12.4f %-4s expected %12.4f  %s"
+              % (reading["raw_value"], reading["calibrated_value"], reading["unit"], expected,
+                 "ok" if ok else "MISMATCH"))
+        failures += 0 if ok else 1
+    return failures
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("url", help="device base URL, e.g. http://192.168.1.50")
+    parser.add_argument("--sensor", type=int, default=0, help="sensor id")
+    parser.add_argument("--samples", type=int, default=3, help="readings checked per calibration")
+    parser.add_argument("--verify-only", action="store_true",
+                        help="only check readings against the current calibration")
+    args = parser.parse_args()
+
+    base = args.url.rstrip("/")
+    config_url = "%s/api/sensors/%d/config" % (base, args.sensor)
+    status, original = request("GET", config_url)
+    if status != 200:
+        print("GET %s: %s" % (config_url, status))
+        return 1
+    original = original["calibration"]
+    print("current: %s" % json.dumps(original))
+
+    if args.verify_only:
+        return 1 if check_readings(base, args.sensor, original, args.samples) else 0
+
+    failures = 0
+    for calib in TESTS:
+        print("%s:" % calib["type"])
+        status, echoed = request("PUT", config_url, calib)
+        if status != 200:
+            print("  PUT refused (%s)" % status)
+            failures += 1
+            continue
+        status, stored = request("GET", config_url)
+        for name, body in (("PUT", echoed), ("GET", stored)):
+            if body is None or not same_calibration(calib, body["calibration"]):
+                print("  %s returned %s" % (name, body and json.dumps(body["calibration"])))
+                failures += 1
+        failures += check_readings(base, args.sensor, dict(calib, unit=calib.get("unit", "raw")),
+                                   args.samples)
+
+    refused = 0
+    for calib in INVALID:
+        status, _ = request("PUT", config_url, calib)
+        if status == 400:
+            refused += 1
+        else:
+            print("  %s accepted (%s)" % (json.dumps(calib), status))
+            failures += 1
+    print("invalid: %d/%d refused" % (refused, len(INVALID)))
+
+    status, _ = request("PUT", config_url, original)
+    print("restored: %s" % ("ok" if status == 200 else status))
+    print("%d failures" % failures)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,121 @@
+"""Minimal CBOR (RFC 8949) codec for the Geekhouse tools.
+
+Covers what the firmware's encoder (main/cbor.c) produces: unsigned and
+negative integers, text strings, arrays and maps (definite and
+indefinite length), booleans, null, and half/single/double floats.
+dumps() mirrors the firmware's choices (shortest integer head, floats as
+half when exact, else single) so sizes can be compared byte for byte.
+"""
+
+import struct
+
+
+def _head(major, value):
+    if value < 24:
+        return bytes([major << 5 | value])
+    for extra, fmt in ((24, "!B"), (25, "!H"), (26, "!I"), (27, "!Q")):
+        if value < 1 << (8 * struct.calcsize(fmt)):
+            return bytes([major << 5 | extra]) + struct.pack(fmt, value)
+    raise ValueError("integer too large")
+
+
+def _float(value):
+    try:
+        half = struct.pack("!e", value)
+        if struct.unpack("!e", half)[0] == value:
+            return b"\xf9" + half
+    except OverflowError:
+        pass
+    return b"\xfa" + struct.pack("!f", value)
+
+
+def dumps(obj):
+    """Encode bools, ints, floats (as float32), strings, lists, dicts and None."""
+    if obj is None:
+        return b"\xf6"
+    if obj is True:
+        return b"\xf5"
+    if obj is False:
+        return b"\xf4"
+    if isinstance(obj, int):
+        return _head(0, obj) if obj >= 0 else _head(1, -1 - obj)
+    if isinstance(obj, float):
+        return _float(struct.unpack("!f", struct.pack("!f", obj))[0])
+    if isinstance(obj, str):
+        data = obj.encode()
+        return _head(3, len(data)) + data
+    if isinstance(obj, (list, tuple)):
+        return _head(4, len(obj)) + b"".join(dumps(item) for item in obj)
+    if isinstance(obj, dict):
+        return _head(5, len(obj)) + b"".join(dumps(k) + dumps(v) for k, v in obj.items())
+    raise TypeError("can't encode %r" % type(obj))
+
+
+_BREAK = object()
+
+
+def _decode(data, pos):
+    initial = data[pos]
+    pos += 1
+    major, info = initial >> 5, initial & 0x1F
+
+    if major == 7:
+        if info == 20:
+            return False, pos
+        if info == 21:
+            return True, pos
+        if info in (22, 23):
+            return None, pos
+        if info == 25:
+            return struct.unpack("!e", data[pos:pos + 2])[0], pos + 2
+        if info == 26:
+            return struct.unpack("!f", data[pos:pos + 4])[0], pos + 4
+        if info == 27:
+            return struct.unpack("!d", data[pos:pos + 8])[0], pos + 8
+        if info == 31:
+            return _BREAK, pos
+        raise ValueError("unsupported simple value %d" % info)
+
+    if info < 24:
+        value = info
+    elif info in (24, 25, 26, 27):
+        size = 1 << (info - 24)
+        value = int.from_bytes(data[pos:pos + size], "big")
+        pos += size
+    elif info == 31 and major in (4, 5):
+        value = None  # Indefinite length
+    else:
+        raise ValueError("unsupported additional info %d" % info)
+
+    if major == 0:
+        return value, pos
+    if major == 1:
+        return -1 - value, pos
+    if major in (2, 3):
+        chunk = bytes(data[pos:pos + value])
+        return (chunk.decode() if major == 3 else chunk), pos + value
+    if major == 4:
+        items = []
+        while value is None or len(items) < value:
+            item, pos = _decode(data, pos)
+            if item is _BREAK:
+                break
+            items.append(item)
+        return items, pos
+    if major == 5:
+        result = {}
+        while value is None or len(result) < value:
+            key, pos = _decode(data, pos)
+            if key is _BREAK:
+                break
+            result[key], pos = _decode(data, pos)
+        return result, pos
+    raise ValueError("unsupported major type %d" % major)
+
+
+def loads(data):
+    """Decode one CBOR item; trailing bytes are an error."""
+    value, pos = _decode(data, 0)
+    if pos != len(data):
+        raise ValueError("%d trailing bytes" % (len(data) - pos))
+    return value
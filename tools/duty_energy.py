@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""Energy estimate for the deep-sleep duty cycle against always-on operation.
+
+    tools/duty_energy.py [--host localhost] [--port 1883]
+    tools/duty_energy.py --stats status.json
+
+Reads the statistics a duty-cycled node publishes (retained) on
+geekhouse/status/duty_cycle after every flush (duty_cycle.h), or a saved
+copy of them, and reports wake-to-sleep time per wake and samples per
+joule. The same figure is worked out for an always-on node, which takes
+two readings every 2 s (sensor_task).
+
+The measured quantities are times; currents come from the options below.
+The defaults are ESP32-C3 datasheet-order figures: replace them with
+what a power meter shows for your board (regulator, sensors and LEDs add
+their own draw).
+"""
+
+import argparse
+import json
+import socket
+import sys
+
+from mqtt_bench import PUBLISH, MqttClient, parse_publish
+
+STATUS_TOPIC = "geekhouse/status/duty_cycle"
+ALWAYS_ON_SAMPLES_PER_S = 1.0  # Two sensors every 2 s
+
+
+def fetch_status(args):
+    """Wait for the retained status message on the broker."""
+    client = MqttClient(args.host, args.port, "duty-energy")
+    client.subscribe(STATUS_TOPIC)
+    client.sock.settimeout(args.timeout)
+    try:
+        while True:
+            kind, flags, body = client.read_packet()
+            if kind == PUBLISH:
+                return json.loads(parse_publish(flags, body)[1])
+    except socket.timeout:
+        return None
+    finally:
+        client.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--host", default="localhost", help="broker host")
+    parser.add_argument("--port", type=int, default=1883, help="broker port")
+    parser.add_argument("--timeout", type=float, default=10.0,
+                        help="seconds to wait for the status message")
+    parser.add_argument("--stats", help="read the status JSON from a file instead")
+    parser.add_argument("--voltage", type=float, default=3.3, help="supply voltage (V)")
+    parser.add_argument("--sample-ma", type=float, default=25.0,
+                        help="current while awake without WiFi (mA)")
+    parser.add_argument("--flush-ma", type=float, default=90.0,
+                        help="average current while connecting and publishing (mA)")
+    parser.add_argument("--sleep-ua", type=float, default=5.0, help="deep sleep current (uA)")
+    parser.add_argument("--always-on-ma", type=float, default=30.0,
+                        help="average current of an always-on node (mA)")
+    parser.add_argument("--battery-mah", type=float, default=2000.0,
+                        help="battery capacity for the lifetime estimate (mAh)")
+    args = parser.parse_args()
+
+    if args.stats:
+        with open(args.stats) as f:
+            st = json.load(f)
+    else:
+        st = fetch_status(args)
+        if st is None:
+            print("no status on %s within %.0f s" % (STATUS_TOPIC, args.timeout))
+            return 1
+
+    sample_s = st["sample_awake_us"] / 1e6
+    flush_s = st["flush_awake_us"] / 1e6
+    asleep_s = st["asleep_us"] / 1e6
+    total_s = sample_s + flush_s + asleep_s
+    if st["samples"] == 0 or total_s == 0:
+        print("no samples yet")
+        return 1
+
+    # Charge in mA*s, energy in J
+    charge = args.sample_ma * sample_s + args.flush_ma * flush_s + args.sleep_ua / 1000 * asleep_s
+    energy = charge / 1000 * args.voltage
+    avg_ma = charge / total_s
+    on_energy_per_sample = args.always_on_ma / 1000 * args.voltage / ALWAYS_ON_SAMPLES_PER_S
+
+    print("%d wakes over %.1f h, period %d s, %d readings per flush"
+          % (st["wakes"], total_s / 3600, st["period_s"], st["batch"]))
+    print("samples %d, dropped %d, pending %d, flushes %d, failed flushes %d"
+          % (st["samples"], st["dropped"], st["pending"], st["flushes"], st["flush_failures"]))
+    print()
+    print("%-14s %7s %12s %12s" % ("wake", "count", "avg ms", "max ms"))
+    for kind in ("sample", "flush"):
+        wakes = st[kind + "_wakes"]
+        avg = st[kind + "_awake_us"] / wakes / 1000 if wakes else 0
+        print("%-14s %7d %12.1f %12.1f" % (kind, wakes, avg, st[kind + "_max_us"] / 1000))
+    print()
+    print("%-14s %12s %12s %14s" % ("mode", "avg mA", "samples/J", "battery days"))
+    print("%-14s %12.3f %12.1f %14.1f"
+          % ("duty cycle", avg_ma, st["samples"] / energy, args.battery_mah / avg_ma / 24))
+    print("%-14s %12.3f %12.1f %14.1f"
+          % ("always on", args.always_on_ma, 1 / on_energy_per_sample,
+             args.battery_mah / args.always_on_ma / 24))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
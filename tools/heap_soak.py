@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""Heap regression check: run a scripted HTTP workload, assert no heap growth.
+
+    tools/heap_soak.py http://<device> [--warmup 50] [--rounds 500]
+
+Runs the workload until the heap settles (warm-up: lazily allocated
+buffers, httpd sessions, LWIP pools), records a baseline from
+GET /api/system/heap, runs it again for --rounds and compares. Fails
+(exit 1) if free heap dropped by more than --tolerance bytes. With
+CONFIG_GEEKHOUSE_HEAP_PROFILING it also fails if any tag's live bytes
+grew, and names the tag.
+
+Free heap is noisy on a live device (WiFi buffers, sockets in TIME_WAIT),
+so the baseline and final samples are each the best of a few reads after
+a short idle period.
+"""
+
+import argparse
+import json
+import sys
+import time
+import urllib.error
+import urllib.request
+
+# (method, path, body) - leaves the device in the state it started in
+WORKLOAD = [
+    ("GET", "/api", None),
+    ("GET", "/api/sensors", None),
+    ("GET", "/api/sensors/0", None),
+    ("GET", "/api/sensors/1", None),
+    ("GET", "/api/leds", None),
+    ("POST", "/api/leds/0", {"action": "toggle"}),
+    ("POST", "/api/leds/0", {"action": "toggle"}),
+    ("GET", "/api/rules", None),
+    ("GET", "/api/system", None),
+    ("GET", "/api/system/tasks", None),
+    ("GET", "/api/sensors/9", None),  # 404 path
+    ("GET", "/metrics", None),
+]
+
+
+def request(base, method, path, body=None, timeout=5):
+    data = json.dumps(body).encode() if body is not None else None
+    req = urllib.request.Request(base + path, data=data, method=method)
+    if data is not None:
+        req.add_header("Content-Type", "application/json")
+    try:
+        with urllib.request.urlopen(req, timeout=timeout) as resp:
+            return resp.status, resp.read()
+    except urllib.error.HTTPError as e:
+        return e.code, e.read()
+
+
+def run_workload(base, rounds):
+    failures = 0
+    for _ in range(rounds):
+        for method, path, body in WORKLOAD:
+            try:
+                status, _ = request(base, method, path, body)
+            except OSError:
+                failures += 1
+                continue
+            if status >= 500:
+                failures += 1
+    return failures
+
+
+def sample(base, reads=3, idle=2.0):
+    """Best of a few heap reads after letting the device go idle."""
+    best = None
+    for _ in range(reads):
+        time.sleep(idle)
+        _, raw = request(base, "GET", "/api/system/heap")
+        heap = json.loads(raw)
+        if best is None or heap["free_bytes"] > best["free_bytes"]:
+            best = heap
+    return best
+
+
+def tag_bytes(heap):
+    return {t["name"]: t["live_bytes"] for t in heap.get("tags", [])}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("base", help="device base URL, e.g. http://192.168.1.50")
+    parser.add_argument("--warmup", type=int, default=50, help="warm-up rounds")
+    parser.add_argument("--rounds", type=int, default=500, help="measured rounds")
+    parser.add_argument("--tolerance", type=int, default=512,
+                        help="allowed drop in free heap / growth per tag (bytes)")
+    args = parser.parse_args()
+    base = args.base.rstrip("/")
+
+    print("warm-up: %d rounds" % args.warmup)
+    run_workload(base, args.warmup)
+    before = sample(base)
+
+    print("workload: %d rounds (%d requests)" % (args.rounds, args.rounds * len(WORKLOAD)))
+    start = time.time()
+    failures = run_workload(base, args.rounds)
+    elapsed = time.time() - start
+    after = sample(base)
+
+    drop = before["free_bytes"] - after["free_bytes"]
+    print("free heap: %d -> %d (%+d), min %d, fragmentation %.2f%% -> %.2f%%"
+          % (before["free_bytes"], after["free_bytes"], -drop, after["min_free_bytes"],
+             before["fragmentation_percent"], after["fragmentation_percent"]))
+    print("%.1f requests/s, %d failed" % (args.rounds * len(WORKLOAD) / elapsed, failures))
+
+    ok = True
+    if drop > args.tolerance:
+        print("FAIL: free heap dropped by %d bytes" % drop)
+        ok = False
+
+    if after.get("profiling"):
+        tags_before = tag_bytes(before)
+        for name, live in sorted(tag_bytes(after).items(), key=lambda kv: -kv[1]):
+            growth = live - tags_before.get(name, 0)
+            if growth > args.tolerance:
+                print("FAIL: tag %s grew by %d bytes (%d live)" % (name, growth, live))
+                ok = False
+
+    if failures:
+        print("FAIL: %d requests failed" % failures)
+        ok = False
+
+    print("PASS" if ok else "FAIL")
+    return 0 if ok else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,231 @@
+#!/usr/bin/env python3
+"""HTTP load generator: per-endpoint p50/p99 latency for a Geekhouse device.
+
+    tools/http_bench.py http://<device> [-n 200] [-c 2] [--path /api/sensors]
+                        [--format json,cbor] [--idle 0]
+
+Sends -n requests to each endpoint from -c concurrent clients and
+reports client-side latency (network + server) next to the server-side
+handler latency from GET /api/system/http, so time spent in a handler
+(ADC reads, cJSON printing) can be told apart from time on the wire.
+
+With --format, the sensor and LED resources (which negotiate their wire
+format on Accept) are fetched once per format instead, reporting body bytes
+per response and the device's own encode time per format from the
+"encoding" section of /api/system/http. CBOR bodies are decoded with
+tools/cborlite.py, so a malformed one counts as an error.
+
+With CONFIG_GEEKHOUSE_POWER_SAVE, the share of light sleep, active and
+idle time and the wakeups during the run (from GET /api/system/power,
+read before and after) are printed too, so latency can be weighed against
+time asleep. Run once with -n 0 and a long --idle to see the baseline.
+
+Only side-effect-free GET endpoints are benchmarked by default.
+"""
+
+import argparse
+import json
+import sys
+import threading
+import time
+import urllib.error
+import urllib.request
+
+import cborlite
+
+ENDPOINTS = [
+    "/api",
+    "/api/sensors",
+    "/api/sensors/0",
+    "/api/leds",
+    "/api/rules",
+    "/api/system",
+    "/api/system/tasks",
+    "/metrics",
+]
+
+# Resources served as JSON or CBOR
+NEGOTIATED = ["/api/sensors", "/api/sensors/0", "/api/leds", "/api/leds/0"]
+
+MEDIA_TYPES = {"json": "application/json", "cbor": "application/cbor"}
+
+
+def fetch(url, fmt=None, timeout=5):
+    """Return (status, latency in us, body bytes); fmt sets the Accept header."""
+    request = urllib.request.Request(url)
+    if fmt:
+        request.add_header("Accept", MEDIA_TYPES[fmt])
+    start = time.perf_counter()
+    body = b""
+    try:
+        with urllib.request.urlopen(request, timeout=timeout) as resp:
+            body = resp.read()
+            status = resp.status
+            if fmt == "cbor":
+                cborlite.loads(body)
+    except urllib.error.HTTPError as e:
+        e.read()
+        status = e.code
+    except (ValueError, IndexError, UnicodeDecodeError):
+        status = 0  # Malformed CBOR
+    except OSError:
+        status = 0
+    return status, int((time.perf_counter() - start) * 1e6), len(body)
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0
+    index = min(len(sorted_values) - 1, int(round(p / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+def bench(base, path, requests, concurrency, fmt=None):
+    """Return (sorted latencies of successful requests, errors, elapsed s, body bytes)."""
+    latencies = []
+    errors = [0]
+    nbytes = [0]
+    lock = threading.Lock()
+    remaining = [requests]
+
+    def worker():
+        while True:
+            with lock:
+                if remaining[0] == 0:
+                    return
+                remaining[0] -= 1
+            status, us, size = fetch(base + path, fmt)
+            with lock:
+                if 200 <= status < 400:
+                    latencies.append(us)
+                    nbytes[0] += size
+                else:
+                    errors[0] += 1
+
+    threads = [threading.Thread(target=worker) for _ in range(concurrency)]
+    start = time.perf_counter()
+    for t in threads:
+        t.start()
+    for t in threads:
+        t.join()
+    return sorted(latencies), errors[0], time.perf_counter() - start, nbytes[0]
+
+
+def http_stats(base):
+    """GET /api/system/http, {} if unavailable."""
+    try:
+        with urllib.request.urlopen(base + "/api/system/http", timeout=5) as resp:
+            return json.load(resp)
+    except (OSError, ValueError):
+        return {}
+
+
+def power_stats(base):
+    """GET /api/system/power, None if unavailable (power saving disabled)."""
+    try:
+        with urllib.request.urlopen(base + "/api/system/power", timeout=5) as resp:
+            return json.load(resp)
+    except (OSError, ValueError):
+        return None
+
+
+def print_power(before, after):
+    """Share of each power state and wakeups between two snapshots."""
+    elapsed = after["uptime_us"] - before["uptime_us"]
+    if elapsed <= 0:
+        return
+    print()
+    print("Power during the run (%.1f s)" % (elapsed / 1e6))
+    for state in ("sleep", "active", "idle"):
+        us = after["states"][state]["us"] - before["states"][state]["us"]
+        print("  %-7s %6.2f%%" % (state, 100.0 * us / elapsed))
+    wakeups = {cause: after["wakeups"][cause] - before["wakeups"].get(cause, 0)
+               for cause in after["wakeups"]}
+    print("  wakeups %s" % ", ".join("%s %d" % item for item in sorted(wakeups.items())))
+
+
+def server_stats(data):
+    """Server-side latency per GET route."""
+    return {r["route"]: r.get("latency_us", {}) for r in data.get("routes", [])
+            if r.get("method") == "GET"}
+
+
+def server_route(stats, path):
+    """Match a concrete path against the route patterns ("{name:type}" captures a segment)."""
+    if path in stats:
+        return stats[path]
+    segments = path.split("?")[0].split("/")
+    for route, latency in stats.items():
+        parts = route.split("/")
+        if len(parts) == len(segments) and all(
+                p == s or (p.startswith("{") and s) for p, s in zip(parts, segments)):
+            return latency
+    return {}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("base", help="device base URL, e.g. http://192.168.1.50")
+    parser.add_argument("-n", "--requests", type=int, default=200, help="requests per endpoint")
+    parser.add_argument("-c", "--concurrency", type=int, default=2,
+                        help="concurrent clients (httpd serves a handful of sockets)")
+    parser.add_argument("--path", action="append",
+                        help="endpoint(s) to test instead of the defaults")
+    parser.add_argument("--idle", type=float, default=0.0,
+                        help="seconds to wait after the requests (power baseline)")
+    parser.add_argument("--format",
+                        help="comma-separated wire formats (json, cbor) to compare on the "
+                             "negotiated resources")
+    args = parser.parse_args()
+    base = args.base.rstrip("/")
+    formats = args.format.split(",") if args.format else [None]
+    for fmt in formats:
+        if fmt is not None and fmt not in MEDIA_TYPES:
+            print("unknown format %r (json or cbor)" % fmt)
+            return 2
+    paths = args.path or (NEGOTIATED if args.format else ENDPOINTS)
+
+    print("%-20s %6s %7s %6s %9s %9s %9s %8s   %9s %9s"
+          % ("Endpoint", "format", "req/s", "errors", "p50 us", "p99 us", "max us", "bytes",
+             "srv p50", "srv p99"))
+    power_before = power_stats(base)
+    results = []
+    for path in paths:
+        for fmt in formats:
+            latencies, errors, elapsed, nbytes = bench(base, path, args.requests,
+                                                       args.concurrency, fmt)
+            results.append((path, fmt, latencies, errors, elapsed, nbytes))
+    time.sleep(args.idle)
+    power_after = power_stats(base)
+
+    # Server-side figures are cumulative since boot; read them once at the end
+    data = http_stats(base)
+    stats = server_stats(data)
+    failed = False
+    for path, fmt, latencies, errors, elapsed, nbytes in results:
+        srv = server_route(stats, path)
+        print("%-20s %6s %7.1f %6d %9d %9d %9d %8.0f   %9s %9s"
+              % (path, fmt or "-", len(latencies) / elapsed if elapsed else 0, errors,
+                 percentile(latencies, 50), percentile(latencies, 99),
+                 latencies[-1] if latencies else 0,
+                 nbytes / float(len(latencies)) if latencies else 0,
+                 srv.get("p50", "-"), srv.get("p99", "-")))
+        failed = failed or errors > 0
+
+    encoding = data.get("encoding", {})
+    if args.format and encoding:
+        print()
+        print("Device encode cost since boot (all negotiated responses)")
+        print("%-6s %10s %10s %8s %8s" % ("format", "responses", "avg bytes", "avg us", "max us"))
+        for fmt in formats:
+            e = encoding.get(fmt, {})
+            print("%-6s %10s %10s %8s %8s"
+                  % (fmt, e.get("responses", "-"), e.get("avg_bytes", "-"),
+                     e.get("avg_us", "-"), e.get("max_us", "-")))
+    if power_before and power_after:
+        print_power(power_before, power_after)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
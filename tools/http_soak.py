@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+"""Connection soak test: many concurrent keep-alive clients against a Geekhouse device.
+
+    tools/http_soak.py http://<device> [-c 32] [--duration 60] [--think 0.5]
+                       [--idle 8] [--bind 192.168.1.201 --bind 192.168.1.202 ...]
+
+Runs -c "dashboard" clients that each keep one HTTP/1.1 connection open
+and poll --path every --think seconds, plus --idle clients that connect,
+make one request and then sit on the connection. Every connection attempt
+ends up as one of:
+
+  accepted   served at least one request
+  rejected   answered 503 or closed before its first response (per-client
+             limit, or a full pool purging it)
+  timed out  connect or response took longer than --timeout
+
+Connections the server closes after serving (LRU purge, idle timeout) are
+counted separately, and the client reconnects. At the end, client-side
+figures are printed next to the "connections" section of
+GET /api/system/http (sampled before and after).
+
+All connections from one host share a client address, so beyond
+CONFIG_GEEKHOUSE_HTTP_SOCKETS_PER_CLIENT they are refused by design. To
+simulate several clients, add addresses to the host's interface and pass
+each with --bind; clients are spread over them round-robin.
+"""
+
+import argparse
+import http.client
+import json
+import socket
+import sys
+import threading
+import time
+import urllib.request
+
+OUTCOMES = ["accepted", "rejected", "timed_out", "server_closed", "errors"]
+
+
+class Tally:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.counts = {name: 0 for name in OUTCOMES}
+        self.requests = 0
+        self.latencies = []
+
+    def add(self, name):
+        with self.lock:
+            self.counts[name] += 1
+
+    def request(self, us):
+        with self.lock:
+            self.requests += 1
+            self.latencies.append(us)
+
+
+def connect(host, port, source, timeout):
+    conn = http.client.HTTPConnection(host, port, timeout=timeout,
+                                      source_address=(source, 0) if source else None)
+    conn.connect()
+    return conn
+
+
+def client(args, host, port, source, deadline, tally, idle):
+    """Poll (or, if idle, hold) connections until the deadline."""
+    conn = None
+    served = 0
+    while time.monotonic() < deadline:
+        try:
+            if conn is None:
+                conn = connect(host, port, source, args.timeout)
+                served = 0
+            start = time.perf_counter()
+            conn.request("GET", args.path, headers={"Connection": "keep-alive"})
+            resp = conn.getresponse()
+            resp.read()
+            if resp.status == 503:
+                tally.add("rejected")
+                conn.close()
+                conn = None
+                time.sleep(args.backoff)
+                continue
+            if resp.status != 200:
+                tally.add("errors")
+            tally.request(int((time.perf_counter() - start) * 1e6))
+            if served == 0:
+                tally.add("accepted")
+            served += 1
+        except socket.timeout:
+            tally.add("timed_out")
+            conn = close(conn)
+            continue
+        except (http.client.HTTPException, ConnectionError, OSError):
+            # Closed by the server: refused before serving, or purged/idle after
+            tally.add("rejected" if served == 0 else "server_closed")
+            conn = close(conn)
+            time.sleep(args.backoff if served == 0 else 0)
+            continue
+
+        if idle:
+            # Hold the connection and see whether the server takes it back
+            while time.monotonic() < deadline and conn.sock is not None:
+                time.sleep(0.5)
+                if server_closed(conn):
+                    tally.add("server_closed")
+                    conn = close(conn)
+                    break
+        else:
+            time.sleep(args.think)
+    close(conn)
+
+
+def close(conn):
+    if conn is not None:
+        conn.close()
+    return None
+
+
+def server_closed(conn):
+    """True if the peer closed an otherwise idle connection."""
+    try:
+        conn.sock.setblocking(False)
+        try:
+            return conn.sock.recv(1, socket.MSG_PEEK) == b""
+        finally:
+            conn.sock.setblocking(True)
+            conn.sock.settimeout(conn.timeout)
+    except BlockingIOError:
+        return False
+    except OSError:
+        return True
+
+
+def connection_stats(base):
+    """The "connections" section of GET /api/system/http, {} if unavailable."""
+    try:
+        with urllib.request.urlopen(base + "/api/system/http", timeout=5) as resp:
+            return json.load(resp).get("connections", {})
+    except (OSError, ValueError):
+        return {}
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0
+    index = min(len(sorted_values) - 1, int(round(p / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("base", help="device base URL, e.g. http://192.168.1.50")
+    parser.add_argument("-c", "--clients", type=int, default=32, help="polling clients")
+    parser.add_argument("--idle", type=int, default=8, help="clients holding idle connections")
+    parser.add_argument("--duration", type=float, default=60.0, help="seconds")
+    parser.add_argument("--think", type=float, default=0.5, help="seconds between polls")
+    parser.add_argument("--path", default="/api/sensors", help="resource to poll")
+    parser.add_argument("--timeout", type=float, default=5.0, help="connect/response timeout")
+    parser.add_argument("--backoff", type=float, default=1.0,
+                        help="seconds to wait after a refused connection")
+    parser.add_argument("--bind", action="append", default=[],
+                        help="local source address (repeat to simulate several clients)")
+    args = parser.parse_args()
+
+    base = args.base.rstrip("/")
+    target = base.split("://")[-1]
+    host, _, port = target.partition(":")
+    port = int(port) if port else 80
+    sources = args.bind or [None]
+
+    before = connection_stats(base)
+    tally = Tally()
+    deadline = time.monotonic() + args.duration
+    threads = []
+    for i in range(args.clients + args.idle):
+        idle = i >= args.clients
+        t = threading.Thread(target=client, daemon=True,
+                             args=(args, host, port, sources[i % len(sources)], deadline, tally,
+                                   idle))
+        threads.append(t)
+        t.start()
+        time.sleep(0.02)  # Stagger connects a little, like real dashboards
+    for t in threads:
+        t.join(args.duration + 2 * args.timeout + 5)
+    time.sleep(1)
+    after = connection_stats(base)
+
+    lat = sorted(tally.latencies)
+    print("%d polling + %d idle clients from %d address(es), %.0f s"
+          % (args.clients, args.idle, len(sources), args.duration))
+    print("Connections (client side)")
+    for name in OUTCOMES:
+        print("  %-14s %6d" % (name, tally.counts[name]))
+    print("Requests        %6d  (%.1f/s)  p50 %d us  p99 %d us  max %d us"
+          % (tally.requests, tally.requests / args.duration, percentile(lat, 50),
+             percentile(lat, 99), lat[-1] if lat else 0))
+
+    if after:
+        print("Connections (server side, during the run)")
+        print("  pool           %6d  (peak open %d)" % (after.get("max", 0), after.get("peak", 0)))
+        for name in ("accepted", "rejected", "closed", "idle_closed", "requests"):
+            print("  %-14s %6d" % (name, after.get(name, 0) - before.get(name, 0)))
+    else:
+        print("(no connection statistics from /api/system/http)")
+
+    # Timeouts mean someone was locked out, which is what the profile should prevent
+    return 1 if tally.counts["timed_out"] else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,432 @@
+#!/usr/bin/env python3
+"""MQTT benchmark: batched telemetry and LED command round trips on a local broker.
+
+    tools/mqtt_bench.py bench [--host localhost] [-n 2000] [--batch 1,4,16,32] [--qos 0]
+                              [--format json,cbor]
+    tools/mqtt_bench.py listen [--host localhost]
+    tools/mqtt_bench.py command [--host localhost] [--led 0] [-n 100] [--action toggle]
+
+bench publishes -n synthetic readings for each batch size, encoded exactly
+like the firmware (mqtt_publisher.h): batch size 1 uses the per-reading
+topic and payload, larger sizes the batch payload. Each size runs once per
+--format: JSON, or CBOR as with CONFIG_GEEKHOUSE_MQTT_CBOR. A subscriber on
+the same broker decodes everything it receives, so delivery is checked end
+to end. Reports readings/s, payload and wire bytes per reading, the time to
+encode one payload (in Python on the host; the device's own encode times
+are in GET /api/system/http) and, with --qos 1, the PUBACK round trip with
+the firmware's in-flight limit.
+
+listen subscribes to a device's topics and prints what arrives: readings/s,
+publishes/s and bytes per reading, decoded from either payload layout and
+either encoding.
+
+command sends -n LED commands to a device (mqtt_commands.h), one at a time,
+each with its own correlation id, and waits for the matching ack. Reports
+the round trip seen by the client next to the device's own latency_us
+(command received to GPIO written); the difference is broker and WiFi time.
+
+Start a broker with `mosquitto -v`. No dependencies beyond the standard
+library (a minimal MQTT 3.1.1 client is included).
+"""
+
+import argparse
+import json
+import random
+import socket
+import struct
+import sys
+import threading
+import time
+
+import cborlite
+
+INFLIGHT_MAX = 8  # MQTT_INFLIGHT_MAX in mqtt_publisher.h
+
+CONNECT, CONNACK, PUBLISH, PUBACK, SUBSCRIBE, SUBACK, DISCONNECT = 1, 2, 3, 4, 8, 9, 14
+
+
+def _string(s):
+    data = s.encode() if isinstance(s, str) else s
+    return struct.pack("!H", len(data)) + data
+
+
+def _packet(kind, flags, body):
+    length = len(body)
+    header = bytearray([kind << 4 | flags])
+    while True:
+        byte = length % 128
+        length //= 128
+        header.append(byte | 0x80 if length else byte)
+        if not length:
+            return bytes(header) + body
+
+
+class MqttClient:
+    """Just enough MQTT 3.1.1 for publishing and subscribing with QoS 0/1."""
+
+    def __init__(self, host, port, client_id, keepalive=60):
+        self.sock = socket.create_connection((host, port), timeout=10)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.buf = b""
+        self.next_id = 1
+        body = _string("MQTT") + bytes([4, 0x02]) + struct.pack("!H", keepalive)
+        self.sock.sendall(_packet(CONNECT, 0, body + _string(client_id)))
+        kind, _, body = self.read_packet()
+        if kind != CONNACK or body[1] != 0:
+            raise ConnectionError("broker refused connection (%r)" % body)
+
+    def _recv_exact(self, n):
+        while len(self.buf) < n:
+            chunk = self.sock.recv(65536)
+            if not chunk:
+                raise ConnectionError("broker closed the connection")
+            self.buf += chunk
+        data, self.buf = self.buf[:n], self.buf[n:]
+        return data
+
+    def read_packet(self):
+        first = self._recv_exact(1)[0]
+        length, shift = 0, 0
+        while True:
+            byte = self._recv_exact(1)[0]
+            length |= (byte & 0x7F) << shift
+            shift += 7
+            if byte < 0x80:
+                break
+        return first >> 4, first & 0x0F, self._recv_exact(length)
+
+    def publish(self, topic, payload, qos=0):
+        """Send a PUBLISH; return (packet id or None, wire bytes)."""
+        packet_id = None
+        body = _string(topic)
+        if qos:
+            packet_id = self.next_id
+            self.next_id = self.next_id % 0xFFFF + 1
+            body += struct.pack("!H", packet_id)
+        data = _packet(PUBLISH, qos << 1, body + payload)
+        self.sock.sendall(data)
+        return packet_id, len(data)
+
+    def subscribe(self, topic):
+        body = struct.pack("!H", self.next_id) + _string(topic) + b"\x00"
+        self.next_id += 1
+        self.sock.sendall(_packet(SUBSCRIBE, 0x02, body))
+        while self.read_packet()[0] != SUBACK:
+            pass
+
+    def close(self):
+        try:
+            self.sock.sendall(_packet(DISCONNECT, 0, b""))
+        except OSError:
+            pass
+        self.sock.close()
+
+
+def parse_publish(flags, body):
+    """Return (topic, payload) of an incoming PUBLISH."""
+    topic_len = struct.unpack("!H", body[:2])[0]
+    offset = 2 + topic_len + (2 if flags & 0x06 else 0)
+    return body[2:2 + topic_len].decode(), body[offset:]
+
+
+def decode(topic, payload):
+    """Readings in a firmware payload, as (id, ts ms, raw, value) tuples."""
+    # JSON objects start with '{', CBOR maps with a major type 5 byte
+    data = json.loads(payload) if payload[:1] == b"{" else cborlite.loads(payload)
+    if topic.endswith("/batch"):
+        return [(r[0], data["ts"] + r[1], r[2], r[3]) for r in data["r"]]
+    sensor_id = int(topic.split("/")[-2])
+    return [(sensor_id, data["ts"], data["raw"], data["value"])]
+
+
+def encode_batch(readings, fmt="json"):
+    """Same output as mqtt_encode_batch() or mqtt_encode_batch_cbor()."""
+    t0 = readings[0][1]
+    if fmt == "cbor":
+        return cborlite.dumps({"ts": t0, "r": [[i, ts - t0, raw, value]
+                                               for i, ts, raw, value in readings]})
+    items = ",".join("[%d,%d,%d,%.2f]" % (i, ts - t0, raw, value)
+                     for i, ts, raw, value in readings)
+    return ('{"ts":%d,"r":[%s]}' % (t0, items)).encode()
+
+
+def encode_reading(reading, fmt="json"):
+    """Same output as mqtt_encode_reading() or mqtt_encode_reading_cbor()."""
+    _, ts, raw, value = reading
+    if fmt == "cbor":
+        return cborlite.dumps({"ts": ts, "raw": raw, "value": value, "unit": "lux"})
+    return ('{"ts":%d,"raw":%d,"value":%.2f,"unit":"%s"}' % (ts, raw, value, "lux")).encode()
+
+
+def synthetic_readings(count):
+    """Two sensors sampled every 2 s, like sensor_task."""
+    rng = random.Random(1)
+    readings = []
+    for i in range(count):
+        raw = rng.randrange(4096)
+        readings.append((i % 2, 2000 * (i // 2) + 5 * (i % 2), raw, raw * 0.0244))
+    return readings
+
+
+class Counter(threading.Thread):
+    """Subscriber counting decoded readings and payload bytes."""
+
+    def __init__(self, host, port, topic):
+        super().__init__(daemon=True)
+        self.client = MqttClient(host, port, "bench-sub-%d" % random.randrange(1 << 20))
+        self.client.subscribe(topic)
+        self.client.sock.settimeout(0.5)
+        self.lock = threading.Lock()
+        self.readings = 0
+        self.publishes = 0
+        self.bytes = 0
+        self.stop = False
+
+    def run(self):
+        while not self.stop:
+            try:
+                kind, flags, body = self.client.read_packet()
+            except socket.timeout:
+                continue
+            except (OSError, ConnectionError):
+                return
+            if kind != PUBLISH:
+                continue
+            topic, payload = parse_publish(flags, body)
+            try:
+                count = len(decode(topic, payload))
+            except (ValueError, KeyError, IndexError):
+                print("undecodable payload on %s: %r" % (topic, payload[:80]))
+                continue
+            with self.lock:
+                self.readings += count
+                self.publishes += 1
+                self.bytes += len(payload)
+
+    def snapshot(self):
+        with self.lock:
+            return self.readings, self.publishes, self.bytes
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0
+    index = min(len(sorted_values) - 1, int(round(p / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+def bench_one(args, readings, batch, fmt):
+    """Publish all readings in groups of batch, encoded as fmt; return a result dict."""
+    prefix = args.prefix
+    counter = Counter(args.host, args.port, prefix + "/sensors/#")
+    counter.start()
+    pub = MqttClient(args.host, args.port, "bench-pub-%d" % random.randrange(1 << 20))
+
+    inflight = {}
+    latencies = []
+    payload_bytes = wire_bytes = publishes = 0
+    encode_s = 0.0
+
+    def wait_acks(limit):
+        while len(inflight) > limit:
+            kind, _, body = pub.read_packet()
+            if kind == PUBACK:
+                sent = inflight.pop(struct.unpack("!H", body[:2])[0], None)
+                if sent is not None:
+                    latencies.append(int((time.perf_counter() - sent) * 1e6))
+
+    start = time.perf_counter()
+    for i in range(0, len(readings), batch):
+        group = readings[i:i + batch]
+        encode_start = time.perf_counter()
+        if batch == 1:
+            topic = "%s/sensors/%d/value" % (prefix, group[0][0])
+            payload = encode_reading(group[0], fmt)
+        else:
+            topic, payload = prefix + "/sensors/batch", encode_batch(group, fmt)
+        encode_s += time.perf_counter() - encode_start
+        if args.qos:
+            wait_acks(INFLIGHT_MAX - 1)
+        packet_id, wire = pub.publish(topic, payload, args.qos)
+        if packet_id is not None:
+            inflight[packet_id] = time.perf_counter()
+        payload_bytes += len(payload)
+        wire_bytes += wire
+        publishes += 1
+    wait_acks(0)
+    elapsed = time.perf_counter() - start
+
+    # Give the subscriber time to catch up
+    deadline = time.time() + 5
+    while counter.snapshot()[0] < len(readings) and time.time() < deadline:
+        time.sleep(0.05)
+    counter.stop = True
+    delivered = counter.snapshot()[0]
+    pub.close()
+    counter.join()
+    counter.client.close()
+
+    latencies.sort()
+    return {
+        "batch": batch,
+        "format": fmt,
+        "publishes": publishes,
+        "readings_per_s": len(readings) / elapsed if elapsed else 0,
+        "publishes_per_s": publishes / elapsed if elapsed else 0,
+        "payload_per_reading": payload_bytes / float(len(readings)),
+        "wire_per_reading": wire_bytes / float(len(readings)),
+        "encode_us": encode_s * 1e6 / publishes if publishes else 0,
+        "ack_p50": percentile(latencies, 50),
+        "ack_p99": percentile(latencies, 99),
+        "delivered": delivered,
+    }
+
+
+def cmd_bench(args):
+    readings = synthetic_readings(args.readings)
+    batches = [int(b) for b in args.batch.split(",")]
+    formats = args.format.split(",")
+    for fmt in formats:
+        if fmt not in ("json", "cbor"):
+            print("unknown format %r (json or cbor)" % fmt)
+            return 2
+    print("%d readings, QoS %d, broker %s:%d" % (len(readings), args.qos, args.host, args.port))
+    print("%6s %6s %9s %11s %10s %9s %9s %9s %9s %9s %10s"
+          % ("batch", "format", "publishes", "readings/s", "pubs/s", "payload/r", "wire/r",
+             "encode us", "ack p50", "ack p99", "delivered"))
+    ok = True
+    for batch in batches:
+        for fmt in formats:
+            r = bench_one(args, readings, batch, fmt)
+            print("%6d %6s %9d %11.0f %10.0f %9.1f %9.1f %9.1f %9s %9s %10d"
+                  % (r["batch"], r["format"], r["publishes"], r["readings_per_s"],
+                     r["publishes_per_s"], r["payload_per_reading"], r["wire_per_reading"],
+                     r["encode_us"], r["ack_p50"] if args.qos else "-",
+                     r["ack_p99"] if args.qos else "-", r["delivered"]))
+            ok = ok and r["delivered"] == len(readings)
+    if not ok:
+        print("FAIL: not every reading was delivered to the subscriber")
+    return 0 if ok else 1
+
+
+def cmd_listen(args):
+    counter = Counter(args.host, args.port, args.prefix + "/sensors/#")
+    counter.start()
+    print("listening on %s:%d for %s/sensors/# (Ctrl-C to stop)"
+          % (args.host, args.port, args.prefix))
+    last = counter.snapshot()
+    try:
+        while True:
+            time.sleep(args.interval)
+            now = counter.snapshot()
+            readings, publishes, nbytes = (now[i] - last[i] for i in range(3))
+            print("%6.2f readings/s %6.2f publishes/s %6.1f bytes/reading"
+                  % (readings / args.interval, publishes / args.interval,
+                     nbytes / float(readings) if readings else 0))
+            last = now
+    except KeyboardInterrupt:
+        pass
+    counter.stop = True
+    return 0
+
+
+def cmd_command(args):
+    base = "%s/leds/%d" % (args.prefix, args.led)
+    client = MqttClient(args.host, args.port, "bench-cmd-%d" % random.randrange(1 << 20))
+    client.subscribe(base + "/ack")
+    client.subscribe(base + "/state")
+    if args.action in ("on", "off", "toggle"):
+        body = {"action": args.action}
+    else:
+        body = {"brightness": int(args.action)}
+    print("%d commands %s to %s/command on %s:%d"
+          % (args.count, json.dumps(body), base, args.host, args.port))
+
+    run = "%06x" % random.randrange(1 << 24)
+    round_trips, device, errors = [], [], {}
+    timeouts = 0
+    state = None
+    for i in range(args.count):
+        cid = "%s-%d" % (run, i)
+        sent = time.perf_counter()
+        client.publish(base + "/command", json.dumps(dict(body, cid=cid)).encode(), qos=1)
+        deadline = sent + args.timeout
+        ack = None
+        while ack is None:
+            client.sock.settimeout(max(0.001, deadline - time.perf_counter()))
+            try:
+                kind, flags, packet = client.read_packet()
+            except socket.timeout:
+                break
+            if kind != PUBLISH:
+                continue
+            topic, payload = parse_publish(flags, packet)
+            message = json.loads(payload)
+            if topic.endswith("/state"):
+                state = message
+            elif message.get("cid") == cid:
+                ack = message
+        if ack is None:
+            timeouts += 1
+        elif ack.get("ok"):
+            round_trips.append(int((time.perf_counter() - sent) * 1e6))
+            device.append(ack.get("latency_us", 0))
+        else:
+            errors[ack.get("error")] = errors.get(ack.get("error"), 0) + 1
+        if args.interval:
+            time.sleep(args.interval)
+    client.close()
+
+    round_trips.sort()
+    device.sort()
+    print("%10s %9s %9s %9s" % ("(us)", "p50", "p99", "max"))
+    for name, values in (("round trip", round_trips), ("device", device)):
+        print("%10s %9d %9d %9d" % (name, percentile(values, 50), percentile(values, 99),
+                                    values[-1] if values else 0))
+    print("acknowledged %d/%d, timeouts %d" % (len(round_trips), args.count, timeouts))
+    for error, count in sorted(errors.items()):
+        print("  error %r: %d" % (error, count))
+    if state is not None:
+        print("last state: %s" % json.dumps(state))
+    return 0 if len(round_trips) == args.count else 1
+
+
+def main():
+    broker = argparse.ArgumentParser(add_help=False)
+    broker.add_argument("--host", default="localhost", help="broker host")
+    broker.add_argument("--port", type=int, default=1883, help="broker port")
+
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    bench = sub.add_parser("bench", parents=[broker], help="compare batch sizes on the broker")
+    bench.add_argument("-n", "--readings", type=int, default=2000, help="readings per run")
+    bench.add_argument("--batch", default="1,4,16,32",
+                       help="comma-separated batch sizes (1 = per-reading publishes)")
+    bench.add_argument("--qos", type=int, choices=(0, 1), default=0, help="publish QoS")
+    bench.add_argument("--format", default="json,cbor",
+                       help="comma-separated payload encodings (json, cbor)")
+    bench.add_argument("--prefix", default="geekhouse-bench",
+                       help="topic prefix (kept apart from real devices)")
+
+    listen = sub.add_parser("listen", parents=[broker], help="decode a device's telemetry")
+    listen.add_argument("--prefix", default="geekhouse", help="topic prefix")
+    listen.add_argument("--interval", type=float, default=10.0, help="report interval (s)")
+
+    command = sub.add_parser("command", parents=[broker], help="time LED commands to a device")
+    command.add_argument("--led", type=int, default=0, help="LED id")
+    command.add_argument("-n", "--count", type=int, default=100, help="commands to send")
+    command.add_argument("--action", default="toggle",
+                         help="on, off, toggle or a brightness (0-255, dimmable LEDs)")
+    command.add_argument("--timeout", type=float, default=2.0, help="ack timeout (s)")
+    command.add_argument("--interval", type=float, default=0.0,
+                         help="pause between commands (s)")
+    command.add_argument("--prefix", default="geekhouse", help="topic prefix")
+
+    args = parser.parse_args()
+    handlers = {"bench": cmd_bench, "listen": cmd_listen, "command": cmd_command}
+    return handlers[args.command](args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
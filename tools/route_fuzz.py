@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+"""Fuzz the URI router of a Geekhouse device.
+
+    tools/route_fuzz.py <device host[:port]> [-n 2000] [--seed 1]
+
+First checks a table of edge cases with known answers: multi-digit and
+out-of-range ids, trailing slashes, empty segments, typed captures that
+don't parse, method mismatches (405 with an Allow header) and malformed
+query strings, and that collections come back as JSON or CBOR as
+Accept and ?format= ask (JSON when neither is given). Then sends -n
+random and mutated request paths and checks that every answer is one of
+200/400/404/405, that failures carry an error body (JSON, or CBOR when
+the path asks for it), and that the device still answers GET /api at
+the end.
+
+Fuzzed requests are GETs only (POST is only sent where it must be
+refused), so nothing on the device is changed.
+"""
+
+import argparse
+import http.client
+import json
+import random
+import sys
+
+import cborlite
+
+# (method, path, expected status, expected Allow header or None)
+CASES = [
+    ("GET", "/api", 200, None),
+    ("GET", "/api/sensors/0", 200, None),
+    ("GET", "/api/sensors/0?format=json", 200, None),
+    ("GET", "/api/sensors/0/config", 200, None),
+    ("GET", "/api/sensors/00", 200, None),
+    ("GET", "/api/sensors/10", 404, None),
+    ("GET", "/api/sensors/99999999999", 404, None),
+    ("GET", "/api/sensors/-1", 404, None),
+    ("GET", "/api/sensors/1x", 404, None),
+    ("GET", "/api/sensors/", 404, None),
+    ("GET", "/api/sensors/0/", 404, None),
+    ("GET", "/api/sensors//config", 404, None),
+    ("GET", "/api/sensors/0/history", 404, None),
+    ("GET", "/api/sensorsX", 404, None),
+    ("GET", "/api/leds/12", 404, None),
+    ("GET", "/nope", 404, None),
+    ("GET", "/api?format=%zz", 400, None),
+    ("GET", "/api?a&b&c&d&e&f&g&h&i", 400, None),
+    ("POST", "/api/sensors", 405, "GET"),
+    ("POST", "/api/sensors/0/config", 405, "GET, PUT"),
+    ("POST", "/api/config", 405, "GET, PATCH"),
+    ("POST", "/metrics", 405, "GET"),
+    ("DELETE", "/api/leds", 405, "GET, POST"),
+    ("OPTIONS", "/api/config", 405, "GET, PATCH"),
+    ("DELETE", "/nope", 404, None),
+]
+
+# (path, Accept header or None, expected Content-Type)
+FORMAT_CASES = [
+    ("/api/leds", None, "application/json"),
+    ("/api/leds", "application/json", "application/json"),
+    ("/api/leds", "application/cbor", "application/cbor"),
+    ("/api/leds?format=json", "application/cbor", "application/json"),
+    ("/api/sensors", None, "application/json"),
+    ("/api/sensors", "application/cbor", "application/cbor"),
+]
+
+SEEDS = ["/api/sensors/0/config?format=cbor", "/api/leds/1", "/api/system/http", "/metrics",
+         "/api?format=json&x=1"]
+ALPHABET = "/apisenorcfgledmtx0123456789?&=%+{}:-._~"
+
+
+def request(conn, method, path, accept=None):
+    """Return (status, Allow header, body, Content-Type without parameters)."""
+    headers = {"Connection": "keep-alive"}
+    if accept is not None:
+        headers["Accept"] = accept
+    conn.request(method, path, body=b"" if method == "POST" else None, headers=headers)
+    resp = conn.getresponse()
+    body = resp.read()
+    content_type = (resp.getheader("Content-Type") or "").split(";")[0]
+    return resp.status, resp.getheader("Allow"), body, content_type
+
+
+def decodes_as(content_type, body):
+    """True if the body parses as the given media type."""
+    try:
+        if content_type == "application/cbor":
+            cborlite.loads(body)
+        else:
+            json.loads(body)
+        return True
+    except Exception:
+        return False
+
+
+def has_error_body(body):
+    """JSON or CBOR (?format=cbor) map with an "error" member."""
+    for decode in (json.loads, cborlite.loads):
+        try:
+            if "error" in decode(body):
+                return True
+        except Exception:
+            pass
+    return False
+
+
+def random_path(rng):
+    if rng.random() < 0.5:
+        return "/" + "".join(rng.choice(ALPHABET) for _ in range(rng.randrange(60)))
+    path = list(rng.choice(SEEDS))
+    for _ in range(rng.randrange(1, 5)):
+        pos = rng.randrange(len(path) + 1)
+        op = rng.randrange(3)
+        if op == 0 and pos < len(path):
+            path[pos] = rng.choice(ALPHABET)
+        elif op == 1:
+            path.insert(pos, rng.choice(ALPHABET))
+        elif pos < len(path) and pos > 0:
+            del path[pos]
+    return "".join(path)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("host", help="device address, e.g. 192.168.1.50 or 192.168.1.50:80")
+    parser.add_argument("-n", "--requests", type=int, default=2000, help="fuzzed requests")
+    parser.add_argument("--seed", type=int, default=1, help="random seed")
+    args = parser.parse_args()
+    host = args.host.split("://")[-1].rstrip("/")
+
+    failures = 0
+    conn = http.client.HTTPConnection(host, timeout=5)
+    for method, path, status, allow in CASES:
+        got, got_allow, _, _ = request(conn, method, path)
+        ok = got == status and (allow is None or got_allow == allow)
+        if not ok:
+            failures += 1
+        print("%-7s %-36s %d%s  %s" % (method, path, got,
+                                       " Allow: %s" % got_allow if got_allow else "",
+                                       "ok" if ok else "expected %d" % status))
+
+    for path, accept, content_type in FORMAT_CASES:
+        try:
+            got, _, body, got_type = request(conn, "GET", path, accept)
+        except (http.client.HTTPException, OSError) as e:
+            # A handler that crashes the server shows up here
+            print("GET     %-36s %s" % (path, e))
+            failures += 1
+            conn.close()
+            conn = http.client.HTTPConnection(host, timeout=5)
+            continue
+        ok = got == 200 and got_type == content_type and decodes_as(content_type, body)
+        if not ok:
+            failures += 1
+        print("GET     %-36s %d %s (Accept: %s)  %s" % (path, got, got_type, accept or "-",
+                                                     "ok" if ok else "expected " + content_type))
+
+    rng = random.Random(args.seed)
+    counts = {}
+    for _ in range(args.requests):
+        path = random_path(rng)
+        try:
+            status, _, body, _ = request(conn, "GET", path)
+        except (http.client.HTTPException, OSError) as e:
+            print("%s: %s" % (path, e))
+            failures += 1
+            conn.close()
+            conn = http.client.HTTPConnection(host, timeout=5)
+            continue
+        counts[status] = counts.get(status, 0) + 1
+        if status not in (200, 400, 404, 405):
+            print("%s: status %d" % (path, status))
+            failures += 1
+        elif status != 200 and not has_error_body(body):
+            print("%s: %d without an error body" % (path, status))
+            failures += 1
+
+    print("fuzzed %d requests: %s" % (args.requests, ", ".join(
+        "%d x %d" % (count, status) for status, count in sorted(counts.items()))))
+    status, _, _, _ = request(conn, "GET", "/api")
+    print("GET /api after fuzzing: %d" % status)
+    failures += status != 200
+    print("%d failures" % failures)
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
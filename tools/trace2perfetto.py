@@ -0,0 +1,254 @@
+#!/usr/bin/env python3
+"""Convert a Geekhouse trace dump to Chrome/Perfetto JSON.
+
+Build with CONFIG_GEEKHOUSE_TRACE=y, then:
+
+    curl -o trace.bin http://<device>/api/trace
+    tools/trace2perfetto.py trace.bin trace.json
+
+Open trace.json in https://ui.perfetto.dev or chrome://tracing. Each task
+gets a track with its run slices, custom spans (sensor_read, rules, ...)
+and queue/mutex waits. A per-task scheduling latency summary (task made
+ready -> task switched in) is printed to stderr.
+
+Overhead: the firmware times 1000 events at boot and logs
+"Tracing enabled: N events (K KB), X ns per event"; the same figure is in
+the dump header and printed here. Each event is one esp_timer read plus a
+16-byte store with interrupts masked, a few hundred ns on the ESP32-C3 at
+160 MHz. A context switch records two events (ready + switch-in).
+
+Dump layout (little endian), see main/trace.c:
+    header   <IHHIIHHI  magic "GHTR", version, event_size, event_count,
+                        total_events, task_count, span_count, overhead_ns
+    tasks    <I16s      handle, name          (task_count times)
+    spans    16s        name                  (span_count times)
+    events   <IBBHII    timestamp_us, type, reserved, arg, task, obj
+"""
+
+import argparse
+import json
+import struct
+import sys
+from collections import defaultdict
+
+MAGIC = 0x52544847
+VERSION = 1
+
+HEADER = struct.Struct("<IHHIIHHI")
+TASK = struct.Struct("<I16s")
+SPAN = struct.Struct("16s")
+EVENT = struct.Struct("<IBBHII")
+
+# trace_event_type_t (main/freertos_hooks.h)
+TASK_SWITCH = 1
+QUEUE_SEND = 2
+QUEUE_RECEIVE = 3
+QUEUE_BLOCK_SEND = 4
+QUEUE_BLOCK_RECEIVE = 5
+SPAN_BEGIN = 6
+SPAN_END = 7
+TASK_READY = 8
+
+# ucQueueType (FreeRTOS queue.h)
+QUEUE_TYPES = {
+    0: "queue",
+    1: "mutex",
+    2: "counting_semaphore",
+    3: "binary_semaphore",
+    4: "recursive_mutex",
+    5: "queue_set",
+}
+
+ISR_TID = 0
+
+
+def cstr(raw):
+    return raw.split(b"\0", 1)[0].decode("ascii", "replace")
+
+
+def parse(data):
+    """Return (header dict, {handle: name}, [span names], [events])."""
+    if len(data) < HEADER.size:
+        raise ValueError("dump too short")
+    (magic, version, event_size, event_count, total_events, task_count, span_count,
+     overhead_ns) = HEADER.unpack_from(data, 0)
+    if magic != MAGIC:
+        raise ValueError("bad magic 0x%08x (not a trace dump)" % magic)
+    if version != VERSION:
+        raise ValueError("unsupported dump version %d" % version)
+    if event_size != EVENT.size:
+        raise ValueError("unexpected event size %d" % event_size)
+
+    offset = HEADER.size
+    tasks = {}
+    for _ in range(task_count):
+        handle, name = TASK.unpack_from(data, offset)
+        tasks[handle] = cstr(name)
+        offset += TASK.size
+
+    spans = []
+    for _ in range(span_count):
+        spans.append(cstr(SPAN.unpack_from(data, offset)[0]))
+        offset += SPAN.size
+
+    events = []
+    for _ in range(event_count):
+        if offset + EVENT.size > len(data):
+            print("warning: dump truncated after %d events" % len(events), file=sys.stderr)
+            break
+        events.append(EVENT.unpack_from(data, offset))
+        offset += EVENT.size
+
+    header = {
+        "event_count": event_count,
+        "total_events": total_events,
+        "overhead_ns": overhead_ns,
+    }
+    return header, tasks, spans, events
+
+
+def unwrap(events):
+    """Replace 32-bit microsecond timestamps with monotonic 64-bit ones."""
+    out = []
+    base = 0
+    prev = None
+    for ts, etype, _reserved, arg, task, obj in events:
+        if prev is not None and ts < prev:
+            base += 1 << 32
+        prev = ts
+        out.append((base + ts, etype, arg, task, obj))
+    return out
+
+
+def percentile(sorted_values, p):
+    if not sorted_values:
+        return 0
+    index = min(len(sorted_values) - 1, int(round(p / 100.0 * (len(sorted_values) - 1))))
+    return sorted_values[index]
+
+
+def convert(header, tasks, spans, events):
+    """Return (Chrome trace event list, {task name: [latencies]})."""
+    out = []
+    tids = {ISR_TID: ISR_TID}
+
+    def tid(handle):
+        if handle not in tids:
+            tids[handle] = len(tids)
+        return tids[handle]
+
+    def name(handle):
+        if handle == ISR_TID:
+            return "ISR"
+        return tasks.get(handle, "task@0x%08x" % handle)
+
+    def span_name(index):
+        return spans[index] if index < len(spans) else "span%d" % index
+
+    running = None  # (handle, start)
+    ready_at = {}  # handle -> time it was made ready
+    latencies = defaultdict(list)
+    waiting = {}  # (task, queue) -> (start, type, kind)
+    open_spans = defaultdict(list)  # tid -> [span index]
+
+    for ts, etype, arg, task, obj in events:
+        if etype == TASK_SWITCH:
+            if running is not None and running[0] != obj:
+                out.append({"name": "running", "ph": "X", "pid": 1, "tid": tid(running[0]),
+                            "ts": running[1], "dur": ts - running[1]})
+            if running is None or running[0] != obj:
+                running = (obj, ts)
+            if obj in ready_at:
+                latencies[name(obj)].append(ts - ready_at.pop(obj))
+
+        elif etype == TASK_READY:
+            ready_at.setdefault(obj, ts)
+
+        elif etype in (QUEUE_BLOCK_SEND, QUEUE_BLOCK_RECEIVE):
+            kind = "send" if etype == QUEUE_BLOCK_SEND else "receive"
+            waiting[(task, obj)] = (ts, arg, kind)
+
+        elif etype in (QUEUE_SEND, QUEUE_RECEIVE):
+            kind = "send" if etype == QUEUE_SEND else "receive"
+            qtype = QUEUE_TYPES.get(arg, "queue")
+            pending = waiting.pop((task, obj), None)
+            if pending is not None and pending[2] == kind:
+                start = pending[0]
+                out.append({"name": "wait %s" % qtype, "ph": "X", "pid": 1, "tid": tid(task),
+                            "ts": start, "dur": ts - start, "cat": "wait",
+                            "args": {"queue": "0x%08x" % obj, "op": kind,
+                                     "wait_us": ts - start}})
+            out.append({"name": "%s %s" % (qtype, kind), "ph": "i", "s": "t", "pid": 1,
+                         "tid": tid(task), "ts": ts, "cat": "queue",
+                         "args": {"queue": "0x%08x" % obj}})
+
+        elif etype == SPAN_BEGIN:
+            open_spans[tid(task)].append(arg)
+            out.append({"name": span_name(arg), "ph": "B", "pid": 1, "tid": tid(task),
+                        "ts": ts, "cat": "span"})
+
+        elif etype == SPAN_END:
+            # Drop ends whose begin was overwritten in the ring
+            stack = open_spans[tid(task)]
+            if arg in stack:
+                while stack and stack.pop() != arg:
+                    pass
+                out.append({"name": span_name(arg), "ph": "E", "pid": 1, "tid": tid(task),
+                            "ts": ts, "cat": "span"})
+
+    if running is not None and events:
+        out.append({"name": "running", "ph": "X", "pid": 1, "tid": tid(running[0]),
+                    "ts": running[1], "dur": events[-1][0] - running[1]})
+
+    out.append({"name": "process_name", "ph": "M", "pid": 1, "args": {"name": "geekhouse"}})
+    for handle, t in tids.items():
+        out.append({"name": "thread_name", "ph": "M", "pid": 1, "tid": t,
+                    "args": {"name": name(handle)}})
+
+    return out, latencies
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("dump", help="binary dump from GET /api/trace")
+    parser.add_argument("output", nargs="?", default="-", help="JSON output (default: stdout)")
+    args = parser.parse_args()
+
+    with open(args.dump, "rb") as f:
+        data = f.read()
+
+    try:
+        header, tasks, spans, raw_events = parse(data)
+    except (ValueError, struct.error) as e:
+        print("error: %s" % e, file=sys.stderr)
+        return 1
+
+    events = unwrap(raw_events)
+    trace, latencies = convert(header, tasks, spans, events)
+
+    document = {"traceEvents": trace, "displayTimeUnit": "ns",
+                "metadata": {"overhead_ns_per_event": header["overhead_ns"],
+                             "total_events": header["total_events"]}}
+    if args.output == "-":
+        json.dump(document, sys.stdout)
+    else:
+        with open(args.output, "w") as f:
+            json.dump(document, f)
+
+    span_us = events[-1][0] - events[0][0] if events else 0
+    print("%d events over %.3f s (%d recorded since boot, %d ns per event)"
+          % (len(events), span_us / 1e6, header["total_events"], header["overhead_ns"]),
+          file=sys.stderr)
+    if latencies:
+        print("%-16s %8s %8s %8s %8s" % ("Scheduling", "count", "p50 us", "p99 us", "max us"),
+              file=sys.stderr)
+        for task_name in sorted(latencies):
+            values = sorted(latencies[task_name])
+            print("%-16s %8d %8d %8d %8d" % (task_name, len(values), percentile(values, 50),
+                                             percentile(values, 99), values[-1]),
+                  file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())